@@ -290,6 +290,10 @@ radv_pipeline_cache_object_deserialize(struct vk_pipeline_cache *cache, const vo
 
    object->base.data_size = total_size;
 
+   /* Read all shaders missing in memory from the disk cache in one go */
+   if ((size_t)(blob->end - blob->current) >= num_shaders * sizeof(blake3_hash))
+      vk_pipeline_cache_prefetch_objects(cache, blob->current, sizeof(blake3_hash), num_shaders);
+
    for (unsigned i = 0; i < num_shaders; i++) {
       const uint8_t *hash = blob_read_bytes(blob, sizeof(blake3_hash));
       struct vk_pipeline_cache_object *shader =
@@ -90,6 +90,8 @@ static const struct debug_named_value nir_debug_control[] = {
      "Print shaders even if they are marked as internal" },
    { "print_pass_flags", NIR_DEBUG_PRINT_PASS_FLAGS,
      "Print pass_flags for every instruction when pass_flags are non-zero" },
+   { "arena", NIR_DEBUG_ARENA,
+     "Allocate the instructions of all shaders from an arena, see nir_shader_set_arena()" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -201,6 +203,10 @@ nir_shader_create(void *mem_ctx,
 #ifndef NDEBUG
    nir_process_debug_variable();
 #endif
+   nir_process_profile_variable();
+
+   if (NIR_DEBUG(ARENA))
+      gc_set_arena(shader->gctx, true);
 
    exec_list_make_empty(&shader->variables);
 
@@ -222,6 +228,21 @@ nir_shader_create(void *mem_ctx,
    return shader;
 }
 
+/**
+ * Puts the shader in arena mode: instructions are bump-allocated one after
+ * the other instead of coming from size-class slabs, and freeing them only
+ * releases memory once a whole arena chunk is unused.  nir_sweep() lets later
+ * instructions reuse the memory of the dead ones, in place.
+ *
+ * This is meant for compiling large shaders, which allocate millions of
+ * instructions and keep most of them.
+ */
+void
+nir_shader_set_arena(nir_shader *shader, bool arena)
+{
+   gc_set_arena(shader->gctx, arena);
+}
+
 void
 nir_shader_add_variable(nir_shader *shader, nir_variable *var)
 {
@@ -257,6 +278,37 @@ nir_shader_add_variable(nir_shader *shader, nir_variable *var)
    exec_list_push_tail(&shader->variables, &var->node);
 }
 
+/* The shader, or the gc_ctx of an instruction, that new allocations come
+ * from: a pass running in parallel on a function_impl allocates from its own
+ * scratch shader, see nir_parallel.c.
+ */
+static inline nir_shader *
+alloc_shader(nir_shader *shader)
+{
+   if (unlikely(nir_parallel_enabled))
+      return _nir_parallel_alloc_shader(shader);
+   return shader;
+}
+
+static inline gc_ctx *
+instr_gc_context(const void *instr)
+{
+   if (unlikely(nir_parallel_enabled)) {
+      nir_shader *scratch = _nir_parallel_alloc_shader(NULL);
+      if (scratch)
+         return scratch->gctx;
+   }
+   return gc_get_context((void *)instr);
+}
+
+static inline void
+instr_gc_free(void *ptr)
+{
+   if (unlikely(nir_parallel_enabled) && _nir_parallel_defer_free(ptr))
+      return;
+   gc_free(ptr);
+}
+
 nir_variable *
 nir_variable_create(nir_shader *shader, nir_variable_mode mode,
                     const struct glsl_type *type, const char *name)
@@ -286,7 +338,8 @@ nir_variable *
 nir_local_variable_create(nir_function_impl *impl,
                           const struct glsl_type *type, const char *name)
 {
-   nir_variable *var = rzalloc(impl->function->shader, nir_variable);
+   nir_variable *var = rzalloc(alloc_shader(impl->function->shader),
+                               nir_variable);
    var->name = ralloc_strdup(var, name);
    var->type = type;
    var->data.mode = nir_var_function_temp;
@@ -498,6 +551,7 @@ nir_function_create(nir_shader *shader, const char *name)
    func->num_params = 0;
    func->params = NULL;
    func->impl = NULL;
+   func->serialized_impl = NULL;
    func->is_entrypoint = false;
    func->is_preamble = false;
    func->dont_inline = false;
@@ -554,6 +608,7 @@ nir_function_impl_create_bare(nir_shader *shader)
    impl->num_blocks = 0;
    impl->valid_metadata = nir_metadata_none;
    impl->structured = true;
+   impl->instr_changes = NULL;
 
    /* create start & end blocks */
    nir_block *start_block = nir_block_create(shader);
@@ -582,7 +637,7 @@ nir_function_impl_create(nir_function *function)
 nir_block *
 nir_block_create(nir_shader *shader)
 {
-   nir_block *block = rzalloc(shader, nir_block);
+   nir_block *block = rzalloc(alloc_shader(shader), nir_block);
 
    cf_init(&block->cf_node, nir_cf_node_block);
 
@@ -613,7 +668,7 @@ src_init(nir_src *src)
 nir_if *
 nir_if_create(nir_shader *shader)
 {
-   nir_if *if_stmt = ralloc(shader, nir_if);
+   nir_if *if_stmt = ralloc(alloc_shader(shader), nir_if);
 
    if_stmt->control = nir_selection_control_none;
 
@@ -636,7 +691,7 @@ nir_if_create(nir_shader *shader)
 nir_loop *
 nir_loop_create(nir_shader *shader)
 {
-   nir_loop *loop = rzalloc(shader, nir_loop);
+   nir_loop *loop = rzalloc(alloc_shader(shader), nir_loop);
 
    cf_init(&loop->cf_node, nir_cf_node_loop);
    /* Assume that loops are divergent until proven otherwise */
@@ -675,7 +730,7 @@ nir_alu_instr *
 nir_alu_instr_create(nir_shader *shader, nir_op op)
 {
    unsigned num_srcs = nir_op_infos[op].num_inputs;
-   nir_alu_instr *instr = gc_zalloc_zla(shader->gctx, nir_alu_instr, nir_alu_src, num_srcs);
+   nir_alu_instr *instr = gc_zalloc_zla(alloc_shader(shader)->gctx, nir_alu_instr, nir_alu_src, num_srcs);
 
    instr_init(&instr->instr, nir_instr_type_alu);
    instr->op = op;
@@ -688,7 +743,7 @@ nir_alu_instr_create(nir_shader *shader, nir_op op)
 nir_deref_instr *
 nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 {
-   nir_deref_instr *instr = gc_zalloc(shader->gctx, nir_deref_instr, 1);
+   nir_deref_instr *instr = gc_zalloc(alloc_shader(shader)->gctx, nir_deref_instr, 1);
 
    instr_init(&instr->instr, nir_instr_type_deref);
 
@@ -706,7 +761,7 @@ nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = gc_alloc(shader->gctx, nir_jump_instr, 1);
+   nir_jump_instr *instr = gc_alloc(alloc_shader(shader)->gctx, nir_jump_instr, 1);
    instr_init(&instr->instr, nir_instr_type_jump);
    src_init(&instr->condition);
    instr->type = type;
@@ -721,7 +776,7 @@ nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
    nir_load_const_instr *instr =
-      gc_zalloc_zla(shader->gctx, nir_load_const_instr, nir_const_value, num_components);
+      gc_zalloc_zla(alloc_shader(shader)->gctx, nir_load_const_instr, nir_const_value, num_components);
    instr_init(&instr->instr, nir_instr_type_load_const);
 
    nir_def_init(&instr->instr, &instr->def, num_components, bit_size);
@@ -734,7 +789,7 @@ nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 {
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    nir_intrinsic_instr *instr =
-      gc_zalloc_zla(shader->gctx, nir_intrinsic_instr, nir_src, num_srcs);
+      gc_zalloc_zla(alloc_shader(shader)->gctx, nir_intrinsic_instr, nir_src, num_srcs);
 
    instr_init(&instr->instr, nir_instr_type_intrinsic);
    instr->intrinsic = op;
@@ -750,7 +805,7 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
    const unsigned num_params = callee->num_params;
    nir_call_instr *instr =
-      gc_zalloc_zla(shader->gctx, nir_call_instr, nir_src, num_params);
+      gc_zalloc_zla(alloc_shader(shader)->gctx, nir_call_instr, nir_src, num_params);
 
    instr_init(&instr->instr, nir_instr_type_call);
    instr->callee = callee;
@@ -771,11 +826,11 @@ static int8_t default_tg4_offsets[4][2] = {
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = gc_zalloc(shader->gctx, nir_tex_instr, 1);
+   nir_tex_instr *instr = gc_zalloc(alloc_shader(shader)->gctx, nir_tex_instr, 1);
    instr_init(&instr->instr, nir_instr_type_tex);
 
    instr->num_srcs = num_srcs;
-   instr->src = gc_alloc(shader->gctx, nir_tex_src, num_srcs);
+   instr->src = gc_alloc(alloc_shader(shader)->gctx, nir_tex_src, num_srcs);
    for (unsigned i = 0; i < num_srcs; i++)
       src_init(&instr->src[i].src);
 
@@ -791,7 +846,7 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                       nir_tex_src_type src_type,
                       nir_def *src)
 {
-   nir_tex_src *new_srcs = gc_zalloc(gc_get_context(tex), nir_tex_src, tex->num_srcs + 1);
+   nir_tex_src *new_srcs = gc_zalloc(instr_gc_context(tex), nir_tex_src, tex->num_srcs + 1);
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
       new_srcs[i].src_type = tex->src[i].src_type;
@@ -799,7 +854,7 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                          &tex->src[i].src);
    }
 
-   gc_free(tex->src);
+   instr_gc_free(tex->src);
    tex->src = new_srcs;
 
    tex->src[tex->num_srcs].src_type = src_type;
@@ -835,7 +890,7 @@ nir_tex_instr_has_explicit_tg4_offsets(nir_tex_instr *tex)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = gc_alloc(shader->gctx, nir_phi_instr, 1);
+   nir_phi_instr *instr = gc_alloc(alloc_shader(shader)->gctx, nir_phi_instr, 1);
    instr_init(&instr->instr, nir_instr_type_phi);
 
    exec_list_make_empty(&instr->srcs);
@@ -856,7 +911,7 @@ nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred, nir_def *src)
 {
    nir_phi_src *phi_src;
 
-   phi_src = gc_zalloc(gc_get_context(instr), nir_phi_src, 1);
+   phi_src = gc_zalloc(instr_gc_context(instr), nir_phi_src, 1);
    phi_src->pred = pred;
    phi_src->src = nir_src_for_ssa(src);
    nir_src_set_parent_instr(&phi_src->src, &instr->instr);
@@ -868,7 +923,7 @@ nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred, nir_def *src)
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = gc_alloc(shader->gctx, nir_parallel_copy_instr, 1);
+   nir_parallel_copy_instr *instr = gc_alloc(alloc_shader(shader)->gctx, nir_parallel_copy_instr, 1);
    instr_init(&instr->instr, nir_instr_type_parallel_copy);
 
    exec_list_make_empty(&instr->entries);
@@ -881,7 +936,7 @@ nir_undef_instr_create(nir_shader *shader,
                        unsigned num_components,
                        unsigned bit_size)
 {
-   nir_undef_instr *instr = gc_alloc(shader->gctx, nir_undef_instr, 1);
+   nir_undef_instr *instr = gc_alloc(alloc_shader(shader)->gctx, nir_undef_instr, 1);
    instr_init(&instr->instr, nir_instr_type_undef);
 
    nir_def_init(&instr->instr, &instr->def, num_components, bit_size);
@@ -1065,6 +1120,17 @@ add_defs_uses(nir_instr *instr)
    nir_foreach_def(instr, add_ssa_def_cb, instr);
 }
 
+/* Optimizations often depend on the uses of a value.  The sources may have
+ * been cleared already by nir_instr_free_and_dce().
+ */
+static bool
+mark_src_changed(nir_src *src, void *state)
+{
+   if (src->ssa)
+      src->ssa->parent_instr->changes = 0xff;
+   return true;
+}
+
 void
 nir_instr_insert(nir_cursor cursor, nir_instr *instr)
 {
@@ -1114,6 +1180,11 @@ nir_instr_insert(nir_cursor cursor, nir_instr *instr)
 
    nir_function_impl *impl = nir_cf_node_get_function(&instr->block->cf_node);
    impl->valid_metadata &= ~nir_metadata_instr_index;
+
+   if (unlikely(nir_instr_changes_enabled)) {
+      instr->changes = 0xff;
+      nir_foreach_src(instr, mark_src_changed, NULL);
+   }
 }
 
 bool
@@ -1158,6 +1229,9 @@ remove_defs_uses(nir_instr *instr)
 void
 nir_instr_remove_v(nir_instr *instr)
 {
+   if (unlikely(nir_instr_changes_enabled))
+      nir_foreach_src(instr, mark_src_changed, NULL);
+
    remove_defs_uses(instr);
    exec_node_remove(&instr->node);
 
@@ -1172,13 +1246,13 @@ nir_instr_free(nir_instr *instr)
 {
    switch (instr->type) {
    case nir_instr_type_tex:
-      gc_free(nir_instr_as_tex(instr)->src);
+      instr_gc_free(nir_instr_as_tex(instr)->src);
       break;
 
    case nir_instr_type_phi: {
       nir_phi_instr *phi = nir_instr_as_phi(instr);
       nir_foreach_phi_src_safe(phi_src, phi)
-         gc_free(phi_src);
+         instr_gc_free(phi_src);
       break;
    }
 
@@ -1186,7 +1260,7 @@ nir_instr_free(nir_instr *instr)
       break;
    }
 
-   gc_free(instr);
+   instr_gc_free(instr);
 }
 
 void
@@ -1236,6 +1310,7 @@ nir_instr_dce_add_dead_srcs_cb(nir_src *src, void *state)
    nir_instr_worklist *wl = state;
 
    list_del(&src->use_link);
+   nir_instr_mark_changed(src->ssa->parent_instr);
    if (!nir_instr_free_and_dce_is_live(src->ssa->parent_instr))
       nir_instr_worklist_push_tail(wl, src->ssa->parent_instr);
 
@@ -1476,11 +1551,19 @@ nir_instr_init_src(nir_instr *instr, nir_src *src, nir_def *def)
 {
    *src = nir_src_for_ssa(def);
    src_add_all_uses(src, instr, NULL);
+
+   nir_instr_mark_changed(instr);
+   nir_instr_mark_changed(def->parent_instr);
 }
 
 void
 nir_instr_clear_src(nir_instr *instr, nir_src *src)
 {
+   if (src->ssa) {
+      nir_instr_mark_changed(instr);
+      nir_instr_mark_changed(src->ssa->parent_instr);
+   }
+
    src_remove_all_uses(src);
    *src = NIR_SRC_INIT;
 }
@@ -1490,6 +1573,11 @@ nir_instr_move_src(nir_instr *dest_instr, nir_src *dest, nir_src *src)
 {
    assert(!src_is_valid(dest) || nir_src_parent_instr(dest) == dest_instr);
 
+   if (src->ssa) {
+      nir_instr_mark_changed(dest_instr);
+      nir_instr_mark_changed(src->ssa->parent_instr);
+   }
+
    src_remove_all_uses(dest);
    src_remove_all_uses(src);
    *dest = *src;
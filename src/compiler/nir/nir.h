@@ -90,6 +90,7 @@ extern bool nir_debug_print_shader[MESA_SHADER_KERNEL + 1];
 #define NIR_DEBUG_PRINT_NO_INLINE_CONSTS (1u << 20)
 #define NIR_DEBUG_PRINT_INTERNAL         (1u << 21)
 #define NIR_DEBUG_PRINT_PASS_FLAGS       (1u << 22)
+#define NIR_DEBUG_ARENA                  (1u << 23)
 
 #define NIR_DEBUG_PRINT (NIR_DEBUG_PRINT_VS |  \
                          NIR_DEBUG_PRINT_TCS | \
@@ -163,6 +164,8 @@ struct nir_shader;
 struct nir_instr;
 struct nir_builder;
 struct nir_xfb_info;
+struct nir_serialized_impl;
+struct util_queue;
 
 /**
  * Description of built-in state associated with a uniform
@@ -941,6 +944,11 @@ typedef struct nir_instr {
     */
    uint8_t pass_flags;
 
+   /* The passes using nir_instr_changes_begin() which haven't seen the last
+    * change of this instruction, one bit per pass.
+    */
+   uint8_t changes;
+
    /** generic instruction index. */
    uint32_t index;
 } nir_instr;
@@ -3258,6 +3266,18 @@ typedef enum {
     */
    nir_metadata_instr_index = 0x20,
 
+   /** Indicates that nir_instr::changes holds every change made to the
+    * instructions since nir_function_impl::instr_changes was set up.
+    *
+    * Instruction changes are only recorded when instructions are inserted or
+    * removed and when sources are set, rewritten or cleared with the nir_src
+    * helpers, like nir_src_rewrite() or nir_def_rewrite_uses().  A pass can
+    * preserve this metadata type if it doesn't otherwise modify instructions
+    * in place.  Modifying an instruction together with rewriting one of its
+    * sources, like nir_copy_prop does with swizzles, is fine.
+    */
+   nir_metadata_instr_changes = 0x40,
+
    /** All metadata
     *
     * This includes all nir_metadata flags except not_properly_reset.  Passes
@@ -3303,6 +3323,11 @@ typedef struct {
    bool structured;
 
    nir_metadata valid_metadata;
+
+   /** Passes using nir_instr::changes, NULL unless enabled by
+    * nir_shader_track_instr_changes(), see nir_instr_changes.c.
+    */
+   struct nir_instr_changes *instr_changes;
 } nir_function_impl;
 
 #define nir_foreach_function_temp_variable(var, impl) \
@@ -3478,6 +3503,13 @@ typedef struct nir_function {
     */
    nir_function_impl *impl;
 
+   /** The implementation while it is still serialized.
+    *
+    * Set by nir_deserialize_lazy(), impl is NULL until
+    * nir_function_deserialize_impl() is called.
+    */
+   struct nir_serialized_impl *serialized_impl;
+
    bool is_entrypoint;
    /* from SPIR-V linkage, only for libraries */
    bool is_exported;
@@ -4103,6 +4135,9 @@ typedef struct nir_shader {
 
    unsigned printf_info_count;
    u_printf_info *printf_info;
+
+   /** Runs impl-level passes in parallel if set, see nir_parallel.c */
+   struct util_queue *impl_queue;
 } nir_shader;
 
 #define nir_foreach_function(func, shader) \
@@ -4204,6 +4239,19 @@ nir_shader *nir_shader_create(void *mem_ctx,
                               const nir_shader_compiler_options *options,
                               shader_info *si);
 
+void nir_shader_set_arena(nir_shader *shader, bool arena);
+
+/* Parallel impl-level passes, see nir_parallel.c */
+extern bool nir_parallel_enabled;
+
+void nir_shader_set_impl_queue(nir_shader *shader, struct util_queue *queue);
+bool nir_shader_foreach_impl_parallel(nir_shader *shader,
+                                      bool (*pass)(nir_function_impl *impl,
+                                                   void *data),
+                                      void *data);
+nir_shader *_nir_parallel_alloc_shader(nir_shader *shader);
+bool _nir_parallel_defer_free(void *ptr);
+
 /** Adds a variable to the appropriate list in nir_shader */
 void nir_shader_add_variable(nir_shader *shader, nir_variable *var);
 
@@ -4600,6 +4648,22 @@ nir_instr_remove(nir_instr *instr)
 
 nir_cursor nir_instr_free_and_dce(nir_instr *instr);
 
+/* Changed instruction tracking, see nir_instr_changes.c */
+extern bool nir_instr_changes_enabled;
+
+void nir_function_impl_track_instr_changes(nir_function_impl *impl);
+void nir_shader_track_instr_changes(nir_shader *shader);
+uint8_t nir_instr_changes_begin(nir_function_impl *impl, const void *key,
+                                const void *options, size_t options_size,
+                                bool *all_changed);
+
+static inline void
+nir_instr_mark_changed(nir_instr *instr)
+{
+   if (unlikely(nir_instr_changes_enabled))
+      instr->changes = 0xff;
+}
+
 /** @} */
 
 nir_def *nir_instr_def(nir_instr *instr);
@@ -4636,6 +4700,12 @@ nir_src_rewrite(nir_src *src, nir_def *new_ssa)
 {
    assert(src->ssa);
    assert(nir_src_is_if(src) ? (nir_src_parent_if(src) != NULL) : (nir_src_parent_instr(src) != NULL));
+   if (unlikely(nir_instr_changes_enabled)) {
+      if (!nir_src_is_if(src))
+         nir_src_parent_instr(src)->changes = 0xff;
+      src->ssa->parent_instr->changes = 0xff;
+      new_ssa->parent_instr->changes = 0xff;
+   }
    list_del(&src->use_link);
    src->ssa = new_ssa;
    list_addtail(&src->use_link, &new_ssa->uses);
@@ -4893,6 +4963,32 @@ should_print_nir(UNUSED nir_shader *shader)
 }
 #endif /* NDEBUG */
 
+/* NIR_PROFILE options, see nir_profile.c */
+#define NIR_PROFILE_TABLE (1u << 0)
+#define NIR_PROFILE_TRACE (1u << 1)
+
+extern uint32_t nir_profile;
+
+void nir_process_profile_variable(void);
+int64_t _nir_pass_profile_begin(const char *pass);
+void _nir_pass_profile_end(const nir_shader *nir, const char *pass,
+                           int64_t start, int progress);
+
+static inline int64_t
+nir_pass_profile_begin(const char *pass)
+{
+   return unlikely(nir_profile) ? _nir_pass_profile_begin(pass) : 0;
+}
+
+/* progress is -1 for passes which don't report it */
+static inline void
+nir_pass_profile_end(const nir_shader *nir, const char *pass, int64_t start,
+                     int progress)
+{
+   if (unlikely(start))
+      _nir_pass_profile_end(nir, pass, start, progress);
+}
+
 #define _PASS(pass, nir, do_pass)                                       \
    do {                                                                 \
       if (should_skip_nir(#pass)) {                                     \
@@ -4913,7 +5009,10 @@ should_print_nir(UNUSED nir_shader *shader)
    nir_metadata_set_validation_flag(nir);                       \
    if (should_print_nir(nir))                                   \
       printf("%s\n", #pass);                                    \
-   if (pass(nir, ##__VA_ARGS__)) {                              \
+   int64_t _start = nir_pass_profile_begin(#pass);              \
+   bool _progress = pass(nir, ##__VA_ARGS__);                   \
+   nir_pass_profile_end(nir, #pass, _start, _progress);         \
+   if (_progress) {                                             \
       nir_validate_shader(nir, "after " #pass " in " __FILE__); \
       UNUSED bool _;                                            \
       progress = true;                                          \
@@ -4926,28 +5025,34 @@ should_print_nir(UNUSED nir_shader *shader)
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir, {        \
    if (should_print_nir(nir))                                \
       printf("%s\n", #pass);                                 \
+   int64_t _start = nir_pass_profile_begin(#pass);           \
    pass(nir, ##__VA_ARGS__);                                 \
+   nir_pass_profile_end(nir, #pass, _start, -1);             \
    nir_validate_shader(nir, "after " #pass " in " __FILE__); \
    if (should_print_nir(nir))                                \
       nir_print_shader(nir, stdout);                         \
 })
 
+void nir_loop_pass_made_progress(struct set *skip, void (*pass)());
+
 #define _NIR_LOOP_PASS(progress, idempotent, skip, nir, pass, ...)   \
 do {                                                                 \
    bool nir_loop_pass_progress = false;                              \
    if (!_mesa_set_search(skip, (void (*)())&pass))                   \
       NIR_PASS(nir_loop_pass_progress, nir, pass, ##__VA_ARGS__);    \
    if (nir_loop_pass_progress)                                       \
-      _mesa_set_clear(skip, NULL);                                   \
+      nir_loop_pass_made_progress(skip, (void (*)())&pass);          \
    if (idempotent || !nir_loop_pass_progress)                        \
       _mesa_set_add(skip, (void (*)())&pass);                        \
    UNUSED bool _ = false;                                            \
    progress |= nir_loop_pass_progress;                               \
 } while (0)
 
-/* Helper to skip a pass if no different passes have made progress since it was
- * previously run. Note that two passes are considered the same if they have
- * the same function pointer, even if they used different options.
+/* Helper to skip a pass if no different passes which may affect it have made
+ * progress since it was previously run. Which passes affect which is declared
+ * in nir_loop_pass.c, passes missing from there are affected by any progress.
+ * Note that two passes are considered the same if they have the same function
+ * pointer, even if they used different options.
  *
  * The usage of this is mostly identical to NIR_PASS. "skip" is a "struct set *"
  * (created by _mesa_pointer_set_create) which the macro uses to keep track of
@@ -1165,6 +1165,7 @@ static const nir_algebraic_table ${pass_name}_table = {
    .values = ${pass_name}_values,
    .expression_cond = ${ pass_name + "_expression_cond" if expression_cond else "NULL" },
    .variable_cond = ${ pass_name + "_variable_cond" if variable_cond else "NULL" },
+   .num_condition_flags = ${len(condition_list)},
 };
 
 bool
@@ -1174,7 +1175,6 @@ ${pass_name}(
    , ${type} ${name}
 % endfor
 ) {
-   bool progress = false;
    bool condition_flags[${len(condition_list)}];
    const nir_shader_compiler_options *options = shader->options;
    const shader_info *info = &shader->info;
@@ -1186,11 +1186,8 @@ ${pass_name}(
    condition_flags[${index}] = ${condition};
    % endfor
 
-   nir_foreach_function_impl(impl, shader) {
-     progress |= nir_algebraic_impl(impl, condition_flags, &${pass_name}_table);
-   }
-
-   return progress;
+   return nir_algebraic_shader(shader, condition_flags,
+                               &${pass_name}_table);
 }
 """)
 
@@ -139,6 +139,39 @@ nir_shader_instructions_pass(nir_shader *shader,
    return progress;
 }
 
+struct nir_instructions_pass_state {
+   nir_instr_pass_cb pass;
+   nir_metadata preserved;
+   void *cb_data;
+};
+
+static inline bool
+_nir_instructions_pass_impl(nir_function_impl *impl, void *data)
+{
+   struct nir_instructions_pass_state *state =
+      (struct nir_instructions_pass_state *)data;
+   return nir_function_instructions_pass(impl, state->pass, state->preserved,
+                                         state->cb_data);
+}
+
+/**
+ * Like nir_shader_instructions_pass(), but runs on the function impls in
+ * parallel if the shader has an impl queue, see nir_parallel.c.  The pass may
+ * only modify the function impl of the instruction, and must not write to
+ * cb_data.
+ */
+static inline bool
+nir_shader_parallel_instructions_pass(nir_shader *shader,
+                                      nir_instr_pass_cb pass,
+                                      nir_metadata preserved,
+                                      void *cb_data)
+{
+   struct nir_instructions_pass_state state = { pass, preserved, cb_data };
+   return nir_shader_foreach_impl_parallel(shader,
+                                           _nir_instructions_pass_impl,
+                                           &state);
+}
+
 /**
  * Iterates over all the intrinsics in a NIR shader and calls the given pass on
  * them.
@@ -636,6 +636,9 @@ clone_function_impl(clone_state *state, const nir_function_impl *fi)
    /* All metadata is invalidated in the cloning process */
    nfi->valid_metadata = 0;
 
+   if (fi->instr_changes)
+      nir_function_impl_track_instr_changes(nfi);
+
    return nfi;
 }
 
@@ -720,6 +723,8 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
    init_clone_state(&state, NULL, true, false);
 
    nir_shader *ns = nir_shader_create(mem_ctx, s->info.stage, s->options, NULL);
+   nir_shader_set_arena(ns, gc_is_arena(s->gctx));
+   ns->impl_queue = s->impl_queue;
    state.ns = ns;
 
    clone_var_list(&state, &ns->variables, &s->variables);
@@ -747,6 +752,7 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
    ns->num_uniforms = s->num_uniforms;
    ns->num_outputs = s->num_outputs;
    ns->scratch_size = s->scratch_size;
+   ns->global_mem_size = s->global_mem_size;
 
    ns->constant_data_size = s->constant_data_size;
    if (s->constant_data_size > 0) {
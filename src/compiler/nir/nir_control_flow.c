@@ -472,7 +472,11 @@ remove_phi_src(nir_block *block, nir_block *pred)
          if (src->pred == pred) {
             list_del(&src->src.use_link);
             exec_node_remove(&src->node);
-            gc_free(src);
+
+            /* Deferred while running a pass in parallel */
+            if (likely(!nir_parallel_enabled) ||
+                !_nir_parallel_defer_free(src))
+               gc_free(src);
          }
       }
    }
@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Records which instructions of a nir_function_impl changed, so that passes
+ * which run many times over the same shader, like the nir_algebraic passes,
+ * only have to look again at the instructions which changed since their
+ * previous run.
+ *
+ * An instruction is marked as changed when it gets inserted, when one of its
+ * sources is set, rewritten or cleared, and when a use of one of its values
+ * is added or removed, as optimizations often depend on the uses of a value.
+ * Every pass using the record, identified by a key, gets one bit of
+ * nir_instr::changes, which it clears when it looks at the instruction.
+ *
+ * Changes made in any other way aren't recorded, so the record is only
+ * trusted while nir_metadata_instr_changes is valid.
+ */
+
+#include "util/u_atomic.h"
+#include "nir.h"
+
+#define MAX_CONSUMERS 8
+
+bool nir_instr_changes_enabled = false;
+
+struct changes_consumer {
+   const void *key;
+   uint32_t epoch;
+
+   void *options;
+   size_t options_size;
+};
+
+struct nir_instr_changes {
+   /* Incremented whenever changes may have gone unrecorded */
+   uint32_t epoch;
+
+   unsigned num_consumers;
+   struct changes_consumer consumers[MAX_CONSUMERS];
+};
+
+void
+nir_function_impl_track_instr_changes(nir_function_impl *impl)
+{
+   if (impl->instr_changes)
+      return;
+
+   if (!p_atomic_read(&nir_instr_changes_enabled))
+      p_atomic_set(&nir_instr_changes_enabled, true);
+
+   impl->instr_changes = rzalloc(impl, struct nir_instr_changes);
+   impl->valid_metadata &= ~nir_metadata_instr_changes;
+}
+
+void
+nir_shader_track_instr_changes(nir_shader *shader)
+{
+   nir_foreach_function_impl(impl, shader)
+      nir_function_impl_track_instr_changes(impl);
+}
+
+/**
+ * Returns the bit of nir_instr::changes for the pass identified by key, which
+ * the caller has to clear on every instruction of the impl it looks at.
+ *
+ * all_changed is set if the changes since the last call with the same key
+ * and options aren't known, in which case every instruction has to be
+ * considered changed.
+ */
+uint8_t
+nir_instr_changes_begin(nir_function_impl *impl, const void *key,
+                        const void *options, size_t options_size,
+                        bool *all_changed)
+{
+   struct nir_instr_changes *changes = impl->instr_changes;
+
+   *all_changed = true;
+   if (!changes)
+      return 0;
+
+   if (!(impl->valid_metadata & nir_metadata_instr_changes)) {
+      changes->epoch++;
+      impl->valid_metadata |= nir_metadata_instr_changes;
+   }
+
+   unsigned i;
+   for (i = 0; i < changes->num_consumers; i++) {
+      if (changes->consumers[i].key == key)
+         break;
+   }
+
+   if (i == changes->num_consumers) {
+      if (i == MAX_CONSUMERS)
+         return 0;
+
+      changes->num_consumers++;
+      changes->consumers[i].key = key;
+      changes->consumers[i].epoch = changes->epoch - 1;
+   }
+
+   struct changes_consumer *consumer = &changes->consumers[i];
+
+   if (consumer->epoch == changes->epoch &&
+       consumer->options_size == options_size &&
+       (!options_size ||
+        memcmp(consumer->options, options, options_size) == 0)) {
+      *all_changed = false;
+   } else {
+      consumer->epoch = changes->epoch;
+      consumer->options = reralloc_size(changes, consumer->options,
+                                        options_size);
+      consumer->options_size = options_size;
+      memcpy(consumer->options, options, options_size);
+   }
+
+   return 1 << i;
+}
@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Dependencies between the passes of NIR_LOOP_PASS optimization loops.
+ *
+ * Every pass of the table declares which kinds of IR it looks at and which
+ * kinds of IR it may change when it makes progress. When a pass makes
+ * progress, only the passes which look at something it may have changed
+ * have to run again, the others stay skipped. Passes which aren't in the
+ * table are assumed to look at and change everything.
+ *
+ * Replacing the uses of an SSA value changes the instructions using it, so
+ * most passes change all instructions. The kinds are coarse on purpose:
+ * forgetting something a pass depends on makes the loop miss
+ * optimizations. As a result, only the passes with narrower writes
+ * (nir_opt_dead_write_vars and nir_opt_find_array_copies) leave other
+ * passes skipped, otherwise this is the same as forgetting the whole skip
+ * set.
+ */
+
+#include "nir.h"
+
+enum nir_ir_kind {
+   /* ALU, load_const and undef instructions */
+   ir_alu = (1 << 0),
+   ir_phis = (1 << 1),
+   /* Variables, deref instructions and deref intrinsics */
+   ir_derefs = (1 << 2),
+   /* Other intrinsics, texture instructions and jumps */
+   ir_intrinsics = (1 << 3),
+   ir_cf = (1 << 4),
+
+   ir_instrs = ir_alu | ir_phis | ir_derefs | ir_intrinsics,
+   ir_all = ir_instrs | ir_cf,
+};
+
+struct nir_pass_deps {
+   void (*pass)();
+   enum nir_ir_kind reads;
+   enum nir_ir_kind writes;
+};
+
+#define PASS(pass, reads, writes) { (void (*)())pass, reads, writes }
+
+static const struct nir_pass_deps pass_deps[] = {
+   PASS(nir_copy_prop, ir_alu, ir_instrs),
+   PASS(nir_lower_alu_to_scalar, ir_alu, ir_instrs),
+   PASS(nir_lower_alu_width, ir_alu, ir_instrs),
+   PASS(nir_lower_flrp, ir_alu, ir_instrs),
+   PASS(nir_lower_phis_to_scalar, ir_instrs, ir_instrs),
+   PASS(nir_lower_vars_to_ssa, ir_alu | ir_derefs | ir_cf, ir_instrs),
+   PASS(nir_opt_constant_folding, ir_alu | ir_derefs | ir_intrinsics, ir_instrs),
+   PASS(nir_opt_copy_prop_vars, ir_alu | ir_derefs | ir_cf, ir_instrs),
+   PASS(nir_opt_cse, ir_instrs, ir_instrs),
+   PASS(nir_opt_dce, ir_all, ir_instrs),
+   PASS(nir_opt_dead_write_vars, ir_alu | ir_derefs | ir_cf, ir_derefs),
+   PASS(nir_opt_deref, ir_alu | ir_derefs, ir_instrs),
+   PASS(nir_opt_find_array_copies, ir_alu | ir_derefs | ir_cf, ir_derefs),
+   PASS(nir_opt_remove_phis, ir_alu | ir_phis, ir_instrs),
+   PASS(nir_opt_undef, ir_instrs, ir_instrs),
+   PASS(nir_shrink_vec_array_vars, ir_derefs, ir_instrs),
+   PASS(nir_split_array_vars, ir_derefs, ir_instrs),
+};
+
+static const struct nir_pass_deps *
+get_pass_deps(void (*pass)())
+{
+   for (unsigned i = 0; i < ARRAY_SIZE(pass_deps); i++) {
+      if (pass_deps[i].pass == pass)
+         return &pass_deps[i];
+   }
+
+   return NULL;
+}
+
+/**
+ * Called by NIR_LOOP_PASS when pass made progress: removes the passes which
+ * may make progress again from the skip set.
+ */
+void
+nir_loop_pass_made_progress(struct set *skip, void (*pass)())
+{
+   const struct nir_pass_deps *deps = get_pass_deps(pass);
+   if (!deps) {
+      _mesa_set_clear(skip, NULL);
+      return;
+   }
+
+   set_foreach(skip, entry) {
+      const struct nir_pass_deps *other = get_pass_deps((void (*)())entry->key);
+      if (!other || (other->reads & deps->writes))
+         _mesa_set_remove(skip, entry);
+   }
+}
@@ -22,6 +22,7 @@
  */
 
 #include <math.h>
+#include "util/u_atomic.h"
 #include "nir.h"
 #include "nir_builder.h"
 #include "nir_constant_expressions.h"
@@ -394,6 +395,27 @@ try_fold_instr(nir_builder *b, nir_instr *instr, void *_state)
    }
 }
 
+static bool
+constant_folding_impl(nir_function_impl *impl, void *data)
+{
+   struct constant_fold_state *shader_state = data;
+   struct constant_fold_state state = { 0 };
+
+   bool progress = nir_function_instructions_pass(impl, try_fold_instr,
+                                                  nir_metadata_block_index |
+                                                     nir_metadata_dominance |
+                                                     nir_metadata_instr_changes,
+                                                  &state);
+
+   /* The function impls may be folded in parallel */
+   if (state.has_load_constant)
+      p_atomic_set(&shader_state->has_load_constant, true);
+   if (state.has_indirect_load_const)
+      p_atomic_set(&shader_state->has_indirect_load_const, true);
+
+   return progress;
+}
+
 bool
 nir_opt_constant_folding(nir_shader *shader)
 {
@@ -401,10 +423,9 @@ nir_opt_constant_folding(nir_shader *shader)
    state.has_load_constant = false;
    state.has_indirect_load_const = false;
 
-   bool progress = nir_shader_instructions_pass(shader, try_fold_instr,
-                                                nir_metadata_block_index |
-                                                   nir_metadata_dominance,
-                                                &state);
+   bool progress = nir_shader_foreach_impl_parallel(shader,
+                                                    constant_folding_impl,
+                                                    &state);
 
    /* This doesn't free the constant data if there are no constant loads because
     * the data might still be used but the loads have been lowered to load_ubo
@@ -159,7 +159,8 @@ nir_copy_prop_impl(nir_function_impl *impl)
 
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
-                                     nir_metadata_dominance);
+                                     nir_metadata_dominance |
+                                     nir_metadata_instr_changes);
    } else {
       nir_metadata_preserve(impl, nir_metadata_all);
    }
@@ -167,15 +168,15 @@ nir_copy_prop_impl(nir_function_impl *impl)
    return progress;
 }
 
+static bool
+nir_copy_prop_impl_cb(nir_function_impl *impl, void *data)
+{
+   return nir_copy_prop_impl(impl);
+}
+
 bool
 nir_copy_prop(nir_shader *shader)
 {
-   bool progress = false;
-
-   nir_foreach_function_impl(impl, shader) {
-      if (nir_copy_prop_impl(impl))
-         progress = true;
-   }
-
-   return progress;
+   return nir_shader_foreach_impl_parallel(shader, nir_copy_prop_impl_cb,
+                                           NULL);
 }
@@ -50,7 +50,8 @@ nir_opt_cse_impl(nir_function_impl *impl)
 
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
-                                     nir_metadata_dominance);
+                                     nir_metadata_dominance |
+                                     nir_metadata_instr_changes);
    } else {
       nir_metadata_preserve(impl, nir_metadata_all);
    }
@@ -59,14 +60,14 @@ nir_opt_cse_impl(nir_function_impl *impl)
    return progress;
 }
 
+static bool
+nir_opt_cse_impl_cb(nir_function_impl *impl, void *data)
+{
+   return nir_opt_cse_impl(impl);
+}
+
 bool
 nir_opt_cse(nir_shader *shader)
 {
-   bool progress = false;
-
-   nir_foreach_function_impl(impl, shader) {
-      progress |= nir_opt_cse_impl(impl);
-   }
-
-   return progress;
+   return nir_shader_foreach_impl_parallel(shader, nir_opt_cse_impl_cb, NULL);
 }
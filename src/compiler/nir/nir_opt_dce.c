@@ -239,7 +239,8 @@ nir_opt_dce_impl(nir_function_impl *impl)
 
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
-                                     nir_metadata_dominance);
+                                     nir_metadata_dominance |
+                                     nir_metadata_instr_changes);
    } else {
       nir_metadata_preserve(impl, nir_metadata_all);
    }
@@ -247,14 +248,14 @@ nir_opt_dce_impl(nir_function_impl *impl)
    return progress;
 }
 
+static bool
+nir_opt_dce_impl_cb(nir_function_impl *impl, void *data)
+{
+   return nir_opt_dce_impl(impl);
+}
+
 bool
 nir_opt_dce(nir_shader *shader)
 {
-   bool progress = false;
-   nir_foreach_function_impl(impl, shader) {
-      if (nir_opt_dce_impl(impl))
-         progress = true;
-   }
-
-   return progress;
+   return nir_shader_foreach_impl_parallel(shader, nir_opt_dce_impl_cb, NULL);
 }
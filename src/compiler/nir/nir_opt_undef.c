@@ -319,9 +319,9 @@ nir_opt_undef(nir_shader *shader)
       }
    }
 
-   return nir_shader_instructions_pass(shader,
-                                       nir_opt_undef_instr,
-                                       nir_metadata_block_index |
-                                       nir_metadata_dominance,
-                                       &options);
+   return nir_shader_parallel_instructions_pass(shader,
+                                                nir_opt_undef_instr,
+                                                nir_metadata_block_index |
+                                                nir_metadata_dominance,
+                                                &options);
 }
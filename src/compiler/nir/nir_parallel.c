@@ -0,0 +1,168 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Runs impl-level passes on the function_impls of a shader in parallel, on
+ * the threads of the util_queue set with nir_shader_set_impl_queue(). This
+ * is meant for shaders with many functions, like OpenCL programs with many
+ * kernels.
+ *
+ * Allocating from a shader isn't thread-safe, so while a pass runs on a
+ * function_impl, the instructions, blocks and local variables it creates
+ * are allocated from a scratch shader, which is moved into the shader once
+ * all the function_impls are done, and the instructions it frees are only
+ * freed then.
+ *
+ * Only passes which don't touch anything outside of the function_impl they
+ * are given can run in parallel: they must not change the shader's
+ * variables, info or constant data, and their own state must be per
+ * function_impl or read-only.
+ */
+
+#include "util/u_atomic.h"
+#include "util/u_dynarray.h"
+#include "util/u_queue.h"
+#include "util/u_thread.h"
+#include "nir.h"
+
+bool nir_parallel_enabled = false;
+
+struct impl_job {
+   struct util_queue_fence fence;
+   nir_function_impl *impl;
+   bool (*pass)(nir_function_impl *impl, void *data);
+   void *data;
+   bool progress;
+
+   /* Created on the first allocation */
+   nir_shader *scratch;
+
+   /* gc allocations of the shader to free after the job */
+   struct util_dynarray dead;
+};
+
+static __THREAD_INITIAL_EXEC struct impl_job *current_job;
+
+/**
+ * Makes nir_shader_foreach_impl_parallel() run on the threads of \p queue,
+ * or serially if it is NULL.  The queue must outlive its use by the shader.
+ */
+void
+nir_shader_set_impl_queue(nir_shader *shader, struct util_queue *queue)
+{
+   if (queue && !p_atomic_read(&nir_parallel_enabled))
+      p_atomic_set(&nir_parallel_enabled, true);
+
+   shader->impl_queue = queue;
+}
+
+/* Returns the shader that the current thread has to allocate from, when
+ * allocating something for \p shader.
+ */
+nir_shader *
+_nir_parallel_alloc_shader(nir_shader *shader)
+{
+   struct impl_job *job = current_job;
+   if (!job)
+      return shader;
+
+   if (!job->scratch) {
+      nir_shader *nir = job->impl->function->shader;
+      job->scratch = nir_shader_create(NULL, nir->info.stage, nir->options,
+                                       NULL);
+      nir_shader_set_arena(job->scratch, gc_is_arena(nir->gctx));
+   }
+
+   return job->scratch;
+}
+
+/* Frees of gc allocations are deferred while running a job, as they may
+ * belong to the shader.
+ */
+bool
+_nir_parallel_defer_free(void *ptr)
+{
+   struct impl_job *job = current_job;
+   if (!job)
+      return false;
+
+   util_dynarray_append(&job->dead, void *, ptr);
+   return true;
+}
+
+static void
+run_impl_job(void *data, void *gdata, int thread_index)
+{
+   struct impl_job *job = data;
+
+   current_job = job;
+   job->progress = job->pass(job->impl, job->data);
+   current_job = NULL;
+}
+
+/**
+ * Calls \p pass on every function_impl of the shader, in parallel if the
+ * shader has an impl queue, and returns whether any call made progress.
+ */
+bool
+nir_shader_foreach_impl_parallel(nir_shader *shader,
+                                 bool (*pass)(nir_function_impl *impl,
+                                              void *data),
+                                 void *data)
+{
+   unsigned num_impls = 0;
+   nir_foreach_function_impl(impl, shader)
+      num_impls++;
+
+   /* Passes running in a job may call this again, serially.  Running
+    * serially is also the fallback if the jobs can't be allocated.
+    */
+   struct impl_job *jobs = NULL;
+   if (shader->impl_queue && num_impls >= 2 && !current_job)
+      jobs = calloc(num_impls, sizeof(*jobs));
+
+   if (!jobs) {
+      bool progress = false;
+      nir_foreach_function_impl(impl, shader)
+         progress |= pass(impl, data);
+      return progress;
+   }
+
+   unsigned i = 0;
+   nir_foreach_function_impl(impl, shader) {
+      struct impl_job *job = &jobs[i++];
+      job->impl = impl;
+      job->pass = pass;
+      job->data = data;
+      util_dynarray_init(&job->dead, NULL);
+      util_queue_fence_init(&job->fence);
+      util_queue_add_job(shader->impl_queue, job, &job->fence, run_impl_job,
+                         NULL, 0);
+   }
+
+   bool progress = false;
+   for (i = 0; i < num_impls; i++) {
+      struct impl_job *job = &jobs[i];
+
+      util_queue_fence_wait(&job->fence);
+      util_queue_fence_destroy(&job->fence);
+
+      util_dynarray_foreach(&job->dead, void *, ptr)
+         gc_free(*ptr);
+      util_dynarray_fini(&job->dead);
+
+      /* Move everything from the scratch shader to the shader. */
+      if (job->scratch) {
+         gc_adopt(shader->gctx, job->scratch->gctx);
+         ralloc_free(job->scratch->gctx);
+         ralloc_adopt(shader, job->scratch);
+         ralloc_free(job->scratch);
+      }
+
+      progress |= job->progress;
+   }
+   free(jobs);
+
+   return progress;
+}
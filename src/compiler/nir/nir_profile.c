@@ -0,0 +1,204 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Compile time profiling of the passes run with NIR_PASS and NIR_PASS_V,
+ * enabled with the NIR_PROFILE environment variable, in release builds too:
+ *
+ *   NIR_PROFILE=table  prints at exit the wall time, number of calls and
+ *                      rate of progress of every pass, per pass name and
+ *                      shader stage, summed over the whole process
+ *   NIR_PROFILE=trace  emits a CPU trace slice for every pass, see
+ *                      util/perf/cpu_trace.h
+ *
+ * The time of a pass includes the time of the passes it runs itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
+#include "util/simple_mtx.h"
+#include "util/u_debug.h"
+#include "nir.h"
+
+#define NUM_STAGES (MESA_SHADER_KERNEL + 1)
+
+uint32_t nir_profile = 0;
+
+static const struct debug_named_value nir_profile_control[] = {
+   { "table", NIR_PROFILE_TABLE,
+     "Print the time spent in every pass at exit" },
+   { "trace", NIR_PROFILE_TRACE,
+     "Emit a CPU trace slice for every pass" },
+   DEBUG_NAMED_VALUE_END
+};
+
+struct pass_stats {
+   uint64_t calls;
+
+   /* Calls which report whether they made progress, and made some */
+   uint64_t reported;
+   uint64_t progress;
+
+   int64_t time_ns;
+};
+
+struct pass_profile {
+   const char *name;
+   struct pass_stats stages[NUM_STAGES];
+};
+
+struct profile_row {
+   const char *name;
+   gl_shader_stage stage;
+   const struct pass_stats *stats;
+};
+
+static simple_mtx_t profile_mtx = SIMPLE_MTX_INITIALIZER;
+static struct hash_table *profile_table;
+
+static int
+compare_rows(const void *a, const void *b)
+{
+   const struct profile_row *ra = a, *rb = b;
+
+   if (ra->stats->time_ns != rb->stats->time_ns)
+      return ra->stats->time_ns < rb->stats->time_ns ? 1 : -1;
+
+   return strcmp(ra->name, rb->name);
+}
+
+static void
+print_profile(void)
+{
+   simple_mtx_lock(&profile_mtx);
+
+   if (!profile_table)
+      goto out;
+
+   unsigned num_rows = 0;
+   hash_table_foreach(profile_table, entry) {
+      struct pass_profile *profile = entry->data;
+      for (unsigned i = 0; i < NUM_STAGES; i++)
+         num_rows += profile->stages[i].calls != 0;
+   }
+
+   struct profile_row *rows = calloc(num_rows, sizeof(*rows));
+   int64_t total_ns = 0;
+   unsigned r = 0;
+
+   hash_table_foreach(profile_table, entry) {
+      struct pass_profile *profile = entry->data;
+      for (unsigned i = 0; i < NUM_STAGES; i++) {
+         if (!profile->stages[i].calls)
+            continue;
+
+         rows[r].name = profile->name;
+         rows[r].stage = i;
+         rows[r].stats = &profile->stages[i];
+         total_ns += profile->stages[i].time_ns;
+         r++;
+      }
+   }
+
+   qsort(rows, num_rows, sizeof(*rows), compare_rows);
+
+   fprintf(stderr, "%-40s %-5s %10s %9s %12s %10s\n",
+           "NIR pass", "stage", "calls", "progress", "total ms", "avg us");
+
+   for (unsigned i = 0; i < num_rows; i++) {
+      const struct pass_stats *stats = rows[i].stats;
+
+      fprintf(stderr, "%-40s %-5s %10" PRIu64 " ", rows[i].name,
+              _mesa_shader_stage_to_abbrev(rows[i].stage), stats->calls);
+      if (stats->reported)
+         fprintf(stderr, "%8.1f%%", 100.0 * stats->progress / stats->reported);
+      else
+         fprintf(stderr, "%9s", "-");
+      fprintf(stderr, " %12.3f %10.2f\n", stats->time_ns / 1e6,
+              stats->time_ns / 1e3 / stats->calls);
+   }
+
+   fprintf(stderr, "%-40s %-5s %10s %9s %12.3f\n", "total", "", "", "",
+           total_ns / 1e6);
+
+   free(rows);
+   _mesa_hash_table_destroy(profile_table, NULL);
+   profile_table = NULL;
+
+out:
+   simple_mtx_unlock(&profile_mtx);
+}
+
+static void
+nir_process_profile_variable_once(void)
+{
+   nir_profile = debug_get_flags_option("NIR_PROFILE", nir_profile_control, 0);
+
+   if (nir_profile & NIR_PROFILE_TABLE)
+      atexit(print_profile);
+}
+
+void
+nir_process_profile_variable(void)
+{
+   static once_flag flag = ONCE_FLAG_INIT;
+   call_once(&flag, nir_process_profile_variable_once);
+}
+
+int64_t
+_nir_pass_profile_begin(const char *pass)
+{
+   if (nir_profile & NIR_PROFILE_TRACE)
+      MESA_TRACE_BEGIN(pass);
+
+   return os_time_get_nano();
+}
+
+void
+_nir_pass_profile_end(const nir_shader *nir, const char *pass, int64_t start,
+                      int progress)
+{
+   int64_t time_ns = os_time_get_nano() - start;
+
+   if (nir_profile & NIR_PROFILE_TRACE)
+      MESA_TRACE_END();
+
+   if (!(nir_profile & NIR_PROFILE_TABLE) ||
+       (unsigned)nir->info.stage >= NUM_STAGES)
+      return;
+
+   simple_mtx_lock(&profile_mtx);
+
+   if (!profile_table) {
+      profile_table = _mesa_hash_table_create(NULL, _mesa_hash_string,
+                                              _mesa_key_string_equal);
+   }
+
+   /* The pass names are string literals, which may belong to a driver that
+    * gets unloaded before exit.
+    */
+   struct pass_profile *profile;
+   struct hash_entry *entry = _mesa_hash_table_search(profile_table, pass);
+   if (entry) {
+      profile = entry->data;
+   } else {
+      profile = rzalloc(profile_table, struct pass_profile);
+      profile->name = ralloc_strdup(profile, pass);
+      _mesa_hash_table_insert(profile_table, profile->name, profile);
+   }
+
+   struct pass_stats *stats = &profile->stages[nir->info.stage];
+   stats->calls++;
+   stats->time_ns += time_ns;
+   if (progress >= 0) {
+      stats->reported++;
+      stats->progress += progress;
+   }
+
+   simple_mtx_unlock(&profile_mtx);
+}
@@ -866,6 +866,35 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
    return false;
 }
 
+static bool
+src_unchanged(nir_src *src, void *state)
+{
+   return !src->ssa->parent_instr->pass_flags;
+}
+
+/* Whether the matches of instr may differ from the last run.  Matching looks
+ * at the sources of an instruction, their uses and the ranges of their
+ * values, so an instruction is considered changed when anything it depends on
+ * changed.  This relies on the instructions being visited in order, which
+ * doesn't hold for the back edges of loops, so loop header phis are always
+ * considered changed.
+ */
+static bool
+instr_changed(nir_instr *instr, uint8_t changes_bit)
+{
+   if (instr->changes & changes_bit)
+      return true;
+
+   if (instr->type == nir_instr_type_phi) {
+      nir_cf_node *parent = instr->block->cf_node.parent;
+      if (parent->type == nir_cf_node_loop &&
+          nir_loop_first_block(nir_cf_node_as_loop(parent)) == instr->block)
+         return true;
+   }
+
+   return !nir_foreach_src(instr, src_unchanged, NULL);
+}
+
 bool
 nir_algebraic_impl(nir_function_impl *impl,
                    const bool *condition_flags,
@@ -873,6 +902,15 @@ nir_algebraic_impl(nir_function_impl *impl,
 {
    bool progress = false;
 
+   /* If the impl records its changed instructions, only the ones which
+    * changed since the last run of this pass need to be matched again.
+    */
+   bool all_changed;
+   uint8_t changes_bit =
+      nir_instr_changes_begin(impl, table, condition_flags,
+                              table->num_condition_flags * sizeof(bool),
+                              &all_changed);
+
    nir_builder build = nir_builder_create(impl);
 
    /* Note: it's important here that we're allocating a zeroed array, since
@@ -881,7 +919,8 @@ nir_algebraic_impl(nir_function_impl *impl,
     */
    struct util_dynarray states = { 0 };
    if (!util_dynarray_resize(&states, uint16_t, impl->ssa_alloc)) {
-      nir_metadata_preserve(impl, nir_metadata_all);
+      nir_metadata_preserve(impl, nir_metadata_all &
+                                  ~nir_metadata_instr_changes);
       return false;
    }
    memset(states.data, 0, states.size);
@@ -893,6 +932,8 @@ nir_algebraic_impl(nir_function_impl *impl,
    /* Walk top-to-bottom setting up the automaton state. */
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block) {
+         instr->pass_flags = all_changed || instr_changed(instr, changes_bit);
+         instr->changes &= ~changes_bit;
          nir_algebraic_automaton(instr, &states, table->pass_op_table);
       }
    }
@@ -903,9 +944,9 @@ nir_algebraic_impl(nir_function_impl *impl,
     */
    nir_foreach_block_reverse(block, impl) {
       nir_foreach_instr_reverse(instr, block) {
-         instr->pass_flags = 0;
-         if (instr->type == nir_instr_type_alu)
+         if (instr->type == nir_instr_type_alu && instr->pass_flags)
             nir_instr_worklist_push_tail(worklist, instr);
+         instr->pass_flags = 0;
       }
    }
 
@@ -934,10 +975,37 @@ nir_algebraic_impl(nir_function_impl *impl,
 
    if (progress) {
       nir_metadata_preserve(impl, nir_metadata_block_index |
-                                     nir_metadata_dominance);
+                                     nir_metadata_dominance |
+                                     nir_metadata_instr_changes);
    } else {
       nir_metadata_preserve(impl, nir_metadata_all);
    }
 
    return progress;
 }
+
+struct algebraic_state {
+   const bool *condition_flags;
+   const nir_algebraic_table *table;
+};
+
+static bool
+nir_algebraic_impl_cb(nir_function_impl *impl, void *data)
+{
+   const struct algebraic_state *state = data;
+   return nir_algebraic_impl(impl, state->condition_flags, state->table);
+}
+
+bool
+nir_algebraic_shader(nir_shader *shader,
+                     const bool *condition_flags,
+                     const nir_algebraic_table *table)
+{
+   struct algebraic_state state = {
+      .condition_flags = condition_flags,
+      .table = table,
+   };
+
+   return nir_shader_foreach_impl_parallel(shader, nir_algebraic_impl_cb,
+                                           &state);
+}
@@ -212,6 +212,9 @@ typedef struct {
     * nir_search_variable->cond.
     */
    const nir_search_variable_cond *variable_cond;
+
+   /** Number of condition flags passed to nir_algebraic_impl() */
+   unsigned num_condition_flags;
 } nir_algebraic_table;
 
 /* Note: these must match the start states created in
@@ -236,4 +239,9 @@ nir_algebraic_impl(nir_function_impl *impl,
                    const bool *condition_flags,
                    const nir_algebraic_table *table);
 
+bool
+nir_algebraic_shader(nir_shader *shader,
+                     const bool *condition_flags,
+                     const nir_algebraic_table *table);
+
 #endif /* _NIR_SEARCH_ */
@@ -24,12 +24,18 @@
 #include "nir_serialize.h"
 #include "util/u_dynarray.h"
 #include "util/u_math.h"
+#include "util/u_queue.h"
 #include "nir_control_flow.h"
 #include "nir_xfb_info.h"
 
 #define NIR_SERIALIZE_FUNC_HAS_IMPL ((void *)(intptr_t)1)
 #define MAX_OBJECT_IDS              (1 << 20)
 
+/* Replaces the object count at the start of the blob in the chunked format,
+ * see nir_serialize_chunked().
+ */
+#define NIR_SERIALIZE_CHUNKED       UINT32_MAX
+
 typedef struct {
    size_t blob_offset;
    nir_def *src;
@@ -44,6 +50,11 @@ typedef struct {
    /* maps pointer to index */
    struct hash_table *remap_table;
 
+   /* When writing a function_impl chunk, maps the shader-level objects
+    * (variables and functions) to their index.
+    */
+   struct hash_table *global_remap_table;
+
    /* the next index to assign to a NIR in-memory object */
    uint32_t next_idx;
 
@@ -80,6 +91,13 @@ typedef struct {
    /* map from index to deserialized pointer */
    void **idx_table;
 
+   /* When reading a function_impl chunk, the indices below first_idx are
+    * the shader-level objects in global_idx_table, and idx_table starts at
+    * first_idx.
+    */
+   uint32_t first_idx;
+   void **global_idx_table;
+
    /* List of phi sources. */
    struct list_head phi_srcs;
 
@@ -101,6 +119,8 @@ static uint32_t
 write_lookup_object(write_ctx *ctx, const void *obj)
 {
    struct hash_entry *entry = _mesa_hash_table_search(ctx->remap_table, obj);
+   if (!entry && ctx->global_remap_table)
+      entry = _mesa_hash_table_search(ctx->global_remap_table, obj);
    assert(entry);
    return (uint32_t)(uintptr_t)entry->data;
 }
@@ -115,6 +135,10 @@ read_add_object(read_ctx *ctx, void *obj)
 static void *
 read_lookup_object(read_ctx *ctx, uint32_t idx)
 {
+   if (idx < ctx->first_idx)
+      return ctx->global_idx_table[idx];
+
+   idx -= ctx->first_idx;
    assert(idx < ctx->idx_table_len);
    return ctx->idx_table[idx];
 }
@@ -1882,6 +1906,9 @@ read_function_impl(read_ctx *ctx)
 static void
 write_function(write_ctx *ctx, const nir_function *fxn)
 {
+   /* The implementation would be lost. */
+   assert(!fxn->serialized_impl);
+
    uint32_t flags = 0;
    if (fxn->is_entrypoint)
       flags |= 0x1;
@@ -1969,40 +1996,27 @@ read_xfb_info(read_ctx *ctx)
    return xfb;
 }
 
-/**
- * Serialize NIR into a binary blob.
- *
- * \param strip  Don't serialize information only useful for debugging,
- *               such as variable names, making cache hits from similar
- *               shaders more likely.
- */
-void
-nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
+static void
+write_shader_header(write_ctx *ctx)
 {
-   write_ctx ctx = { 0 };
-   ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
-   ctx.blob = blob;
-   ctx.nir = nir;
-   ctx.strip = strip;
-   util_dynarray_init(&ctx.phi_fixups, NULL);
-
-   size_t idx_size_offset = blob_reserve_uint32(blob);
+   const nir_shader *nir = ctx->nir;
+   struct blob *blob = ctx->blob;
 
    struct shader_info info = nir->info;
    uint32_t strings = 0;
-   if (!strip && info.name)
+   if (!ctx->strip && info.name)
       strings |= 0x1;
-   if (!strip && info.label)
+   if (!ctx->strip && info.label)
       strings |= 0x2;
    blob_write_uint32(blob, strings);
-   if (!strip && info.name)
+   if (!ctx->strip && info.name)
       blob_write_string(blob, info.name);
-   if (!strip && info.label)
+   if (!ctx->strip && info.label)
       blob_write_string(blob, info.label);
    info.name = info.label = NULL;
    blob_write_bytes(blob, (uint8_t *)&info, sizeof(info));
 
-   write_var_list(&ctx, &nir->variables);
+   write_var_list(ctx, &nir->variables);
 
    blob_write_uint32(blob, nir->num_inputs);
    blob_write_uint32(blob, nir->num_uniforms);
@@ -2011,21 +2025,52 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 
    blob_write_uint32(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
-      write_function(&ctx, fxn);
+      write_function(ctx, fxn);
    }
+}
 
-   nir_foreach_function_impl(impl, nir) {
-      write_function_impl(&ctx, impl);
-   }
+static void
+write_shader_tail(write_ctx *ctx)
+{
+   const nir_shader *nir = ctx->nir;
+   struct blob *blob = ctx->blob;
 
    blob_write_uint32(blob, nir->constant_data_size);
    if (nir->constant_data_size > 0)
       blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
 
-   write_xfb_info(&ctx, nir->xfb_info);
+   write_xfb_info(ctx, nir->xfb_info);
 
    if (nir->info.uses_printf)
       nir_serialize_printf_info(blob, nir->printf_info, nir->printf_info_count);
+}
+
+/**
+ * Serialize NIR into a binary blob.
+ *
+ * \param strip  Don't serialize information only useful for debugging,
+ *               such as variable names, making cache hits from similar
+ *               shaders more likely.
+ */
+void
+nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
+{
+   write_ctx ctx = { 0 };
+   ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
+   ctx.blob = blob;
+   ctx.nir = nir;
+   ctx.strip = strip;
+   util_dynarray_init(&ctx.phi_fixups, NULL);
+
+   size_t idx_size_offset = blob_reserve_uint32(blob);
+
+   write_shader_header(&ctx);
+
+   nir_foreach_function_impl(impl, nir) {
+      write_function_impl(&ctx, impl);
+   }
+
+   write_shader_tail(&ctx);
 
    blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
 
@@ -2033,16 +2078,124 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
-nir_shader *
-nir_deserialize(void *mem_ctx,
-                const struct nir_shader_compiler_options *options,
-                struct blob_reader *blob)
+struct write_impl_job {
+   struct util_queue_fence fence;
+   const nir_function_impl *impl;
+   write_ctx ctx;
+   struct blob blob;
+};
+
+static void
+write_impl_job(void *data, void *gdata, int thread_index)
 {
-   read_ctx ctx = { 0 };
+   struct write_impl_job *job = data;
+   write_ctx *ctx = &job->ctx;
+
+   ctx->remap_table = _mesa_pointer_hash_table_create(NULL);
+   util_dynarray_init(&ctx->phi_fixups, NULL);
+
+   write_function_impl(ctx, job->impl);
+
+   _mesa_hash_table_destroy(ctx->remap_table, NULL);
+   util_dynarray_fini(&ctx->phi_fixups);
+}
+
+/**
+ * Serialize NIR into a binary blob made of one chunk per function_impl.
+ *
+ * A chunk is written with its own object numbering, on top of the shader's
+ * variables and functions, so the function_impls can be written and read
+ * independently of each other: with a \p queue they are written in parallel
+ * by its threads, and nir_deserialize_parallel() and nir_deserialize_lazy()
+ * take advantage of it when reading.  nir_deserialize() reads both formats.
+ *
+ * This must not be called from a thread of \p queue.
+ */
+void
+nir_serialize_chunked(struct blob *blob, const nir_shader *nir, bool strip,
+                      struct util_queue *queue)
+{
+   write_ctx ctx = { 0 };
+   ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
    ctx.blob = blob;
-   list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_uint32(blob);
-   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+   ctx.nir = nir;
+   ctx.strip = strip;
+
+   blob_write_uint32(blob, NIR_SERIALIZE_CHUNKED);
+   size_t idx_size_offset = blob_reserve_uint32(blob);
+
+   write_shader_header(&ctx);
+
+   unsigned num_impls = 0;
+   nir_foreach_function_impl(impl, nir) {
+      num_impls++;
+   }
+
+   struct write_impl_job *jobs = calloc(num_impls, sizeof(*jobs));
+   unsigned i = 0;
+   nir_foreach_function_impl(impl, nir) {
+      struct write_impl_job *job = &jobs[i++];
+
+      job->impl = impl;
+      job->ctx.global_remap_table = ctx.remap_table;
+      job->ctx.next_idx = ctx.next_idx;
+      job->ctx.blob = &job->blob;
+      job->ctx.nir = nir;
+      job->ctx.strip = strip;
+      blob_init(&job->blob);
+
+      if (queue) {
+         util_queue_fence_init(&job->fence);
+         util_queue_add_job(queue, job, &job->fence, write_impl_job, NULL, 0);
+      } else {
+         write_impl_job(job, NULL, 0);
+      }
+   }
+
+   for (i = 0; i < num_impls; i++) {
+      struct write_impl_job *job = &jobs[i];
+
+      if (queue) {
+         util_queue_fence_wait(&job->fence);
+         util_queue_fence_destroy(&job->fence);
+      }
+
+      if (job->blob.out_of_memory)
+         blob->out_of_memory = true;
+
+      blob_write_uint32(blob, job->ctx.next_idx - ctx.next_idx);
+      blob_write_uint32(blob, job->blob.size);
+      blob_align(blob, 8);
+      blob_write_bytes(blob, job->blob.data, job->blob.size);
+      blob_finish(&job->blob);
+   }
+   free(jobs);
+
+   write_shader_tail(&ctx);
+
+   blob_overwrite_uint32(blob, idx_size_offset, ctx.next_idx);
+
+   _mesa_hash_table_destroy(ctx.remap_table, NULL);
+}
+
+/* A function_impl of the chunked format which hasn't been read yet */
+struct nir_serialized_impl {
+   /* The shader's variables and functions, the first num_globals indices */
+   void **globals;
+   uint32_t num_globals;
+
+   /* The number of objects the function_impl adds */
+   uint32_t num_objects;
+
+   const void *data;
+   uint32_t size;
+};
+
+static void
+read_shader_header(read_ctx *ctx, void *mem_ctx,
+                   const struct nir_shader_compiler_options *options)
+{
+   struct blob_reader *blob = ctx->blob;
 
    uint32_t strings = blob_read_uint32(blob);
    char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
@@ -2051,44 +2204,215 @@ nir_deserialize(void *mem_ctx,
    struct shader_info info;
    blob_copy_bytes(blob, (uint8_t *)&info, sizeof(info));
 
-   ctx.nir = nir_shader_create(mem_ctx, info.stage, options, NULL);
+   ctx->nir = nir_shader_create(mem_ctx, info.stage, options, NULL);
 
-   info.name = name ? ralloc_strdup(ctx.nir, name) : NULL;
-   info.label = label ? ralloc_strdup(ctx.nir, label) : NULL;
+   info.name = name ? ralloc_strdup(ctx->nir, name) : NULL;
+   info.label = label ? ralloc_strdup(ctx->nir, label) : NULL;
 
-   ctx.nir->info = info;
+   ctx->nir->info = info;
 
-   read_var_list(&ctx, &ctx.nir->variables);
+   read_var_list(ctx, &ctx->nir->variables);
 
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->scratch_size = blob_read_uint32(blob);
+   ctx->nir->num_inputs = blob_read_uint32(blob);
+   ctx->nir->num_uniforms = blob_read_uint32(blob);
+   ctx->nir->num_outputs = blob_read_uint32(blob);
+   ctx->nir->scratch_size = blob_read_uint32(blob);
 
    unsigned num_functions = blob_read_uint32(blob);
    for (unsigned i = 0; i < num_functions; i++)
-      read_function(&ctx);
+      read_function(ctx);
+}
+
+static void
+read_shader_tail(read_ctx *ctx)
+{
+   struct blob_reader *blob = ctx->blob;
+
+   ctx->nir->constant_data_size = blob_read_uint32(blob);
+   if (ctx->nir->constant_data_size > 0) {
+      ctx->nir->constant_data =
+         ralloc_size(ctx->nir, ctx->nir->constant_data_size);
+      blob_copy_bytes(blob, ctx->nir->constant_data,
+                      ctx->nir->constant_data_size);
+   }
+
+   ctx->nir->xfb_info = read_xfb_info(ctx);
 
-   nir_foreach_function(fxn, ctx.nir) {
-      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
-         nir_function_set_impl(fxn, read_function_impl(&ctx));
+   if (ctx->nir->info.uses_printf) {
+      ctx->nir->printf_info =
+         nir_deserialize_printf_info(ctx->nir, blob,
+                                     &ctx->nir->printf_info_count);
    }
+}
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
-   if (ctx.nir->constant_data_size > 0) {
-      ctx.nir->constant_data =
-         ralloc_size(ctx.nir, ctx.nir->constant_data_size);
-      blob_copy_bytes(blob, ctx.nir->constant_data,
-                      ctx.nir->constant_data_size);
+static void
+read_impl_chunks(read_ctx *ctx, bool copy)
+{
+   void **globals = ctx->idx_table;
+
+   /* Lazily read chunks outlive the blob and the read_ctx. */
+   if (copy) {
+      globals = ralloc_array(ctx->nir, void *, ctx->next_idx);
+      memcpy(globals, ctx->idx_table, ctx->next_idx * sizeof(void *));
    }
 
-   ctx.nir->xfb_info = read_xfb_info(&ctx);
+   nir_foreach_function(fxn, ctx->nir) {
+      if (fxn->impl != NIR_SERIALIZE_FUNC_HAS_IMPL)
+         continue;
+
+      struct nir_serialized_impl *chunk =
+         ralloc(fxn, struct nir_serialized_impl);
 
-   if (ctx.nir->info.uses_printf) {
-      ctx.nir->printf_info =
-         nir_deserialize_printf_info(ctx.nir, blob,
-                                     &ctx.nir->printf_info_count);
+      chunk->globals = globals;
+      chunk->num_globals = ctx->next_idx;
+      chunk->num_objects = blob_read_uint32(ctx->blob);
+      chunk->size = blob_read_uint32(ctx->blob);
+      blob_reader_align(ctx->blob, 8);
+      chunk->data = blob_read_bytes(ctx->blob, chunk->size);
+
+      if (copy && chunk->data) {
+         void *data = ralloc_size(chunk, chunk->size);
+         memcpy(data, chunk->data, chunk->size);
+         chunk->data = data;
+      }
+
+      fxn->impl = NULL;
+      fxn->serialized_impl = chunk;
    }
+}
+
+static nir_function_impl *
+read_impl_chunk(nir_shader *nir, const struct nir_serialized_impl *chunk)
+{
+   struct blob_reader blob;
+   blob_reader_init(&blob, chunk->data, chunk->size);
+
+   read_ctx ctx = { 0 };
+   ctx.nir = nir;
+   ctx.blob = &blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.first_idx = chunk->num_globals;
+   ctx.global_idx_table = chunk->globals;
+   ctx.idx_table_len = chunk->num_objects;
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+
+   nir_function_impl *impl = read_function_impl(&ctx);
+
+   free(ctx.idx_table);
+
+   return impl;
+}
+
+static void
+set_read_impl(nir_function *fxn, nir_function_impl *impl)
+{
+   ralloc_free(fxn->serialized_impl);
+   fxn->serialized_impl = NULL;
+   nir_function_set_impl(fxn, impl);
+}
+
+struct read_impl_job {
+   struct util_queue_fence fence;
+   nir_function *fxn;
+   bool arena;
+
+   /* Scratch shader the function_impl is allocated from */
+   nir_shader *nir;
+   nir_function_impl *impl;
+};
+
+static void
+read_impl_job(void *data, void *gdata, int thread_index)
+{
+   struct read_impl_job *job = data;
+   const nir_shader *shader = job->fxn->shader;
+
+   /* Allocating from the shader isn't thread-safe. */
+   job->nir = nir_shader_create(NULL, shader->info.stage, shader->options,
+                                NULL);
+   nir_shader_set_arena(job->nir, job->arena);
+
+   job->impl = read_impl_chunk(job->nir, job->fxn->serialized_impl);
+}
+
+static void
+read_impls(nir_shader *shader, struct util_queue *queue)
+{
+   unsigned num_impls = 0;
+   nir_foreach_function(fxn, shader) {
+      if (fxn->serialized_impl)
+         num_impls++;
+   }
+
+   if (!queue || num_impls < 2) {
+      nir_foreach_function(fxn, shader) {
+         if (fxn->serialized_impl)
+            set_read_impl(fxn, read_impl_chunk(shader, fxn->serialized_impl));
+      }
+      return;
+   }
+
+   struct read_impl_job *jobs = calloc(num_impls, sizeof(*jobs));
+   unsigned i = 0;
+   nir_foreach_function(fxn, shader) {
+      if (!fxn->serialized_impl)
+         continue;
+
+      struct read_impl_job *job = &jobs[i++];
+      job->fxn = fxn;
+      job->arena = gc_is_arena(shader->gctx);
+      util_queue_fence_init(&job->fence);
+      util_queue_add_job(queue, job, &job->fence, read_impl_job, NULL, 0);
+   }
+
+   for (i = 0; i < num_impls; i++) {
+      struct read_impl_job *job = &jobs[i];
+
+      util_queue_fence_wait(&job->fence);
+      util_queue_fence_destroy(&job->fence);
+
+      /* Move everything from the scratch shader to the shader. */
+      gc_adopt(shader->gctx, job->nir->gctx);
+      ralloc_free(job->nir->gctx);
+      ralloc_adopt(shader, job->nir);
+      ralloc_free(job->nir);
+
+      set_read_impl(job->fxn, job->impl);
+   }
+   free(jobs);
+}
+
+static nir_shader *
+deserialize(void *mem_ctx,
+            const struct nir_shader_compiler_options *options,
+            struct blob_reader *blob, bool lazy, struct util_queue *queue)
+{
+   read_ctx ctx = { 0 };
+   ctx.blob = blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.idx_table_len = blob_read_uint32(blob);
+
+   bool chunked = ctx.idx_table_len == NIR_SERIALIZE_CHUNKED;
+   if (chunked)
+      ctx.idx_table_len = blob_read_uint32(blob);
+
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+
+   read_shader_header(&ctx, mem_ctx, options);
+
+   if (chunked) {
+      read_impl_chunks(&ctx, lazy);
+   } else {
+      nir_foreach_function(fxn, ctx.nir) {
+         if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
+            nir_function_set_impl(fxn, read_function_impl(&ctx));
+      }
+   }
+
+   read_shader_tail(&ctx);
+
+   if (chunked && !lazy)
+      read_impls(ctx.nir, queue);
 
    free(ctx.idx_table);
 
@@ -2097,6 +2421,75 @@ nir_deserialize(void *mem_ctx,
    return ctx.nir;
 }
 
+nir_shader *
+nir_deserialize(void *mem_ctx,
+                const struct nir_shader_compiler_options *options,
+                struct blob_reader *blob)
+{
+   return deserialize(mem_ctx, options, blob, false, NULL);
+}
+
+/**
+ * Like nir_deserialize(), but the function_impls of a blob written by
+ * nir_serialize_chunked() are read in parallel by the threads of \p queue.
+ *
+ * This must not be called from a thread of \p queue.
+ */
+nir_shader *
+nir_deserialize_parallel(void *mem_ctx,
+                         const struct nir_shader_compiler_options *options,
+                         struct blob_reader *blob, struct util_queue *queue)
+{
+   return deserialize(mem_ctx, options, blob, false, queue);
+}
+
+/**
+ * Like nir_deserialize(), but the function_impls of a blob written by
+ * nir_serialize_chunked() are only read when they are asked for with
+ * nir_function_deserialize_impl() or nir_shader_deserialize_impls(), e.g.
+ * so that only the functions of a library which are called get read.
+ *
+ * Until then, the impl of such functions is NULL and their serialized_impl
+ * is set: the shader must not be passed to anything else than these two
+ * functions, and the blob can be freed.
+ */
+nir_shader *
+nir_deserialize_lazy(void *mem_ctx,
+                     const struct nir_shader_compiler_options *options,
+                     struct blob_reader *blob)
+{
+   return deserialize(mem_ctx, options, blob, true, NULL);
+}
+
+/**
+ * Returns the impl of a function of a shader from nir_deserialize_lazy(),
+ * reading it first if needed.
+ */
+nir_function_impl *
+nir_function_deserialize_impl(nir_function *fxn)
+{
+   if (fxn->serialized_impl) {
+      set_read_impl(fxn, read_impl_chunk(fxn->shader, fxn->serialized_impl));
+      nir_validate_shader(fxn->shader, "after deserialize");
+   }
+
+   return fxn->impl;
+}
+
+/**
+ * Reads all the function_impls of a shader from nir_deserialize_lazy() which
+ * haven't been read yet, in parallel on the threads of \p queue if it isn't
+ * NULL.
+ *
+ * This must not be called from a thread of \p queue.
+ */
+void
+nir_shader_deserialize_impls(nir_shader *shader, struct util_queue *queue)
+{
+   read_impls(shader, queue);
+   nir_validate_shader(shader, "after deserialize");
+}
+
 void
 nir_shader_serialize_deserialize(nir_shader *shader)
 {
@@ -39,10 +39,25 @@ u_printf_info *nir_deserialize_printf_info(void *mem_ctx,
                                            struct blob_reader *blob,
                                            unsigned *printf_info_count);
 
+struct util_queue;
+
 void nir_serialize(struct blob *blob, const nir_shader *nir, bool strip);
+void nir_serialize_chunked(struct blob *blob, const nir_shader *nir,
+                           bool strip, struct util_queue *queue);
 nir_shader *nir_deserialize(void *mem_ctx,
                             const struct nir_shader_compiler_options *options,
                             struct blob_reader *blob);
+nir_shader *nir_deserialize_parallel(void *mem_ctx,
+                                     const struct nir_shader_compiler_options *options,
+                                     struct blob_reader *blob,
+                                     struct util_queue *queue);
+nir_shader *nir_deserialize_lazy(void *mem_ctx,
+                                 const struct nir_shader_compiler_options *options,
+                                 struct blob_reader *blob);
+
+nir_function_impl *nir_function_deserialize_impl(nir_function *fxn);
+void nir_shader_deserialize_impls(nir_shader *shader,
+                                  struct util_queue *queue);
 
 #ifdef __cplusplus
 } /* extern "C" */
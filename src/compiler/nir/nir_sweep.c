@@ -33,6 +33,9 @@
  * The expectation is that drivers should call this when finished compiling the shader
  * (after any optimization, lowering, and so on).  However, it's also fine to call it
  * earlier, and even many times, trading CPU cycles for memory savings.
+ *
+ * For shaders in arena mode (see nir_shader_set_arena()), the memory of dead instructions
+ * is reused by later ones instead, unless their whole arena chunk is dead.
  */
 
 #define steal_list(mem_ctx, type, list)        \
@@ -0,0 +1,124 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * nir_opt_algebraic benchmark.
+ *
+ * Runs an optimization loop over shaders serialized with nir_serialize(),
+ * with and without nir_shader_track_instr_changes(), and reports the time
+ * spent in nir_opt_algebraic, separately for the first call of the loop,
+ * which has to look at every instruction either way, and for the following
+ * ones, as well as the total time of the loops and the peak RSS.  The
+ * results of both runs are also compared.  With -s, nir_sweep() runs after
+ * every iteration of the loop, e.g. to compare with NIR_DEBUG=arena:
+ *
+ *   algebraic_bench [-r passes] [-s] shader...
+ */
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "util/os_time.h"
+#include "nir.h"
+#include "nir_bench.h"
+
+static bool sweep;
+
+static bool
+parse_opt(int opt, const char *arg)
+{
+   sweep = true;
+   return true;
+}
+
+struct bench_stats {
+   int64_t time[2];
+   unsigned calls[2];
+   int64_t total;
+};
+
+static nir_shader *
+optimize(const struct nir_bench_file *file, bool track,
+         struct bench_stats *stats)
+{
+   nir_shader *nir = nir_bench_load_shader(file);
+
+   if (track)
+      nir_shader_track_instr_changes(nir);
+
+   int64_t loop_start = os_time_get_nano();
+   bool progress;
+   unsigned i = 0;
+   do {
+      progress = false;
+
+      int64_t start = os_time_get_nano();
+      progress |= nir_opt_algebraic(nir);
+      stats->time[i] += os_time_get_nano() - start;
+      stats->calls[i]++;
+      i = 1;
+
+      progress |= nir_opt_constant_folding(nir);
+      progress |= nir_copy_prop(nir);
+      progress |= nir_opt_remove_phis(nir);
+      progress |= nir_opt_dce(nir);
+      progress |= nir_opt_cse(nir);
+
+      if (sweep)
+         nir_sweep(nir);
+   } while (progress);
+   stats->total += os_time_get_nano() - loop_start;
+
+   return nir;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct nir_bench bench;
+   nir_bench_init(&bench, argc, argv, "s", "[-s]", parse_opt);
+
+   struct bench_stats stats[2] = { 0 };
+   unsigned mismatches = 0;
+
+   for (unsigned p = 0; p < bench.passes; p++) {
+      for (unsigned i = 0; i < bench.num_files; i++) {
+         const struct nir_bench_file *file = &bench.files[i];
+         nir_shader *full = optimize(file, false, &stats[0]);
+         nir_shader *incremental = optimize(file, true, &stats[1]);
+
+         if (p == 0 && !nir_bench_same_shaders(full, incremental)) {
+            fprintf(stderr, "%s: the results differ\n", file->name);
+            mismatches++;
+         }
+
+         ralloc_free(full);
+         ralloc_free(incremental);
+      }
+   }
+
+   printf("%u shaders, %u passes\n", bench.num_files, bench.passes);
+   for (unsigned i = 0; i < 2; i++) {
+      for (unsigned j = 0; j < 2; j++) {
+         const struct bench_stats *s = &stats[i];
+         printf("%-11s %-6s %8u calls %10.3f ms %8.2f us/call\n",
+                i ? "incremental" : "full", j ? "repeat" : "first",
+                s->calls[j], s->time[j] / 1e6,
+                s->calls[j] ? s->time[j] / 1e3 / s->calls[j] : 0.0);
+      }
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      printf("%-11s total  %10.3f ms\n", i ? "incremental" : "full",
+             stats[i].total / 1e6);
+   }
+
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   printf("peak RSS %ld KiB\n", usage.ru_maxrss);
+
+   nir_bench_finish(&bench);
+
+   return mismatches ? 1 : 0;
+}
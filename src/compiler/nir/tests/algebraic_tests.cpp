@@ -23,6 +23,7 @@
  */
 
 #include "nir_test.h"
+#include "nir_serialize.h"
 
 namespace {
 
@@ -99,6 +100,27 @@ protected:
    }
 };
 
+static void
+optimize(nir_shader *shader)
+{
+   bool progress;
+   do {
+      progress = false;
+      progress |= nir_opt_algebraic(shader);
+      progress |= nir_opt_constant_folding(shader);
+      progress |= nir_copy_prop(shader);
+      progress |= nir_opt_dce(shader);
+      progress |= nir_opt_cse(shader);
+   } while (progress);
+}
+
+static void
+serialize(nir_shader *shader, struct blob *blob)
+{
+   blob_init(blob);
+   nir_serialize(blob, shader, false);
+}
+
 TEST_F(nir_opt_algebraic_test, umod_pow2_src2)
 {
    for (int i = 0; i <= 9; i++)
@@ -172,6 +194,62 @@ TEST_F(nir_opt_algebraic_test, msad)
    }
 }
 
+TEST_F(nir_opt_algebraic_test, incremental)
+{
+   nir_shader_track_instr_changes(b->shader);
+
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *zero = nir_imm_int(b, 0);
+   nir_def *sum = nir_iadd(b, x, nir_imm_int(b, 1));
+   nir_store_var(b, res_var, sum, 0x1);
+
+   ASSERT_FALSE(nir_opt_algebraic(b->shader));
+
+   /* Instructions inserted with the builder are matched */
+   nir_store_var(b, res_var, nir_iadd(b, x, zero), 0x1);
+   ASSERT_TRUE(nir_opt_algebraic(b->shader));
+   ASSERT_FALSE(nir_opt_algebraic(b->shader));
+
+   /* Instructions modified in place aren't recorded, so they aren't looked
+    * at again until nir_metadata_instr_changes is invalidated.
+    */
+   nir_instr_as_alu(sum->parent_instr)->op = nir_op_imul;
+   ASSERT_FALSE(nir_opt_algebraic(b->shader));
+
+   nir_metadata_preserve(b->impl, nir_metadata_none);
+   ASSERT_TRUE(nir_opt_algebraic(b->shader));
+}
+
+TEST_F(nir_opt_algebraic_test, incremental_matches_full)
+{
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *y = nir_imul_imm(b, x, 4);
+   nir_def *z = nir_ineg(b, nir_ineg(b, nir_iadd_imm(b, y, 0)));
+   nir_def *w = nir_ior(b, nir_iand(b, z, z), nir_imm_int(b, 0));
+   nir_def *v = nir_isub(b, nir_iadd(b, w, x), nir_iadd(b, x, w));
+   nir_def *f = nir_fmul_imm(b, nir_fadd_imm(b, nir_u2f32(b, w), 0.0), 1.0);
+   nir_def *res = nir_iadd(b, nir_iadd(b, v, nir_f2u32(b, f)),
+                           nir_bcsel(b, nir_ieq(b, x, x), w, y));
+   nir_store_var(b, res_var, res, 0x1);
+
+   nir_shader *full = nir_shader_clone(NULL, b->shader);
+   nir_shader_track_instr_changes(b->shader);
+
+   optimize(full);
+   optimize(b->shader);
+
+   struct blob expected, actual;
+   serialize(full, &expected);
+   serialize(b->shader, &actual);
+
+   ASSERT_EQ(expected.size, actual.size);
+   EXPECT_EQ(memcmp(expected.data, actual.data, actual.size), 0);
+
+   blob_finish(&expected);
+   blob_finish(&actual);
+   ralloc_free(full);
+}
+
 TEST_F(nir_opt_idiv_const_test, umod)
 {
    for (uint32_t d : {16u, 17u, 0u, UINT32_MAX}) {
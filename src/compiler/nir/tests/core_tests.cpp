@@ -117,4 +117,61 @@ TEST_F(nir_core_test, nir_instr_free_and_dce_multiple_src_test)
    nir_validate_shader(b->shader, "after remove_and_dce");
 }
 
+TEST_F(nir_core_test, nir_loop_pass_deps_test)
+{
+   nir_variable *v = nir_local_variable_create(b->impl, glsl_int_type(), "v");
+   nir_store_var(b, v, nir_imm_int(b, 0), 0x1);
+   nir_store_var(b, v, nir_imm_int(b, 1), 0x1);
+
+   struct set *skip = _mesa_pointer_set_create(NULL);
+   _mesa_set_add(skip, (void *)&nir_copy_prop);
+   _mesa_set_add(skip, (void *)&nir_opt_dce);
+   _mesa_set_add(skip, (void *)&nir_opt_if);
+
+   /* Only removes a store, which can't give nir_copy_prop anything to do */
+   ASSERT_TRUE(nir_opt_dead_write_vars(b->shader));
+   nir_loop_pass_made_progress(skip, (void (*)())&nir_opt_dead_write_vars);
+
+   ASSERT_TRUE(_mesa_set_search(skip, (void *)&nir_copy_prop));
+   ASSERT_FALSE(_mesa_set_search(skip, (void *)&nir_opt_dce));
+   ASSERT_FALSE(_mesa_set_search(skip, (void *)&nir_opt_if));
+
+   /* Passes without declared dependencies affect every pass */
+   nir_loop_pass_made_progress(skip, (void (*)())&nir_opt_intrinsics);
+   ASSERT_EQ(skip->entries, 0);
+
+   _mesa_set_destroy(skip, NULL);
+}
+
+TEST_F(nir_core_test, nir_loop_pass_deps_split_array_vars_test)
+{
+   nir_variable *arr =
+      nir_local_variable_create(b->impl, glsl_array_type(glsl_int_type(), 4, 0), "arr");
+   nir_variable *out = nir_variable_create(b->shader, nir_var_shader_out,
+                                           glsl_int_type(), "out");
+
+   nir_def *one = nir_imm_int(b, 1);
+   nir_push_if(b, nir_ieq_imm(b, nir_load_local_invocation_index(b), 0));
+   nir_push_else(b, NULL);
+   /* Out of bounds, so nir_split_array_vars turns it into an undef */
+   nir_def *load = nir_load_array_var_imm(b, arr, 5);
+   nir_pop_if(b, NULL);
+   nir_store_var(b, out, nir_if_phi(b, one, load), 0x1);
+
+   struct set *skip = _mesa_pointer_set_create(NULL);
+   ASSERT_FALSE(nir_opt_remove_phis(b->shader));
+   _mesa_set_add(skip, (void *)&nir_opt_remove_phis);
+
+   ASSERT_TRUE(nir_split_array_vars(b->shader, nir_var_function_temp));
+   nir_loop_pass_made_progress(skip, (void (*)())&nir_split_array_vars);
+
+   /* The phi of the undef can go now */
+   ASSERT_FALSE(_mesa_set_search(skip, (void *)&nir_opt_remove_phis));
+   ASSERT_TRUE(nir_opt_remove_phis(b->shader));
+
+   nir_validate_shader(b->shader, "after nir_opt_remove_phis");
+
+   _mesa_set_destroy(skip, NULL);
+}
+
 }
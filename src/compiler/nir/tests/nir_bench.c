@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util/blob.h"
+#include "util/os_file.h"
+#include "nir_bench.h"
+#include "nir_serialize.h"
+
+static const nir_shader_compiler_options options = { 0 };
+
+static void
+usage(const char *name, const char *opts_usage)
+{
+   fprintf(stderr, "usage: %s [-r passes]%s%s shader...\n", name,
+           opts_usage ? " " : "", opts_usage ? opts_usage : "");
+   exit(1);
+}
+
+void
+nir_bench_init(struct nir_bench *bench, int argc, char **argv,
+               const char *opts, const char *opts_usage,
+               bool (*parse_opt)(int opt, const char *arg))
+{
+   char optstring[32];
+   int opt;
+
+   snprintf(optstring, sizeof(optstring), "r:%s", opts ? opts : "");
+
+   bench->passes = 10;
+   while ((opt = getopt(argc, argv, optstring)) != -1) {
+      if (opt == 'r')
+         bench->passes = atoi(optarg);
+      else if (opt == '?' || !parse_opt || !parse_opt(opt, optarg))
+         usage(argv[0], opts_usage);
+   }
+   if (!bench->passes || optind == argc)
+      usage(argv[0], opts_usage);
+
+   bench->num_files = argc - optind;
+   bench->files = calloc(bench->num_files, sizeof(*bench->files));
+   if (!bench->files) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+
+   for (unsigned i = 0; i < bench->num_files; i++) {
+      struct nir_bench_file *file = &bench->files[i];
+
+      file->name = argv[optind + i];
+      file->data = os_read_file(file->name, &file->size);
+      if (!file->data) {
+         fprintf(stderr, "failed to read %s\n", file->name);
+         exit(1);
+      }
+   }
+
+   glsl_type_singleton_init_or_ref();
+}
+
+void
+nir_bench_finish(struct nir_bench *bench)
+{
+   glsl_type_singleton_decref();
+
+   for (unsigned i = 0; i < bench->num_files; i++)
+      free(bench->files[i].data);
+   free(bench->files);
+}
+
+nir_shader *
+nir_bench_load_shader(const struct nir_bench_file *file)
+{
+   struct blob_reader reader;
+   blob_reader_init(&reader, file->data, file->size);
+
+   nir_shader *nir = nir_deserialize(NULL, &options, &reader);
+   if (!nir || reader.overrun) {
+      fprintf(stderr, "%s: not a serialized NIR shader\n", file->name);
+      exit(1);
+   }
+
+   return nir;
+}
+
+bool
+nir_bench_same_shaders(nir_shader *a, nir_shader *b)
+{
+   struct blob blob_a, blob_b;
+
+   blob_init(&blob_a);
+   blob_init(&blob_b);
+   nir_serialize(&blob_a, a, false);
+   nir_serialize(&blob_b, b, false);
+
+   bool same = blob_a.size == blob_b.size &&
+               memcmp(blob_a.data, blob_b.data, blob_a.size) == 0;
+
+   blob_finish(&blob_a);
+   blob_finish(&blob_b);
+   return same;
+}
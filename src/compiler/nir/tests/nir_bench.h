@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef NIR_BENCH_H
+#define NIR_BENCH_H
+
+#include "nir.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A shader serialized with nir_serialize() */
+struct nir_bench_file {
+   const char *name;
+   void *data;
+   size_t size;
+};
+
+struct nir_bench {
+   unsigned passes;
+   unsigned num_files;
+   struct nir_bench_file *files;
+};
+
+/*
+ * Parses "[-r passes] <opts> shader..." and reads the shaders.  Any option
+ * in opts is handed to parse_opt, which returns false if it is invalid.
+ * Exits with a usage message, including opts_usage, on errors.
+ */
+void nir_bench_init(struct nir_bench *bench, int argc, char **argv,
+                    const char *opts, const char *opts_usage,
+                    bool (*parse_opt)(int opt, const char *arg));
+
+void nir_bench_finish(struct nir_bench *bench);
+
+/* Deserializes a new copy of the shader, exits if that fails */
+nir_shader *nir_bench_load_shader(const struct nir_bench_file *file);
+
+bool nir_bench_same_shaders(nir_shader *a, nir_shader *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NIR_BENCH_H */
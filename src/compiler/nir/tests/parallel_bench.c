@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Parallel impl-level pass benchmark.
+ *
+ * Runs an optimization loop over shaders serialized with nir_serialize(),
+ * typically OpenCL programs with many kernels, serially and with an impl
+ * queue of the given number of threads, and reports the compile times and
+ * the speed-up.  The results of both runs are also compared:
+ *
+ *   parallel_bench [-r passes] [-j threads] shader...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/os_time.h"
+#include "util/u_queue.h"
+#include "nir.h"
+#include "nir_bench.h"
+
+static unsigned threads = 4;
+
+static bool
+parse_opt(int opt, const char *arg)
+{
+   threads = atoi(arg);
+   return threads > 0;
+}
+
+static nir_shader *
+optimize(const struct nir_bench_file *file, struct util_queue *queue,
+         int64_t *time)
+{
+   nir_shader *nir = nir_bench_load_shader(file);
+
+   nir_shader_set_impl_queue(nir, queue);
+
+   int64_t start = os_time_get_nano();
+
+   bool progress;
+   do {
+      progress = false;
+      progress |= nir_opt_algebraic(nir);
+      progress |= nir_opt_constant_folding(nir);
+      progress |= nir_copy_prop(nir);
+      progress |= nir_opt_remove_phis(nir);
+      progress |= nir_opt_dce(nir);
+      progress |= nir_opt_cse(nir);
+      progress |= nir_opt_undef(nir);
+   } while (progress);
+
+   *time += os_time_get_nano() - start;
+
+   return nir;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct nir_bench bench;
+   nir_bench_init(&bench, argc, argv, "j:", "[-j threads]", parse_opt);
+
+   struct util_queue queue;
+   if (!util_queue_init(&queue, "nir_bench", 64, threads, 0, NULL)) {
+      fprintf(stderr, "failed to create the queue\n");
+      return 1;
+   }
+
+   unsigned mismatches = 0;
+
+   printf("%-24s %6s %12s %12s %8s\n", "shader", "impls", "serial ms",
+          "parallel ms", "speed-up");
+
+   for (unsigned i = 0; i < bench.num_files; i++) {
+      const struct nir_bench_file *file = &bench.files[i];
+      int64_t time[2] = { 0 };
+      unsigned num_impls = 0;
+
+      for (unsigned p = 0; p < bench.passes; p++) {
+         nir_shader *serial = optimize(file, NULL, &time[0]);
+         nir_shader *parallel = optimize(file, &queue, &time[1]);
+
+         if (p == 0) {
+            nir_foreach_function_impl(impl, serial)
+               num_impls++;
+
+            if (!nir_bench_same_shaders(serial, parallel)) {
+               fprintf(stderr, "%s: the results differ\n", file->name);
+               mismatches++;
+            }
+         }
+
+         ralloc_free(serial);
+         ralloc_free(parallel);
+      }
+
+      printf("%-24s %6u %12.3f %12.3f %7.2fx\n", file->name, num_impls,
+             time[0] / 1e6 / bench.passes, time[1] / 1e6 / bench.passes,
+             (double)time[0] / time[1]);
+   }
+
+   util_queue_destroy(&queue);
+   nir_bench_finish(&bench);
+
+   return mismatches ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "nir_test.h"
+#include "nir_serialize.h"
+#include "util/u_queue.h"
+
+namespace {
+
+class nir_parallel_test : public nir_test {
+protected:
+   nir_parallel_test();
+   ~nir_parallel_test();
+
+   void add_kernel(const char *name, unsigned n);
+   void ASSERT_SHADER_EQ(nir_shader *expected, nir_shader *actual);
+
+   nir_variable *shared;
+   struct util_queue queue;
+};
+
+nir_parallel_test::nir_parallel_test()
+   : nir_test::nir_test("nir_parallel_test")
+{
+   shared = nir_variable_create(b->shader, nir_var_mem_shared,
+                                glsl_array_type(glsl_uint_type(), 16, 4), "shared");
+
+   add_kernel("kernel0", 0);
+   add_kernel("kernel1", 1);
+   add_kernel("kernel2", 2);
+   add_kernel("kernel3", 3);
+
+   util_queue_init(&queue, "nir_par", 16, 3, 0, NULL);
+}
+
+nir_parallel_test::~nir_parallel_test()
+{
+   util_queue_destroy(&queue);
+}
+
+void
+nir_parallel_test::add_kernel(const char *name, unsigned n)
+{
+   nir_function *fxn = nir_function_create(b->shader, name);
+   fxn->is_entrypoint = true;
+
+   nir_function_impl *impl = nir_function_impl_create(fxn);
+   nir_builder kb = nir_builder_at(nir_after_impl(impl));
+   nir_variable *local = nir_local_variable_create(impl, glsl_uint_type(), "local");
+
+   nir_def *x = nir_load_local_invocation_index(&kb);
+   nir_store_var(&kb, local, nir_iadd_imm(&kb, x, 0), 1);
+
+   nir_loop *loop = nir_push_loop(&kb);
+   {
+      nir_def *v = nir_load_var(&kb, local);
+      nir_push_if(&kb, nir_uge_imm(&kb, v, 100 + n));
+      nir_jump(&kb, nir_jump_break);
+      nir_pop_if(&kb, NULL);
+
+      /* Redundant computations for CSE and nir_opt_algebraic */
+      nir_def *a = nir_imul_imm(&kb, v, n + 2);
+      nir_def *c = nir_imul_imm(&kb, v, n + 2);
+      nir_def *d = nir_ior(&kb, nir_iand(&kb, c, c), nir_imm_int(&kb, 0));
+      nir_store_var(&kb, local, nir_iadd(&kb, a, nir_ineg(&kb, nir_ineg(&kb, d))), 1);
+   }
+   nir_pop_loop(&kb, loop);
+
+   nir_def *v = nir_load_var(&kb, local);
+   nir_deref_instr *deref = nir_build_deref_var(&kb, shared);
+   nir_store_deref(&kb, nir_build_deref_array_imm(&kb, deref, n), v, 1);
+}
+
+/* Compares the shaders through their serialization. */
+void
+nir_parallel_test::ASSERT_SHADER_EQ(nir_shader *expected, nir_shader *actual)
+{
+   struct blob expected_blob, actual_blob;
+
+   blob_init(&expected_blob);
+   blob_init(&actual_blob);
+   nir_serialize(&expected_blob, expected, false);
+   nir_serialize(&actual_blob, actual, false);
+
+   ASSERT_EQ(expected_blob.size, actual_blob.size);
+   ASSERT_EQ(memcmp(expected_blob.data, actual_blob.data, expected_blob.size), 0);
+
+   blob_finish(&expected_blob);
+   blob_finish(&actual_blob);
+}
+
+static void
+optimize(nir_shader *shader)
+{
+   NIR_PASS_V(shader, nir_lower_vars_to_ssa);
+
+   bool progress;
+   do {
+      progress = false;
+      NIR_PASS(progress, shader, nir_opt_algebraic);
+      NIR_PASS(progress, shader, nir_opt_constant_folding);
+      NIR_PASS(progress, shader, nir_copy_prop);
+      NIR_PASS(progress, shader, nir_opt_remove_phis);
+      NIR_PASS(progress, shader, nir_opt_dce);
+      NIR_PASS(progress, shader, nir_opt_cse);
+      NIR_PASS(progress, shader, nir_opt_undef);
+   } while (progress);
+}
+
+/* Replaces imul by an if with the multiplication in one branch. */
+static bool
+lower_imul_to_if(nir_builder *b, nir_instr *instr, void *data)
+{
+   if (instr->type != nir_instr_type_alu)
+      return false;
+
+   /* The new imul is exact, so that it doesn't get lowered again. */
+   nir_alu_instr *alu = nir_instr_as_alu(instr);
+   if (alu->op != nir_op_imul || alu->exact)
+      return false;
+
+   b->cursor = nir_before_instr(instr);
+
+   nir_def *x = nir_ssa_for_alu_src(b, alu, 0);
+   nir_def *y = nir_ssa_for_alu_src(b, alu, 1);
+
+   nir_push_if(b, nir_ieq_imm(b, y, 0));
+   nir_def *zero = nir_imm_int(b, 0);
+   nir_push_else(b, NULL);
+   nir_def *mul = nir_imul(b, x, y);
+   nir_pop_if(b, NULL);
+   nir_instr_as_alu(mul->parent_instr)->exact = true;
+
+   nir_def_rewrite_uses(&alu->def, nir_if_phi(b, zero, mul));
+   nir_instr_remove(instr);
+   return true;
+}
+
+} // namespace
+
+TEST_F(nir_parallel_test, matches_serial)
+{
+   nir_shader *serial = nir_shader_clone(NULL, b->shader);
+   optimize(serial);
+
+   nir_shader_set_impl_queue(b->shader, &queue);
+   optimize(b->shader);
+
+   ASSERT_SHADER_EQ(serial, b->shader);
+
+   /* Everything the passes allocated belongs to the shader. */
+   nir_sweep(b->shader);
+   nir_validate_shader(b->shader, "after nir_sweep");
+   ASSERT_SHADER_EQ(serial, b->shader);
+
+   ralloc_free(serial);
+}
+
+TEST_F(nir_parallel_test, creates_cf)
+{
+   NIR_PASS_V(b->shader, nir_lower_vars_to_ssa);
+
+   nir_shader *serial = nir_shader_clone(NULL, b->shader);
+   ASSERT_TRUE(nir_shader_instructions_pass(serial, lower_imul_to_if,
+                                            nir_metadata_none, NULL));
+
+   nir_shader_set_impl_queue(b->shader, &queue);
+   ASSERT_TRUE(nir_shader_parallel_instructions_pass(b->shader,
+                                                     lower_imul_to_if,
+                                                     nir_metadata_none, NULL));
+   nir_validate_shader(b->shader, "after lower_imul_to_if");
+
+   ASSERT_SHADER_EQ(serial, b->shader);
+
+   nir_sweep(b->shader);
+   nir_validate_shader(b->shader, "after nir_sweep");
+
+   ralloc_free(serial);
+}
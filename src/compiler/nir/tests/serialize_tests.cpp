@@ -26,6 +26,7 @@
 #include "nir.h"
 #include "nir_builder.h"
 #include "nir_serialize.h"
+#include "util/u_queue.h"
 
 namespace {
 
@@ -195,3 +196,211 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+namespace {
+
+class nir_serialize_chunked_test : public ::testing::Test {
+protected:
+   nir_serialize_chunked_test();
+   ~nir_serialize_chunked_test();
+
+   nir_function *add_helper(const char *name, nir_function *callee);
+   nir_shader *round_trip(bool parallel, bool lazy);
+   void ASSERT_SHADER_EQ(nir_shader *nir);
+
+   nir_builder *b, _b;
+   nir_variable *shared;
+   nir_function *helpers[3];
+   struct util_queue queue;
+   const nir_shader_compiler_options options;
+};
+
+nir_serialize_chunked_test::nir_serialize_chunked_test()
+:  options()
+{
+   glsl_type_singleton_init_or_ref();
+
+   _b = nir_builder_init_simple_shader(MESA_SHADER_COMPUTE, &options, "chunked serialize test");
+   b = &_b;
+
+   shared = nir_variable_create(b->shader, nir_var_mem_shared,
+                                glsl_array_type(glsl_uint_type(), 16, 4), "shared");
+
+   /* Each helper calls the previous one, the entrypoint calls the last. */
+   helpers[0] = add_helper("helper0", NULL);
+   helpers[1] = add_helper("helper1", helpers[0]);
+   helpers[2] = add_helper("helper2", helpers[1]);
+
+   nir_def *arg = nir_channel(b, nir_load_local_invocation_id(b), 0);
+   nir_build_call(b, helpers[2], 1, &arg);
+
+   nir_validate_shader(b->shader, "chunked serialize test");
+
+   util_queue_init(&queue, "nir_ser", 16, 3, 0, NULL);
+}
+
+nir_serialize_chunked_test::~nir_serialize_chunked_test()
+{
+   util_queue_destroy(&queue);
+
+   if (HasFailure()) {
+      printf("\nShader from the failed test\n\n");
+      nir_print_shader(b->shader, stdout);
+   }
+
+   ralloc_free(b->shader);
+
+   glsl_type_singleton_decref();
+}
+
+nir_function *
+nir_serialize_chunked_test::add_helper(const char *name, nir_function *callee)
+{
+   nir_function *fxn = nir_function_create(b->shader, name);
+   fxn->num_params = 1;
+   fxn->params = ralloc_array(fxn, nir_parameter, 1);
+   fxn->params[0].num_components = 1;
+   fxn->params[0].bit_size = 32;
+
+   nir_function_impl *impl = nir_function_impl_create(fxn);
+   nir_builder hb = nir_builder_at(nir_after_impl(impl));
+   nir_variable *local = nir_local_variable_create(impl, glsl_uint_type(), "local");
+
+   nir_store_var(&hb, local, nir_load_param(&hb, 0), 1);
+
+   nir_loop *loop = nir_push_loop(&hb);
+   {
+      nir_def *v = nir_load_var(&hb, local);
+      nir_push_if(&hb, nir_uge_imm(&hb, v, 100));
+      nir_jump(&hb, nir_jump_break);
+      nir_pop_if(&hb, NULL);
+      nir_store_var(&hb, local, nir_iadd_imm(&hb, v, 3), 1);
+   }
+   nir_pop_loop(&hb, loop);
+
+   nir_def *v = nir_load_var(&hb, local);
+   nir_if *nif = nir_push_if(&hb, nir_ieq_imm(&hb, v, 101));
+   nir_def *then_def = nir_imul_imm(&hb, v, 2);
+   nir_push_else(&hb, nif);
+   nir_def *else_def = nir_iadd_imm(&hb, v, 7);
+   nir_pop_if(&hb, nif);
+   nir_def *phi = nir_if_phi(&hb, then_def, else_def);
+
+   nir_deref_instr *deref = nir_build_deref_var(&hb, shared);
+   nir_store_deref(&hb, nir_build_deref_array(&hb, deref, nir_iand_imm(&hb, phi, 15)), phi, 1);
+
+   if (callee)
+      nir_build_call(&hb, callee, 1, &phi);
+
+   return fxn;
+}
+
+nir_shader *
+nir_serialize_chunked_test::round_trip(bool parallel, bool lazy)
+{
+   struct blob blob;
+   struct blob_reader reader;
+   nir_shader *nir;
+
+   blob_init(&blob);
+   nir_serialize_chunked(&blob, b->shader, false, parallel ? &queue : NULL);
+   blob_reader_init(&reader, blob.data, blob.size);
+   if (lazy)
+      nir = nir_deserialize_lazy(b->shader, &options, &reader);
+   else if (parallel)
+      nir = nir_deserialize_parallel(b->shader, &options, &reader, &queue);
+   else
+      nir = nir_deserialize(b->shader, &options, &reader);
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.current, reader.end);
+   blob_finish(&blob);
+
+   return nir;
+}
+
+/* Compares the shaders through their serialization in the existing format. */
+void
+nir_serialize_chunked_test::ASSERT_SHADER_EQ(nir_shader *nir)
+{
+   struct blob expected, actual;
+
+   blob_init(&expected);
+   blob_init(&actual);
+   nir_serialize(&expected, b->shader, false);
+   nir_serialize(&actual, nir, false);
+
+   ASSERT_EQ(expected.size, actual.size);
+   ASSERT_EQ(memcmp(expected.data, actual.data, expected.size), 0);
+
+   blob_finish(&expected);
+   blob_finish(&actual);
+}
+
+} // namespace
+
+TEST_F(nir_serialize_chunked_test, round_trip)
+{
+   nir_shader *nir = round_trip(false, false);
+
+   ASSERT_SHADER_EQ(nir);
+}
+
+TEST_F(nir_serialize_chunked_test, parallel)
+{
+   struct blob serial, parallel;
+
+   /* The output doesn't depend on the threads. */
+   blob_init(&serial);
+   blob_init(&parallel);
+   nir_serialize_chunked(&serial, b->shader, true, NULL);
+   nir_serialize_chunked(&parallel, b->shader, true, &queue);
+   ASSERT_EQ(serial.size, parallel.size);
+   ASSERT_EQ(memcmp(serial.data, parallel.data, serial.size), 0);
+   blob_finish(&serial);
+   blob_finish(&parallel);
+
+   nir_shader *nir = round_trip(true, false);
+
+   ASSERT_SHADER_EQ(nir);
+}
+
+TEST_F(nir_serialize_chunked_test, lazy)
+{
+   nir_shader *nir = round_trip(false, true);
+
+   nir_foreach_function(fxn, nir) {
+      ASSERT_EQ(fxn->impl, nullptr);
+      ASSERT_NE(fxn->serialized_impl, nullptr);
+   }
+
+   nir_function *helper = nir_shader_get_function_for_name(nir, "helper1");
+   ASSERT_NE(nir_function_deserialize_impl(helper), nullptr);
+   ASSERT_EQ(helper->serialized_impl, nullptr);
+
+   unsigned num_read = 0;
+   nir_foreach_function_impl(impl, nir)
+      num_read++;
+   ASSERT_EQ(num_read, 1);
+
+   nir_shader_deserialize_impls(nir, &queue);
+
+   ASSERT_SHADER_EQ(nir);
+}
+
+TEST_F(nir_serialize_chunked_test, lazy_unchunked)
+{
+   struct blob blob;
+   struct blob_reader reader;
+
+   /* Blobs in the existing format are read at once. */
+   blob_init(&blob);
+   nir_serialize(&blob, b->shader, false);
+   blob_reader_init(&reader, blob.data, blob.size);
+   nir_shader *nir = nir_deserialize_lazy(b->shader, &options, &reader);
+   blob_finish(&blob);
+
+   nir_foreach_function(fxn, nir)
+      ASSERT_NE(fxn->impl, nullptr);
+
+   ASSERT_SHADER_EQ(nir);
+}
@@ -61,6 +61,11 @@ llvmpipe_destroy(struct pipe_context *pipe)
    mtx_unlock(&lp_screen->ctx_mutex);
    lp_print_counters();
 
+   if (llvmpipe->async_fs_compile) {
+      util_queue_finish(&llvmpipe->fs_compile_queue);
+      util_queue_destroy(&llvmpipe->fs_compile_queue);
+   }
+
    if (llvmpipe->csctx) {
       lp_csctx_destroy(llvmpipe->csctx);
    }
@@ -107,7 +112,11 @@ llvmpipe_destroy(struct pipe_context *pipe)
 
    llvmpipe_sampler_matrix_destroy(llvmpipe);
 
+   util_dynarray_fini(&llvmpipe->fs_compiles_pending);
+
 #ifndef USE_GLOBAL_LLVM_CONTEXT
+   if (llvmpipe->fs_compile_context)
+      LLVMContextDispose(llvmpipe->fs_compile_context);
    LLVMContextDispose(llvmpipe->context);
 #endif
    llvmpipe->context = NULL;
@@ -221,6 +230,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
 
    list_inithead(&llvmpipe->cs_variants_list.list);
 
+   util_dynarray_init(&llvmpipe->fs_compiles_pending, NULL);
+
    llvmpipe->pipe.screen = screen;
    llvmpipe->pipe.priv = priv;
 
@@ -269,6 +280,25 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    LLVMContextSetOpaquePointers(llvmpipe->context, false);
 #endif
 
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+   /*
+    * Optionally JIT fragment shader variants on a helper thread.  LLVM
+    * contexts aren't thread safe, so the helper gets its own.  If any of
+    * this fails we just keep compiling synchronously.
+    */
+   if (debug_get_bool_option("LP_ASYNC_FS_COMPILE", false)) {
+      llvmpipe->fs_compile_context = LLVMContextCreate();
+      if (llvmpipe->fs_compile_context) {
+#if LLVM_VERSION_MAJOR == 15
+         LLVMContextSetOpaquePointers(llvmpipe->fs_compile_context, false);
+#endif
+         llvmpipe->async_fs_compile =
+            util_queue_init(&llvmpipe->fs_compile_queue, "lpfs", 64, 1,
+                            UTIL_QUEUE_INIT_RESIZE_IF_FULL, llvmpipe);
+      }
+   }
+#endif
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
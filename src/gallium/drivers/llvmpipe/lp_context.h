@@ -35,6 +35,8 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_dynarray.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
@@ -165,6 +167,13 @@ struct llvmpipe_context {
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Background FS variant compilation (LP_ASYNC_FS_COMPILE) */
+   bool async_fs_compile;
+   struct util_queue fs_compile_queue;
+   LLVMContextRef fs_compile_context;
+   /** Variants whose compile fence hasn't been retired yet */
+   struct util_dynarray fs_compiles_pending;
+
    bool permit_linear_rasterizer;
    bool single_vp;
 
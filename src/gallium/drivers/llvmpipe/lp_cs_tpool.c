@@ -24,85 +24,252 @@
  **************************************************************************/
 
 /**
- * compute shader thread pool.
- * based on threadpool.c but modified heavily to be compute shader tuned.
+ * llvmpipe thread pool.
+ * based on threadpool.c but modified heavily to be compute shader tuned,
+ * and since shared with the rasterizer, to steal work between threads.
  */
 
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
 
-static int
-lp_cs_tpool_worker(void *data)
+static void
+lp_cs_tpool_run(struct lp_cs_tpool *pool, struct lp_cs_tpool_task *task,
+                unsigned iter, struct lp_cs_local_mem *lmem)
 {
-   struct lp_cs_tpool *pool = data;
-   struct lp_cs_local_mem lmem;
+   const unsigned iter_total = task->iter_total;
 
-   memset(&lmem, 0, sizeof(lmem));
-   mtx_lock(&pool->m);
+   task->work(task->data, iter, lmem);
 
-   while (!pool->shutdown) {
-      struct lp_cs_tpool_task *task;
-      unsigned iter_per_thread;
+   /* The task may be gone as soon as our iteration is counted, unless
+    * it was the last one.
+    */
+   if (p_atomic_inc_return(&task->iter_finished) != iter_total)
+      return;
 
-      while (list_is_empty(&pool->workqueue) && !pool->shutdown)
-         cnd_wait(&pool->new_work, &pool->m);
+   if (task->done) {
+      /* nobody waits for async tasks, the last iteration cleans up */
+      task->done(task->data);
+      FREE(task);
+      return;
+   }
 
-      if (pool->shutdown)
-         break;
+   mtx_lock(&pool->m);
+   task->finished = true;
+   cnd_broadcast(&task->finish);
+   mtx_unlock(&pool->m);
+}
 
-      task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
-                              list);
+/**
+ * Take the next iteration of the oldest slice queued on the worker.
+ */
+static bool
+lp_cs_tpool_pop(struct lp_cs_tpool_worker *worker,
+                struct lp_cs_tpool_task **task, unsigned *iter)
+{
+   bool found = false;
+
+   mtx_lock(&worker->m);
+   if (!list_is_empty(&worker->slices)) {
+      struct lp_cs_tpool_slice *slice =
+         list_first_entry(&worker->slices, struct lp_cs_tpool_slice, list);
+
+      *task = slice->task;
+      *iter = slice->next++;
+      if (slice->next == slice->end)
+         list_del(&slice->list);
+      found = true;
+   }
+   mtx_unlock(&worker->m);
+
+   return found;
+}
 
-      unsigned this_iter = task->iter_start;
+/**
+ * Take the back half of the newest slice queued on the victim.
+ * Returns the number of iterations taken, starting at \p first.
+ */
+static unsigned
+lp_cs_tpool_steal(struct lp_cs_tpool_worker *victim,
+                  struct lp_cs_tpool_task **task, unsigned *first)
+{
+   unsigned count = 0;
+
+   mtx_lock(&victim->m);
+   if (!list_is_empty(&victim->slices)) {
+      struct lp_cs_tpool_slice *slice =
+         list_last_entry(&victim->slices, struct lp_cs_tpool_slice, list);
+
+      count = DIV_ROUND_UP(slice->end - slice->next, 2);
+      slice->end -= count;
+      *task = slice->task;
+      *first = slice->end;
+      if (slice->next == slice->end)
+         list_del(&slice->list);
+   }
+   mtx_unlock(&victim->m);
 
-      iter_per_thread = task->iter_per_thread;
+   return count;
+}
 
-      if (task->iter_remainder &&
-          task->iter_start + task->iter_remainder == task->iter_total) {
-         task->iter_remainder--;
-         iter_per_thread = 1;
+/**
+ * Find work for a worker: its own slices first, then steal from the
+ * workers in the same CPU domain, then from everybody else.  Stolen
+ * iterations are queued as the worker's own slice of the task, so they
+ * can be stolen again.  Returns the number of iterations to run right
+ * away, starting at \p first.
+ */
+static unsigned
+lp_cs_tpool_get_work(struct lp_cs_tpool_worker *worker,
+                     struct lp_cs_tpool_task **task, unsigned *first)
+{
+   struct lp_cs_tpool *pool = worker->pool;
+   const unsigned num_threads = pool->num_threads;
+   const unsigned domain = worker->index % pool->num_domains;
+
+   if (lp_cs_tpool_pop(worker, task, first))
+      return 1;
+
+   for (unsigned pass = 0; pass < 2; pass++) {
+      for (unsigned i = 1; i < num_threads; i++) {
+         struct lp_cs_tpool_worker *victim =
+            &pool->workers[(worker->index + i) % num_threads];
+
+         if ((victim->index % pool->num_domains == domain) != (pass == 0))
+            continue;
+
+         unsigned count = lp_cs_tpool_steal(victim, task, first);
+         if (!count)
+            continue;
+
+         if (count > 1) {
+            struct lp_cs_tpool_slice *slice = &(*task)->slices[worker->index];
+
+            /* The task may have queued a new slice on us since we looked,
+             * in which case the stolen iterations are just run here.
+             */
+            mtx_lock(&worker->m);
+            if (slice->next == slice->end) {
+               slice->next = *first + 1;
+               slice->end = *first + count;
+               list_addtail(&slice->list, &worker->slices);
+               count = 1;
+            }
+            mtx_unlock(&worker->m);
+         }
+         return count;
       }
+   }
 
-      task->iter_start += iter_per_thread;
+   return 0;
+}
 
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
+static int
+lp_cs_tpool_worker(void *data)
+{
+   struct lp_cs_tpool_worker *worker = data;
+   struct lp_cs_tpool *pool = worker->pool;
+   struct lp_cs_local_mem lmem;
+   char thread_name[16];
 
-      mtx_unlock(&pool->m);
-      for (unsigned i = 0; i < iter_per_thread; i++)
-         task->work(task->data, this_iter + i, &lmem);
+   snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", worker->index);
+   u_thread_setname(thread_name);
+
+   memset(&lmem, 0, sizeof(lmem));
+
+   while (!p_atomic_read(&pool->shutdown)) {
+      struct lp_cs_tpool_task *task;
+      unsigned first, count;
+
+      /* Read the sequence number before looking for work so that slices
+       * queued while we look don't get missed.
+       */
+      unsigned seq = p_atomic_read(&pool->work_seq);
+
+      count = lp_cs_tpool_get_work(worker, &task, &first);
+      if (count) {
+         for (unsigned i = 0; i < count; i++)
+            lp_cs_tpool_run(pool, task, first + i, &lmem);
+         continue;
+      }
 
       mtx_lock(&pool->m);
-      task->iter_finished += iter_per_thread;
-      if (task->iter_finished == task->iter_total)
-         cnd_broadcast(&task->finish);
+      while (pool->work_seq == seq && !pool->shutdown)
+         cnd_wait(&pool->new_work, &pool->m);
+      mtx_unlock(&pool->m);
    }
-   mtx_unlock(&pool->m);
+
    FREE(lmem.local_mem_ptr);
    return 0;
 }
 
+/**
+ * Number of CPU domains (L3 caches) to spread the threads over.
+ * LP_PIN_THREADS=false disables pinning.
+ */
+static unsigned
+lp_cs_tpool_num_domains(unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (num_threads < 2 || caps->num_L3_caches < 2 ||
+       !caps->L3_affinity_mask ||
+       !debug_get_bool_option("LP_PIN_THREADS", true))
+      return 1;
+
+   return MIN2(caps->num_L3_caches, num_threads);
+}
+
 struct lp_cs_tpool *
 lp_cs_tpool_create(unsigned num_threads)
 {
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
    struct lp_cs_tpool *pool = CALLOC_STRUCT(lp_cs_tpool);
 
    if (!pool)
       return NULL;
 
+   pool->threads = CALLOC(MAX2(1, num_threads), sizeof *pool->threads);
+   pool->workers = CALLOC(MAX2(1, num_threads), sizeof *pool->workers);
+   if (!pool->threads || !pool->workers) {
+      FREE(pool->threads);
+      FREE(pool->workers);
+      FREE(pool);
+      return NULL;
+   }
+
    (void) mtx_init(&pool->m, mtx_plain);
    cnd_init(&pool->new_work);
 
-   list_inithead(&pool->workqueue);
-   assert (num_threads <= LP_MAX_THREADS);
+   pool->num_domains = lp_cs_tpool_num_domains(num_threads);
+
    for (unsigned i = 0; i < num_threads; i++) {
-      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, pool)) {
-         num_threads = i;  /* previous thread is max */
-         break;
+      struct lp_cs_tpool_worker *worker = &pool->workers[i];
+
+      worker->pool = pool;
+      worker->index = i;
+      (void) mtx_init(&worker->m, mtx_plain);
+      list_inithead(&worker->slices);
+
+      if (thrd_success != u_thread_create(pool->threads + i, lp_cs_tpool_worker, worker)) {
+         mtx_destroy(&worker->m);
+         break;  /* previous thread is max */
+      }
+      pool->num_threads = i + 1;
+
+      /* Keep each thread on the CPUs sharing its domain's L3 so the
+       * tiles it keeps coming back to stay in that cache (and, on
+       * multi-socket machines, on that node).
+       */
+      if (pool->num_domains > 1) {
+         util_set_thread_affinity(pool->threads[i],
+                                  caps->L3_affinity_mask[i % pool->num_domains],
+                                  NULL, caps->num_cpu_mask_bits);
       }
    }
-   pool->num_threads = num_threads;
    return pool;
 }
 
@@ -119,63 +286,161 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    for (unsigned i = 0; i < pool->num_threads; i++) {
       thrd_join(pool->threads[i], NULL);
+      mtx_destroy(&pool->workers[i].m);
    }
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->workers);
+   FREE(pool->threads);
    FREE(pool);
 }
 
-struct lp_cs_tpool_task *
-lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
-                       lp_cs_tpool_task_func work, void *data, int num_iters)
+static void
+lp_cs_tpool_run_inline(lp_cs_tpool_task_func work, void *data, int num_iters)
 {
-   struct lp_cs_tpool_task *task;
-
-   if (pool->num_threads == 0) {
-      struct lp_cs_local_mem lmem;
+   struct lp_cs_local_mem lmem;
 
-      memset(&lmem, 0, sizeof(lmem));
-      for (unsigned t = 0; t < num_iters; t++) {
-         work(data, t, &lmem);
-      }
-      FREE(lmem.local_mem_ptr);
-      return NULL;
+   memset(&lmem, 0, sizeof(lmem));
+   for (unsigned t = 0; t < num_iters; t++) {
+      work(data, t, &lmem);
    }
-   task = CALLOC_STRUCT(lp_cs_tpool_task);
+   FREE(lmem.local_mem_ptr);
+}
+
+static struct lp_cs_tpool_task *
+lp_cs_tpool_queue(struct lp_cs_tpool *pool,
+                  lp_cs_tpool_task_func work, lp_cs_tpool_done_func done,
+                  void *data, int num_iters)
+{
+   const unsigned num_threads = pool->num_threads;
+   struct lp_cs_tpool_task *task;
+
+   task = CALLOC(1, sizeof(*task) + num_threads * sizeof(task->slices[0]));
    if (!task) {
       return NULL;
    }
 
    task->work = work;
    task->data = data;
+   task->done = done;
    task->iter_total = num_iters;
 
-   task->iter_per_thread = num_iters / pool->num_threads;
-   task->iter_remainder = num_iters % pool->num_threads;
+   if (!done)
+      cnd_init(&task->finish);
 
-   cnd_init(&task->finish);
+   /* Iteration i of an n iteration task lands on worker i, the rasterizer
+    * relies on this to keep its tasks on their CPU domain.
+    */
+   for (unsigned i = 0; i < num_threads; i++) {
+      struct lp_cs_tpool_slice *slice = &task->slices[i];
 
-   mtx_lock(&pool->m);
+      slice->task = task;
+      slice->next = (uint64_t)num_iters * i / num_threads;
+      slice->end = (uint64_t)num_iters * (i + 1) / num_threads;
+   }
+
+   /* All slices must be set up before the first one is queued, a thief
+    * may put stolen iterations in its own slice right away.
+    */
+   for (unsigned i = 0; i < num_threads; i++) {
+      struct lp_cs_tpool_slice *slice = &task->slices[i];
 
-   list_addtail(&task->list, &pool->workqueue);
+      if (slice->next == slice->end)
+         continue;
 
+      mtx_lock(&pool->workers[i].m);
+      list_addtail(&slice->list, &pool->workers[i].slices);
+      mtx_unlock(&pool->workers[i].m);
+   }
+
+   mtx_lock(&pool->m);
+   p_atomic_inc(&pool->work_seq);
    cnd_broadcast(&pool->new_work);
    mtx_unlock(&pool->m);
    return task;
 }
 
+struct lp_cs_tpool_task *
+lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
+                       lp_cs_tpool_task_func work, void *data, int num_iters)
+{
+   if (pool->num_threads == 0 || num_iters == 0) {
+      lp_cs_tpool_run_inline(work, data, num_iters);
+      return NULL;
+   }
+
+   return lp_cs_tpool_queue(pool, work, NULL, data, num_iters);
+}
+
+/**
+ * Queue a task nobody waits for: \p done is called by the thread that
+ * finishes the last iteration, and the task is freed after that.
+ * Without threads the task runs right away.
+ */
+void
+lp_cs_tpool_queue_async(struct lp_cs_tpool *pool,
+                        lp_cs_tpool_task_func work,
+                        lp_cs_tpool_done_func done,
+                        void *data, int num_iters)
+{
+   if (pool->num_threads == 0 || num_iters == 0 ||
+       !lp_cs_tpool_queue(pool, work, done, data, num_iters)) {
+      lp_cs_tpool_run_inline(work, data, num_iters);
+      done(data);
+   }
+}
+
+/**
+ * Take one iteration of the task from the back of any of its slices.
+ */
+static bool
+lp_cs_tpool_help(struct lp_cs_tpool *pool, struct lp_cs_tpool_task *task,
+                 unsigned *iter)
+{
+   for (unsigned i = 0; i < pool->num_threads; i++) {
+      struct lp_cs_tpool_slice *slice = &task->slices[i];
+      bool found = false;
+
+      mtx_lock(&pool->workers[i].m);
+      if (slice->next != slice->end) {
+         *iter = --slice->end;
+         if (slice->next == slice->end)
+            list_del(&slice->list);
+         found = true;
+      }
+      mtx_unlock(&pool->workers[i].m);
+
+      if (found)
+         return true;
+   }
+
+   return false;
+}
+
+/**
+ * Wait for a task queued with lp_cs_tpool_queue_task().  Rather than
+ * sleeping while the workers are busy, e.g. rasterizing a scene, the
+ * waiting thread runs the iterations nobody has picked up yet.
+ */
 void
 lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
                           struct lp_cs_tpool_task **task_handle)
 {
    struct lp_cs_tpool_task *task = *task_handle;
+   struct lp_cs_local_mem lmem;
+   unsigned iter;
 
    if (!pool || !task)
       return;
 
+   memset(&lmem, 0, sizeof(lmem));
+   while (lp_cs_tpool_help(pool, task, &iter))
+      lp_cs_tpool_run(pool, task, iter, &lmem);
+   FREE(lmem.local_mem_ptr);
+
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (!task->finished)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
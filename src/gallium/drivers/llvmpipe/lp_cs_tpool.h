@@ -23,11 +23,16 @@
  *
  **************************************************************************/
 
-/* This is a compute shader specific thread pool.
+/* This is the llvmpipe thread pool, shared by compute shaders, parallel
+ * triangle setup and the rasterizer.
  * It allows the queuing of a number of tasks per work item.
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * The iterations are split into one slice per worker thread. Each worker
+ * runs its own slices first and steals half of a slice from the other
+ * workers when it runs out, so a compute dispatch and a scene being
+ * rasterized share the same threads instead of oversubscribing the CPUs.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -41,13 +46,29 @@
 
 #include "lp_limits.h"
 
+struct lp_cs_tpool_worker {
+   struct lp_cs_tpool *pool;
+   unsigned index;
+
+   /** Protects the slices queued on this worker */
+   mtx_t m;
+   struct list_head slices;
+};
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
+   unsigned work_seq;   /**< bumped whenever slices are queued */
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+   struct lp_cs_tpool_worker *workers;
    unsigned num_threads;
-   struct list_head workqueue;
+
+   /**
+    * Number of CPU domains (L3 caches) the threads are spread over,
+    * worker i is pinned to domain i % num_domains.
+    */
+   unsigned num_domains;
    bool shutdown;
 };
 
@@ -57,17 +78,29 @@ struct lp_cs_local_mem {
 };
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
+typedef void (*lp_cs_tpool_done_func)(void *data);
+
+/**
+ * A range of iterations of a task, queued on one worker.  The owner takes
+ * iterations from the front, thieves from the back, both under the
+ * worker's lock.
+ */
+struct lp_cs_tpool_slice {
+   struct lp_cs_tpool_task *task;
+   struct list_head list;
+   unsigned next;
+   unsigned end;
+};
 
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
-   struct list_head list;
+   lp_cs_tpool_done_func done;   /**< for lp_cs_tpool_queue_async() */
    cnd_t finish;
+   bool finished;                /**< protected by the pool mutex */
    unsigned iter_total;
-   unsigned iter_start;
    unsigned iter_finished;
-   unsigned iter_per_thread;
-   unsigned iter_remainder;
+   struct lp_cs_tpool_slice slices[];   /**< one per worker */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -77,6 +110,11 @@ struct lp_cs_tpool_task *lp_cs_tpool_queue_task(struct lp_cs_tpool *,
                                                 lp_cs_tpool_task_func func,
                                                 void *data, int num_iters);
 
+void lp_cs_tpool_queue_async(struct lp_cs_tpool *pool,
+                             lp_cs_tpool_task_func func,
+                             lp_cs_tpool_done_func done,
+                             void *data, int num_iters);
+
 void lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
                             struct lp_cs_tpool_task **task);
 
@@ -28,6 +28,7 @@
 
 #include "pipe/p_screen.h"
 #include "util/u_memory.h"
+#include "util/os_time.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
 
@@ -93,6 +94,9 @@ lp_fence_signal(struct lp_fence *fence)
 
    mtx_lock(&fence->mutex);
 
+   if (fence->count + 1 == fence->rank)
+      fence->signalled_time = os_time_get_nano();
+
    fence->count++;
    assert(fence->count <= fence->rank);
 
@@ -49,6 +49,8 @@ struct lp_fence
    bool issued;
    unsigned rank;
    unsigned count;
+
+   int64_t signalled_time;   /**< os_time_get_nano() when count hit rank */
 };
 
 
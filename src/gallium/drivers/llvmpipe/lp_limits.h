@@ -35,10 +35,18 @@
 
 /**
  * Tile size (width and height). This needs to be a power of two.
+ *
+ * TILE_SIZE is the default and the size the linear rasterizer and the
+ * debug code assume.  Each scene may pick a different tile size between
+ * MIN_TILE_ORDER and MAX_TILE_ORDER, see lp_setup_choose_tile_order().
  */
 #define TILE_ORDER 6
 #define TILE_SIZE (1 << TILE_ORDER)
 
+#define MIN_TILE_ORDER 5
+#define MAX_TILE_ORDER 7
+#define MAX_TILE_SIZE (1 << MAX_TILE_ORDER)
+
 
 /**
  * Max texture sizes
@@ -66,8 +74,6 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
-
 
 /**
  * Max number of shader variants (for all shaders combined,
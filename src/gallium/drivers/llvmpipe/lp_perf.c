@@ -122,5 +122,11 @@ lp_print_counters(void)
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      debug_printf("llvmpipe: nr_fs_async_compiles:         %u\n", lp_count.nr_fs_async_compiles);
+      debug_printf("llvmpipe: nr_fs_deferred_draws:         %u\n", lp_count.nr_fs_deferred_draws);
+      debug_printf("llvmpipe: nr_fs_async_compile_failures: %u\n", lp_count.nr_fs_async_compile_failures);
+      debug_printf("llvmpipe: max_fs_compile_queue_depth:   %u\n", lp_count.max_fs_compile_queue_depth);
+      debug_printf("llvmpipe: nr_scene_stalls:              %u\n", lp_count.nr_scene_stalls);
+
    }
 }
@@ -64,6 +64,11 @@ struct lp_counters
    unsigned nr_non_empty_4;
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_async_compiles;
+   unsigned nr_fs_deferred_draws;  /**< draws binned before their FS was ready */
+   unsigned nr_fs_async_compile_failures;
+   unsigned max_fs_compile_queue_depth;
+   unsigned nr_scene_stalls;       /**< setup waits for a free scene */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
@@ -79,10 +84,13 @@ extern struct lp_counters lp_count;
 #define LP_COUNT(counter) lp_count.counter++
 #define LP_COUNT_ADD(counter, incr)  lp_count.counter += (incr)
 #define LP_COUNT_GET(counter) (lp_count.counter)
+#define LP_COUNT_MAX(counter, val) \
+   lp_count.counter = MAX2(lp_count.counter, (val))
 #else
 #define LP_COUNT(counter) do {} while (0)
 #define LP_COUNT_ADD(counter, incr) (void)(incr)
 #define LP_COUNT_GET(counter) 0
+#define LP_COUNT_MAX(counter, val) (void)(val)
 #endif
 
 
@@ -32,6 +32,7 @@
 
 #include "draw/draw_context.h"
 #include "pipe/p_defines.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
 #include "lp_context.h"
@@ -55,10 +56,21 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
-   assert(type < PIPE_QUERY_TYPES);
-
-   struct llvmpipe_query *pq = CALLOC_STRUCT(llvmpipe_query);
+   assert(type < PIPE_QUERY_TYPES ||
+          type == LP_QUERY_SETUP_STALL_TIME ||
+          type == LP_QUERY_NUM_SCENES ||
+          type == LP_QUERY_DISK_CACHE_HITS ||
+          type == LP_QUERY_DISK_CACHE_MISSES);
+
+   /* The per-thread counters are allocated along with the query. */
+   const unsigned num_threads =
+      MAX2(1, llvmpipe_screen(pipe->screen)->num_threads);
+   struct llvmpipe_query *pq =
+      CALLOC(1, sizeof *pq + 2 * num_threads * sizeof(uint64_t));
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
+      pq->num_threads = num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -193,6 +205,17 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
       result->so_statistics.num_primitives_written = pq->num_primitives_written[0];
       result->so_statistics.primitives_storage_needed = pq->num_primitives_generated[0];
       break;
+   case LP_QUERY_SETUP_STALL_TIME:
+      /* microseconds */
+      result->u64 = (pq->end[0] - pq->start[0]) / 1000;
+      break;
+   case LP_QUERY_NUM_SCENES:
+      result->u64 = pq->end[0];
+      break;
+   case LP_QUERY_DISK_CACHE_HITS:
+   case LP_QUERY_DISK_CACHE_MISSES:
+      result->u64 = pq->end[0] - pq->start[0];
+      break;
    case PIPE_QUERY_PIPELINE_STATISTICS:
       {
          /* only ps_invocations are per-bin/thread */
@@ -306,6 +329,16 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
       case PIPE_QUERY_SO_OVERFLOW_PREDICATE:
          value = (pq->num_primitives_generated[0] > pq->num_primitives_written[0]);
          break;
+      case LP_QUERY_SETUP_STALL_TIME:
+         value = (pq->end[0] - pq->start[0]) / 1000;
+         break;
+      case LP_QUERY_NUM_SCENES:
+         value = pq->end[0];
+         break;
+      case LP_QUERY_DISK_CACHE_HITS:
+      case LP_QUERY_DISK_CACHE_MISSES:
+         value = pq->end[0] - pq->start[0];
+         break;
       case PIPE_QUERY_PIPELINE_STATISTICS:
          switch ((enum pipe_statistics_query_index)index) {
          case PIPE_STAT_QUERY_IA_VERTICES:
@@ -399,6 +432,7 @@ static bool
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
    /* Check if the query is already in the scene.  If so, we need to
@@ -409,8 +443,26 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe_finish(pipe, __func__);
    }
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, pq->num_threads * sizeof(*pq->end));
+
+   /* Driver queries are sampled on the CPU, they don't go in the scene */
+   switch (pq->type) {
+   case LP_QUERY_SETUP_STALL_TIME:
+      pq->start[0] = lp_setup_get_stall_time(llvmpipe->setup);
+      return true;
+   case LP_QUERY_NUM_SCENES:
+      return true;
+   case LP_QUERY_DISK_CACHE_HITS:
+      pq->start[0] = p_atomic_read(&screen->disk_cache_hits);
+      return true;
+   case LP_QUERY_DISK_CACHE_MISSES:
+      pq->start[0] = p_atomic_read(&screen->disk_cache_misses);
+      return true;
+   default:
+      break;
+   }
+
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -461,8 +513,26 @@ static bool
 llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   switch (pq->type) {
+   case LP_QUERY_SETUP_STALL_TIME:
+      pq->end[0] = lp_setup_get_stall_time(llvmpipe->setup);
+      return true;
+   case LP_QUERY_NUM_SCENES:
+      pq->end[0] = lp_setup_get_num_scenes(llvmpipe->setup);
+      return true;
+   case LP_QUERY_DISK_CACHE_HITS:
+      pq->end[0] = p_atomic_read(&screen->disk_cache_hits);
+      return true;
+   case LP_QUERY_DISK_CACHE_MISSES:
+      pq->end[0] = p_atomic_read(&screen->disk_cache_misses);
+      return true;
+   default:
+      break;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -578,6 +648,45 @@ llvmpipe_set_active_query_state(struct pipe_context *pipe, bool enable)
 }
 
 
+static const struct pipe_driver_query_info lp_driver_query_list[] = {
+   {"setup-stall-time", LP_QUERY_SETUP_STALL_TIME, {0},
+    PIPE_DRIVER_QUERY_TYPE_MICROSECONDS,
+    PIPE_DRIVER_QUERY_RESULT_TYPE_CUMULATIVE},
+   {"num-scenes", LP_QUERY_NUM_SCENES, {0},
+    PIPE_DRIVER_QUERY_TYPE_UINT64,
+    PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE},
+   {"disk-cache-hits", LP_QUERY_DISK_CACHE_HITS, {0},
+    PIPE_DRIVER_QUERY_TYPE_UINT64,
+    PIPE_DRIVER_QUERY_RESULT_TYPE_CUMULATIVE},
+   {"disk-cache-misses", LP_QUERY_DISK_CACHE_MISSES, {0},
+    PIPE_DRIVER_QUERY_TYPE_UINT64,
+    PIPE_DRIVER_QUERY_RESULT_TYPE_CUMULATIVE},
+};
+
+
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   if (!info)
+      return ARRAY_SIZE(lp_driver_query_list);
+
+   if (index >= ARRAY_SIZE(lp_driver_query_list))
+      return 0;
+
+   *info = lp_driver_query_list[index];
+   return 1;
+}
+
+
+void
+llvmpipe_init_screen_query_funcs(struct pipe_screen *screen)
+{
+   screen->get_driver_query_info = llvmpipe_get_driver_query_info;
+}
+
+
 void
 llvmpipe_init_query_funcs(struct llvmpipe_context *llvmpipe)
 {
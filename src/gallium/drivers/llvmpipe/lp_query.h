@@ -41,11 +41,19 @@
 struct llvmpipe_context;
 
 
+/** Driver specific queries, see llvmpipe_get_driver_query_info() */
+#define LP_QUERY_SETUP_STALL_TIME (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_NUM_SCENES       (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_DISK_CACHE_HITS  (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_DISK_CACHE_MISSES (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+
+
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
+   unsigned num_threads;            /* size of the start/end arrays */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
-   enum pipe_query_type type;
+   unsigned type;                   /* PIPE_QUERY_x or LP_QUERY_x */
    unsigned index;
    unsigned num_primitives_generated[PIPE_MAX_VERTEX_STREAMS];
    unsigned num_primitives_written[PIPE_MAX_VERTEX_STREAMS];
@@ -56,6 +64,8 @@ struct llvmpipe_query {
 
 extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
+extern void llvmpipe_init_screen_query_funcs(struct pipe_screen *);
+
 extern bool llvmpipe_check_render_cond(struct llvmpipe_context *);
 
 #endif /* LP_QUERY_H */
@@ -50,10 +50,6 @@
 #include "lp_screen.h"
 #include "lp_tex_sample.h"
 
-#ifdef _WIN32
-#include <windows.h>
-#endif
-
 #ifdef DEBUG
 int jit_line = 0;
 const struct lp_rast_state *jit_state = NULL;
@@ -74,11 +70,12 @@ lp_rast_begin(struct lp_rasterizer *rast,
               struct lp_scene *scene)
 {
    rast->curr_scene = scene;
+   scene->raster_begin_time = os_time_get_nano();
 
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, rast->bands, rast->num_domains);
 }
 
 
@@ -104,12 +101,10 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    LP_DBG(DEBUG_RAST, "%s %d,%d\n", __func__, x, y);
 
    task->bin = bin;
-   task->x = x * TILE_SIZE;
-   task->y = y * TILE_SIZE;
-   task->width = TILE_SIZE + x * TILE_SIZE > scene->fb.width ?
-                    scene->fb.width - x * TILE_SIZE : TILE_SIZE;
-   task->height = TILE_SIZE + y * TILE_SIZE > scene->fb.height ?
-                    scene->fb.height - y * TILE_SIZE : TILE_SIZE;
+   task->x = x * scene->tile_size;
+   task->y = y * scene->tile_size;
+   task->width = MIN2(scene->tile_size, scene->fb.width - task->x);
+   task->height = MIN2(scene->tile_size, scene->fb.height - task->y);
 
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
@@ -420,8 +415,8 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
    assert(state);
 
    /* Sanity checks */
-   assert(x < scene->tiles_x * TILE_SIZE);
-   assert(y < scene->tiles_y * TILE_SIZE);
+   assert(x < scene->tiles_x * scene->tile_size);
+   assert(y < scene->tiles_y * scene->tile_size);
    assert(x % TILE_VECTOR_WIDTH == 0);
    assert(y % TILE_VECTOR_HEIGHT == 0);
 
@@ -461,7 +456,7 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if (x - task->x < task->width && y - task->y < task->height) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -1058,13 +1053,32 @@ rasterize_scene(struct lp_rasterizer_task *task,
 
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
+      struct lp_scene_bin_iter iter = { .band = task->domain };
       struct cmd_bin *bin;
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-         if (!is_empty_bin(bin))
+
+      const bool stats = (LP_DEBUG & DEBUG_COUNTERS) != 0;
+      int64_t t0 = stats ? os_time_get_nano() : 0;
+
+      if (lp_scene_wait_frag_shaders(scene) && stats) {
+         const int64_t t1 = os_time_get_nano();
+         task->fs_wait_time += t1 - t0;
+         task->nr_fs_waits++;
+         t0 = t1;
+      }
+
+      while ((bin = lp_scene_bin_iter_next(scene, &iter, &i, &j))) {
+         if (!is_empty_bin(bin)) {
             rasterize_bin(task, bin, i, j);
+            task->nr_bins++;
+         }
+      }
+
+      if (stats) {
+         task->busy_time += os_time_get_nano() - t0;
+         task->nr_bins_stolen += iter.stolen;
       }
    }
 
@@ -1090,6 +1104,73 @@ rasterize_scene(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Pool task body: iteration i rasterizes the current scene as
+ * rasterizer task i.
+ */
+static void
+rast_scene_work(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct lp_rasterizer *rast = data;
+
+   /* Make sure that denorms are treated like zeros. This is
+    * the behavior required by D3D10. OpenGL doesn't care.
+    * The pool threads also run compute shaders, so only do it here.
+    */
+   unsigned fpstate = util_fpstate_get();
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   rasterize_scene(&rast->tasks[iter_idx], rast->curr_scene);
+
+   util_fpstate_set(fpstate);
+}
+
+
+static void
+rast_start_next_scene(struct lp_rasterizer *rast, bool scene_done);
+
+
+static void
+rast_scene_done(void *data)
+{
+   struct lp_rasterizer *rast = data;
+
+   lp_rast_end(rast);
+   rast_start_next_scene(rast, true);
+}
+
+
+/**
+ * Start rasterizing the oldest queued scene on the thread pool, unless
+ * a scene is being rasterized already.
+ * \param scene_done  the scene being rasterized just completed
+ */
+static void
+rast_start_next_scene(struct lp_rasterizer *rast, bool scene_done)
+{
+   struct lp_scene *scene = NULL;
+
+   mtx_lock(&rast->scene_mutex);
+   if (scene_done)
+      rast->scene_busy = false;
+   if (!rast->scene_busy) {
+      scene = lp_scene_dequeue(rast->full_scenes, false);
+      if (scene)
+         rast->scene_busy = true;
+      else
+         cnd_broadcast(&rast->scene_idle);
+   }
+   mtx_unlock(&rast->scene_mutex);
+
+   if (!scene)
+      return;
+
+   lp_rast_begin(rast, scene);
+   lp_cs_tpool_queue_async(rast->tpool, rast_scene_work, rast_scene_done,
+                           rast, rast->num_threads);
+}
+
+
 /**
  * Called by setup module when it has something for us to render.
  */
@@ -1124,11 +1205,7 @@ lp_rast_queue_scene(struct lp_rasterizer *rast,
    } else {
       /* threaded rendering! */
       lp_scene_enqueue(rast->full_scenes, scene);
-
-      /* signal the threads that there's work to do */
-      for (unsigned i = 0; i < rast->num_threads; i++) {
-         util_semaphore_signal(&rast->tasks[i].work_ready);
-      }
+      rast_start_next_scene(rast, false);
    }
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __func__);
@@ -1141,116 +1218,23 @@ lp_rast_finish(struct lp_rasterizer *rast)
    if (rast->num_threads == 0) {
       /* nothing to do */
    } else {
-      /* wait for work to complete */
-      for (unsigned i = 0; i < rast->num_threads; i++) {
-         util_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
-/**
- * This is the thread's main entrypoint.
- * It's a simple loop:
- *   1. wait for work
- *   2. do work
- *   3. signal that we're done
- */
-static int
-thread_function(void *init_data)
-{
-   struct lp_rasterizer_task *task = (struct lp_rasterizer_task *) init_data;
-   struct lp_rasterizer *rast = task->rast;
-   bool debug = false;
-   char thread_name[16];
-
-   snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
-   u_thread_setname(thread_name);
-
-   /* Make sure that denorms are treated like zeros. This is
-    * the behavior required by D3D10. OpenGL doesn't care.
-    */
-   unsigned fpstate = util_fpstate_get();
-   util_fpstate_set_denorms_to_zero(fpstate);
-
-   while (1) {
-      /* wait for work */
-      if (debug)
-         debug_printf("thread %d waiting for work\n", task->thread_index);
-      util_semaphore_wait(&task->work_ready);
-
-      if (rast->exit_flag)
-         break;
-
-      if (task->thread_index == 0) {
-         /* thread[0]:
-          *  - get next scene to rasterize
-          *  - map the framebuffer surfaces
-          */
-         lp_rast_begin(rast, lp_scene_dequeue(rast->full_scenes, true));
-      }
-
-      /* Wait for all threads to get here so that threads[1+] don't
-       * get a null rast->curr_scene pointer.
-       */
-      util_barrier_wait(&rast->barrier);
-
-      /* do work */
-      if (debug)
-         debug_printf("thread %d doing work\n", task->thread_index);
-
-      rasterize_scene(task, rast->curr_scene);
-
-      /* wait for all threads to finish with this scene */
-      util_barrier_wait(&rast->barrier);
-
-      /* XXX: shouldn't be necessary:
-       */
-      if (task->thread_index == 0) {
-         lp_rast_end(rast);
-      }
-
-      /* signal done with work */
-      if (debug)
-         debug_printf("thread %d done working\n", task->thread_index);
-
-      util_semaphore_signal(&task->work_done);
-   }
-
-#ifdef _WIN32
-   util_semaphore_signal(&task->work_done);
-#endif
-
-   return 0;
-}
-
-
-/**
- * Initialize semaphores and spawn the threads.
- */
-static void
-create_rast_threads(struct lp_rasterizer *rast)
-{
-   /* NOTE: if num_threads is zero, we won't use any threads */
-   for (unsigned i = 0; i < rast->num_threads; i++) {
-      util_semaphore_init(&rast->tasks[i].work_ready, 0);
-      util_semaphore_init(&rast->tasks[i].work_done, 0);
-      if (thrd_success != u_thread_create(rast->threads + i, thread_function,
-                                            (void *) &rast->tasks[i])) {
-         rast->num_threads = i; /* previous thread is max */
-         break;
-      }
+      /* wait for the queued scenes to complete */
+      mtx_lock(&rast->scene_mutex);
+      while (rast->scene_busy)
+         cnd_wait(&rast->scene_idle, &rast->scene_mutex);
+      mtx_unlock(&rast->scene_mutex);
    }
 }
 
 
 /**
- * Create new lp_rasterizer.  If num_threads is zero, don't create any
- * new threads, do rendering synchronously.
- * \param num_threads  number of rasterizer threads to create
+ * Create new lp_rasterizer.  If num_threads is zero, don't use any
+ * threads, do rendering synchronously.
+ * \param num_threads  number of rasterizer tasks to split scenes into
+ * \param tpool  the screen's thread pool the scenes are rasterized on
  */
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads)
+lp_rast_create(unsigned num_threads, struct lp_cs_tpool *tpool)
 {
    struct lp_rasterizer *rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
@@ -1262,10 +1246,20 @@ lp_rast_create(unsigned num_threads)
       goto no_full_scenes;
    }
 
+   rast->tpool = tpool;
+   rast->num_domains = num_threads > 0 ? tpool->num_domains : 1;
+
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->bands = CALLOC(rast->num_domains, sizeof *rast->bands);
+   if (!rast->tasks || !rast->bands) {
+      goto no_tasks;
+   }
+
    for (unsigned i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->domain = i % rast->num_domains;
       task->thread_data.cache =
          align_malloc(sizeof(struct lp_build_format_cache), 16);
       if (!task->thread_data.cache) {
@@ -1277,23 +1271,22 @@ lp_rast_create(unsigned num_threads)
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
-   create_rast_threads(rast);
-
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_init(&rast->barrier, rast->num_threads);
-   }
+   (void) mtx_init(&rast->scene_mutex, mtx_plain);
+   cnd_init(&rast->scene_idle);
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
    return rast;
 
 no_thread_data_cache:
-   for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (unsigned i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
+no_tasks:
+   FREE(rast->bands);
+   FREE(rast->tasks);
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
@@ -1308,51 +1301,37 @@ no_rast:
 void
 lp_rast_destroy(struct lp_rasterizer *rast)
 {
-   /* Set exit_flag and signal each thread's work_ready semaphore.
-    * Each thread will be woken up, notice that the exit_flag is set and
-    * break out of its main loop.  The thread will then exit.
+   /* Wait for the pool to be done with our scenes before cleaning up
+    * per-thread data.  The pool itself is owned by the screen.
     */
-   rast->exit_flag = true;
-   for (unsigned i = 0; i < rast->num_threads; i++) {
-      util_semaphore_signal(&rast->tasks[i].work_ready);
-   }
-
-   /* Wait for threads to terminate before cleaning up per-thread data.
-    * We don't actually call pipe_thread_wait to avoid dead lock on Windows
-    * per https://bugs.freedesktop.org/show_bug.cgi?id=76252 */
-   for (unsigned i = 0; i < rast->num_threads; i++) {
-#ifdef _WIN32
-      /* Threads might already be dead - Windows apparently terminates
-       * other threads when returning from main.
-       */
-      DWORD exit_code = STILL_ACTIVE;
-      if (GetExitCodeThread(rast->threads[i].handle, &exit_code) &&
-          exit_code == STILL_ACTIVE) {
-         util_semaphore_wait(&rast->tasks[i].work_done);
+   lp_rast_finish(rast);
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
+         const struct lp_rasterizer_task *task = &rast->tasks[i];
+         debug_printf("llvmpipe: rast task %2u: busy %.3f sec, "
+                      "%u bins (%u stolen), %u scenes waited %.3f sec "
+                      "for fs compiles\n",
+                      i, task->busy_time / 1e9,
+                      task->nr_bins, task->nr_bins_stolen,
+                      task->nr_fs_waits, task->fs_wait_time / 1e9);
       }
-#else
-      thrd_join(rast->threads[i], NULL);
-#endif
    }
 
    /* Clean up per-thread data */
-   for (unsigned i = 0; i < rast->num_threads; i++) {
-      util_semaphore_destroy(&rast->tasks[i].work_ready);
-      util_semaphore_destroy(&rast->tasks[i].work_done);
-   }
    for (unsigned i = 0; i < MAX2(1, rast->num_threads); i++) {
       align_free(rast->tasks[i].thread_data.cache);
    }
 
    lp_fence_reference(&rast->last_fence, NULL);
 
-   /* for synchronizing rasterization threads */
-   if (rast->num_threads > 0) {
-      util_barrier_destroy(&rast->barrier);
-   }
+   cnd_destroy(&rast->scene_idle);
+   mtx_destroy(&rast->scene_mutex);
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->bands);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
@@ -46,6 +46,7 @@
 struct lp_rasterizer;
 struct lp_scene;
 struct lp_fence;
+struct lp_cs_tpool;
 struct cmd_bin;
 
 #define FIXED_TYPE_WIDTH 64
@@ -231,7 +232,7 @@ GET_PLANES(const struct lp_rast_triangle *tri)
 
 
 struct lp_rasterizer *
-lp_rast_create(unsigned num_threads);
+lp_rast_create(unsigned num_threads, struct lp_cs_tpool *tpool);
 
 void
 lp_rast_destroy(struct lp_rasterizer *);
@@ -32,6 +32,7 @@
 #include "util/u_thread.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
+#include "lp_cs_tpool.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
 #include "lp_state.h"
@@ -97,22 +98,28 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** CPU domain (L3 cache) of the pool thread this task is queued on */
+   unsigned domain;
+
+   /** Scheduling stats, only gathered with LP_DEBUG=counters */
+   int64_t busy_time;   /**< ns spent rasterizing bins */
+   unsigned nr_bins;
+   unsigned nr_bins_stolen;
+   int64_t fs_wait_time;   /**< ns spent waiting for LP_ASYNC_FS_COMPILE */
+   unsigned nr_fs_waits;   /**< scenes that had to wait for it */
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
-
-   util_semaphore work_ready;
-   util_semaphore work_done;
 };
 
 
 /**
  * This is the state required while rasterizing tiles.
  * Note that this contains per-thread information too.
- * The tile size is TILE_SIZE x TILE_SIZE pixels.
+ * The tile size is chosen per scene, see lp_scene::tile_size.
  */
 struct lp_rasterizer
 {
-   bool exit_flag;
    bool no_rast;  /**< For debugging/profiling */
 
    /** The incoming queue of scenes ready to rasterize */
@@ -121,14 +128,29 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /**
+    * A task object for each rasterization thread.  Scenes are rasterized
+    * on the screen's thread pool, with one pool iteration per task.
+    */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   struct lp_cs_tpool *tpool;
 
-   /** For synchronizing the rasterization threads */
-   util_barrier barrier;
+   /**
+    * Only one scene is rasterized at a time, the pool task of a scene
+    * starts the next queued one when it completes.
+    */
+   mtx_t scene_mutex;
+   cnd_t scene_idle;
+   bool scene_busy;
+
+   /**
+    * Number of CPU domains the threads are spread over, and the band of
+    * tiles of the current scene each domain rasterizes first.
+    */
+   unsigned num_domains;
+   struct lp_scene_band *bands;
 
    struct lp_fence *last_fence;
 };
@@ -148,7 +170,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 
 
 /**
- * Get the pointer to a 4x4 color block (within a 64x64 tile).
+ * Get the pointer to a 4x4 color block (within a tile).
  * \param x, y location of 4x4 block in window coords
  */
 static inline uint8_t *
@@ -156,8 +178,8 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
                                 unsigned buf, unsigned x, unsigned y,
                                 unsigned layer)
 {
-   assert(x < task->scene->tiles_x * TILE_SIZE);
-   assert(y < task->scene->tiles_y * TILE_SIZE);
+   assert(x < task->scene->tiles_x * task->scene->tile_size);
+   assert(y < task->scene->tiles_y * task->scene->tile_size);
    assert((x % TILE_VECTOR_WIDTH) == 0);
    assert((y % TILE_VECTOR_HEIGHT) == 0);
    assert(buf < task->scene->fb.nr_cbufs);
@@ -166,10 +188,10 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
    /*
     * We don't actually benefit from having per tile cbuf/zsbuf pointers,
     * it's just extra work - the mul/add would be exactly the same anyway.
-    * Fortunately the extra work (modulo) here is very cheap at least...
+    * Fortunately the extra work (a subtraction) here is very cheap...
     */
-   unsigned px = x % TILE_SIZE;
-   unsigned py = y % TILE_SIZE;
+   unsigned px = x - task->x;
+   unsigned py = y - task->y;
 
    unsigned pixel_offset = px * task->scene->cbufs[buf].format_bytes +
                            py * task->scene->cbufs[buf].stride;
@@ -186,21 +208,21 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
 
 
 /**
- * Get the pointer to a 4x4 depth block (within a 64x64 tile).
+ * Get the pointer to a 4x4 depth block (within a tile).
  * \param x, y location of 4x4 block in window coords
  */
 static inline uint8_t *
 lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
                                 unsigned x, unsigned y, unsigned layer)
 {
-   assert(x < task->scene->tiles_x * TILE_SIZE);
-   assert(y < task->scene->tiles_y * TILE_SIZE);
+   assert(x < task->scene->tiles_x * task->scene->tile_size);
+   assert(y < task->scene->tiles_y * task->scene->tile_size);
    assert((x % TILE_VECTOR_WIDTH) == 0);
    assert((y % TILE_VECTOR_HEIGHT) == 0);
    assert(task->depth_tile);
 
-   unsigned px = x % TILE_SIZE;
-   unsigned py = y % TILE_SIZE;
+   unsigned px = x - task->x;
+   unsigned py = y - task->y;
 
    unsigned pixel_offset = px * task->scene->zsbuf.format_bytes +
                            py * task->scene->zsbuf.stride;
@@ -263,7 +285,7 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if (x - task->x < task->width && y - task->y < task->height) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -189,34 +189,24 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
 
 /**
- * Scan the tile in chunks and figure out which pixels to rasterize
- * for this triangle.
+ * Scan a 64x64 block in 16x16 chunks and figure out which pixels to
+ * rasterize for this triangle.  Chunks already set in \p outmask are
+ * skipped.
  */
-void
-TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
-                      const union lp_rast_cmd_arg arg)
+static void
+TAG(do_block_64)(struct lp_rasterizer_task *task,
+                 const struct lp_rast_triangle *tri,
+                 const struct lp_rast_plane *plane,
+                 int x, int y,
+                 unsigned outmask)
 {
-   const struct lp_rast_triangle *tri = arg.triangle.tri;
-   unsigned plane_mask = arg.triangle.plane_mask;
-   const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
-   const int x = task->x, y = task->y;
-   struct lp_rast_plane plane[NR_PLANES];
    int64_t c[NR_PLANES];
-   unsigned outmask, inmask, partmask, partial_mask;
-   unsigned j = 0;
+   unsigned inmask, partmask, partial_mask;
+   unsigned j;
 
-   if (tri->inputs.disable) {
-      /* This triangle was partially binned and has been disabled */
-      return;
-   }
-
-   outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
-   while (plane_mask) {
-      int i = ffs(plane_mask) - 1;
-      plane[j] = tri_plane[i];
-      plane_mask &= ~(1 << i);
+   for (j = 0; j < NR_PLANES; j++) {
       c[j] = plane[j].c + IMUL64(plane[j].dcdy, y) - IMUL64(plane[j].dcdx, x);
 
       {
@@ -242,8 +232,8 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
          /*
           * Plausibility check to ensure the 32bit math works.
           * Note that within a tile, the max we can move the edge function
-          * is essentially dcdx * TILE_SIZE + dcdy * TILE_SIZE.
-          * TILE_SIZE is 64, dcdx/dcdy are nominally 21 bit (for 8192 max size
+          * is essentially dcdx * 64 + dcdy * 64 (larger tiles are walked
+          * in 64x64 blocks), dcdx/dcdy are nominally 21 bit (for 8192 max size
           * and 8 subpixel bits), I'd be happy with 2 bits more too (1 for
           * increasing fb size to 16384, the required d3d11 value, another one
           * because I'm not quite sure we can't be _just_ above the max value
@@ -285,16 +275,15 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
                      &outmask,   /* sign bits from c[i][0..15] + cox */
                      &partmask); /* sign bits from c[i][0..15] + cio */
       }
-
-      j++;
    }
 
    if (outmask == 0xffff)
       return;
 
-   /* Mask of sub-blocks which are inside all trivial accept planes:
+   /* Mask of sub-blocks which are inside all trivial accept planes
+    * (and not masked off by the caller):
     */
-   inmask = ~partmask & 0xffff;
+   inmask = ~(partmask | outmask) & 0xffff;
 
    /* Mask of sub-blocks which are inside all trivial reject planes,
     * but outside at least one trivial accept plane:
@@ -343,6 +332,58 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Scan the tile in chunks and figure out which pixels to rasterize
+ * for this triangle.
+ *
+ * The 16x16 chunk masks cover a 64x64 area, so smaller tiles mask off
+ * the chunks past the tile edge and larger tiles are walked 64x64 at a
+ * time.
+ */
+void
+TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
+                      const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   unsigned plane_mask = arg.triangle.plane_mask;
+   const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
+   const unsigned tile_size = task->scene->tile_size;
+   struct lp_rast_plane plane[NR_PLANES];
+   unsigned j = 0;
+
+   if (tri->inputs.disable) {
+      /* This triangle was partially binned and has been disabled */
+      return;
+   }
+
+   while (plane_mask) {
+      int i = ffs(plane_mask) - 1;
+      plane[j++] = tri_plane[i];
+      plane_mask &= ~(1 << i);
+   }
+
+   if (tile_size == TILE_SIZE) {
+      TAG(do_block_64)(task, tri, plane, task->x, task->y, 0);
+   } else if (tile_size < TILE_SIZE) {
+      const unsigned n = tile_size / 16;
+      const unsigned row = (1 << n) - 1;
+      unsigned inside = 0;
+
+      for (unsigned i = 0; i < n; i++)
+         inside |= row << (i * 4);
+
+      TAG(do_block_64)(task, tri, plane, task->x, task->y, ~inside & 0xffff);
+   } else {
+      for (unsigned qy = 0; qy < task->height; qy += TILE_SIZE) {
+         for (unsigned qx = 0; qx < task->width; qx += TILE_SIZE) {
+            TAG(do_block_64)(task, tri, plane,
+                             task->x + qx, task->y + qy, 0);
+         }
+      }
+   }
+}
+
+
 #if DETECT_ARCH_SSE && defined(TRI_16)
 /* XXX: special case this when intersection is not required.
  *      - tile completely within bbox,
@@ -360,13 +401,15 @@ TRI_16(struct lp_rasterizer_task *task,
    int y = (mask >> 8);
    unsigned outmask = 0;    /* outside one or more trivial reject planes */
 
-   if (x + 12 >= 64) {
-      int i = ((x + 12) - 64) / 4;
+   const int tile_size = task->scene->tile_size;
+
+   if (x + 12 >= tile_size) {
+      int i = ((x + 12) - tile_size) / 4;
       outmask |= right_mask_tab[i];
    }
 
-   if (y + 12 >= 64) {
-      int i = ((y + 12) - 64) / 4;
+   if (y + 12 >= tile_size) {
+      int i = ((y + 12) - tile_size) / 4;
       outmask |= bottom_mask_tab[i];
    }
 
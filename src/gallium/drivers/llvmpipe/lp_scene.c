@@ -35,6 +35,7 @@
 #include "lp_fence.h"
 #include "lp_debug.h"
 #include "lp_context.h"
+#include "lp_perf.h"
 #include "lp_state_fs.h"
 #include "lp_setup_context.h"
 
@@ -103,6 +104,7 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -547,75 +549,144 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+static int
+compare_bin_cost(const void *a, const void *b)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
-   }
-   return true;
+   const struct lp_scene_bin_ref *ra = a, *rb = b;
+
+   if (ra->cost != rb->cost)
+      return ra->cost > rb->cost ? -1 : 1;
+   if (ra->y != rb->y)
+      return ra->y < rb->y ? -1 : 1;
+   return ra->x < rb->x ? -1 : ra->x > rb->x;
 }
 
 
+/**
+ * Prepare to hand out the scene's bins.
+ *
+ * The tiles are split into \p num_bands horizontal bands, one per
+ * rasterizer CPU domain.  Within a band the non-empty bins are ordered
+ * by decreasing command count, so the expensive tiles get started first
+ * and whatever is left to steal at the end is cheap.  The bands storage
+ * is owned by the caller and must outlive the iteration.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene,
+                        struct lp_scene_band *bands,
+                        unsigned num_bands)
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned n = 0;
+
+   num_bands = MAX2(1, MIN2(num_bands, scene->tiles_y));
+
+   for (unsigned i = 0; i < num_bands; i++) {
+      const unsigned y0 = i * scene->tiles_y / num_bands;
+      const unsigned y1 = (i + 1) * scene->tiles_y / num_bands;
+
+      bands[i].next = n;
+
+      for (unsigned y = y0; y < y1; y++) {
+         for (unsigned x = 0; x < scene->tiles_x; x++) {
+            const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+            if (!bin->head)
+               continue;
+
+            unsigned cost = 0;
+            for (const struct cmd_block *block = bin->head; block;
+                 block = block->next)
+               cost += block->count;
+
+            scene->bin_order[n].x = x;
+            scene->bin_order[n].y = y;
+            scene->bin_order[n].cost = cost;
+            n++;
+         }
+      }
+
+      bands[i].end = n;
+
+      qsort(&scene->bin_order[bands[i].next], n - bands[i].next,
+            sizeof(struct lp_scene_bin_ref), compare_bin_cost);
+   }
+
+   scene->bands = bands;
+   scene->num_bands = num_bands;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
- * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ *
+ * Multiple rendering threads will call this function to get a chunk of
+ * work to do.  A thread takes bins one at a time from its own band;
+ * once that's drained it steals the cheaper half of the fullest other
+ * band in one go and works through it without taking the lock again.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene,
+                       struct lp_scene_bin_iter *iter,
+                       int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   if (iter->next == iter->end) {
+      mtx_lock(&scene->mutex);
 
-   mtx_lock(&scene->mutex);
+      struct lp_scene_band *own =
+         &scene->bands[iter->band % scene->num_bands];
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+      if (own->next < own->end) {
+         iter->next = own->next++;
+         iter->end = own->next;
+      } else {
+         struct lp_scene_band *victim = NULL;
+         unsigned most = 0;
+
+         for (unsigned i = 0; i < scene->num_bands; i++) {
+            const unsigned remaining =
+               scene->bands[i].end - scene->bands[i].next;
+            if (remaining > most) {
+               most = remaining;
+               victim = &scene->bands[i];
+            }
+         }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+         if (victim) {
+            const unsigned batch = DIV_ROUND_UP(most, 2);
+            victim->end -= batch;
+            iter->next = victim->end;
+            iter->end = victim->end + batch;
+            iter->stolen += batch;
+         }
+      }
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+      mtx_unlock(&scene->mutex);
+
+      if (iter->next == iter->end)
+         return NULL;
+   }
+
+   const struct lp_scene_bin_ref *ref = &scene->bin_order[iter->next++];
+   *x = ref->x;
+   *y = ref->y;
+   return lp_scene_get_bin(scene, ref->x, ref->y);
 }
 
 
 void
 lp_scene_begin_binning(struct lp_scene *scene,
-                       struct pipe_framebuffer_state *fb)
+                       struct pipe_framebuffer_state *fb,
+                       unsigned tile_order)
 {
    assert(lp_scene_is_empty(scene));
+   assert(tile_order >= MIN_TILE_ORDER && tile_order <= MAX_TILE_ORDER);
 
    util_copy_framebuffer_state(&scene->fb, fb);
 
-   scene->tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
-   scene->tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
-   assert(scene->tiles_x <= TILES_X);
-   assert(scene->tiles_y <= TILES_Y);
+   scene->tile_order = tile_order;
+   scene->tile_size = 1 << tile_order;
+   scene->tiles_x = align(fb->width, scene->tile_size) >> tile_order;
+   scene->tiles_y = align(fb->height, scene->tile_size) >> tile_order;
+   assert(scene->tiles_x * scene->tiles_y <= TILES_X * TILES_Y);
 
    unsigned num_required_tiles = scene->tiles_x * scene->tiles_y;
    if (scene->num_alloced_tiles < num_required_tiles) {
@@ -627,6 +698,14 @@ lp_scene_begin_binning(struct lp_scene *scene,
       scene->num_alloced_tiles = num_required_tiles;
    }
 
+   if (scene->num_alloced_bin_order < num_required_tiles) {
+      scene->bin_order = reallocarray(scene->bin_order, num_required_tiles,
+                                      sizeof(struct lp_scene_bin_ref));
+      if (!scene->bin_order)
+         return;
+      scene->num_alloced_bin_order = num_required_tiles;
+   }
+
    /*
     * Determine how many layers the fb has (used for clamping layer value).
     * OpenGL (but not d3d10) permits different amount of layers per rt,
@@ -662,6 +741,30 @@ lp_scene_begin_binning(struct lp_scene *scene,
 }
 
 
+/**
+ * Wait for any fragment shader variant referenced by the scene which is
+ * still being compiled in the background (LP_ASYNC_FS_COMPILE).
+ * Returns whether there was one.
+ */
+bool
+lp_scene_wait_frag_shaders(const struct lp_scene *scene)
+{
+   bool waited = false;
+
+   for (struct shader_ref *ref = scene->frag_shaders; ref; ref = ref->next) {
+      for (int i = 0; i < ref->count; i++) {
+         struct lp_fragment_shader_variant *variant = ref->variant[i];
+         if (!util_queue_fence_is_signalled(&variant->compile_fence)) {
+            util_queue_fence_wait(&variant->compile_fence);
+            waited = true;
+         }
+      }
+   }
+
+   return waited;
+}
+
+
 void
 lp_scene_end_binning(struct lp_scene *scene)
 {
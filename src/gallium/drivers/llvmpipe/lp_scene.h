@@ -101,6 +101,36 @@ struct cmd_bin {
 };
 
 
+/**
+ * A non-empty bin queued for rasterization, see lp_scene_bin_iter_begin().
+ */
+struct lp_scene_bin_ref {
+   uint16_t x, y;
+   unsigned cost;   /**< estimated, in commands */
+};
+
+
+/**
+ * A horizontal band of tiles handed out to the rasterizer threads of one
+ * CPU domain first.  Indices are into lp_scene::bin_order.
+ */
+struct lp_scene_band {
+   unsigned next;
+   unsigned end;
+};
+
+
+/**
+ * A rasterizer thread's view of the bin queue: its own band, plus the
+ * range of lp_scene::bin_order it's currently working through.
+ */
+struct lp_scene_bin_iter {
+   unsigned band;
+   unsigned next, end;
+   unsigned stolen;   /**< bins taken from other bands */
+};
+
+
 /**
  * This stores bulk data which is used for all memory allocations
  * within a scene.
@@ -189,13 +219,24 @@ struct lp_scene {
    bool alloc_failed;
    bool permit_linear_rasterizer;
 
+   /** When the rasterizer picked the scene up, see lp_rast_begin() */
+   int64_t raster_begin_time;
+
+   /** Tile size of this scene, 1 << tile_order pixels square */
+   unsigned tile_order;
+   unsigned tile_size;
+
    /**
     * Number of active tiles in each dimension.
     * This basically the framebuffer size divided by tile size
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
+   /** For iterating over bins, see lp_scene_bin_iter_begin() */
+   struct lp_scene_band *bands;
+   unsigned num_bands;
+   unsigned num_alloced_bin_order;
+   struct lp_scene_bin_ref *bin_order;
    mtx_t mutex;
 
    unsigned num_alloced_tiles;
@@ -229,6 +270,8 @@ unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
 bool lp_scene_add_frag_shader_reference(struct lp_scene *scene,
                                         struct lp_fragment_shader_variant *variant);
 
+bool lp_scene_wait_frag_shaders(const struct lp_scene *scene);
+
 
 
 /**
@@ -396,10 +439,14 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene,
+                        struct lp_scene_band *bands,
+                        unsigned num_bands);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene,
+                       struct lp_scene_bin_iter *iter,
+                       int *x, int *y);
 
 
 
@@ -407,7 +454,8 @@ lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
  */
 void
 lp_scene_begin_binning(struct lp_scene *scene,
-                       struct pipe_framebuffer_state *fb);
+                       struct pipe_framebuffer_state *fb,
+                       unsigned tile_order);
 
 void
 lp_scene_end_binning(struct lp_scene *scene);
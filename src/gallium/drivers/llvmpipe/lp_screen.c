@@ -26,6 +26,7 @@
  **************************************************************************/
 
 
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_cpu_detect.h"
@@ -50,6 +51,7 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_public.h"
+#include "lp_query.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
@@ -875,12 +877,13 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
 
-   if (screen->cs_tpool)
-      lp_cs_tpool_destroy(screen->cs_tpool);
-
+   /* the rasterizer runs on the thread pool */
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   if (screen->cs_tpool)
+      lp_cs_tpool_destroy(screen->cs_tpool);
+
    lp_jit_screen_cleanup(screen);
 
    disk_cache_destroy(screen->disk_shader_cache);
@@ -960,6 +963,9 @@ lp_disk_cache_create(struct llvmpipe_screen *screen)
       return;
 
    _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
+   /* LP_NATIVE_VECTOR_WIDTH changes the generated code too */
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
    update_cache_sha1_cpu(&ctx);
    _mesa_sha1_final(&ctx, sha1);
    mesa_bytes_to_hex(cache_id, sha1, 20);
@@ -1005,9 +1011,11 @@ lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
    uint8_t *buffer = disk_cache_get(screen->disk_shader_cache,
                                     sha1, &binary_size);
    if (!buffer) {
+      p_atomic_inc(&screen->disk_cache_misses);
       cache->data_size = 0;
       return;
    }
+   p_atomic_inc(&screen->disk_cache_hits);
    cache->data_size = binary_size;
    cache->data = buffer;
 }
@@ -1038,15 +1046,16 @@ llvmpipe_screen_late_init(struct llvmpipe_screen *screen)
    if (screen->late_init_done)
       goto out;
 
-   screen->rast = lp_rast_create(screen->num_threads);
-   if (!screen->rast) {
+   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
+   if (!screen->cs_tpool) {
       ret = false;
       goto out;
    }
 
-   screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
-   if (!screen->cs_tpool) {
-      lp_rast_destroy(screen->rast);
+   screen->rast = lp_rast_create(screen->num_threads, screen->cs_tpool);
+   if (!screen->rast) {
+      lp_cs_tpool_destroy(screen->cs_tpool);
+      screen->cs_tpool = NULL;
       ret = false;
       goto out;
    }
@@ -1116,13 +1125,13 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
 
    screen->base.get_disk_shader_cache = lp_get_disk_shader_cache;
    llvmpipe_init_screen_resource_funcs(&screen->base);
+   llvmpipe_init_screen_query_funcs(&screen->base);
 
    screen->allow_cl = !!getenv("LP_CL");
    screen->num_threads = util_get_cpu_caps()->nr_cpus > 1
       ? util_get_cpu_caps()->nr_cpus : 0;
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
                                               screen->num_threads);
-   screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
 
    snprintf(screen->renderer_string, sizeof(screen->renderer_string),
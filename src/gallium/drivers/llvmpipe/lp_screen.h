@@ -73,6 +73,8 @@ struct llvmpipe_screen
    char renderer_string[100];
 
    struct disk_cache *disk_shader_cache;
+   uint64_t disk_cache_hits;     /**< variants loaded from the disk cache */
+   uint64_t disk_cache_misses;   /**< variants that had to be compiled */
 };
 
 
@@ -49,6 +49,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -65,15 +66,117 @@ static bool
 try_update_scene_state(struct lp_setup_context *setup);
 
 
+/** Update the running average \p avg with \p sample */
+static inline void
+update_average(int64_t *avg, int64_t sample)
+{
+   *avg += (sample - *avg) / 8;
+}
+
+
+/**
+ * How many scenes we let be in flight.
+ *
+ * While the rasterizer works on one scene setup can bin the next ones,
+ * so we want about as many scenes as get binned in the time it takes
+ * to rasterize one, plus the one being binned.  That's only worth it
+ * while it fits in the LP_MAX_SCENE_MEMORY budget; past that setup
+ * waits for the rasterizer.
+ */
+static unsigned
+lp_setup_scene_limit(const struct lp_setup_context *setup)
+{
+   unsigned wanted = INITIAL_SCENES;
+
+   if (setup->avg_bin_time > 0) {
+      const int64_t overlap = DIV_ROUND_UP(setup->avg_raster_time,
+                                           setup->avg_bin_time) + 1;
+      wanted = MAX2(wanted, MIN2(overlap, MAX_SCENES));
+   }
+
+   return MIN2(wanted, setup->max_scenes);
+}
+
+
+/**
+ * Pick the tile size for the next scene.
+ *
+ * Small render targets don't have enough 64x64 tiles to keep all the
+ * rasterizer threads busy, so split them finer.  Very large targets
+ * spend a lot of binning time replicating big triangles into every
+ * tile they touch, so use fewer, larger tiles there as long as that
+ * still leaves several tiles per thread.  The linear rasterizer only
+ * knows about the default tile size.
+ */
+static unsigned
+lp_setup_choose_tile_order(const struct lp_setup_context *setup)
+{
+   const unsigned width = setup->fb.width;
+   const unsigned height = setup->fb.height;
+   const unsigned num_threads = MAX2(1, setup->num_threads);
+   unsigned order = TILE_ORDER;
+
+   if (setup->permit_linear_rasterizer)
+      return TILE_ORDER;
+
+   if (setup->tile_order) {
+      order = setup->tile_order;
+   } else if (num_threads > 1) {
+      const unsigned tiles = DIV_ROUND_UP(width, TILE_SIZE) *
+                             DIV_ROUND_UP(height, TILE_SIZE);
+      if (tiles < 2 * num_threads)
+         order = TILE_ORDER - 1;
+      else if (width * height >= 3840 * 2160 && tiles >= 16 * num_threads)
+         order = TILE_ORDER + 1;
+   }
+
+   /* Don't exceed the bin count the scene size limits were made for. */
+   while (order < MAX_TILE_ORDER &&
+          DIV_ROUND_UP(width, 1 << order) * DIV_ROUND_UP(height, 1 << order) >
+          TILES_X * TILES_Y)
+      order++;
+
+   return order;
+}
+
+
+/** Take a scene back from the rasterizer once its fence has signalled */
+static void
+lp_setup_retire_scene(struct lp_setup_context *setup,
+                      struct lp_scene *scene)
+{
+   assert(lp_fence_signalled(scene->fence));
+
+   update_average(&setup->avg_raster_time,
+                  scene->fence->signalled_time - scene->raster_begin_time);
+
+   lp_scene_end_rasterization(scene);
+}
+
+
 static unsigned
 lp_setup_wait_empty_scene(struct lp_setup_context *setup)
 {
-   /* just use the first scene if we run out */
-   if (setup->scenes[0]->fence) {
-      lp_fence_wait(setup->scenes[0]->fence);
-      lp_scene_end_rasterization(setup->scenes[0]);
+   /* Wait for the oldest scene, it's the first one the rasterizer
+    * will be done with.
+    */
+   unsigned oldest = 0;
+   for (unsigned i = 1; i < setup->num_active_scenes; i++) {
+      if ((int)(setup->scenes[i]->fence->id -
+                setup->scenes[oldest]->fence->id) < 0)
+         oldest = i;
+   }
+
+   struct lp_scene *scene = setup->scenes[oldest];
+   if (!lp_fence_signalled(scene->fence)) {
+      const int64_t start = os_time_get_nano();
+      lp_fence_wait(scene->fence);
+      setup->stall_time += os_time_get_nano() - start;
+      LP_COUNT(nr_scene_stalls);
    }
-   return 0;
+   lp_setup_retire_scene(setup, scene);
+
+   return oldest;
 }
 
 
@@ -87,7 +190,7 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
    for (i = 0; i < setup->num_active_scenes; i++) {
       if (setup->scenes[i]->fence) {
          if (lp_fence_signalled(setup->scenes[i]->fence)) {
-            lp_scene_end_rasterization(setup->scenes[i]);
+            lp_setup_retire_scene(setup, setup->scenes[i]);
             break;
          }
       } else {
@@ -95,11 +198,13 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       }
    }
 
-   if (setup->num_active_scenes + 1 > MAX_SCENES) {
-      i = lp_setup_wait_empty_scene(setup);
-   } else if (i == setup->num_active_scenes) {
-      /* allocate a new scene */
-      struct lp_scene *scene = lp_scene_create(setup);
+   if (i == setup->num_active_scenes) {
+      struct lp_scene *scene = NULL;
+
+      /* allocate a new scene if the rasterizer is far enough behind */
+      if (setup->num_active_scenes < lp_setup_scene_limit(setup))
+         scene = lp_scene_create(setup);
+
       if (!scene) {
          /* block and reuse scenes */
          i = lp_setup_wait_empty_scene(setup);
@@ -111,9 +216,11 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       }
    }
 
+   setup->bin_begin_time = os_time_get_nano();
    setup->scene = setup->scenes[i];
    setup->scene->permit_linear_rasterizer = setup->permit_linear_rasterizer;
-   lp_scene_begin_binning(setup->scene, &setup->fb);
+   lp_scene_begin_binning(setup->scene, &setup->fb,
+                          lp_setup_choose_tile_order(setup));
 }
 
 
@@ -209,6 +316,9 @@ lp_setup_rasterize_scene(struct lp_setup_context *setup)
 
    lp_scene_end_binning(scene);
 
+   update_average(&setup->avg_bin_time,
+                  os_time_get_nano() - setup->bin_begin_time);
+
    mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
    mtx_unlock(&screen->rast_mutex);
@@ -1239,6 +1349,12 @@ lp_setup_update_state(struct lp_setup_context *setup,
                     setup->setup.variant->key.size) == 0);
    }
 
+   /* The fragment shader may still be compiling in the background; we
+    * bin anyway and the rasterizer waits for it.
+    */
+   if (update_scene && lp_fs_variant_is_compiling(setup->fs.current.variant))
+      LP_COUNT(nr_fs_deferred_draws);
+
    if (update_scene && setup->state != SETUP_ACTIVE) {
       if (!set_scene_state(setup, SETUP_ACTIVE, __func__))
          return false;
@@ -1316,6 +1432,8 @@ lp_setup_destroy(struct lp_setup_context *setup)
    LP_DBG(DEBUG_SETUP, "number of scenes used: %d\n", setup->num_active_scenes);
    slab_destroy(&setup->scene_slab);
 
+   align_free(setup->tri_batch);
+
    FREE(setup);
 }
 
@@ -1335,6 +1453,9 @@ lp_setup_create(struct pipe_context *pipe,
       goto no_setup;
    }
 
+   setup->parallel_tri_setup = screen->num_threads > 1 &&
+      debug_get_bool_option("LP_PARALLEL_SETUP", true);
+
    lp_setup_init_vbuf(setup);
 
    setup->psize_slot = -1;
@@ -1347,6 +1468,16 @@ lp_setup_create(struct pipe_context *pipe,
    setup->pipe = pipe;
 
    setup->num_threads = screen->num_threads;
+
+   const uint64_t scene_memory =
+      debug_get_num_option("LP_MAX_SCENE_MEMORY", DEFAULT_SCENE_MEMORY);
+   setup->max_scenes = CLAMP(scene_memory * 1024 * 1024 / LP_SCENE_MAX_SIZE,
+                             2, MAX_SCENES);
+
+   const unsigned tile_size = debug_get_num_option("LP_TILE_SIZE", 0);
+   if (util_is_power_of_two_nonzero(tile_size) &&
+       tile_size >= (1 << MIN_TILE_ORDER) && tile_size <= MAX_TILE_SIZE)
+      setup->tile_order = util_logbase2(tile_size);
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1515,6 +1646,22 @@ fail:
 }
 
 
+/** Total time, in nanoseconds, setup waited for a free scene */
+uint64_t
+lp_setup_get_stall_time(const struct lp_setup_context *setup)
+{
+   return setup->stall_time;
+}
+
+
+/** Number of scenes allocated so far, see lp_setup_scene_limit() */
+unsigned
+lp_setup_get_num_scenes(const struct lp_setup_context *setup)
+{
+   return setup->num_active_scenes;
+}
+
+
 bool
 lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
@@ -154,6 +154,12 @@ void
 lp_setup_end_query(struct lp_setup_context *setup,
                    struct llvmpipe_query *pq);
 
+uint64_t
+lp_setup_get_stall_time(const struct lp_setup_context *setup);
+
+unsigned
+lp_setup_get_num_scenes(const struct lp_setup_context *setup);
+
 static inline unsigned
 lp_clamp_viewport_idx(int idx)
 {
@@ -59,6 +59,9 @@ struct lp_setup_variant;
 #define INITIAL_SCENES 4
 #define MAX_SCENES 64
 
+/** Default LP_MAX_SCENE_MEMORY, in MB */
+#define DEFAULT_SCENE_MEMORY 1024
+
 
 
 /**
@@ -96,6 +99,15 @@ struct lp_setup_context
    struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
+   /* Adaptive number of scenes, see lp_setup_scene_limit() */
+   unsigned max_scenes;          /**< LP_MAX_SCENE_MEMORY budget, in scenes */
+   int64_t bin_begin_time;       /**< when the current scene was started */
+   int64_t avg_bin_time;         /**< ns between scenes, running average */
+   int64_t avg_raster_time;      /**< ns to rasterize a scene, running average */
+   uint64_t stall_time;          /**< ns spent waiting for a free scene */
+
+   unsigned tile_order;          /**< LP_TILE_SIZE override, or 0 */
+
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
@@ -110,6 +122,7 @@ struct lp_setup_context
    unsigned multisample:1;
    unsigned rectangular_lines:1;
    unsigned cullmode:2; /**< PIPE_FACE_x */
+   unsigned parallel_tri_setup:1; /**< LP_PARALLEL_SETUP */
    unsigned bottom_edge_rule;
    float pixel_offset;
    float line_width;
@@ -174,6 +187,10 @@ struct lp_setup_context
 
    unsigned dirty;   /**< bitmask of LP_SETUP_NEW_x bits */
 
+   /** Scratch space for lp_setup_triangles() */
+   void *tri_batch;
+   size_t tri_batch_size;
+
    void (*point)(struct lp_setup_context *,
                  const float (*v0)[4]);
 
@@ -220,6 +237,13 @@ lp_setup_add_scissor_planes(const struct u_rect *scissor,
 void
 lp_setup_choose_triangle(struct lp_setup_context *setup);
 
+bool
+lp_setup_triangles(struct lp_setup_context *setup,
+                   const void *vertex_buffer,
+                   unsigned stride,
+                   const uint16_t *indices,
+                   unsigned nr_tris);
+
 void
 lp_setup_choose_line(struct lp_setup_context *setup);
 
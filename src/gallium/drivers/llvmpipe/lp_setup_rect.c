@@ -200,10 +200,11 @@ partial(struct lp_setup_context *setup,
         unsigned mask) // RECT_PLANE_x bits
 {
    if (mask == 0) {
-      assert(rect->box.x0 <= ix * TILE_SIZE);
-      assert(rect->box.y0 <= iy * TILE_SIZE);
-      assert(rect->box.x1 >= (ix+1) * TILE_SIZE - 1);
-      assert(rect->box.y1 >= (iy+1) * TILE_SIZE - 1);
+      ASSERTED const unsigned tile_size = setup->scene->tile_size;
+      assert(rect->box.x0 <= ix * tile_size);
+      assert(rect->box.y0 <= iy * tile_size);
+      assert(rect->box.x1 >= (ix+1) * tile_size - 1);
+      assert(rect->box.y1 >= (iy+1) * tile_size - 1);
 
       lp_setup_whole_tile(setup, &rect->inputs, ix, iy, opaque);
    } else {
@@ -367,10 +368,11 @@ lp_setup_bin_rectangle(struct lp_setup_context *setup,
 
    /* Convert to inclusive tile coordinates:
     */
-   const unsigned ix0 = rect->box.x0 / TILE_SIZE;
-   const unsigned iy0 = rect->box.y0 / TILE_SIZE;
-   const unsigned ix1 = rect->box.x1 / TILE_SIZE;
-   const unsigned iy1 = rect->box.y1 / TILE_SIZE;
+   const unsigned tile_size = scene->tile_size;
+   const unsigned ix0 = rect->box.x0 >> scene->tile_order;
+   const unsigned iy0 = rect->box.y0 >> scene->tile_order;
+   const unsigned ix1 = rect->box.x1 >> scene->tile_order;
+   const unsigned iy1 = rect->box.y1 >> scene->tile_order;
 
    /*
     * Clamp to framebuffer size
@@ -380,16 +382,16 @@ lp_setup_bin_rectangle(struct lp_setup_context *setup,
    assert(ix1 == MIN2(ix1, scene->tiles_x - 1));
    assert(iy1 == MIN2(iy1, scene->tiles_y - 1));
 
-   if (ix0 * TILE_SIZE != rect->box.x0)
+   if (ix0 * tile_size != rect->box.x0)
       left_mask = RECT_PLANE_LEFT;
 
-   if (ix1 * TILE_SIZE + TILE_SIZE - 1 != rect->box.x1)
+   if (ix1 * tile_size + tile_size - 1 != rect->box.x1)
       right_mask  = RECT_PLANE_RIGHT;
 
-   if (iy0 * TILE_SIZE != rect->box.y0)
+   if (iy0 * tile_size != rect->box.y0)
       top_mask    = RECT_PLANE_TOP;
 
-   if (iy1 * TILE_SIZE + TILE_SIZE - 1 != rect->box.y1)
+   if (iy1 * tile_size + tile_size - 1 != rect->box.y1)
       bottom_mask = RECT_PLANE_BOTTOM;
 
    /* Determine which tile(s) intersect the rectangle's bounding box
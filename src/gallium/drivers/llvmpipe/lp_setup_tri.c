@@ -54,6 +54,8 @@ altivec.h inclusion in -std=c++98..11 causes bool to be redefined
 #include "lp_state_fs.h"
 #include "lp_state_setup.h"
 #include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_screen.h"
 
 #include <inttypes.h>
 
@@ -89,10 +91,8 @@ struct fixed_position {
  * \param num_inputs  number of fragment shader inputs
  * \return pointer to triangle space
  */
-struct lp_rast_triangle *
-lp_setup_alloc_triangle(struct lp_scene *scene,
-                        unsigned nr_inputs,
-                        unsigned nr_planes)
+static inline unsigned
+triangle_size(unsigned nr_inputs, unsigned nr_planes)
 {
    // add 1 for XYZW position
    unsigned input_array_sz = (nr_inputs + 1) * sizeof(float[4]);
@@ -100,15 +100,24 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
 
    STATIC_ASSERT(sizeof(struct lp_rast_plane) % 8 == 0);
 
-   const unsigned tri_size  = sizeof(struct lp_rast_triangle)
+   return sizeof(struct lp_rast_triangle)
       + 3 * input_array_sz +   // 3 = da + dadx + dady
       + plane_sz;
+}
+
+
+struct lp_rast_triangle *
+lp_setup_alloc_triangle(struct lp_scene *scene,
+                        unsigned nr_inputs,
+                        unsigned nr_planes)
+{
+   const unsigned tri_size = triangle_size(nr_inputs, nr_planes);
 
    struct lp_rast_triangle *tri = lp_scene_alloc_aligned(scene, tri_size, 16);
    if (!tri)
       return NULL;
 
-   tri->inputs.stride = input_array_sz;
+   tri->inputs.stride = (nr_inputs + 1) * sizeof(float[4]);
 
    {
       ASSERTED char *a = (char *)tri;
@@ -266,21 +275,74 @@ check_opaque(const struct lp_setup_context *setup,
 }
 
 
+/** What do_triangle_ccw() needs to bin a triangle which has been set up */
+struct tri_bin_info {
+   struct u_rect bbox;
+   int nr_planes;
+   unsigned viewport_index;
+   bool use_32bits;
+   bool opaque;
+};
+
+
+/** Chunk of triangles set up by one thread, see lp_setup_triangles() */
+struct tri_chunk {
+   uint8_t *mem;
+   size_t used;
+   unsigned count;
+   unsigned culled;   /**< LP_COUNT(nr_culled_tris) of this chunk */
+};
+
+
+/** Header of each triangle stored in a tri_chunk */
+struct tri_record {
+   struct tri_bin_info info;
+   unsigned size;   /**< of the lp_rast_triangle following the header */
+};
+
+#define TRI_RECORD_SIZE align(sizeof(struct tri_record), 16)
+
+
+static struct lp_rast_triangle *
+tri_chunk_alloc(struct tri_chunk *chunk, unsigned nr_inputs,
+                unsigned nr_planes)
+{
+   const unsigned tri_size = triangle_size(nr_inputs, nr_planes);
+   struct tri_record *record = (struct tri_record *)(chunk->mem + chunk->used);
+   struct lp_rast_triangle *tri =
+      (struct lp_rast_triangle *)((uint8_t *)record + TRI_RECORD_SIZE);
+
+   record->size = tri_size;
+   tri->inputs.stride = (nr_inputs + 1) * sizeof(float[4]);
+
+   return tri;
+}
+
+
 /**
  * Do basic setup for triangle rasterization and determine which
- * framebuffer tiles are touched.  Put the triangle in the scene's
- * bins for the tiles which we overlap.
+ * framebuffer tiles are touched.
+ *
+ * The triangle is allocated from the current scene, or from \p chunk
+ * when set up on a worker thread.  Returns false if out of memory;
+ * *tri_out is NULL if the triangle got culled.  The LP_COUNT counters
+ * aren't atomic, so they're only updated here for serial setup.
  */
-static bool
-do_triangle_ccw(struct lp_setup_context *setup,
-                struct fixed_position *position,
-                const float (*v0)[4],
-                const float (*v1)[4],
-                const float (*v2)[4],
-                bool frontfacing)
+static inline bool
+setup_triangle_ccw(struct lp_setup_context *setup,
+                   struct fixed_position *position,
+                   const float (*v0)[4],
+                   const float (*v1)[4],
+                   const float (*v2)[4],
+                   bool frontfacing,
+                   struct tri_chunk *chunk,
+                   struct tri_bin_info *info,
+                   struct lp_rast_triangle **tri_out)
 {
    struct lp_scene *scene = setup->scene;
 
+   *tri_out = NULL;
+
    const float (*pv)[4];
    if (setup->flatshade_first) {
       pv = v0;
@@ -325,7 +387,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
 
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("no intersection\n");
-      LP_COUNT(nr_culled_tris);
+      if (!chunk)
+         LP_COUNT(nr_culled_tris);
       return true;
    }
 
@@ -356,7 +419,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
    nr_planes += s_planes[0] + s_planes[1] + s_planes[2] + s_planes[3];
 
    const struct lp_setup_variant_key *key = &setup->setup.variant->key;
-   struct lp_rast_triangle *tri =
+   struct lp_rast_triangle *tri = chunk ?
+      tri_chunk_alloc(chunk, key->num_inputs, nr_planes) :
       lp_setup_alloc_triangle(scene, key->num_inputs, nr_planes);
    if (!tri)
       return false;
@@ -370,7 +434,8 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->v[2][1] = v2[0][1];
 #endif
 
-   LP_COUNT(nr_tris);
+   if (!chunk)
+      LP_COUNT(nr_tris);
 
    /*
     * Rotate the tri such that v0 is closest to the fb origin.
@@ -744,9 +809,41 @@ do_triangle_ccw(struct lp_setup_context *setup,
                                   s_planes, setup->multisample);
    }
 
-   return lp_setup_bin_triangle(setup, tri, use_32bits,
-                                check_opaque(setup, v0, v1, v2),
-                                &bbox, nr_planes, viewport_index);
+   info->bbox = bbox;
+   info->nr_planes = nr_planes;
+   info->viewport_index = viewport_index;
+   info->use_32bits = use_32bits;
+   info->opaque = check_opaque(setup, v0, v1, v2);
+   *tri_out = tri;
+   return true;
+}
+
+
+/**
+ * Set up a triangle and put it in the scene's bins for the tiles which
+ * we overlap.
+ */
+static bool
+do_triangle_ccw(struct lp_setup_context *setup,
+                struct fixed_position *position,
+                const float (*v0)[4],
+                const float (*v1)[4],
+                const float (*v2)[4],
+                bool frontfacing)
+{
+   struct tri_bin_info info;
+   struct lp_rast_triangle *tri;
+
+   if (!setup_triangle_ccw(setup, position, v0, v1, v2, frontfacing,
+                           NULL, &info, &tri))
+      return false;
+
+   if (!tri)
+      return true;
+
+   return lp_setup_bin_triangle(setup, tri, info.use_32bits, info.opaque,
+                                &info.bbox, info.nr_planes,
+                                info.viewport_index);
 }
 
 /*
@@ -819,21 +916,24 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
 
    /* Determine which tile(s) intersect the triangle's bounding box
     */
-   if (dx < TILE_SIZE) {
-      const int ix0 = bbox->x0 / TILE_SIZE;
-      const int iy0 = bbox->y0 / TILE_SIZE;
-      unsigned px = bbox->x0 & 63 & ~3;
-      unsigned py = bbox->y0 & 63 & ~3;
+   const unsigned tile_order = scene->tile_order;
+   const int tile_size = scene->tile_size;
+
+   if (dx < tile_size) {
+      const int ix0 = bbox->x0 >> tile_order;
+      const int iy0 = bbox->y0 >> tile_order;
+      unsigned px = bbox->x0 & (tile_size - 1) & ~3;
+      unsigned py = bbox->y0 & (tile_size - 1) & ~3;
 
-      assert(iy0 == bbox->y1 / TILE_SIZE &&
-             ix0 == bbox->x1 / TILE_SIZE);
+      assert(iy0 == bbox->y1 >> tile_order &&
+             ix0 == bbox->x1 >> tile_order);
 
       if (nr_planes == 3) {
          if (sz < 4) {
             /* Triangle is contained in a single 4x4 stamp:
              */
-            assert(px + 4 <= TILE_SIZE);
-            assert(py + 4 <= TILE_SIZE);
+            assert(px + 4 <= tile_size);
+            assert(py + 4 <= tile_size);
             if (setup->multisample)
                cmd = LP_RAST_OP_MS_TRIANGLE_3_4;
             else
@@ -852,11 +952,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
              * dimensions if the triangle is 16 pixels in one dimension but 4
              * in the other. So budge the 16x16 back inside the tile.
              */
-            px = MIN2(px, TILE_SIZE - 16);
-            py = MIN2(py, TILE_SIZE - 16);
+            px = MIN2(px, tile_size - 16);
+            py = MIN2(py, tile_size - 16);
 
-            assert(px + 16 <= TILE_SIZE);
-            assert(py + 16 <= TILE_SIZE);
+            assert(px + 16 <= tile_size);
+            assert(py + 16 <= tile_size);
 
             if (setup->multisample)
                cmd = LP_RAST_OP_MS_TRIANGLE_3_16;
@@ -867,11 +967,11 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                                                lp_rast_arg_triangle_contained(tri, px, py));
          }
       } else if (nr_planes == 4 && sz < 16) {
-         px = MIN2(px, TILE_SIZE - 16);
-         py = MIN2(py, TILE_SIZE - 16);
+         px = MIN2(px, tile_size - 16);
+         py = MIN2(py, tile_size - 16);
 
-         assert(px + 16 <= TILE_SIZE);
-         assert(py + 16 <= TILE_SIZE);
+         assert(px + 16 <= tile_size);
+         assert(py + 16 <= tile_size);
 
          if (setup->multisample)
             cmd = LP_RAST_OP_MS_TRIANGLE_4_16;
@@ -901,23 +1001,23 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       int64_t xstep[MAX_PLANES];
       int64_t ystep[MAX_PLANES];
 
-      const int ix0 = trimmed_box.x0 / TILE_SIZE;
-      const int iy0 = trimmed_box.y0 / TILE_SIZE;
-      const int ix1 = trimmed_box.x1 / TILE_SIZE;
-      const int iy1 = trimmed_box.y1 / TILE_SIZE;
+      const int ix0 = trimmed_box.x0 >> tile_order;
+      const int iy0 = trimmed_box.y0 >> tile_order;
+      const int ix1 = trimmed_box.x1 >> tile_order;
+      const int iy1 = trimmed_box.y1 >> tile_order;
 
       for (int i = 0; i < nr_planes; i++) {
          c[i] = (plane[i].c +
-                 IMUL64(plane[i].dcdy, iy0) * TILE_SIZE -
-                 IMUL64(plane[i].dcdx, ix0) * TILE_SIZE);
+                 IMUL64(plane[i].dcdy, iy0) * tile_size -
+                 IMUL64(plane[i].dcdx, ix0) * tile_size);
 
          ei[i] = (plane[i].dcdy -
                   plane[i].dcdx -
-                  (int64_t)plane[i].eo) << TILE_ORDER;
+                  (int64_t)plane[i].eo) << tile_order;
 
-         eo[i] = (int64_t)plane[i].eo << TILE_ORDER;
-         xstep[i] = -(((int64_t)plane[i].dcdx) << TILE_ORDER);
-         ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
+         eo[i] = (int64_t)plane[i].eo << tile_order;
+         xstep[i] = -(((int64_t)plane[i].dcdx) << tile_order);
+         ystep[i] = ((int64_t)plane[i].dcdy) << tile_order;
       }
 
       tri->inputs.is_blit = lp_setup_is_blit(setup, &tri->inputs);
@@ -1252,6 +1352,217 @@ triangle_noop(struct lp_setup_context *setup,
 }
 
 
+/*
+ * Parallel triangle setup.
+ *
+ * For big triangle lists the per-triangle work (culling, fixed point
+ * positions, interpolants and edge planes) is spread over the screen's
+ * thread pool.  Each worker sets up a contiguous range of the triangles
+ * into its own chunk of setup->tri_batch, then the context thread copies
+ * them into the scene and bins them in submission order, so every bin
+ * ends up with exactly the commands serial setup would have produced.
+ */
+
+/* Below this the pool round trip costs more than it saves */
+#define LP_SETUP_PARALLEL_MIN_TRIS 256
+
+struct tri_batch {
+   struct lp_setup_context *setup;
+   const uint8_t *vertex_buffer;
+   unsigned stride;
+   const uint16_t *indices;   /**< NULL for non-indexed draws */
+   unsigned nr_tris;
+   unsigned tris_per_chunk;
+   bool keep_ccw, keep_cw;
+   struct tri_chunk *chunks;
+};
+
+
+static inline const float (*
+batch_vert(const struct tri_batch *batch, unsigned i))[4]
+{
+   const unsigned idx = batch->indices ? batch->indices[i] : i;
+   return (const float (*)[4])(batch->vertex_buffer + idx * batch->stride);
+}
+
+
+static void
+setup_tri_chunk(void *data, int chunk_idx, struct lp_cs_local_mem *lmem)
+{
+   struct tri_batch *batch = data;
+   struct lp_setup_context *setup = batch->setup;
+   struct tri_chunk *chunk = &batch->chunks[chunk_idx];
+   const unsigned first = chunk_idx * batch->tris_per_chunk;
+   const unsigned last = MIN2(first + batch->tris_per_chunk, batch->nr_tris);
+
+   for (unsigned t = first; t < last; t++) {
+      alignas(16) struct fixed_position position;
+      const float (*v0)[4] = batch_vert(batch, 3 * t + 0);
+      const float (*v1)[4] = batch_vert(batch, 3 * t + 1);
+      const float (*v2)[4] = batch_vert(batch, 3 * t + 2);
+      bool front;
+
+      /* Same as triangle_cw/ccw/both() */
+      int8_t area_sign = calc_fixed_position(setup, &position, v0, v1, v2);
+
+      if (area_sign > 0 && batch->keep_ccw) {
+         front = setup->ccw_is_frontface;
+      } else if (area_sign < 0 && batch->keep_cw) {
+         front = !setup->ccw_is_frontface;
+         if (setup->flatshade_first) {
+            const float (*vt)[4] = v1;
+            rotate_fixed_position_12(&position);
+            v1 = v2;
+            v2 = vt;
+         } else {
+            const float (*vt)[4] = v0;
+            rotate_fixed_position_01(&position);
+            v0 = v1;
+            v1 = vt;
+         }
+      } else {
+         continue;
+      }
+
+      struct tri_bin_info info;
+      struct lp_rast_triangle *tri;
+      setup_triangle_ccw(setup, &position, v0, v1, v2, front,
+                         chunk, &info, &tri);
+      if (tri) {
+         struct tri_record *record =
+            (struct tri_record *)(chunk->mem + chunk->used);
+         record->info = info;
+         chunk->used += TRI_RECORD_SIZE + align(record->size, 16);
+         chunk->count++;
+      } else {
+         chunk->culled++;
+      }
+   }
+}
+
+
+/**
+ * Copy a triangle set up by setup_tri_chunk() into the scene and bin it,
+ * restarting the scene if it's full.
+ */
+static void
+bin_tri_record(struct lp_setup_context *setup,
+               const struct tri_record *record)
+{
+   const struct lp_rast_triangle *src =
+      (const struct lp_rast_triangle *)((const uint8_t *)record +
+                                        TRI_RECORD_SIZE);
+
+   for (unsigned attempt = 0; attempt < 2; attempt++) {
+      struct lp_rast_triangle *tri =
+         lp_scene_alloc_aligned(setup->scene, record->size, 16);
+      if (tri) {
+         memcpy(tri, src, record->size);
+         if (lp_setup_bin_triangle(setup, tri, record->info.use_32bits,
+                                   record->info.opaque, &record->info.bbox,
+                                   record->info.nr_planes,
+                                   record->info.viewport_index))
+            return;
+      }
+
+      if (attempt == 0 && !lp_setup_flush_and_restart(setup))
+         return;
+   }
+}
+
+
+/**
+ * Set up and bin a list of \p nr_tris triangles using the thread pool.
+ * \param indices  vertex indices, or NULL for consecutive vertices
+ * \return false if the list should be drawn with setup->triangle instead
+ */
+bool
+lp_setup_triangles(struct lp_setup_context *setup,
+                   const void *vertex_buffer,
+                   unsigned stride,
+                   const uint16_t *indices,
+                   unsigned nr_tris)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+
+   if (!setup->parallel_tri_setup ||
+       nr_tris < LP_SETUP_PARALLEL_MIN_TRIS ||
+       setup->rasterizer_discard ||
+       setup->cullmode == PIPE_FACE_FRONT_AND_BACK ||
+       lp_setup_zero_sample_mask(setup))
+      return false;
+
+   struct tri_batch batch = {
+      .setup = setup,
+      .vertex_buffer = vertex_buffer,
+      .stride = stride,
+      .indices = indices,
+      .nr_tris = nr_tris,
+      .keep_ccw = setup->cullmode == PIPE_FACE_NONE ||
+                  (setup->cullmode == PIPE_FACE_BACK) == setup->ccw_is_frontface,
+      .keep_cw = setup->cullmode == PIPE_FACE_NONE ||
+                 (setup->cullmode == PIPE_FACE_FRONT) == setup->ccw_is_frontface,
+   };
+
+   const unsigned nr_chunks = MIN2(screen->num_threads,
+                                   DIV_ROUND_UP(nr_tris,
+                                                LP_SETUP_PARALLEL_MIN_TRIS / 4));
+   batch.tris_per_chunk = DIV_ROUND_UP(nr_tris, nr_chunks);
+
+   /* Worst case every triangle survives and needs all scissor planes. */
+   const unsigned num_inputs = setup->setup.variant->key.num_inputs;
+   const size_t chunk_size = (size_t)batch.tris_per_chunk *
+      (TRI_RECORD_SIZE + align(triangle_size(num_inputs, 7), 16));
+   const size_t chunks_offset = align(nr_chunks * sizeof(struct tri_chunk), 16);
+   const size_t batch_size = chunks_offset + nr_chunks * chunk_size;
+
+   if (setup->tri_batch_size < batch_size) {
+      align_free(setup->tri_batch);
+      setup->tri_batch = align_malloc(batch_size, 16);
+      setup->tri_batch_size = setup->tri_batch ? batch_size : 0;
+      if (!setup->tri_batch)
+         return false;
+   }
+
+   batch.chunks = setup->tri_batch;
+   for (unsigned i = 0; i < nr_chunks; i++) {
+      batch.chunks[i].mem = (uint8_t *)setup->tri_batch + chunks_offset +
+                            i * chunk_size;
+      batch.chunks[i].used = 0;
+      batch.chunks[i].count = 0;
+      batch.chunks[i].culled = 0;
+   }
+
+   struct lp_cs_tpool_task *task;
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, setup_tri_chunk,
+                                 &batch, nr_chunks);
+   mtx_unlock(&screen->cs_mutex);
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+   struct llvmpipe_context *lp_context = llvmpipe_context(setup->pipe);
+   if (lp_context->active_statistics_queries) {
+      lp_context->pipeline_statistics.c_primitives += nr_tris;
+   }
+
+   for (unsigned i = 0; i < nr_chunks; i++) {
+      LP_COUNT_ADD(nr_tris, batch.chunks[i].count);
+      LP_COUNT_ADD(nr_culled_tris, batch.chunks[i].culled);
+   }
+
+   for (unsigned i = 0; i < nr_chunks; i++) {
+      const uint8_t *p = batch.chunks[i].mem;
+      for (unsigned j = 0; j < batch.chunks[i].count; j++) {
+         const struct tri_record *record = (const struct tri_record *)p;
+         bin_tri_record(setup, record);
+         p += TRI_RECORD_SIZE + align(record->size, 16);
+      }
+   }
+
+   return true;
+}
+
+
 void
 lp_setup_choose_triangle(struct lp_setup_context *setup)
 {
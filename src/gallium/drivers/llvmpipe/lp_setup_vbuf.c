@@ -53,6 +53,13 @@
 
 #define LP_MAX_VBUF_SIZE    4096
 
+/* Larger batches when triangle lists are set up on the thread pool, so
+ * lp_setup_triangles() gets enough triangles per call to be worth it.
+ */
+#define LP_MAX_VBUF_INDEXES_PARALLEL (LP_MAX_VBUF_INDEXES * 16)
+
+#define LP_MAX_VBUF_SIZE_PARALLEL    (LP_MAX_VBUF_SIZE * 64)
+
 
 
 /** cast wrapper */
@@ -233,6 +240,9 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
                  get_vert(vertex_buffer, indices[i-1], stride),
                  get_vert(vertex_buffer, indices[i-0], stride));
          }
+      } else if (lp_setup_triangles(setup, vertex_buffer, stride,
+                                    indices, nr / 3)) {
+         /* Set up on the thread pool */
       } else {
          for (i = 2; i < nr; i += 3) {
             setup->triangle(setup,
@@ -446,6 +456,9 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
          /* If lp_setup_analyse_triangles() returned true, it also
           * emitted (setup) the rect or triangles.
           */
+      } else if (lp_setup_triangles(setup, vertex_buffer, stride,
+                                    NULL, nr / 3)) {
+         /* Set up on the thread pool */
       } else {
          for (i = 2; i < nr; i += 3) {
             setup->triangle(setup,
@@ -705,8 +718,13 @@ lp_setup_pipeline_statistics(
 void
 lp_setup_init_vbuf(struct lp_setup_context *setup)
 {
-   setup->base.max_indices = LP_MAX_VBUF_INDEXES;
-   setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   if (setup->parallel_tri_setup) {
+      setup->base.max_indices = LP_MAX_VBUF_INDEXES_PARALLEL;
+      setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE_PARALLEL;
+   } else {
+      setup->base.max_indices = LP_MAX_VBUF_INDEXES;
+      setup->base.max_vertex_buffer_bytes = LP_MAX_VBUF_SIZE;
+   }
 
    setup->base.get_vertex_info = lp_setup_get_vertex_info;
    setup->base.allocate_vertices = lp_setup_allocate_vertices;
@@ -68,6 +68,7 @@
 #include "util/u_dual_blend.h"
 #include "util/u_upload_mgr.h"
 #include "util/os_time.h"
+#include "util/log.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "nir/tgsi_to_nir.h"
@@ -3714,9 +3715,162 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 }
 
 
+/**
+ * Build and JIT the LLVM functions of a fragment shader variant.
+ *
+ * Only touches the variant (and the shader's NIR), so it may run on the
+ * context's compile thread with that thread's own LLVM context.
+ */
+static bool
+compile_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader_variant *variant,
+                LLVMContextRef context)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   int64_t t0 = os_time_get();
+
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching = false;
+   if (shader->base.ir.nir) {
+      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
+
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+            shader->no, variant->no);
+   variant->gallivm = gallivm_create(module_name, context, &cached);
+   if (!variant->gallivm)
+      return false;
+
+   lp_jit_init_types(variant);
+
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(lp, shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /* If the original fastpath doesn't cover this variant, try the new
+    * code:
+    */
+   if (variant->linear_pipeline && variant->jit_linear == NULL) {
+      if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
+          shader->kind == LP_FS_KIND_BLIT_RGB1 ||
+          shader->kind == LP_FS_KIND_LLVM_LINEAR) {
+         llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+         gallivm_jit_function(variant->gallivm,
+                              variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+         variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   if (variant->linear_pipeline) {
+      if (variant->linear_function) {
+         variant->jit_linear_llvm = (lp_jit_linear_llvm_func)
+            gallivm_jit_function(variant->gallivm, variant->linear_function);
+      }
+
+      /*
+       * This must be done after LLVM compilation, as it will call the JIT'ed
+       * code to determine active inputs.
+       */
+      lp_linear_check_variant(variant);
+   }
+
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
+
+   gallivm_free_ir(variant->gallivm);
+
+   LP_COUNT_ADD(llvm_compile_time, os_time_get() - t0);
+   LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+
+   return true;
+}
+
+
+/**
+ * Stand-in for the JIT functions of a variant which couldn't be compiled
+ * in the background: the fragments are dropped.
+ */
+static void
+skip_fragments(const struct lp_jit_context *context,
+               const struct lp_jit_resources *resources,
+               uint32_t x,
+               uint32_t y,
+               uint32_t facing,
+               const void *a0,
+               const void *dadx,
+               const void *dady,
+               uint8_t **cbufs,
+               uint8_t *depth,
+               uint64_t int_mask,
+               struct lp_jit_thread_data *thread_data,
+               unsigned *strides,
+               unsigned depth_stride,
+               unsigned *sample_stride,
+               unsigned depth_sample_stride)
+{
+}
+
+
+static void
+compile_variant_job(void *job, void *gdata, int thread_index)
+{
+   struct lp_fragment_shader_variant *variant = job;
+   struct llvmpipe_context *lp = gdata;
+
+   if (!compile_variant(lp, variant, lp->fs_compile_context)) {
+      /* The draws using the variant are binned already, so there's nothing
+       * to fall back to.
+       */
+      mesa_loge_once("llvmpipe: background fragment shader compile failed, "
+                     "dropping the fragments of the affected draws");
+      LP_COUNT(nr_fs_async_compile_failures);
+      variant->jit_function[RAST_WHOLE] = skip_fragments;
+      variant->jit_function[RAST_EDGE_TEST] = skip_fragments;
+   }
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * Everything the binner needs (opaque/blit analysis, linear fastpaths) is
+ * worked out here.  The LLVM compilation is either done right away or,
+ * with LP_ASYNC_FS_COMPILE, queued on the context's compile thread.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
@@ -3732,31 +3886,11 @@ generate_variant(struct llvmpipe_context *lp,
    memset(variant, 0, sizeof(*variant));
 
    pipe_reference_init(&variant->reference, 1);
+   util_queue_fence_init(&variant->compile_fence);
    lp_fs_reference(lp, &variant->shader, shader);
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
-   struct lp_cached_code cached = { 0 };
-   unsigned char ir_sha1_cache_key[20];
-   bool needs_caching = false;
-   if (shader->base.ir.nir) {
-      lp_fs_get_ir_cache_key(variant, ir_sha1_cache_key);
-
-      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
-      if (!cached.data_size)
-         needs_caching = true;
-   }
-
-   char module_name[64];
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    variant->no = shader->variants_created++;
@@ -3849,7 +3983,7 @@ generate_variant(struct llvmpipe_context *lp,
    /* Determine whether this shader + pipeline state is a candidate for
     * the linear path.
     */
-   const bool linear_pipeline =
+   variant->linear_pipeline =
          !key->stencil[0].enabled &&
          !key->depth.enabled &&
          !nir->info.fs.uses_discard &&
@@ -3867,19 +4001,7 @@ generate_variant(struct llvmpipe_context *lp,
 
    llvmpipe_fs_variant_fastpath(variant);
 
-   lp_jit_init_types(variant);
-
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   if (linear_pipeline) {
+   if (variant->linear_pipeline) {
       /* Currently keeping both the old fastpaths and new linear path
        * active.  The older code is still somewhat faster for the cases
        * it covers.
@@ -3891,17 +4013,6 @@ generate_variant(struct llvmpipe_context *lp,
           !key->blend.alpha_to_coverage) {
          llvmpipe_fs_variant_linear_fastpath(variant);
       }
-
-      /* If the original fastpath doesn't cover this variant, try the new
-       * code:
-       */
-      if (variant->jit_linear == NULL) {
-         if (shader->kind == LP_FS_KIND_BLIT_RGBA ||
-             shader->kind == LP_FS_KIND_BLIT_RGB1 ||
-             shader->kind == LP_FS_KIND_LLVM_LINEAR) {
-            llvmpipe_fs_variant_linear_llvm(lp, shader, variant);
-         }
-      }
    } else {
       if (LP_DEBUG & DEBUG_LINEAR) {
          lp_debug_fs_variant(variant);
@@ -3909,48 +4020,23 @@ generate_variant(struct llvmpipe_context *lp,
       }
    }
 
-   /*
-    * Compile everything
-    */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
-
-   if (variant->function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         gallivm_jit_function(variant->gallivm,
-                              variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-         variant->jit_function[RAST_EDGE_TEST];
-   }
-
-   if (linear_pipeline) {
-      if (variant->linear_function) {
-         variant->jit_linear_llvm = (lp_jit_linear_llvm_func)
-            gallivm_jit_function(variant->gallivm, variant->linear_function);
-      }
-
-      /*
-       * This must be done after LLVM compilation, as it will call the JIT'ed
-       * code to determine active inputs.
-       */
-      lp_linear_check_variant(variant);
-   }
-
-   if (needs_caching) {
-      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   if (lp->async_fs_compile) {
+      variant->compile_pending = true;
+      util_dynarray_append(&lp->fs_compiles_pending,
+                           struct lp_fragment_shader_variant *, variant);
+      LP_COUNT(nr_fs_async_compiles);
+      LP_COUNT_MAX(max_fs_compile_queue_depth,
+                   util_dynarray_num_elements(&lp->fs_compiles_pending,
+                                              struct lp_fragment_shader_variant *));
+      util_queue_add_job(&lp->fs_compile_queue, variant,
+                         &variant->compile_fence, compile_variant_job,
+                         NULL, 0);
+   } else if (!compile_variant(lp, variant, lp->context)) {
+      lp_fs_reference(lp, &variant->shader, NULL);
+      FREE(variant);
+      return NULL;
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -4077,6 +4163,34 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 }
 
 
+/**
+ * Account the instructions of finished background compiles so that the
+ * variant eviction heuristics see them.
+ */
+static void
+retire_fs_compiles(struct llvmpipe_context *lp)
+{
+   unsigned i = 0;
+
+   while (i < util_dynarray_num_elements(&lp->fs_compiles_pending,
+                                         struct lp_fragment_shader_variant *)) {
+      struct lp_fragment_shader_variant **pending =
+         util_dynarray_element(&lp->fs_compiles_pending,
+                               struct lp_fragment_shader_variant *, i);
+      struct lp_fragment_shader_variant *variant = *pending;
+
+      if (util_queue_fence_is_signalled(&variant->compile_fence)) {
+         variant->compile_pending = false;
+         lp->nr_fs_instrs += variant->nr_instrs;
+         *pending = util_dynarray_pop(&lp->fs_compiles_pending,
+                                      struct lp_fragment_shader_variant *);
+      } else {
+         i++;
+      }
+   }
+}
+
+
 /**
  * Remove shader variant from two lists: the shader's variant list
  * and the context's variant list.
@@ -4085,6 +4199,11 @@ static void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   if (variant->compile_pending) {
+      util_queue_fence_wait(&variant->compile_fence);
+      retire_fs_compiles(lp);
+   }
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -4109,7 +4228,10 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
-   gallivm_destroy(variant->gallivm);
+   util_queue_fence_wait(&variant->compile_fence);
+   util_queue_fence_destroy(&variant->compile_fence);
+   if (variant->gallivm)
+      gallivm_destroy(variant->gallivm);
    lp_fs_reference(lp, &variant->shader, NULL);
    FREE(variant);
 }
@@ -4632,6 +4754,9 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
    struct lp_fragment_shader_variant *variant = NULL;
    struct lp_fs_variant_list_item *li;
+
+   retire_fs_compiles(lp);
+
    /* Search the variants for one which matches the key */
    LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
       if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
@@ -4699,19 +4824,15 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /*
        * Generate the new variant.
        */
-      int64_t t0 = os_time_get();
       variant = generate_variant(lp, shader, key);
-      int64_t t1 = os_time_get();
-      int64_t dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
       if (variant) {
          list_add(&variant->list_item_local.list, &shader->variants.list);
          list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
+         if (!variant->compile_pending)
+            lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
       }
    }
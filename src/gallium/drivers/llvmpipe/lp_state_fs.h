@@ -38,6 +38,7 @@
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 #include "util/u_inlines.h"
+#include "util/u_queue.h"
 #include "lp_jit.h"
 
 struct lp_fragment_shader;
@@ -150,9 +151,19 @@ struct lp_fragment_shader_variant
 
    unsigned opaque:1;
    unsigned blit:1;
+   unsigned linear_pipeline:1;
    unsigned linear_input_mask:16;
    struct pipe_reference reference;
 
+   /*
+    * Signalled once the JIT functions below are ready.  With
+    * LP_ASYNC_FS_COMPILE the variant may be binned before that happens;
+    * the rasterizer waits on this fence before running the scene.
+    */
+   struct util_queue_fence compile_fence;
+   /* nr_instrs not yet accounted in llvmpipe_context::nr_fs_instrs */
+   bool compile_pending;
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_type;
@@ -266,6 +277,12 @@ void
 llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant);
 
+static inline bool
+lp_fs_variant_is_compiling(struct lp_fragment_shader_variant *variant)
+{
+   return variant && !util_queue_fence_is_signalled(&variant->compile_fence);
+}
+
 static inline void
 lp_fs_variant_reference(struct llvmpipe_context *llvmpipe,
                         struct lp_fragment_shader_variant **ptr,
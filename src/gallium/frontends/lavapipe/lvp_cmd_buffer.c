@@ -28,10 +28,15 @@
 #include "vk_common_entrypoints.h"
 
 static void
-lvp_cmd_buffer_destroy(struct vk_command_buffer *cmd_buffer)
+lvp_cmd_buffer_destroy(struct vk_command_buffer *vk_cmd_buffer)
 {
-   vk_command_buffer_finish(cmd_buffer);
-   vk_free(&cmd_buffer->pool->alloc, cmd_buffer);
+   struct lvp_cmd_buffer *cmd_buffer =
+      container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk);
+
+   util_dynarray_fini(&cmd_buffer->packets);
+   util_dynarray_fini(&cmd_buffer->packet_data);
+   vk_command_buffer_finish(vk_cmd_buffer);
+   vk_free(&vk_cmd_buffer->pool->alloc, cmd_buffer);
 }
 
 static VkResult
@@ -55,6 +60,8 @@ lvp_create_cmd_buffer(struct vk_command_pool *pool,
    }
 
    cmd_buffer->device = device;
+   util_dynarray_init(&cmd_buffer->packets, NULL);
+   util_dynarray_init(&cmd_buffer->packet_data, NULL);
 
    *cmd_buffer_out = &cmd_buffer->vk;
 
@@ -65,6 +72,11 @@ static void
 lvp_reset_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer,
                      UNUSED VkCommandBufferResetFlags flags)
 {
+   struct lvp_cmd_buffer *cmd_buffer =
+      container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk);
+
+   util_dynarray_clear(&cmd_buffer->packets);
+   util_dynarray_clear(&cmd_buffer->packet_data);
    vk_command_buffer_reset(vk_cmd_buffer);
 }
 
@@ -90,6 +102,10 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_EndCommandBuffer(
 {
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
+   /* compile first so allocation failures end up in the recorded result */
+   if (!vk_command_buffer_has_error(&cmd_buffer->vk))
+      lvp_cmd_buffer_compile(cmd_buffer);
+
    return vk_command_buffer_end(&cmd_buffer->vk);
 }
 
@@ -1295,7 +1295,7 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .queueFlags = VK_QUEUE_GRAPHICS_BIT |
          VK_QUEUE_COMPUTE_BIT |
          VK_QUEUE_TRANSFER_BIT,
-         .queueCount = 1,
+         .queueCount = LVP_MAX_QUEUES,
          .timestampValidBits = 64,
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
       };
@@ -1387,12 +1387,18 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(
    return lvp_GetInstanceProcAddr(instance, pName);
 }
 
+/* pipelines are always deferred to the first queue, and their CSOs live on
+ * its context; any queue may destroy them as long as it holds that queue's
+ * lock, which is also held whenever the first queue uses its context
+ */
 static void
-destroy_pipelines(struct lvp_queue *queue)
+destroy_pipelines(struct lvp_device *device)
 {
+   struct lvp_queue *queue = &device->queue;
+
    simple_mtx_lock(&queue->lock);
    while (util_dynarray_contains(&queue->pipeline_destroys, struct lvp_pipeline*)) {
-      lvp_pipeline_destroy(queue->device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*), true);
+      lvp_pipeline_destroy(device, util_dynarray_pop(&queue->pipeline_destroys, struct lvp_pipeline*), true);
    }
    simple_mtx_unlock(&queue->lock);
 }
@@ -1417,18 +1423,22 @@ lvp_queue_submit(struct vk_queue *vk_queue,
 
       lvp_execute_cmds(queue->device, queue, cmd_buffer);
    }
+   lvp_queue_collect_shaders(queue);
 
-   simple_mtx_unlock(&queue->lock);
-
+   /* the other queues compile shaders on the first queue's context with its
+    * lock held, so it must be held for the flush as well
+    */
    if (submit->command_buffer_count > 0)
       queue->ctx->flush(queue->ctx, &queue->last_fence, 0);
 
+   simple_mtx_unlock(&queue->lock);
+
    for (uint32_t i = 0; i < submit->signal_count; i++) {
       struct lvp_pipe_sync *sync =
          vk_sync_as_lvp_pipe_sync(submit->signals[i].sync);
       lvp_pipe_sync_signal_with_fence(queue->device, sync, queue->last_fence);
    }
-   destroy_pipelines(queue);
+   destroy_pipelines(queue->device);
 
    return VK_SUCCESS;
 }
@@ -1460,6 +1470,16 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
    simple_mtx_init(&queue->lock, mtx_plain);
    util_dynarray_init(&queue->pipeline_destroys, NULL);
 
+   simple_mtx_init(&queue->shader_lock, mtx_plain);
+   _mesa_hash_table_init(&queue->shader_csos, NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
+   util_dynarray_init(&queue->shader_garbage, NULL);
+
+   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
+   struct pipe_shader_state shstate = {0};
+   shstate.type = PIPE_SHADER_IR_NIR;
+   shstate.ir.nir = b.shader;
+   queue->noop_fs = queue->ctx->create_fs_state(queue->ctx, &shstate);
+
    return VK_SUCCESS;
 }
 
@@ -1468,15 +1488,79 @@ lvp_queue_finish(struct lvp_queue *queue)
 {
    vk_queue_finish(&queue->vk);
 
-   destroy_pipelines(queue);
+   if (lvp_queue_is_primary(queue))
+      destroy_pipelines(queue->device);
+
+   /* shaders the application never destroyed */
+   hash_table_foreach(&queue->shader_csos, he)
+      util_dynarray_append(&queue->shader_garbage, struct lvp_queue_shader *, he->data);
+   lvp_queue_collect_shaders(queue);
+   ralloc_free(queue->shader_csos.table);
+   util_dynarray_fini(&queue->shader_garbage);
+   simple_mtx_destroy(&queue->shader_lock);
+
    simple_mtx_destroy(&queue->lock);
    util_dynarray_fini(&queue->pipeline_destroys);
 
+   queue->ctx->delete_fs_state(queue->ctx, queue->noop_fs);
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
+
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
 }
 
+static void
+lvp_device_finish_queues(struct lvp_device *device)
+{
+   /* the first queue goes last: it owns everything the others share */
+   while (device->queue_count) {
+      struct lvp_queue *queue = device->queues[--device->queue_count];
+      lvp_queue_finish(queue);
+      if (queue != &device->queue)
+         vk_free(&device->vk.alloc, queue);
+   }
+}
+
+static VkResult
+lvp_device_init_queues(struct lvp_device *device, const VkDeviceCreateInfo *pCreateInfo)
+{
+   size_t state_size = lvp_get_rendering_state_size();
+
+   assert(pCreateInfo->queueCreateInfoCount == 1);
+   const VkDeviceQueueCreateInfo *queue_info = &pCreateInfo->pQueueCreateInfos[0];
+   assert(queue_info->queueFamilyIndex == 0);
+   assert(queue_info->queueCount >= 1 && queue_info->queueCount <= LVP_MAX_QUEUES);
+
+   /* each queue gets its own context and submit thread, so command buffers
+    * submitted to different queues are executed concurrently
+    */
+   for (uint32_t i = 0; i < queue_info->queueCount; i++) {
+      struct lvp_queue *queue = &device->queue;
+      if (i) {
+         queue = vk_zalloc(&device->vk.alloc, sizeof(*queue) + state_size, 8,
+                           VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+         if (!queue) {
+            lvp_device_finish_queues(device);
+            return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+         }
+         queue->state = queue + 1;
+      }
+
+      VkResult result = lvp_queue_init(device, queue, queue_info, i);
+      if (result != VK_SUCCESS) {
+         if (i)
+            vk_free(&device->vk.alloc, queue);
+         lvp_device_finish_queues(device);
+         return result;
+      }
+      device->queues[device->queue_count++] = queue;
+   }
+
+   return VK_SUCCESS;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
    VkPhysicalDevice                            physicalDevice,
    const VkDeviceCreateInfo*                   pCreateInfo,
@@ -1523,20 +1607,28 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   result = lvp_device_init_queues(device, pCreateInfo);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, device);
       return result;
    }
 
-   nir_builder b = nir_builder_init_simple_shader(MESA_SHADER_FRAGMENT, NULL, "dummy_frag");
-   struct pipe_shader_state shstate = {0};
-   shstate.type = PIPE_SHADER_IR_NIR;
-   shstate.ir.nir = b.shader;
-   device->noop_fs = device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+   /* llvmpipe creates its disk cache when the first context is created; it
+    * stores the JIT code and also backs the lowered NIR kept in
+    * vk_pipeline_cache, so a warm start skips all shader compilation.
+    */
+   if (!physical_device->vk.disk_cache && device->pscreen->get_disk_shader_cache)
+      physical_device->vk.disk_cache = device->pscreen->get_disk_shader_cache(device->pscreen);
+
+   struct vk_pipeline_cache_create_info pcc_info = { };
+   device->mem_cache = vk_pipeline_cache_create(&device->vk, &pcc_info, NULL);
+   if (!device->mem_cache) {
+      lvp_device_finish_queues(device);
+      vk_device_finish(&device->vk);
+      vk_free(&device->vk.alloc, device);
+      return vk_error(instance, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
    _mesa_hash_table_init(&device->bda, NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
    simple_mtx_init(&device->bda_lock, mtx_plain);
 
@@ -1576,15 +1668,12 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
    device->queue.ctx->delete_texture_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_texture_handle);
    device->queue.ctx->delete_image_handle(device->queue.ctx, (uint64_t)(uintptr_t)device->null_image_handle);
 
-   device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
-
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
-   lvp_queue_finish(&device->queue);
+   vk_pipeline_cache_destroy(device->mem_cache, NULL);
+   lvp_device_finish_queues(device);
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
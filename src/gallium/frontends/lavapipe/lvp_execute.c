@@ -82,6 +82,7 @@ struct lvp_render_attachment {
 struct rendering_state {
    struct pipe_context *pctx;
    struct lvp_device *device; //for uniform inlining only
+   struct lvp_queue *queue;
    struct u_upload_mgr *uploader;
    struct cso_context *cso;
 
@@ -103,7 +104,9 @@ struct rendering_state {
    bool sample_mask_dirty;
    bool min_samples_dirty;
    bool poison_mem;
+   bool print_cmds;
    bool noop_fs_bound;
+   const uint8_t *packet_data;
    struct pipe_draw_indirect_info indirect_info;
    struct pipe_draw_info info;
 
@@ -290,13 +293,36 @@ update_pcbuf(struct rendering_state *state, enum pipe_shader_type pstage)
    state->pcbuf_dirty[pstage] = false;
 }
 
+/* inline variants live on the shader and belong to the device's first queue */
+static bool
+shader_inlines(const struct rendering_state *state, const struct lvp_shader *shader)
+{
+   return shader->inlines.can_inline && lvp_queue_is_primary(state->queue);
+}
+
+static void *
+shader_cso(struct rendering_state *state, struct lvp_shader *shader)
+{
+   if (lvp_queue_is_primary(state->queue))
+      return shader->shader_cso;
+   return lvp_queue_get_shader(state->queue, shader)->cso;
+}
+
+static void *
+shader_tess_ccw_cso(struct rendering_state *state, struct lvp_shader *shader)
+{
+   if (lvp_queue_is_primary(state->queue))
+      return shader->tess_ccw_cso;
+   return lvp_queue_get_shader(state->queue, shader)->tess_ccw_cso;
+}
+
 static void
 update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type sh, bool pcbuf_dirty)
 {
    unsigned stage = tgsi_processor_to_shader_stage(sh);
    state->inlines_dirty[sh] = false;
    struct lvp_shader *shader = state->shaders[stage];
-   if (!shader || !shader->inlines.can_inline)
+   if (!shader || !shader_inlines(state, shader))
       return;
    struct lvp_inline_variant v;
    v.mask = shader->inlines.can_inline;
@@ -334,7 +360,8 @@ update_inline_shader_state(struct rendering_state *state, enum pipe_shader_type
          /* not enough change; don't inline further */
          shader->inlines.can_inline = 0;
          ralloc_free(nir);
-         shader->shader_cso = lvp_shader_compile(state->device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir), true);
+         if (!shader->shader_cso)
+            shader->shader_cso = lvp_shader_compile(state->device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir), true);
          _mesa_set_remove(&shader->inlines.variants, entry);
          shader_state = shader->shader_cso;
       } else {
@@ -419,7 +446,7 @@ static void update_vertex_elements_buffer_index(struct rendering_state *state)
 static void emit_state(struct rendering_state *state)
 {
    if (!state->shaders[MESA_SHADER_FRAGMENT] && !state->noop_fs_bound) {
-      state->pctx->bind_fs_state(state->pctx, state->device->noop_fs);
+      state->pctx->bind_fs_state(state->pctx, state->queue->noop_fs);
       state->noop_fs_bound = true;
    }
    if (state->blend_dirty) {
@@ -562,9 +589,9 @@ handle_compute_shader(struct rendering_state *state, struct lvp_shader *shader,
    state->dispatch_info.block[0] = shader->pipeline_nir->nir->info.workgroup_size[0];
    state->dispatch_info.block[1] = shader->pipeline_nir->nir->info.workgroup_size[1];
    state->dispatch_info.block[2] = shader->pipeline_nir->nir->info.workgroup_size[2];
-   state->inlines_dirty[MESA_SHADER_COMPUTE] = shader->inlines.can_inline;
-   if (!shader->inlines.can_inline)
-      state->pctx->bind_compute_state(state->pctx, shader->shader_cso);
+   state->inlines_dirty[MESA_SHADER_COMPUTE] = shader_inlines(state, shader);
+   if (!state->inlines_dirty[MESA_SHADER_COMPUTE])
+      state->pctx->bind_compute_state(state->pctx, shader_cso(state, shader));
 }
 
 static void handle_compute_pipeline(struct vk_cmd_queue_entry *cmd,
@@ -628,61 +655,61 @@ handle_graphics_stages(struct rendering_state *state, VkShaderStageFlagBits shad
 
       switch (vk_stage) {
       case VK_SHADER_STAGE_FRAGMENT_BIT:
-         state->inlines_dirty[MESA_SHADER_FRAGMENT] = state->shaders[MESA_SHADER_FRAGMENT]->inlines.can_inline;
-         if (!state->shaders[MESA_SHADER_FRAGMENT]->inlines.can_inline) {
-            state->pctx->bind_fs_state(state->pctx, state->shaders[MESA_SHADER_FRAGMENT]->shader_cso);
+         state->inlines_dirty[MESA_SHADER_FRAGMENT] = shader_inlines(state, state->shaders[MESA_SHADER_FRAGMENT]);
+         if (!state->inlines_dirty[MESA_SHADER_FRAGMENT]) {
+            state->pctx->bind_fs_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_FRAGMENT]));
             state->noop_fs_bound = false;
          }
          break;
       case VK_SHADER_STAGE_VERTEX_BIT:
-         state->inlines_dirty[MESA_SHADER_VERTEX] = state->shaders[MESA_SHADER_VERTEX]->inlines.can_inline;
-         if (!state->shaders[MESA_SHADER_VERTEX]->inlines.can_inline)
-            state->pctx->bind_vs_state(state->pctx, state->shaders[MESA_SHADER_VERTEX]->shader_cso);
+         state->inlines_dirty[MESA_SHADER_VERTEX] = shader_inlines(state, state->shaders[MESA_SHADER_VERTEX]);
+         if (!state->inlines_dirty[MESA_SHADER_VERTEX])
+            state->pctx->bind_vs_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_VERTEX]));
          break;
       case VK_SHADER_STAGE_GEOMETRY_BIT:
-         state->inlines_dirty[MESA_SHADER_GEOMETRY] = state->shaders[MESA_SHADER_GEOMETRY]->inlines.can_inline;
-         if (!state->shaders[MESA_SHADER_GEOMETRY]->inlines.can_inline)
-            state->pctx->bind_gs_state(state->pctx, state->shaders[MESA_SHADER_GEOMETRY]->shader_cso);
+         state->inlines_dirty[MESA_SHADER_GEOMETRY] = shader_inlines(state, state->shaders[MESA_SHADER_GEOMETRY]);
+         if (!state->inlines_dirty[MESA_SHADER_GEOMETRY])
+            state->pctx->bind_gs_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_GEOMETRY]));
          state->gs_output_lines = state->shaders[MESA_SHADER_GEOMETRY]->pipeline_nir->nir->info.gs.output_primitive == MESA_PRIM_LINES ? GS_OUTPUT_LINES : GS_OUTPUT_NOT_LINES;
          break;
       case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
-         state->inlines_dirty[MESA_SHADER_TESS_CTRL] = state->shaders[MESA_SHADER_TESS_CTRL]->inlines.can_inline;
-         if (!state->shaders[MESA_SHADER_TESS_CTRL]->inlines.can_inline)
-            state->pctx->bind_tcs_state(state->pctx, state->shaders[MESA_SHADER_TESS_CTRL]->shader_cso);
+         state->inlines_dirty[MESA_SHADER_TESS_CTRL] = shader_inlines(state, state->shaders[MESA_SHADER_TESS_CTRL]);
+         if (!state->inlines_dirty[MESA_SHADER_TESS_CTRL])
+            state->pctx->bind_tcs_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_TESS_CTRL]));
          break;
       case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
-         state->inlines_dirty[MESA_SHADER_TESS_EVAL] = state->shaders[MESA_SHADER_TESS_EVAL]->inlines.can_inline;
+         state->inlines_dirty[MESA_SHADER_TESS_EVAL] = shader_inlines(state, state->shaders[MESA_SHADER_TESS_EVAL]);
          state->tess_states[0] = NULL;
          state->tess_states[1] = NULL;
-         if (!state->shaders[MESA_SHADER_TESS_EVAL]->inlines.can_inline) {
+         if (!state->inlines_dirty[MESA_SHADER_TESS_EVAL]) {
             if (dynamic_tess_origin) {
-               state->tess_states[0] = state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso;
-               state->tess_states[1] = state->shaders[MESA_SHADER_TESS_EVAL]->tess_ccw_cso;
+               state->tess_states[0] = shader_cso(state, state->shaders[MESA_SHADER_TESS_EVAL]);
+               state->tess_states[1] = shader_tess_ccw_cso(state, state->shaders[MESA_SHADER_TESS_EVAL]);
                state->pctx->bind_tes_state(state->pctx, state->tess_states[state->tess_ccw]);
             } else {
-               state->pctx->bind_tes_state(state->pctx, state->shaders[MESA_SHADER_TESS_EVAL]->shader_cso);
+               state->pctx->bind_tes_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_TESS_EVAL]));
             }
          }
          if (!dynamic_tess_origin)
             state->tess_ccw = false;
          break;
       case VK_SHADER_STAGE_TASK_BIT_EXT:
-         state->inlines_dirty[MESA_SHADER_TASK] = state->shaders[MESA_SHADER_TASK]->inlines.can_inline;
+         state->inlines_dirty[MESA_SHADER_TASK] = shader_inlines(state, state->shaders[MESA_SHADER_TASK]);
          state->dispatch_info.block[0] = state->shaders[MESA_SHADER_TASK]->pipeline_nir->nir->info.workgroup_size[0];
          state->dispatch_info.block[1] = state->shaders[MESA_SHADER_TASK]->pipeline_nir->nir->info.workgroup_size[1];
          state->dispatch_info.block[2] = state->shaders[MESA_SHADER_TASK]->pipeline_nir->nir->info.workgroup_size[2];
-         if (!state->shaders[MESA_SHADER_TASK]->inlines.can_inline)
-            state->pctx->bind_ts_state(state->pctx, state->shaders[MESA_SHADER_TASK]->shader_cso);
+         if (!state->inlines_dirty[MESA_SHADER_TASK])
+            state->pctx->bind_ts_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_TASK]));
          break;
       case VK_SHADER_STAGE_MESH_BIT_EXT:
-         state->inlines_dirty[MESA_SHADER_MESH] = state->shaders[MESA_SHADER_MESH]->inlines.can_inline;
+         state->inlines_dirty[MESA_SHADER_MESH] = shader_inlines(state, state->shaders[MESA_SHADER_MESH]);
          if (!(shader_stages & VK_SHADER_STAGE_TASK_BIT_EXT)) {
             state->dispatch_info.block[0] = state->shaders[MESA_SHADER_MESH]->pipeline_nir->nir->info.workgroup_size[0];
             state->dispatch_info.block[1] = state->shaders[MESA_SHADER_MESH]->pipeline_nir->nir->info.workgroup_size[1];
             state->dispatch_info.block[2] = state->shaders[MESA_SHADER_MESH]->pipeline_nir->nir->info.workgroup_size[2];
          }
-         if (!state->shaders[MESA_SHADER_MESH]->inlines.can_inline)
-            state->pctx->bind_ms_state(state->pctx, state->shaders[MESA_SHADER_MESH]->shader_cso);
+         if (!state->inlines_dirty[MESA_SHADER_MESH])
+            state->pctx->bind_ms_state(state->pctx, shader_cso(state, state->shaders[MESA_SHADER_MESH]));
          break;
       default:
          assert(0);
@@ -748,7 +775,13 @@ static void handle_graphics_pipeline(struct lvp_pipeline *pipeline,
                                      struct rendering_state *state)
 {
    const struct vk_graphics_pipeline_state *ps = &pipeline->graphics_state;
-   lvp_pipeline_shaders_compile(pipeline, true);
+   if (lvp_queue_is_primary(state->queue)) {
+      lvp_pipeline_shaders_compile(pipeline, true);
+   } else {
+      simple_mtx_lock(&state->device->queue.lock);
+      lvp_pipeline_shaders_compile(pipeline, true);
+      simple_mtx_unlock(&state->device->queue.lock);
+   }
    bool dynamic_tess_origin = BITSET_TEST(ps->dynamic, MESA_VK_DYNAMIC_TS_DOMAIN_ORIGIN);
    unbind_graphics_stages(state,
                           (~pipeline->graphics_state.shader_stages) &
@@ -2716,13 +2749,15 @@ static void handle_push_constants(struct vk_cmd_queue_entry *cmd,
 
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
                                    struct rendering_state *state, bool print_cmds);
+static void lvp_execute_packets(struct lvp_cmd_buffer *cmd_buffer,
+                                struct rendering_state *state);
 
 static void handle_execute_commands(struct vk_cmd_queue_entry *cmd,
-                                    struct rendering_state *state, bool print_cmds)
+                                    struct rendering_state *state)
 {
    for (unsigned i = 0; i < cmd->u.execute_commands.command_buffer_count; i++) {
       LVP_FROM_HANDLE(lvp_cmd_buffer, secondary_buf, cmd->u.execute_commands.command_buffers[i]);
-      lvp_execute_cmd_buffer(&secondary_buf->vk.cmd_queue.cmds, state, print_cmds);
+      lvp_execute_packets(secondary_buf, state);
    }
 }
 
@@ -4426,6 +4461,417 @@ void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
 #undef ENQUEUE_CMD
 }
 
+/* Recorded commands are compiled into packets when the command buffer is
+ * ended, so submitting it again only walks an array. Direct draws, viewports
+ * and scissors are resolved into the gallium structs they end up as; the
+ * other commands keep their vk_cmd_queue entry and the handler for it.
+ */
+typedef void (*lvp_cmd_handler)(struct vk_cmd_queue_entry *cmd, struct rendering_state *state);
+
+struct lvp_cmd_packet;
+typedef void (*lvp_packet_handler)(const struct lvp_cmd_packet *packet, struct rendering_state *state);
+
+struct lvp_draw_packet {
+   uint32_t start_instance;
+   uint32_t instance_count;
+   uint32_t draw_count;
+   uint32_t draws; /* offset of the pipe_draw_start_count_bias array */
+   uint8_t index_size; /* 0 for non-indexed draws */
+   bool index_bias_varies;
+};
+
+struct lvp_viewport {
+   float scale[2];
+   float translate[2];
+   float min_depth, max_depth;
+};
+
+struct lvp_viewport_packet {
+   uint32_t first; /* UINT32_MAX also sets the viewport count */
+   uint32_t count;
+   uint32_t viewports; /* offset of the lvp_viewport array */
+};
+
+struct lvp_scissor_packet {
+   uint32_t first; /* UINT32_MAX also sets the scissor count */
+   uint32_t count;
+   uint32_t scissors; /* offset of the pipe_scissor_state array */
+};
+
+struct lvp_cmd_packet {
+   lvp_packet_handler execute;
+   struct vk_cmd_queue_entry *cmd;
+   union {
+      lvp_cmd_handler handle;
+      struct lvp_draw_packet draw;
+      struct lvp_viewport_packet viewport;
+      struct lvp_scissor_packet scissor;
+   };
+};
+
+/* The index buffer binding as far as it is known when compiling */
+struct lvp_index_binding {
+   bool known;
+   uint8_t size;
+   unsigned offset;
+   unsigned buffer_size; //UINT32_MAX for unset
+};
+
+static void
+handle_noop(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+}
+
+static void
+exec_draw(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw(cmd, state);
+}
+
+static void
+exec_draw_multi(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_multi(cmd, state);
+}
+
+static void
+exec_draw_indexed(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indexed(cmd, state);
+}
+
+static void
+exec_draw_indirect(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indirect(cmd, state, false);
+}
+
+static void
+exec_draw_indexed_indirect(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indirect(cmd, state, true);
+}
+
+static void
+exec_draw_multi_indexed(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_multi_indexed(cmd, state);
+}
+
+static void
+exec_dispatch(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_compute_state(state);
+   handle_dispatch(cmd, state);
+}
+
+static void
+exec_dispatch_base(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_compute_state(state);
+   handle_dispatch_base(cmd, state);
+}
+
+static void
+exec_dispatch_indirect(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_compute_state(state);
+   handle_dispatch_indirect(cmd, state);
+}
+
+static void
+exec_draw_indirect_count(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indirect_count(cmd, state, false);
+}
+
+static void
+exec_draw_indexed_indirect_count(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indirect_count(cmd, state, true);
+}
+
+static void
+exec_draw_indirect_byte_count(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_indirect_byte_count(cmd, state);
+}
+
+static void
+exec_end_conditional_rendering(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   handle_end_conditional_rendering(state);
+}
+
+static void
+exec_draw_mesh_tasks(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_mesh_tasks(cmd, state);
+}
+
+static void
+exec_draw_mesh_tasks_indirect(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_mesh_tasks_indirect(cmd, state);
+}
+
+static void
+exec_draw_mesh_tasks_indirect_count(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   emit_state(state);
+   handle_draw_mesh_tasks_indirect_count(cmd, state);
+}
+
+static void
+exec_execute_generated_commands(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   handle_execute_generated_commands(cmd, state, state->print_cmds);
+}
+
+static lvp_cmd_handler
+get_cmd_handler(enum vk_cmd_type type)
+{
+   switch (type) {
+   case VK_CMD_BIND_PIPELINE:
+      return handle_pipeline;
+   case VK_CMD_SET_VIEWPORT:
+      return handle_set_viewport;
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      return handle_set_viewport_with_count;
+   case VK_CMD_SET_SCISSOR:
+      return handle_set_scissor;
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      return handle_set_scissor_with_count;
+   case VK_CMD_SET_LINE_WIDTH:
+      return handle_set_line_width;
+   case VK_CMD_SET_DEPTH_BIAS:
+      return handle_set_depth_bias;
+   case VK_CMD_SET_BLEND_CONSTANTS:
+      return handle_set_blend_constants;
+   case VK_CMD_SET_DEPTH_BOUNDS:
+      return handle_set_depth_bounds;
+   case VK_CMD_SET_STENCIL_COMPARE_MASK:
+      return handle_set_stencil_compare_mask;
+   case VK_CMD_SET_STENCIL_WRITE_MASK:
+      return handle_set_stencil_write_mask;
+   case VK_CMD_SET_STENCIL_REFERENCE:
+      return handle_set_stencil_reference;
+   case VK_CMD_BIND_DESCRIPTOR_SETS2_KHR:
+      return handle_descriptor_sets_cmd;
+   case VK_CMD_BIND_INDEX_BUFFER:
+      return handle_index_buffer;
+   case VK_CMD_BIND_INDEX_BUFFER2_KHR:
+      return handle_index_buffer2;
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+      return handle_vertex_buffers2;
+   case VK_CMD_DRAW:
+      return exec_draw;
+   case VK_CMD_DRAW_MULTI_EXT:
+      return exec_draw_multi;
+   case VK_CMD_DRAW_INDEXED:
+      return exec_draw_indexed;
+   case VK_CMD_DRAW_INDIRECT:
+      return exec_draw_indirect;
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+      return exec_draw_indexed_indirect;
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+      return exec_draw_multi_indexed;
+   case VK_CMD_DISPATCH:
+      return exec_dispatch;
+   case VK_CMD_DISPATCH_BASE:
+      return exec_dispatch_base;
+   case VK_CMD_DISPATCH_INDIRECT:
+      return exec_dispatch_indirect;
+   case VK_CMD_COPY_BUFFER2:
+      return handle_copy_buffer;
+   case VK_CMD_COPY_IMAGE2:
+      return handle_copy_image;
+   case VK_CMD_BLIT_IMAGE2:
+      return handle_blit_image;
+   case VK_CMD_COPY_BUFFER_TO_IMAGE2:
+      return handle_copy_buffer_to_image;
+   case VK_CMD_COPY_IMAGE_TO_BUFFER2:
+      return handle_copy_image_to_buffer2;
+   case VK_CMD_UPDATE_BUFFER:
+      return handle_update_buffer;
+   case VK_CMD_FILL_BUFFER:
+      return handle_fill_buffer;
+   case VK_CMD_CLEAR_COLOR_IMAGE:
+      return handle_clear_color_image;
+   case VK_CMD_CLEAR_DEPTH_STENCIL_IMAGE:
+      return handle_clear_ds_image;
+   case VK_CMD_CLEAR_ATTACHMENTS:
+      return handle_clear_attachments;
+   case VK_CMD_RESOLVE_IMAGE2:
+      return handle_resolve_image;
+   case VK_CMD_PIPELINE_BARRIER2:
+      return handle_pipeline_barrier;
+   case VK_CMD_BEGIN_QUERY_INDEXED_EXT:
+      return handle_begin_query_indexed_ext;
+   case VK_CMD_END_QUERY_INDEXED_EXT:
+      return handle_end_query_indexed_ext;
+   case VK_CMD_BEGIN_QUERY:
+      return handle_begin_query;
+   case VK_CMD_END_QUERY:
+      return handle_end_query;
+   case VK_CMD_RESET_QUERY_POOL:
+      return handle_reset_query_pool;
+   case VK_CMD_COPY_QUERY_POOL_RESULTS:
+      return handle_copy_query_pool_results;
+   case VK_CMD_PUSH_CONSTANTS2_KHR:
+      return handle_push_constants;
+   case VK_CMD_EXECUTE_COMMANDS:
+      return handle_execute_commands;
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+      return exec_draw_indirect_count;
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+      return exec_draw_indexed_indirect_count;
+   case VK_CMD_PUSH_DESCRIPTOR_SET2_KHR:
+      return handle_push_descriptor_set;
+   case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2_KHR:
+      return handle_push_descriptor_set_with_template;
+   case VK_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS_EXT:
+      return handle_bind_transform_feedback_buffers;
+   case VK_CMD_BEGIN_TRANSFORM_FEEDBACK_EXT:
+      return handle_begin_transform_feedback;
+   case VK_CMD_END_TRANSFORM_FEEDBACK_EXT:
+      return handle_end_transform_feedback;
+   case VK_CMD_DRAW_INDIRECT_BYTE_COUNT_EXT:
+      return exec_draw_indirect_byte_count;
+   case VK_CMD_BEGIN_CONDITIONAL_RENDERING_EXT:
+      return handle_begin_conditional_rendering;
+   case VK_CMD_END_CONDITIONAL_RENDERING_EXT:
+      return exec_end_conditional_rendering;
+   case VK_CMD_SET_VERTEX_INPUT_EXT:
+      return handle_set_vertex_input;
+   case VK_CMD_SET_CULL_MODE:
+      return handle_set_cull_mode;
+   case VK_CMD_SET_FRONT_FACE:
+      return handle_set_front_face;
+   case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
+      return handle_set_primitive_topology;
+   case VK_CMD_SET_DEPTH_TEST_ENABLE:
+      return handle_set_depth_test_enable;
+   case VK_CMD_SET_DEPTH_WRITE_ENABLE:
+      return handle_set_depth_write_enable;
+   case VK_CMD_SET_DEPTH_COMPARE_OP:
+      return handle_set_depth_compare_op;
+   case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
+      return handle_set_depth_bounds_test_enable;
+   case VK_CMD_SET_STENCIL_TEST_ENABLE:
+      return handle_set_stencil_test_enable;
+   case VK_CMD_SET_STENCIL_OP:
+      return handle_set_stencil_op;
+   case VK_CMD_SET_LINE_STIPPLE_EXT:
+      return handle_set_line_stipple;
+   case VK_CMD_SET_DEPTH_BIAS_ENABLE:
+      return handle_set_depth_bias_enable;
+   case VK_CMD_SET_LOGIC_OP_EXT:
+      return handle_set_logic_op;
+   case VK_CMD_SET_PATCH_CONTROL_POINTS_EXT:
+      return handle_set_patch_control_points;
+   case VK_CMD_SET_PRIMITIVE_RESTART_ENABLE:
+      return handle_set_primitive_restart_enable;
+   case VK_CMD_SET_RASTERIZER_DISCARD_ENABLE:
+      return handle_set_rasterizer_discard_enable;
+   case VK_CMD_SET_COLOR_WRITE_ENABLE_EXT:
+      return handle_set_color_write_enable;
+   case VK_CMD_BEGIN_RENDERING:
+      return handle_begin_rendering;
+   case VK_CMD_END_RENDERING:
+      return handle_end_rendering;
+   case VK_CMD_SET_DEVICE_MASK:
+      return handle_noop;
+   case VK_CMD_RESET_EVENT2:
+      return handle_event_reset2;
+   case VK_CMD_SET_EVENT2:
+      return handle_event_set2;
+   case VK_CMD_WAIT_EVENTS2:
+      return handle_wait_events2;
+   case VK_CMD_WRITE_TIMESTAMP2:
+      return handle_write_timestamp2;
+   case VK_CMD_SET_POLYGON_MODE_EXT:
+      return handle_set_polygon_mode;
+   case VK_CMD_SET_TESSELLATION_DOMAIN_ORIGIN_EXT:
+      return handle_set_tessellation_domain_origin;
+   case VK_CMD_SET_DEPTH_CLAMP_ENABLE_EXT:
+      return handle_set_depth_clamp_enable;
+   case VK_CMD_SET_DEPTH_CLIP_ENABLE_EXT:
+      return handle_set_depth_clip_enable;
+   case VK_CMD_SET_LOGIC_OP_ENABLE_EXT:
+      return handle_set_logic_op_enable;
+   case VK_CMD_SET_SAMPLE_MASK_EXT:
+      return handle_set_sample_mask;
+   case VK_CMD_SET_RASTERIZATION_SAMPLES_EXT:
+      return handle_set_samples;
+   case VK_CMD_SET_ALPHA_TO_COVERAGE_ENABLE_EXT:
+      return handle_set_alpha_to_coverage;
+   case VK_CMD_SET_ALPHA_TO_ONE_ENABLE_EXT:
+      return handle_set_alpha_to_one;
+   case VK_CMD_SET_DEPTH_CLIP_NEGATIVE_ONE_TO_ONE_EXT:
+      return handle_set_halfz;
+   case VK_CMD_SET_LINE_RASTERIZATION_MODE_EXT:
+      return handle_set_line_rasterization_mode;
+   case VK_CMD_SET_LINE_STIPPLE_ENABLE_EXT:
+      return handle_set_line_stipple_enable;
+   case VK_CMD_SET_PROVOKING_VERTEX_MODE_EXT:
+      return handle_set_provoking_vertex_mode;
+   case VK_CMD_SET_COLOR_BLEND_ENABLE_EXT:
+      return handle_set_color_blend_enable;
+   case VK_CMD_SET_COLOR_WRITE_MASK_EXT:
+      return handle_set_color_write_mask;
+   case VK_CMD_SET_COLOR_BLEND_EQUATION_EXT:
+      return handle_set_color_blend_equation;
+   case VK_CMD_BIND_SHADERS_EXT:
+      return handle_shaders;
+   case VK_CMD_SET_ATTACHMENT_FEEDBACK_LOOP_ENABLE_EXT:
+      return handle_noop;
+   case VK_CMD_DRAW_MESH_TASKS_EXT:
+      return exec_draw_mesh_tasks;
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
+      return exec_draw_mesh_tasks_indirect;
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
+      return exec_draw_mesh_tasks_indirect_count;
+   case VK_CMD_BIND_PIPELINE_SHADER_GROUP_NV:
+      return handle_graphics_pipeline_group;
+   case VK_CMD_PREPROCESS_GENERATED_COMMANDS_NV:
+      return handle_preprocess_generated_commands;
+   case VK_CMD_EXECUTE_GENERATED_COMMANDS_NV:
+      return exec_execute_generated_commands;
+   case VK_CMD_BIND_DESCRIPTOR_BUFFERS_EXT:
+      return handle_descriptor_buffers;
+   case VK_CMD_SET_DESCRIPTOR_BUFFER_OFFSETS2_EXT:
+      return handle_descriptor_buffer_offsets;
+   case VK_CMD_BIND_DESCRIPTOR_BUFFER_EMBEDDED_SAMPLERS2_EXT:
+      return handle_descriptor_buffer_embedded_samplers;
+#ifdef VK_ENABLE_BETA_EXTENSIONS
+   case VK_CMD_INITIALIZE_GRAPH_SCRATCH_MEMORY_AMDX:
+      return handle_noop;
+   case VK_CMD_DISPATCH_GRAPH_INDIRECT_COUNT_AMDX:
+      return handle_noop;
+   case VK_CMD_DISPATCH_GRAPH_INDIRECT_AMDX:
+      return handle_noop;
+   case VK_CMD_DISPATCH_GRAPH_AMDX:
+      return handle_dispatch_graph;
+#endif
+   default:
+      fprintf(stderr, "Unsupported command %s\n", vk_cmd_queue_type_names[type]);
+      unreachable("Unsupported command");
+      return handle_noop;
+   }
+}
+
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
                                    struct rendering_state *state, bool print_cmds)
 {
@@ -4435,365 +4881,363 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
    LIST_FOR_EACH_ENTRY(cmd, cmds, cmd_link) {
       if (print_cmds)
          fprintf(stderr, "%s\n", vk_cmd_queue_type_names[cmd->type]);
-      switch (cmd->type) {
-      case VK_CMD_BIND_PIPELINE:
-         handle_pipeline(cmd, state);
-         break;
-      case VK_CMD_SET_VIEWPORT:
-         handle_set_viewport(cmd, state);
-         break;
-      case VK_CMD_SET_VIEWPORT_WITH_COUNT:
-         handle_set_viewport_with_count(cmd, state);
-         break;
-      case VK_CMD_SET_SCISSOR:
-         handle_set_scissor(cmd, state);
-         break;
-      case VK_CMD_SET_SCISSOR_WITH_COUNT:
-         handle_set_scissor_with_count(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_WIDTH:
-         handle_set_line_width(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BIAS:
-         handle_set_depth_bias(cmd, state);
-         break;
-      case VK_CMD_SET_BLEND_CONSTANTS:
-         handle_set_blend_constants(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BOUNDS:
-         handle_set_depth_bounds(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_COMPARE_MASK:
-         handle_set_stencil_compare_mask(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_WRITE_MASK:
-         handle_set_stencil_write_mask(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_REFERENCE:
-         handle_set_stencil_reference(cmd, state);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_SETS2_KHR:
-         handle_descriptor_sets_cmd(cmd, state);
-         break;
-      case VK_CMD_BIND_INDEX_BUFFER:
-         handle_index_buffer(cmd, state);
-         break;
-      case VK_CMD_BIND_INDEX_BUFFER2_KHR:
-         handle_index_buffer2(cmd, state);
-         break;
-      case VK_CMD_BIND_VERTEX_BUFFERS2:
-         handle_vertex_buffers2(cmd, state);
-         break;
-      case VK_CMD_DRAW:
-         emit_state(state);
-         handle_draw(cmd, state);
-         break;
-      case VK_CMD_DRAW_MULTI_EXT:
-         emit_state(state);
-         handle_draw_multi(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDEXED:
-         emit_state(state);
-         handle_draw_indexed(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDIRECT:
-         emit_state(state);
-         handle_draw_indirect(cmd, state, false);
-         break;
-      case VK_CMD_DRAW_INDEXED_INDIRECT:
-         emit_state(state);
-         handle_draw_indirect(cmd, state, true);
-         break;
-      case VK_CMD_DRAW_MULTI_INDEXED_EXT:
-         emit_state(state);
-         handle_draw_multi_indexed(cmd, state);
-         break;
-      case VK_CMD_DISPATCH:
-         emit_compute_state(state);
-         handle_dispatch(cmd, state);
-         break;
-      case VK_CMD_DISPATCH_BASE:
-         emit_compute_state(state);
-         handle_dispatch_base(cmd, state);
-         break;
-      case VK_CMD_DISPATCH_INDIRECT:
-         emit_compute_state(state);
-         handle_dispatch_indirect(cmd, state);
-         break;
-      case VK_CMD_COPY_BUFFER2:
-         handle_copy_buffer(cmd, state);
-         break;
-      case VK_CMD_COPY_IMAGE2:
-         handle_copy_image(cmd, state);
-         break;
-      case VK_CMD_BLIT_IMAGE2:
-         handle_blit_image(cmd, state);
-         break;
-      case VK_CMD_COPY_BUFFER_TO_IMAGE2:
-         handle_copy_buffer_to_image(cmd, state);
-         break;
-      case VK_CMD_COPY_IMAGE_TO_BUFFER2:
-         handle_copy_image_to_buffer2(cmd, state);
-         break;
-      case VK_CMD_UPDATE_BUFFER:
-         handle_update_buffer(cmd, state);
-         break;
-      case VK_CMD_FILL_BUFFER:
-         handle_fill_buffer(cmd, state);
-         break;
-      case VK_CMD_CLEAR_COLOR_IMAGE:
-         handle_clear_color_image(cmd, state);
-         break;
-      case VK_CMD_CLEAR_DEPTH_STENCIL_IMAGE:
-         handle_clear_ds_image(cmd, state);
-         break;
-      case VK_CMD_CLEAR_ATTACHMENTS:
-         handle_clear_attachments(cmd, state);
-         break;
-      case VK_CMD_RESOLVE_IMAGE2:
-         handle_resolve_image(cmd, state);
-         break;
-      case VK_CMD_PIPELINE_BARRIER2:
+      if (cmd->type == VK_CMD_PIPELINE_BARRIER2) {
          /* flushes are actually stalls, so multiple flushes are redundant */
          if (did_flush)
             continue;
          handle_pipeline_barrier(cmd, state);
          did_flush = true;
          continue;
-      case VK_CMD_BEGIN_QUERY_INDEXED_EXT:
-         handle_begin_query_indexed_ext(cmd, state);
-         break;
-      case VK_CMD_END_QUERY_INDEXED_EXT:
-         handle_end_query_indexed_ext(cmd, state);
-         break;
-      case VK_CMD_BEGIN_QUERY:
-         handle_begin_query(cmd, state);
-         break;
-      case VK_CMD_END_QUERY:
-         handle_end_query(cmd, state);
-         break;
-      case VK_CMD_RESET_QUERY_POOL:
-         handle_reset_query_pool(cmd, state);
-         break;
-      case VK_CMD_COPY_QUERY_POOL_RESULTS:
-         handle_copy_query_pool_results(cmd, state);
-         break;
-      case VK_CMD_PUSH_CONSTANTS2_KHR:
-         handle_push_constants(cmd, state);
-         break;
-      case VK_CMD_EXECUTE_COMMANDS:
-         handle_execute_commands(cmd, state, print_cmds);
-         break;
-      case VK_CMD_DRAW_INDIRECT_COUNT:
-         emit_state(state);
-         handle_draw_indirect_count(cmd, state, false);
-         break;
-      case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
-         emit_state(state);
-         handle_draw_indirect_count(cmd, state, true);
-         break;
-      case VK_CMD_PUSH_DESCRIPTOR_SET2_KHR:
-         handle_push_descriptor_set(cmd, state);
-         break;
-      case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2_KHR:
-         handle_push_descriptor_set_with_template(cmd, state);
-         break;
-      case VK_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS_EXT:
-         handle_bind_transform_feedback_buffers(cmd, state);
-         break;
-      case VK_CMD_BEGIN_TRANSFORM_FEEDBACK_EXT:
-         handle_begin_transform_feedback(cmd, state);
-         break;
-      case VK_CMD_END_TRANSFORM_FEEDBACK_EXT:
-         handle_end_transform_feedback(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDIRECT_BYTE_COUNT_EXT:
-         emit_state(state);
-         handle_draw_indirect_byte_count(cmd, state);
-         break;
-      case VK_CMD_BEGIN_CONDITIONAL_RENDERING_EXT:
-         handle_begin_conditional_rendering(cmd, state);
-         break;
-      case VK_CMD_END_CONDITIONAL_RENDERING_EXT:
-         handle_end_conditional_rendering(state);
-         break;
-      case VK_CMD_SET_VERTEX_INPUT_EXT:
-         handle_set_vertex_input(cmd, state);
-         break;
-      case VK_CMD_SET_CULL_MODE:
-         handle_set_cull_mode(cmd, state);
-         break;
-      case VK_CMD_SET_FRONT_FACE:
-         handle_set_front_face(cmd, state);
-         break;
-      case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
-         handle_set_primitive_topology(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_TEST_ENABLE:
-         handle_set_depth_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_WRITE_ENABLE:
-         handle_set_depth_write_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_COMPARE_OP:
-         handle_set_depth_compare_op(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
-         handle_set_depth_bounds_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_TEST_ENABLE:
-         handle_set_stencil_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_OP:
-         handle_set_stencil_op(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_STIPPLE_EXT:
-         handle_set_line_stipple(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BIAS_ENABLE:
-         handle_set_depth_bias_enable(cmd, state);
-         break;
-      case VK_CMD_SET_LOGIC_OP_EXT:
-         handle_set_logic_op(cmd, state);
-         break;
-      case VK_CMD_SET_PATCH_CONTROL_POINTS_EXT:
-         handle_set_patch_control_points(cmd, state);
-         break;
-      case VK_CMD_SET_PRIMITIVE_RESTART_ENABLE:
-         handle_set_primitive_restart_enable(cmd, state);
-         break;
-      case VK_CMD_SET_RASTERIZER_DISCARD_ENABLE:
-         handle_set_rasterizer_discard_enable(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_WRITE_ENABLE_EXT:
-         handle_set_color_write_enable(cmd, state);
-         break;
-      case VK_CMD_BEGIN_RENDERING:
-         handle_begin_rendering(cmd, state);
-         break;
-      case VK_CMD_END_RENDERING:
-         handle_end_rendering(cmd, state);
-         break;
-      case VK_CMD_SET_DEVICE_MASK:
-         /* no-op */
-         break;
-      case VK_CMD_RESET_EVENT2:
-         handle_event_reset2(cmd, state);
-         break;
-      case VK_CMD_SET_EVENT2:
-         handle_event_set2(cmd, state);
-         break;
-      case VK_CMD_WAIT_EVENTS2:
-         handle_wait_events2(cmd, state);
-         break;
-      case VK_CMD_WRITE_TIMESTAMP2:
-         handle_write_timestamp2(cmd, state);
-         break;
-      case VK_CMD_SET_POLYGON_MODE_EXT:
-         handle_set_polygon_mode(cmd, state);
-         break;
-      case VK_CMD_SET_TESSELLATION_DOMAIN_ORIGIN_EXT:
-         handle_set_tessellation_domain_origin(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLAMP_ENABLE_EXT:
-         handle_set_depth_clamp_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLIP_ENABLE_EXT:
-         handle_set_depth_clip_enable(cmd, state);
-         break;
-      case VK_CMD_SET_LOGIC_OP_ENABLE_EXT:
-         handle_set_logic_op_enable(cmd, state);
-         break;
-      case VK_CMD_SET_SAMPLE_MASK_EXT:
-         handle_set_sample_mask(cmd, state);
-         break;
-      case VK_CMD_SET_RASTERIZATION_SAMPLES_EXT:
-         handle_set_samples(cmd, state);
-         break;
-      case VK_CMD_SET_ALPHA_TO_COVERAGE_ENABLE_EXT:
-         handle_set_alpha_to_coverage(cmd, state);
-         break;
-      case VK_CMD_SET_ALPHA_TO_ONE_ENABLE_EXT:
-         handle_set_alpha_to_one(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLIP_NEGATIVE_ONE_TO_ONE_EXT:
-         handle_set_halfz(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_RASTERIZATION_MODE_EXT:
-         handle_set_line_rasterization_mode(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_STIPPLE_ENABLE_EXT:
-         handle_set_line_stipple_enable(cmd, state);
-         break;
-      case VK_CMD_SET_PROVOKING_VERTEX_MODE_EXT:
-         handle_set_provoking_vertex_mode(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_BLEND_ENABLE_EXT:
-         handle_set_color_blend_enable(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_WRITE_MASK_EXT:
-         handle_set_color_write_mask(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_BLEND_EQUATION_EXT:
-         handle_set_color_blend_equation(cmd, state);
-         break;
-      case VK_CMD_BIND_SHADERS_EXT:
-         handle_shaders(cmd, state);
-         break;
-      case VK_CMD_SET_ATTACHMENT_FEEDBACK_LOOP_ENABLE_EXT:
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks(cmd, state);
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks_indirect(cmd, state);
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks_indirect_count(cmd, state);
-         break;
-      case VK_CMD_BIND_PIPELINE_SHADER_GROUP_NV:
-         handle_graphics_pipeline_group(cmd, state);
-         break;
-      case VK_CMD_PREPROCESS_GENERATED_COMMANDS_NV:
-         handle_preprocess_generated_commands(cmd, state);
-         break;
-      case VK_CMD_EXECUTE_GENERATED_COMMANDS_NV:
-         handle_execute_generated_commands(cmd, state, print_cmds);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_BUFFERS_EXT:
-         handle_descriptor_buffers(cmd, state);
-         break;
-      case VK_CMD_SET_DESCRIPTOR_BUFFER_OFFSETS2_EXT:
-         handle_descriptor_buffer_offsets(cmd, state);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_BUFFER_EMBEDDED_SAMPLERS2_EXT:
-         handle_descriptor_buffer_embedded_samplers(cmd, state);
-         break;
-#ifdef VK_ENABLE_BETA_EXTENSIONS
-      case VK_CMD_INITIALIZE_GRAPH_SCRATCH_MEMORY_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_INDIRECT_COUNT_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_INDIRECT_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_AMDX:
-         handle_dispatch_graph(cmd, state);
-         break;
-#endif
-      default:
-         fprintf(stderr, "Unsupported command %s\n", vk_cmd_queue_type_names[cmd->type]);
-         unreachable("Unsupported command");
-         break;
       }
+      get_cmd_handler(cmd->type)(cmd, state);
       did_flush = false;
       if (!cmd->cmd_link.next)
          break;
    }
 }
 
+static void
+exec_cmd(const struct lvp_cmd_packet *packet, struct rendering_state *state)
+{
+   packet->handle(packet->cmd, state);
+}
+
+static inline const void *
+packet_data(const struct rendering_state *state, uint32_t offset)
+{
+   return state->packet_data + offset;
+}
+
+static void
+exec_draw_packet(const struct lvp_cmd_packet *packet, struct rendering_state *state)
+{
+   const struct lvp_draw_packet *draw = &packet->draw;
+
+   emit_state(state);
+
+   state->info.index_size = draw->index_size;
+   if (draw->index_size) {
+      state->info.index_bounds_valid = false;
+      state->info.min_index = 0;
+      state->info.max_index = ~0U;
+      state->info.index.resource = state->index_buffer;
+      if (state->info.primitive_restart)
+         state->info.restart_index = util_prim_restart_index_from_size(draw->index_size);
+      state->info.index_bias_varies = draw->index_bias_varies;
+   } else {
+      state->info.index.resource = NULL;
+   }
+   state->info.start_instance = draw->start_instance;
+   state->info.instance_count = draw->instance_count;
+   if (draw->draw_count > 1)
+      state->info.increment_draw_id = true;
+
+   if (draw->draw_count)
+      state->pctx->draw_vbo(state->pctx, &state->info, 0, NULL,
+                            packet_data(state, draw->draws), draw->draw_count);
+}
+
+static void
+exec_viewport_packet(const struct lvp_cmd_packet *packet, struct rendering_state *state)
+{
+   const struct lvp_viewport_packet *vp = &packet->viewport;
+   const struct lvp_viewport *viewports = packet_data(state, vp->viewports);
+   unsigned base = 0;
+
+   if (vp->first == UINT32_MAX)
+      state->num_viewports = vp->count;
+   else
+      base = vp->first;
+
+   for (unsigned i = 0; i < vp->count; i++) {
+      unsigned idx = i + base;
+      memcpy(state->viewports[idx].scale, viewports[i].scale, sizeof(float) * 2);
+      memcpy(state->viewports[idx].translate, viewports[i].translate, sizeof(float) * 2);
+      state->depth[idx].min = viewports[i].min_depth;
+      state->depth[idx].max = viewports[i].max_depth;
+      set_viewport_depth_xform(state, idx);
+   }
+   state->vp_dirty = true;
+}
+
+static void
+exec_scissor_packet(const struct lvp_cmd_packet *packet, struct rendering_state *state)
+{
+   const struct lvp_scissor_packet *sc = &packet->scissor;
+   unsigned base = 0;
+
+   if (sc->first == UINT32_MAX)
+      state->num_scissors = sc->count;
+   else
+      base = sc->first;
+
+   memcpy(&state->scissors[base], packet_data(state, sc->scissors),
+          sc->count * sizeof(struct pipe_scissor_state));
+   state->scissor_dirty = true;
+}
+
+/* Allocates size bytes of 8-byte aligned packet data, returns false on
+ * allocation failure.
+ */
+static bool
+alloc_packet_data(struct lvp_cmd_buffer *cmd_buffer, size_t size,
+                  uint32_t *offset, void **ptr)
+{
+   struct util_dynarray *data = &cmd_buffer->packet_data;
+   unsigned start = align(data->size, 8);
+
+   *offset = start;
+   *ptr = NULL;
+   if (!size)
+      return true;
+
+   if (!util_dynarray_grow_bytes(data, start - data->size + size, 1))
+      return false;
+
+   *ptr = (uint8_t *)data->data + start;
+   return true;
+}
+
+static bool
+compile_draw(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_packet *packet,
+             uint32_t draw_count, uint32_t start_instance, uint32_t instance_count,
+             struct pipe_draw_start_count_bias **draws)
+{
+   packet->execute = exec_draw_packet;
+   packet->draw = (struct lvp_draw_packet) {
+      .start_instance = start_instance,
+      .instance_count = instance_count,
+      .draw_count = draw_count,
+   };
+
+   return alloc_packet_data(cmd_buffer, draw_count * sizeof(**draws),
+                            &packet->draw.draws, (void **)draws);
+}
+
+/* Same results as handle_draw_indexed() and handle_draw_multi_indexed() with
+ * the index buffer binding given.
+ */
+static bool
+compile_draw_indexed(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_packet *packet,
+                     const struct lvp_index_binding *ib)
+{
+   struct vk_cmd_queue_entry *cmd = packet->cmd;
+   struct pipe_draw_start_count_bias *draws;
+
+   if (cmd->type == VK_CMD_DRAW_INDEXED) {
+      if (!compile_draw(cmd_buffer, packet, 1,
+                        cmd->u.draw_indexed.first_instance,
+                        cmd->u.draw_indexed.instance_count, &draws))
+         return false;
+
+      draws[0].count = MIN2(cmd->u.draw_indexed.index_count, ib->buffer_size / ib->size);
+      draws[0].index_bias = cmd->u.draw_indexed.vertex_offset;
+      draws[0].start = util_clamped_uadd(ib->offset / ib->size,
+                                         cmd->u.draw_indexed.first_index);
+      packet->draw.index_bias_varies = !cmd->u.draw_indexed.vertex_offset;
+   } else {
+      const struct vk_cmd_draw_multi_indexed_ext *multi = &cmd->u.draw_multi_indexed_ext;
+
+      if (!compile_draw(cmd_buffer, packet, multi->draw_count,
+                        multi->first_instance, multi->instance_count, &draws))
+         return false;
+
+      memcpy(draws, multi->index_info, multi->draw_count * sizeof(*draws));
+      if (ib->buffer_size != UINT32_MAX) {
+         for (unsigned i = 0; i < multi->draw_count; i++)
+            draws[i].count = MIN2(draws[i].count, ib->buffer_size / ib->size - draws[i].start);
+      }
+
+      /* only the first member is read if index_bias_varies is true */
+      if (multi->draw_count && multi->vertex_offset)
+         draws[0].index_bias = *multi->vertex_offset;
+
+      for (unsigned i = 0; i < multi->draw_count; i++)
+         draws[i].start = util_clamped_uadd(ib->offset / ib->size, draws[i].start);
+
+      packet->draw.index_bias_varies = !multi->vertex_offset;
+   }
+
+   packet->draw.index_size = ib->size;
+   return true;
+}
+
+static bool
+compile_viewports(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_packet *packet,
+                  uint32_t first, uint32_t count, const VkViewport *viewports)
+{
+   packet->execute = exec_viewport_packet;
+   packet->viewport.first = first;
+   packet->viewport.count = count;
+
+   struct lvp_viewport *vp;
+   if (!alloc_packet_data(cmd_buffer, count * sizeof(*vp),
+                          &packet->viewport.viewports, (void **)&vp))
+      return false;
+
+   for (unsigned i = 0; i < count; i++) {
+      float half_width = 0.5f * viewports[i].width;
+      float half_height = 0.5f * viewports[i].height;
+
+      vp[i].scale[0] = half_width;
+      vp[i].translate[0] = half_width + viewports[i].x;
+      vp[i].scale[1] = half_height;
+      vp[i].translate[1] = half_height + viewports[i].y;
+      vp[i].min_depth = viewports[i].minDepth;
+      vp[i].max_depth = viewports[i].maxDepth;
+   }
+   return true;
+}
+
+static bool
+compile_scissors(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_packet *packet,
+                 uint32_t first, uint32_t count, const VkRect2D *scissors)
+{
+   packet->execute = exec_scissor_packet;
+   packet->scissor.first = first;
+   packet->scissor.count = count;
+
+   struct pipe_scissor_state *sc;
+   if (!alloc_packet_data(cmd_buffer, count * sizeof(*sc),
+                          &packet->scissor.scissors, (void **)&sc))
+      return false;
+
+   for (unsigned i = 0; i < count; i++) {
+      sc[i].minx = scissors[i].offset.x;
+      sc[i].miny = scissors[i].offset.y;
+      sc[i].maxx = scissors[i].offset.x + scissors[i].extent.width;
+      sc[i].maxy = scissors[i].offset.y + scissors[i].extent.height;
+   }
+   return true;
+}
+
+/* Fills in the packet for cmd, returns false on allocation failure. */
+static bool
+compile_cmd(struct lvp_cmd_buffer *cmd_buffer, struct lvp_cmd_packet *packet,
+            struct vk_cmd_queue_entry *cmd, struct lvp_index_binding *ib)
+{
+   struct pipe_draw_start_count_bias *draws;
+
+   packet->cmd = cmd;
+
+   switch (cmd->type) {
+   case VK_CMD_DRAW:
+      if (!compile_draw(cmd_buffer, packet, 1, cmd->u.draw.first_instance,
+                        cmd->u.draw.instance_count, &draws))
+         return false;
+      draws[0].start = cmd->u.draw.first_vertex;
+      draws[0].count = cmd->u.draw.vertex_count;
+      draws[0].index_bias = 0;
+      return true;
+   case VK_CMD_DRAW_MULTI_EXT:
+      if (!compile_draw(cmd_buffer, packet, cmd->u.draw_multi_ext.draw_count,
+                        cmd->u.draw_multi_ext.first_instance,
+                        cmd->u.draw_multi_ext.instance_count, &draws))
+         return false;
+      for (unsigned i = 0; i < cmd->u.draw_multi_ext.draw_count; i++) {
+         draws[i].start = cmd->u.draw_multi_ext.vertex_info[i].firstVertex;
+         draws[i].count = cmd->u.draw_multi_ext.vertex_info[i].vertexCount;
+         draws[i].index_bias = 0;
+      }
+      return true;
+   case VK_CMD_DRAW_INDEXED:
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+      if (ib->known)
+         return compile_draw_indexed(cmd_buffer, packet, ib);
+      break;
+   case VK_CMD_SET_VIEWPORT:
+      return compile_viewports(cmd_buffer, packet,
+                               cmd->u.set_viewport.first_viewport,
+                               cmd->u.set_viewport.viewport_count,
+                               cmd->u.set_viewport.viewports);
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      return compile_viewports(cmd_buffer, packet, UINT32_MAX,
+                               cmd->u.set_viewport_with_count.viewport_count,
+                               cmd->u.set_viewport_with_count.viewports);
+   case VK_CMD_SET_SCISSOR:
+      return compile_scissors(cmd_buffer, packet,
+                              cmd->u.set_scissor.first_scissor,
+                              cmd->u.set_scissor.scissor_count,
+                              cmd->u.set_scissor.scissors);
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      return compile_scissors(cmd_buffer, packet, UINT32_MAX,
+                              cmd->u.set_scissor_with_count.scissor_count,
+                              cmd->u.set_scissor_with_count.scissors);
+   case VK_CMD_BIND_INDEX_BUFFER:
+      ib->size = vk_index_type_to_bytes(cmd->u.bind_index_buffer.index_type);
+      ib->buffer_size = UINT32_MAX;
+      ib->offset = cmd->u.bind_index_buffer.buffer ? cmd->u.bind_index_buffer.offset : 0;
+      ib->known = ib->size != 0;
+      break;
+   case VK_CMD_BIND_INDEX_BUFFER2_KHR:
+      if (cmd->u.bind_index_buffer2_khr.buffer) {
+         ib->size = vk_index_type_to_bytes(cmd->u.bind_index_buffer2_khr.index_type);
+         ib->buffer_size = cmd->u.bind_index_buffer2_khr.size;
+         ib->offset = cmd->u.bind_index_buffer2_khr.offset;
+      } else {
+         ib->size = 4;
+         ib->buffer_size = sizeof(uint32_t);
+         ib->offset = 0;
+      }
+      ib->known = ib->size != 0;
+      break;
+   case VK_CMD_EXECUTE_COMMANDS:
+   case VK_CMD_EXECUTE_GENERATED_COMMANDS_NV:
+      /* these may bind other index buffers */
+      ib->known = false;
+      break;
+   default:
+      break;
+   }
+
+   packet->execute = exec_cmd;
+   packet->handle = get_cmd_handler(cmd->type);
+   return true;
+}
+
+void
+lvp_cmd_buffer_compile(struct lvp_cmd_buffer *cmd_buffer)
+{
+   /* secondaries run with whatever the primary has bound */
+   struct lvp_index_binding ib = {
+      .known = cmd_buffer->vk.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .size = 4,
+      .buffer_size = sizeof(uint32_t),
+   };
+   bool did_flush = false;
+
+   util_dynarray_clear(&cmd_buffer->packets);
+   util_dynarray_clear(&cmd_buffer->packet_data);
+   list_for_each_entry(struct vk_cmd_queue_entry, cmd, &cmd_buffer->vk.cmd_queue.cmds, cmd_link) {
+      /* flushes are actually stalls, so multiple flushes are redundant */
+      if (cmd->type == VK_CMD_PIPELINE_BARRIER2 && did_flush)
+         continue;
+      did_flush = cmd->type == VK_CMD_PIPELINE_BARRIER2;
+
+      struct lvp_cmd_packet *packet =
+         util_dynarray_grow(&cmd_buffer->packets, struct lvp_cmd_packet, 1);
+      if (!packet || !compile_cmd(cmd_buffer, packet, cmd, &ib)) {
+         vk_command_buffer_set_error(&cmd_buffer->vk, VK_ERROR_OUT_OF_HOST_MEMORY);
+         return;
+      }
+   }
+}
+
+static void
+lvp_execute_packets(struct lvp_cmd_buffer *cmd_buffer,
+                    struct rendering_state *state)
+{
+   const uint8_t *packet_data = state->packet_data;
+
+   state->packet_data = cmd_buffer->packet_data.data;
+   util_dynarray_foreach(&cmd_buffer->packets, struct lvp_cmd_packet, packet) {
+      if (state->print_cmds)
+         fprintf(stderr, "%s\n", vk_cmd_queue_type_names[packet->cmd->type]);
+      packet->execute(packet, state);
+   }
+   state->packet_data = packet_data;
+}
+
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer)
@@ -4802,6 +5246,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    memset(state, 0, sizeof(*state));
    state->pctx = queue->ctx;
    state->device = device;
+   state->queue = queue;
    state->uploader = queue->uploader;
    state->cso = queue->cso;
    state->blend_dirty = true;
@@ -4814,6 +5259,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    state->min_samples_dirty = true;
    state->sample_mask = UINT32_MAX;
    state->poison_mem = device->poison_mem;
+   state->print_cmds = device->print_cmds;
    util_dynarray_init(&state->push_desc_sets, NULL);
 
    /* default values */
@@ -4836,7 +5282,7 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    state->index_buffer = state->device->zero_buffer;
 
    /* create a gallium context */
-   lvp_execute_cmd_buffer(&cmd_buffer->vk.cmd_queue.cmds, state, device->print_cmds);
+   lvp_execute_packets(cmd_buffer, state);
 
    state->start_vb = -1;
    state->num_vb = 0;
@@ -42,37 +42,56 @@
 
 typedef void (*cso_destroy_func)(struct pipe_context*, void*);
 
+static void
+delete_shader_state(struct pipe_context *ctx, gl_shader_stage stage, void *cso)
+{
+   cso_destroy_func destroy[] = {
+      ctx->delete_vs_state,
+      ctx->delete_tcs_state,
+      ctx->delete_tes_state,
+      ctx->delete_gs_state,
+      ctx->delete_fs_state,
+      ctx->delete_compute_state,
+      ctx->delete_ts_state,
+      ctx->delete_ms_state,
+   };
+
+   destroy[stage](ctx, cso);
+}
+
 static void
 shader_destroy(struct lvp_device *device, struct lvp_shader *shader, bool locked)
 {
    if (!shader->pipeline_nir)
       return;
    gl_shader_stage stage = shader->pipeline_nir->nir->info.stage;
-   cso_destroy_func destroy[] = {
-      device->queue.ctx->delete_vs_state,
-      device->queue.ctx->delete_tcs_state,
-      device->queue.ctx->delete_tes_state,
-      device->queue.ctx->delete_gs_state,
-      device->queue.ctx->delete_fs_state,
-      device->queue.ctx->delete_compute_state,
-      device->queue.ctx->delete_ts_state,
-      device->queue.ctx->delete_ms_state,
-   };
+
+   /* the other queues delete their copies the next time they run */
+   for (uint32_t i = 1; i < device->queue_count; i++) {
+      struct lvp_queue *queue = device->queues[i];
+      simple_mtx_lock(&queue->shader_lock);
+      struct hash_entry *he = _mesa_hash_table_search(&queue->shader_csos, shader);
+      if (he) {
+         util_dynarray_append(&queue->shader_garbage, struct lvp_queue_shader *, he->data);
+         _mesa_hash_table_remove(&queue->shader_csos, he);
+      }
+      simple_mtx_unlock(&queue->shader_lock);
+   }
 
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
    set_foreach(&shader->inlines.variants, entry) {
       struct lvp_inline_variant *variant = (void*)entry->key;
-      destroy[stage](device->queue.ctx, variant->cso);
+      delete_shader_state(device->queue.ctx, stage, variant->cso);
       free(variant);
    }
    ralloc_free(shader->inlines.variants.table);
 
    if (shader->shader_cso)
-      destroy[stage](device->queue.ctx, shader->shader_cso);
+      delete_shader_state(device->queue.ctx, stage, shader->shader_cso);
    if (shader->tess_ccw_cso)
-      destroy[stage](device->queue.ctx, shader->tess_ccw_cso);
+      delete_shader_state(device->queue.ctx, stage, shader->tess_ccw_cso);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -216,49 +235,51 @@ static void
 optimize(nir_shader *nir)
 {
    bool progress = false;
+   struct set *skip = _mesa_pointer_set_create(NULL);
    do {
       progress = false;
 
-      NIR_PASS(progress, nir, nir_lower_flrp, 32|64, true);
-      NIR_PASS(progress, nir, nir_split_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_flrp, 32|64, true);
+      NIR_LOOP_PASS(progress, skip, nir, nir_split_array_vars, nir_var_function_temp);
+      NIR_LOOP_PASS(progress, skip, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_vars_to_ssa);
 
-      NIR_PASS(progress, nir, nir_opt_copy_prop_vars);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_copy_prop_vars);
 
-      NIR_PASS(progress, nir, nir_copy_prop);
-      NIR_PASS(progress, nir, nir_opt_dce);
-      NIR_PASS(progress, nir, nir_opt_peephole_select, 8, true, true);
+      NIR_LOOP_PASS(progress, skip, nir, nir_copy_prop);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_dce);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_peephole_select, 8, true, true);
 
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_algebraic);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_constant_folding);
 
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
       bool loop = false;
-      NIR_PASS(loop, nir, nir_opt_loop);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(loop, skip, nir, nir_opt_loop);
       progress |= loop;
       if (loop) {
          /* If nir_opt_loop makes progress, then we need to clean
           * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
           * to make progress.
           */
-         NIR_PASS(progress, nir, nir_copy_prop);
-         NIR_PASS(progress, nir, nir_opt_dce);
-         NIR_PASS(progress, nir, nir_opt_remove_phis);
+         NIR_LOOP_PASS(progress, skip, nir, nir_copy_prop);
+         NIR_LOOP_PASS(progress, skip, nir, nir_opt_dce);
+         NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
       }
-      NIR_PASS(progress, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
-      NIR_PASS(progress, nir, nir_opt_dead_cf);
-      NIR_PASS(progress, nir, nir_opt_conditional_discard);
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
-      NIR_PASS(progress, nir, nir_opt_cse);
-      NIR_PASS(progress, nir, nir_opt_undef);
-
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_alu_to_scalar, NULL, NULL);
-      NIR_PASS(progress, nir, nir_opt_loop_unroll);
-      NIR_PASS(progress, nir, lvp_nir_fixup_indirect_tex);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_dead_cf);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_conditional_discard);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_remove_phis);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_cse);
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_undef);
+
+      NIR_LOOP_PASS(progress, skip, nir, nir_opt_deref);
+      NIR_LOOP_PASS(progress, skip, nir, nir_lower_alu_to_scalar, NULL, NULL);
+      NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, nir_opt_loop_unroll);
+      NIR_LOOP_PASS(progress, skip, nir, lvp_nir_fixup_indirect_tex);
    } while (progress);
+   _mesa_set_destroy(skip, NULL);
 }
 
 void
@@ -509,19 +530,32 @@ lvp_shader_init(struct lvp_shader *shader, nir_shader *nir)
 
 static VkResult
 lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline,
+                         struct vk_pipeline_cache *cache,
                          const VkPipelineShaderStageCreateInfo *sinfo)
 {
    struct lvp_device *pdevice = pipeline->device;
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= LVP_SHADER_STAGES && stage != MESA_SHADER_NONE);
    struct lvp_shader *shader = &pipeline->shaders[stage];
-   nir_shader *nir;
-   VkResult result = compile_spirv(pdevice, sinfo, &nir);
-   if (result == VK_SUCCESS) {
+   unsigned char key[SHA1_DIGEST_LENGTH];
+
+   lvp_pipeline_cache_shader_key(sinfo, pipeline->layout, key);
+
+   nir_shader *nir = vk_pipeline_cache_lookup_nir(cache, key, sizeof(key),
+                                                  pdevice->physical_device->drv_options[stage],
+                                                  NULL, NULL);
+   if (!nir) {
+      VkResult result = compile_spirv(pdevice, sinfo, &nir);
+      if (result != VK_SUCCESS)
+         return result;
       lvp_shader_lower(pdevice, pipeline, nir, pipeline->layout);
-      lvp_shader_init(shader, nir);
+
+      /* exec graph lowering stores the next node in the pipeline */
+      if (!pipeline->exec_graph.next_name)
+         vk_pipeline_cache_add_nir(cache, key, sizeof(key), nir);
    }
-   return result;
+   lvp_shader_init(shader, nir);
+   return VK_SUCCESS;
 }
 
 static void
@@ -610,14 +644,14 @@ lvp_pipeline_xfb_init(struct lvp_pipeline *pipeline)
 }
 
 static void *
-lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir)
+lvp_shader_compile_stage(struct pipe_context *ctx, struct lvp_shader *shader, nir_shader *nir)
 {
    if (nir->info.stage == MESA_SHADER_COMPUTE) {
       struct pipe_compute_state shstate = {0};
       shstate.prog = nir;
       shstate.ir_type = PIPE_SHADER_IR_NIR;
       shstate.static_shared_mem = nir->info.shared_size;
-      return device->queue.ctx->create_compute_state(device->queue.ctx, &shstate);
+      return ctx->create_compute_state(ctx, &shstate);
    } else {
       struct pipe_shader_state shstate = {0};
       shstate.type = PIPE_SHADER_IR_NIR;
@@ -626,19 +660,19 @@ lvp_shader_compile_stage(struct lvp_device *device, struct lvp_shader *shader, n
 
       switch (nir->info.stage) {
       case MESA_SHADER_FRAGMENT:
-         return device->queue.ctx->create_fs_state(device->queue.ctx, &shstate);
+         return ctx->create_fs_state(ctx, &shstate);
       case MESA_SHADER_VERTEX:
-         return device->queue.ctx->create_vs_state(device->queue.ctx, &shstate);
+         return ctx->create_vs_state(ctx, &shstate);
       case MESA_SHADER_GEOMETRY:
-         return device->queue.ctx->create_gs_state(device->queue.ctx, &shstate);
+         return ctx->create_gs_state(ctx, &shstate);
       case MESA_SHADER_TESS_CTRL:
-         return device->queue.ctx->create_tcs_state(device->queue.ctx, &shstate);
+         return ctx->create_tcs_state(ctx, &shstate);
       case MESA_SHADER_TESS_EVAL:
-         return device->queue.ctx->create_tes_state(device->queue.ctx, &shstate);
+         return ctx->create_tes_state(ctx, &shstate);
       case MESA_SHADER_TASK:
-         return device->queue.ctx->create_ts_state(device->queue.ctx, &shstate);
+         return ctx->create_ts_state(ctx, &shstate);
       case MESA_SHADER_MESH:
-         return device->queue.ctx->create_ms_state(device->queue.ctx, &shstate);
+         return ctx->create_ms_state(ctx, &shstate);
       default:
          unreachable("illegal shader");
          break;
@@ -655,7 +689,7 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    if (!locked)
       simple_mtx_lock(&device->queue.lock);
 
-   void *state = lvp_shader_compile_stage(device, shader, nir);
+   void *state = lvp_shader_compile_stage(device->queue.ctx, shader, nir);
 
    if (!locked)
       simple_mtx_unlock(&device->queue.lock);
@@ -663,6 +697,70 @@ lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_sha
    return state;
 }
 
+static void *
+lvp_queue_compile_shader(struct lvp_queue *queue, struct lvp_shader *shader, nir_shader *nir)
+{
+   struct pipe_screen *pscreen = queue->device->physical_device->pscreen;
+   nir = nir_shader_clone(NULL, nir);
+   pscreen->finalize_nir(pscreen, nir);
+   return lvp_shader_compile_stage(queue->ctx, shader, nir);
+}
+
+/* Returns the calling queue's own CSOs for a shader, compiling them on first
+ * use. Must be called with queue->lock held, from a queue other than the
+ * device's first one; these never inline uniforms.
+ */
+struct lvp_queue_shader *
+lvp_queue_get_shader(struct lvp_queue *queue, struct lvp_shader *shader)
+{
+   struct lvp_device *device = queue->device;
+
+   assert(!lvp_queue_is_primary(queue));
+
+   simple_mtx_lock(&queue->shader_lock);
+   struct hash_entry *he = _mesa_hash_table_search(&queue->shader_csos, shader);
+   struct lvp_queue_shader *qshader = he ? he->data : NULL;
+   simple_mtx_unlock(&queue->shader_lock);
+   if (qshader)
+      return qshader;
+
+   /* texture handles are created on the first queue's context, and llvmpipe
+    * only compiles their sample functions for shaders that context has seen
+    */
+   simple_mtx_lock(&device->queue.lock);
+   if (!shader->shader_cso)
+      shader->shader_cso = lvp_shader_compile(device, shader, nir_shader_clone(NULL, shader->pipeline_nir->nir), true);
+   simple_mtx_unlock(&device->queue.lock);
+
+   qshader = calloc(1, sizeof(*qshader));
+   qshader->stage = shader->pipeline_nir->nir->info.stage;
+   qshader->cso = lvp_queue_compile_shader(queue, shader, shader->pipeline_nir->nir);
+   if (shader->tess_ccw)
+      qshader->tess_ccw_cso = lvp_queue_compile_shader(queue, shader, shader->tess_ccw->nir);
+
+   simple_mtx_lock(&queue->shader_lock);
+   _mesa_hash_table_insert(&queue->shader_csos, shader, qshader);
+   simple_mtx_unlock(&queue->shader_lock);
+   return qshader;
+}
+
+/* deletes the queue's copies of shaders destroyed since it last ran; must be
+ * called with queue->lock held
+ */
+void
+lvp_queue_collect_shaders(struct lvp_queue *queue)
+{
+   simple_mtx_lock(&queue->shader_lock);
+   util_dynarray_foreach(&queue->shader_garbage, struct lvp_queue_shader *, qshader) {
+      delete_shader_state(queue->ctx, (*qshader)->stage, (*qshader)->cso);
+      if ((*qshader)->tess_ccw_cso)
+         delete_shader_state(queue->ctx, (*qshader)->stage, (*qshader)->tess_ccw_cso);
+      free(*qshader);
+   }
+   util_dynarray_clear(&queue->shader_garbage);
+   simple_mtx_unlock(&queue->shader_lock);
+}
+
 #ifndef NDEBUG
 static bool
 layouts_equal(const struct lvp_descriptor_set_layout *a, const struct lvp_descriptor_set_layout *b)
@@ -782,7 +880,7 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo,
                            VkPipelineCreateFlagBits2KHR flags)
 {
@@ -875,7 +973,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, sinfo);
+      result = lvp_shader_compile_to_ir(pipeline, cache, sinfo);
       if (result != VK_SUCCESS)
          goto fail;
 
@@ -976,7 +1074,8 @@ lvp_graphics_pipeline_create(
    bool group)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   struct vk_pipeline_cache *cache = _cache != VK_NULL_HANDLE ?
+      vk_pipeline_cache_from_handle(_cache) : device->mem_cache;
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1072,7 +1171,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo)
 {
    pipeline->device = device;
@@ -1082,7 +1181,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->type = LVP_PIPELINE_COMPUTE;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, &pCreateInfo->stage);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1102,7 +1201,8 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   struct vk_pipeline_cache *cache = _cache != VK_NULL_HANDLE ?
+      vk_pipeline_cache_from_handle(_cache) : device->mem_cache;
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -21,82 +21,89 @@
  * IN THE SOFTWARE.
  */
 
+/* VkPipelineCache itself is the common vk_pipeline_cache; lavapipe stores
+ * the NIR produced by lvp_shader_lower() in it.  The gallivm object code is
+ * stored by llvmpipe in the screen's disk cache, which also backs the
+ * device's vk_pipeline_cache disk lookups.
+ */
+
 #include "lvp_private.h"
+#include "vk_pipeline.h"
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_CreatePipelineCache(
-    VkDevice                                    _device,
-    const VkPipelineCacheCreateInfo*            pCreateInfo,
-    const VkAllocationCallbacks*                pAllocator,
-    VkPipelineCache*                            pPipelineCache)
+static void
+hash_set_layout(struct mesa_sha1 *ctx,
+                const struct lvp_descriptor_set_layout *set_layout)
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   struct lvp_pipeline_cache *cache;
+   _mesa_sha1_update(ctx, &set_layout->binding_count,
+                     sizeof(set_layout->binding_count));
+   _mesa_sha1_update(ctx, &set_layout->size, sizeof(set_layout->size));
 
-   assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO);
+   for (uint32_t b = 0; b < set_layout->binding_count; b++) {
+      const struct lvp_descriptor_set_binding_layout *binding =
+         &set_layout->binding[b];
 
-   cache = vk_alloc2(&device->vk.alloc, pAllocator,
-                       sizeof(*cache), 8,
-                       VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (cache == NULL)
-      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+      _mesa_sha1_update(ctx, &binding->valid, sizeof(binding->valid));
+      if (!binding->valid)
+         continue;
 
-   vk_object_base_init(&device->vk, &cache->base,
-                       VK_OBJECT_TYPE_PIPELINE_CACHE);
-   if (pAllocator)
-     cache->alloc = *pAllocator;
-   else
-     cache->alloc = device->vk.alloc;
+      _mesa_sha1_update(ctx, &binding->descriptor_index, sizeof(binding->descriptor_index));
+      _mesa_sha1_update(ctx, &binding->type, sizeof(binding->type));
+      _mesa_sha1_update(ctx, &binding->stride, sizeof(binding->stride));
+      _mesa_sha1_update(ctx, &binding->array_size, sizeof(binding->array_size));
+      _mesa_sha1_update(ctx, &binding->dynamic_index, sizeof(binding->dynamic_index));
+      _mesa_sha1_update(ctx, &binding->uniform_block_offset, sizeof(binding->uniform_block_offset));
+      _mesa_sha1_update(ctx, &binding->uniform_block_size, sizeof(binding->uniform_block_size));
 
-   cache->device = device;
-   *pPipelineCache = lvp_pipeline_cache_to_handle(cache);
+      if (!binding->immutable_samplers)
+         continue;
 
-   return VK_SUCCESS;
+      /* YCbCr conversions of immutable samplers are lowered into the shader */
+      for (uint32_t i = 0; i < binding->array_size; i++) {
+         const struct vk_ycbcr_conversion *conversion =
+            binding->immutable_samplers[i]->vk.ycbcr_conversion;
+         bool has_conversion = conversion != NULL;
+         _mesa_sha1_update(ctx, &has_conversion, sizeof(has_conversion));
+         if (conversion)
+            _mesa_sha1_update(ctx, &conversion->state, sizeof(conversion->state));
+      }
+   }
 }
 
-VKAPI_ATTR void VKAPI_CALL lvp_DestroyPipelineCache(
-    VkDevice                                    _device,
-    VkPipelineCache                             _cache,
-    const VkAllocationCallbacks*                pAllocator)
+/* Computes the key under which the lowered NIR of a shader stage is stored.
+ * Everything lvp_shader_lower() depends on besides the SPIR-V itself must be
+ * hashed here.
+ */
+void
+lvp_pipeline_cache_shader_key(const VkPipelineShaderStageCreateInfo *sinfo,
+                              const struct lvp_pipeline_layout *layout,
+                              unsigned char key[SHA1_DIGEST_LENGTH])
 {
-   LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   struct mesa_sha1 ctx;
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
 
-   if (!_cache)
-      return;
-//   lvp_pipeline_cache_finish(cache);
-   vk_object_base_finish(&cache->base);
-   vk_free2(&device->vk.alloc, pAllocator, cache);
-}
+   vk_pipeline_hash_shader_stage(sinfo, NULL, stage_sha1);
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_GetPipelineCacheData(
-        VkDevice                                    _device,
-        VkPipelineCache                             _cache,
-        size_t*                                     pDataSize,
-        void*                                       pData)
-{
-   VkResult result = VK_SUCCESS;
-   if (pData) {
-      if (*pDataSize < 32) {
-         *pDataSize = 0;
-         result = VK_INCOMPLETE;
-      } else {
-         uint32_t *hdr = (uint32_t *)pData;
-         hdr[0] = 32;
-         hdr[1] = 1;
-         hdr[2] = VK_VENDOR_ID_MESA;
-         hdr[3] = 0;
-         lvp_device_get_cache_uuid(&hdr[4]);
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+
+#ifdef VK_ENABLE_BETA_EXTENSIONS
+   const VkPipelineShaderStageNodeCreateInfoAMDX *node_info = vk_find_struct_const(
+      sinfo->pNext, PIPELINE_SHADER_STAGE_NODE_CREATE_INFO_AMDX);
+   uint32_t shader_index = node_info ? node_info->index : 0;
+   _mesa_sha1_update(&ctx, &shader_index, sizeof(shader_index));
+#endif
+
+   if (layout) {
+      _mesa_sha1_update(&ctx, &layout->push_constant_size,
+                        sizeof(layout->push_constant_size));
+      _mesa_sha1_update(&ctx, &layout->vk.set_count, sizeof(layout->vk.set_count));
+      for (uint32_t i = 0; i < layout->vk.set_count; i++) {
+         bool has_set = layout->vk.set_layouts[i] != NULL;
+         _mesa_sha1_update(&ctx, &has_set, sizeof(has_set));
+         if (has_set)
+            hash_set_layout(&ctx, vk_to_lvp_descriptor_set_layout(layout->vk.set_layouts[i]));
       }
-   } else
-      *pDataSize = 32;
-   return result;
-}
+   }
 
-VKAPI_ATTR VkResult VKAPI_CALL lvp_MergePipelineCaches(
-        VkDevice                                    _device,
-        VkPipelineCache                             destCache,
-        uint32_t                                    srcCacheCount,
-        const VkPipelineCache*                      pSrcCaches)
-{
-   return VK_SUCCESS;
+   _mesa_sha1_final(&ctx, key);
 }
@@ -33,6 +33,7 @@
 
 #include "util/macros.h"
 #include "util/list.h"
+#include "util/mesa-sha1.h"
 #include "util/u_dynarray.h"
 #include "util/simple_mtx.h"
 #include "util/u_queue.h"
@@ -71,6 +72,7 @@ typedef uint32_t xcb_window_t;
 #include "vk_command_pool.h"
 #include "vk_descriptor_set_layout.h"
 #include "vk_graphics_state.h"
+#include "vk_pipeline_cache.h"
 #include "vk_pipeline_layout.h"
 #include "vk_queue.h"
 #include "vk_sampler.h"
@@ -94,6 +96,7 @@ extern "C" {
 #define MAX_PER_STAGE_DESCRIPTOR_UNIFORM_BLOCKS 8
 #define MAX_DGC_STREAMS 16
 #define MAX_DGC_TOKENS 16
+#define LVP_MAX_QUEUES 4
 
 #ifdef _WIN32
 #define lvp_printflike(a, b)
@@ -181,22 +184,35 @@ struct lvp_queue {
    void *state;
    struct util_dynarray pipeline_destroys;
    simple_mtx_t lock;
+   void *noop_fs;
+
+   /* Shader CSOs belong to the context that created them, so queues other
+    * than the device's first one compile their own copy of each shader they
+    * run. Guarded by shader_lock, which is always taken last.
+    */
+   simple_mtx_t shader_lock;
+   struct hash_table shader_csos; /* lvp_shader -> lvp_queue_shader */
+   struct util_dynarray shader_garbage; /* lvp_queue_shader */
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
+struct lvp_queue_shader {
+   gl_shader_stage stage;
+   void *cso;
+   void *tess_ccw_cso;
 };
 
 struct lvp_device {
    struct vk_device vk;
 
+   /* creates and owns all pipe objects shared between queues */
    struct lvp_queue queue;
+   struct lvp_queue *queues[LVP_MAX_QUEUES]; /* queues[0] == &queue */
+   uint32_t queue_count;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
-   void *noop_fs;
+   /* used when the application doesn't provide a VkPipelineCache */
+   struct vk_pipeline_cache *mem_cache;
    simple_mtx_t bda_lock;
    struct hash_table bda;
    struct pipe_resource *zero_buffer; /* for zeroed bda */
@@ -209,6 +225,12 @@ struct lvp_device {
    struct util_dynarray bda_image_handles;
 };
 
+static inline bool
+lvp_queue_is_primary(const struct lvp_queue *queue)
+{
+   return queue == &queue->device->queue;
+}
+
 void lvp_device_get_cache_uuid(void *uuid);
 
 enum lvp_device_memory_type {
@@ -554,6 +576,11 @@ struct lvp_exec_graph_internal_data {
 bool
 lvp_lower_exec_graph(struct lvp_pipeline *pipeline, nir_shader *nir);
 
+void
+lvp_pipeline_cache_shader_key(const VkPipelineShaderStageCreateInfo *sinfo,
+                              const struct lvp_pipeline_layout *layout,
+                              unsigned char key[SHA1_DIGEST_LENGTH]);
+
 void
 lvp_pipeline_shaders_compile(struct lvp_pipeline *pipeline, bool locked);
 
@@ -596,6 +623,11 @@ struct lvp_cmd_buffer {
    struct lvp_device *                          device;
 
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
+
+   /* cmd_queue compiled at vkEndCommandBuffer, replayed by every submit */
+   struct util_dynarray packets;
+   /* draws, viewports and scissors resolved for the packets */
+   struct util_dynarray packet_data;
 };
 
 struct lvp_indirect_command_layout {
@@ -653,8 +685,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -670,6 +700,8 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_indirect_command_layout, base, VkIndirectComm
 
 void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp);
 
+void
+lvp_cmd_buffer_compile(struct lvp_cmd_buffer *cmd_buffer);
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
@@ -730,6 +762,10 @@ void
 lvp_inline_uniforms(nir_shader *nir, const struct lvp_shader *shader, const uint32_t *uniform_values, uint32_t ubo);
 void *
 lvp_shader_compile(struct lvp_device *device, struct lvp_shader *shader, nir_shader *nir, bool locked);
+struct lvp_queue_shader *
+lvp_queue_get_shader(struct lvp_queue *queue, struct lvp_shader *shader);
+void
+lvp_queue_collect_shaders(struct lvp_queue *queue);
 enum vk_cmd_type
 lvp_nv_dgc_token_to_cmd_type(const VkIndirectCommandsLayoutTokenNV *token);
 #ifdef __cplusplus
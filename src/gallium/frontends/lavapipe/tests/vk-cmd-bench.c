@@ -0,0 +1,572 @@
+/**************************************************************************
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Command buffer replay benchmark.
+ *
+ * Records one command buffer full of cheap state commands (push
+ * constants, viewport, scissor, ...) with SIMULTANEOUS_USE, submits it
+ * over and over and reports recorded commands executed per second.
+ * Nothing is drawn, so the number is dominated by the driver's
+ * per-command submit overhead, e.g.:
+ *
+ *   VK_ICD_FILENAMES=.../lvp_icd.x86_64.json vk-cmd-bench -n 100000 -s 200
+ *
+ * With -d, every other command is a vkCmdDraw or vkCmdDrawIndexed of a
+ * degenerate triangle inside a dynamic rendering pass, so the draw path
+ * is measured without the rasterizer dominating it.
+ *
+ * The Vulkan loader is opened at runtime, so no link-time dependency
+ * on it is needed.
+ */
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "util/os_time.h"
+
+static PFN_vkGetInstanceProcAddr get_instance_proc_addr;
+
+#define VK_CHECK(expr) do { \
+   VkResult _res = (expr); \
+   if (_res != VK_SUCCESS) { \
+      fprintf(stderr, "%s failed: %d\n", #expr, _res); \
+      exit(1); \
+   } \
+} while (0)
+
+#define INSTANCE_PROC(instance, name) \
+   PFN_##name name = (PFN_##name)get_instance_proc_addr(instance, #name)
+
+/* void main() { gl_Position = vec4(0, 0, 0, 1); } */
+static const uint32_t vs_spirv[] = {
+   0x07230203, 0x00010000, 0x00000000, 12, 0x00000000,
+   0x00020011, 1,                                  /* OpCapability Shader */
+   0x0003000e, 0, 1,                               /* OpMemoryModel Logical GLSL450 */
+   0x0006000f, 0, 1, 0x6e69616d, 0x00000000, 2,    /* OpEntryPoint Vertex %1 "main" %2 */
+   0x00040047, 2, 11, 0,                           /* OpDecorate %2 BuiltIn Position */
+   0x00020013, 3,                                  /* %3 = OpTypeVoid */
+   0x00030021, 4, 3,                               /* %4 = OpTypeFunction %3 */
+   0x00030016, 5, 32,                              /* %5 = OpTypeFloat 32 */
+   0x00040017, 6, 5, 4,                            /* %6 = OpTypeVector %5 4 */
+   0x00040020, 7, 3, 6,                            /* %7 = OpTypePointer Output %6 */
+   0x0004003b, 7, 2, 3,                            /* %2 = OpVariable %7 Output */
+   0x0004002b, 5, 8, 0x00000000,                   /* %8 = OpConstant %5 0.0 */
+   0x0004002b, 5, 9, 0x3f800000,                   /* %9 = OpConstant %5 1.0 */
+   0x0007002c, 6, 10, 8, 8, 8, 9,                  /* %10 = OpConstantComposite %6 %8 %8 %8 %9 */
+   0x00050036, 3, 1, 0, 4,                         /* %1 = OpFunction %3 None %4 */
+   0x000200f8, 11,                                 /* %11 = OpLabel */
+   0x0003003e, 2, 10,                              /* OpStore %2 %10 */
+   0x000100fd,                                     /* OpReturn */
+   0x00010038,                                     /* OpFunctionEnd */
+};
+
+/* layout(location = 0) out vec4 color; void main() { color = vec4(0, 0, 0, 1); } */
+static const uint32_t fs_spirv[] = {
+   0x07230203, 0x00010000, 0x00000000, 12, 0x00000000,
+   0x00020011, 1,                                  /* OpCapability Shader */
+   0x0003000e, 0, 1,                               /* OpMemoryModel Logical GLSL450 */
+   0x0006000f, 4, 1, 0x6e69616d, 0x00000000, 2,    /* OpEntryPoint Fragment %1 "main" %2 */
+   0x00030010, 1, 7,                               /* OpExecutionMode %1 OriginUpperLeft */
+   0x00040047, 2, 30, 0,                           /* OpDecorate %2 Location 0 */
+   0x00020013, 3,                                  /* %3 = OpTypeVoid */
+   0x00030021, 4, 3,                               /* %4 = OpTypeFunction %3 */
+   0x00030016, 5, 32,                              /* %5 = OpTypeFloat 32 */
+   0x00040017, 6, 5, 4,                            /* %6 = OpTypeVector %5 4 */
+   0x00040020, 7, 3, 6,                            /* %7 = OpTypePointer Output %6 */
+   0x0004003b, 7, 2, 3,                            /* %2 = OpVariable %7 Output */
+   0x0004002b, 5, 8, 0x00000000,                   /* %8 = OpConstant %5 0.0 */
+   0x0004002b, 5, 9, 0x3f800000,                   /* %9 = OpConstant %5 1.0 */
+   0x0007002c, 6, 10, 8, 8, 8, 9,                  /* %10 = OpConstantComposite %6 %8 %8 %8 %9 */
+   0x00050036, 3, 1, 0, 4,                         /* %1 = OpFunction %3 None %4 */
+   0x000200f8, 11,                                 /* %11 = OpLabel */
+   0x0003003e, 2, 10,                              /* OpStore %2 %10 */
+   0x000100fd,                                     /* OpReturn */
+   0x00010038,                                     /* OpFunctionEnd */
+};
+
+#define RT_SIZE 64
+#define RT_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+static void usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-n commands] [-s submits] [-b batch] [-d]\n", name);
+   exit(1);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned num_cmds = 100000;
+   unsigned num_submits = 100;
+   unsigned batch = 1;
+   bool draw = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:s:b:d")) != -1) {
+      switch (opt) {
+      case 'n': num_cmds = atoi(optarg); break;
+      case 's': num_submits = atoi(optarg); break;
+      case 'b': batch = atoi(optarg); break;
+      case 'd': draw = true; break;
+      default: usage(argv[0]);
+      }
+   }
+   if (!num_cmds || !num_submits || !batch)
+      usage(argv[0]);
+
+   void *loader = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_LOCAL);
+   if (!loader) {
+      fprintf(stderr, "failed to open the Vulkan loader: %s\n", dlerror());
+      return 1;
+   }
+   get_instance_proc_addr =
+      (PFN_vkGetInstanceProcAddr)dlsym(loader, "vkGetInstanceProcAddr");
+
+   INSTANCE_PROC(NULL, vkCreateInstance);
+   const VkApplicationInfo app_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "vk-cmd-bench",
+      .apiVersion = VK_API_VERSION_1_3,
+   };
+   const VkInstanceCreateInfo instance_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+   };
+   VkInstance instance;
+   VK_CHECK(vkCreateInstance(&instance_info, NULL, &instance));
+
+   INSTANCE_PROC(instance, vkEnumeratePhysicalDevices);
+   INSTANCE_PROC(instance, vkGetPhysicalDeviceProperties);
+   INSTANCE_PROC(instance, vkGetPhysicalDeviceMemoryProperties);
+   INSTANCE_PROC(instance, vkCreateDevice);
+   INSTANCE_PROC(instance, vkGetDeviceProcAddr);
+   INSTANCE_PROC(instance, vkDestroyInstance);
+
+   uint32_t pdev_count = 1;
+   VkPhysicalDevice pdev;
+   VkResult res = vkEnumeratePhysicalDevices(instance, &pdev_count, &pdev);
+   if ((res != VK_SUCCESS && res != VK_INCOMPLETE) || !pdev_count) {
+      fprintf(stderr, "no Vulkan device\n");
+      return 1;
+   }
+
+   VkPhysicalDeviceProperties props;
+   vkGetPhysicalDeviceProperties(pdev, &props);
+
+   const float priority = 1.0f;
+   const VkDeviceQueueCreateInfo queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+      .pQueuePriorities = &priority,
+   };
+   const VkPhysicalDeviceVulkan13Features features13 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+      .dynamicRendering = VK_TRUE,
+   };
+   const VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = draw ? &features13 : NULL,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &queue_info,
+   };
+   VkDevice device;
+   VK_CHECK(vkCreateDevice(pdev, &device_info, NULL, &device));
+
+#define DEVICE_PROC(name) \
+   PFN_##name name = (PFN_##name)vkGetDeviceProcAddr(device, #name)
+   DEVICE_PROC(vkGetDeviceQueue);
+   DEVICE_PROC(vkCreateCommandPool);
+   DEVICE_PROC(vkAllocateCommandBuffers);
+   DEVICE_PROC(vkBeginCommandBuffer);
+   DEVICE_PROC(vkEndCommandBuffer);
+   DEVICE_PROC(vkCreatePipelineLayout);
+   DEVICE_PROC(vkCreateFence);
+   DEVICE_PROC(vkResetFences);
+   DEVICE_PROC(vkWaitForFences);
+   DEVICE_PROC(vkQueueSubmit);
+   DEVICE_PROC(vkCmdPushConstants);
+   DEVICE_PROC(vkCmdSetViewport);
+   DEVICE_PROC(vkCmdSetScissor);
+   DEVICE_PROC(vkCmdSetLineWidth);
+   DEVICE_PROC(vkCmdSetBlendConstants);
+   DEVICE_PROC(vkCmdSetStencilReference);
+   DEVICE_PROC(vkCreateImage);
+   DEVICE_PROC(vkCreateImageView);
+   DEVICE_PROC(vkCreateBuffer);
+   DEVICE_PROC(vkGetImageMemoryRequirements);
+   DEVICE_PROC(vkGetBufferMemoryRequirements);
+   DEVICE_PROC(vkAllocateMemory);
+   DEVICE_PROC(vkBindImageMemory);
+   DEVICE_PROC(vkBindBufferMemory);
+   DEVICE_PROC(vkMapMemory);
+   DEVICE_PROC(vkUnmapMemory);
+   DEVICE_PROC(vkCreateShaderModule);
+   DEVICE_PROC(vkCreateGraphicsPipelines);
+   DEVICE_PROC(vkCmdPipelineBarrier);
+   DEVICE_PROC(vkCmdBeginRendering);
+   DEVICE_PROC(vkCmdEndRendering);
+   DEVICE_PROC(vkCmdBindPipeline);
+   DEVICE_PROC(vkCmdBindIndexBuffer);
+   DEVICE_PROC(vkCmdDraw);
+   DEVICE_PROC(vkCmdDrawIndexed);
+   DEVICE_PROC(vkDestroyPipeline);
+   DEVICE_PROC(vkDestroyShaderModule);
+   DEVICE_PROC(vkDestroyImageView);
+   DEVICE_PROC(vkDestroyImage);
+   DEVICE_PROC(vkDestroyBuffer);
+   DEVICE_PROC(vkFreeMemory);
+   DEVICE_PROC(vkDestroyPipelineLayout);
+   DEVICE_PROC(vkDestroyFence);
+   DEVICE_PROC(vkDestroyCommandPool);
+   DEVICE_PROC(vkDestroyDevice);
+#undef DEVICE_PROC
+
+   VkQueue queue;
+   vkGetDeviceQueue(device, 0, 0, &queue);
+
+   const VkCommandPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .queueFamilyIndex = 0,
+   };
+   VkCommandPool pool;
+   VK_CHECK(vkCreateCommandPool(device, &pool_info, NULL, &pool));
+
+   const VkCommandBufferAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+   };
+   VkCommandBuffer cmd;
+   VK_CHECK(vkAllocateCommandBuffers(device, &alloc_info, &cmd));
+
+   const VkPushConstantRange range = {
+      .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
+      .size = 16,
+   };
+   const VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &range,
+   };
+   VkPipelineLayout layout;
+   VK_CHECK(vkCreatePipelineLayout(device, &layout_info, NULL, &layout));
+
+   VkImage image = VK_NULL_HANDLE;
+   VkImageView view = VK_NULL_HANDLE;
+   VkBuffer index_buffer = VK_NULL_HANDLE;
+   VkDeviceMemory image_mem = VK_NULL_HANDLE, index_mem = VK_NULL_HANDLE;
+   VkShaderModule vs = VK_NULL_HANDLE, fs = VK_NULL_HANDLE;
+   VkPipeline pipeline = VK_NULL_HANDLE;
+   if (draw) {
+      VkPhysicalDeviceMemoryProperties mem_props;
+      vkGetPhysicalDeviceMemoryProperties(pdev, &mem_props);
+
+      const VkImageCreateInfo image_info = {
+         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+         .imageType = VK_IMAGE_TYPE_2D,
+         .format = RT_FORMAT,
+         .extent = { RT_SIZE, RT_SIZE, 1 },
+         .mipLevels = 1,
+         .arrayLayers = 1,
+         .samples = VK_SAMPLE_COUNT_1_BIT,
+         .tiling = VK_IMAGE_TILING_OPTIMAL,
+         .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      };
+      VK_CHECK(vkCreateImage(device, &image_info, NULL, &image));
+
+      const VkBufferCreateInfo buffer_info = {
+         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+         .size = 3 * sizeof(uint16_t),
+         .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      };
+      VK_CHECK(vkCreateBuffer(device, &buffer_info, NULL, &index_buffer));
+
+      /* the index buffer is filled through a mapping */
+      VkMemoryRequirements reqs[2];
+      vkGetImageMemoryRequirements(device, image, &reqs[0]);
+      vkGetBufferMemoryRequirements(device, index_buffer, &reqs[1]);
+      VkDeviceMemory *mems[2] = { &image_mem, &index_mem };
+      for (unsigned i = 0; i < 2; i++) {
+         uint32_t type = 0;
+         while (type < mem_props.memoryTypeCount &&
+                (!(reqs[i].memoryTypeBits & (1u << type)) ||
+                 !(mem_props.memoryTypes[type].propertyFlags &
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)))
+            type++;
+         if (type == mem_props.memoryTypeCount) {
+            fprintf(stderr, "no host visible memory type\n");
+            return 1;
+         }
+         const VkMemoryAllocateInfo mem_info = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = reqs[i].size,
+            .memoryTypeIndex = type,
+         };
+         VK_CHECK(vkAllocateMemory(device, &mem_info, NULL, mems[i]));
+      }
+      VK_CHECK(vkBindImageMemory(device, image, image_mem, 0));
+      VK_CHECK(vkBindBufferMemory(device, index_buffer, index_mem, 0));
+
+      uint16_t *indices;
+      VK_CHECK(vkMapMemory(device, index_mem, 0, VK_WHOLE_SIZE, 0, (void **)&indices));
+      indices[0] = 0;
+      indices[1] = 1;
+      indices[2] = 2;
+      vkUnmapMemory(device, index_mem);
+
+      const VkImageViewCreateInfo view_info = {
+         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+         .image = image,
+         .viewType = VK_IMAGE_VIEW_TYPE_2D,
+         .format = RT_FORMAT,
+         .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+      };
+      VK_CHECK(vkCreateImageView(device, &view_info, NULL, &view));
+
+      const VkShaderModuleCreateInfo vs_info = {
+         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+         .codeSize = sizeof(vs_spirv),
+         .pCode = vs_spirv,
+      };
+      const VkShaderModuleCreateInfo fs_info = {
+         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+         .codeSize = sizeof(fs_spirv),
+         .pCode = fs_spirv,
+      };
+      VK_CHECK(vkCreateShaderModule(device, &vs_info, NULL, &vs));
+      VK_CHECK(vkCreateShaderModule(device, &fs_info, NULL, &fs));
+
+      const VkPipelineShaderStageCreateInfo stages[] = {
+         {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vs,
+            .pName = "main",
+         },
+         {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fs,
+            .pName = "main",
+         },
+      };
+      const VkPipelineVertexInputStateCreateInfo vi = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      };
+      const VkPipelineInputAssemblyStateCreateInfo ia = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+         .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      };
+      const VkPipelineViewportStateCreateInfo vp = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+         .viewportCount = 1,
+         .scissorCount = 1,
+      };
+      const VkPipelineRasterizationStateCreateInfo rs = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+         .polygonMode = VK_POLYGON_MODE_FILL,
+         .cullMode = VK_CULL_MODE_NONE,
+         .lineWidth = 1.0f,
+      };
+      const VkPipelineMultisampleStateCreateInfo ms = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+         .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      };
+      const VkPipelineColorBlendAttachmentState blend_att = {
+         .colorWriteMask = 0xf,
+      };
+      const VkPipelineColorBlendStateCreateInfo cb = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+         .attachmentCount = 1,
+         .pAttachments = &blend_att,
+      };
+      const VkDynamicState dynamic_states[] = {
+         VK_DYNAMIC_STATE_VIEWPORT,
+         VK_DYNAMIC_STATE_SCISSOR,
+      };
+      const VkPipelineDynamicStateCreateInfo dyn = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+         .dynamicStateCount = 2,
+         .pDynamicStates = dynamic_states,
+      };
+      const VkFormat rt_format = RT_FORMAT;
+      const VkPipelineRenderingCreateInfo rendering_info = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+         .colorAttachmentCount = 1,
+         .pColorAttachmentFormats = &rt_format,
+      };
+      const VkGraphicsPipelineCreateInfo pipeline_info = {
+         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+         .pNext = &rendering_info,
+         .stageCount = 2,
+         .pStages = stages,
+         .pVertexInputState = &vi,
+         .pInputAssemblyState = &ia,
+         .pViewportState = &vp,
+         .pRasterizationState = &rs,
+         .pMultisampleState = &ms,
+         .pColorBlendState = &cb,
+         .pDynamicState = &dyn,
+         .layout = layout,
+      };
+      VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                         NULL, &pipeline));
+   }
+
+   int64_t start = os_time_get_nano();
+
+   const VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+   };
+   VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+   if (draw) {
+      const VkImageMemoryBarrier barrier = {
+         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+         .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+         .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+         .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .image = image,
+         .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+      };
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           0, 0, NULL, 0, NULL, 1, &barrier);
+
+      const VkRenderingAttachmentInfo color = {
+         .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+         .imageView = view,
+         .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+         .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      };
+      const VkRenderingInfo rendering = {
+         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+         .renderArea = { { 0, 0 }, { RT_SIZE, RT_SIZE } },
+         .layerCount = 1,
+         .colorAttachmentCount = 1,
+         .pColorAttachments = &color,
+      };
+      vkCmdBeginRendering(cmd, &rendering);
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      vkCmdBindIndexBuffer(cmd, index_buffer, 0, VK_INDEX_TYPE_UINT16);
+   }
+   for (unsigned i = 0; i < num_cmds; i++) {
+      const float f = (float)(i & 255);
+      const VkViewport viewport = { 0, 0, 256 + f, 256, 0, 1 };
+      const VkRect2D scissor = { { 0, 0 }, { 256, 256 + (i & 255) } };
+      const float blend[4] = { f, f, f, f };
+      const uint32_t pc[4] = { i, i, i, i };
+
+      if (draw) {
+         switch (i % 4) {
+         case 0: vkCmdSetViewport(cmd, 0, 1, &viewport); break;
+         case 1: vkCmdDraw(cmd, 3, 1, 0, 0); break;
+         case 2: vkCmdSetScissor(cmd, 0, 1, &scissor); break;
+         case 3: vkCmdDrawIndexed(cmd, 3, 1, 0, 0, 0); break;
+         }
+         continue;
+      }
+
+      switch (i % 6) {
+      case 0: vkCmdPushConstants(cmd, layout, range.stageFlags, 0, sizeof(pc), pc); break;
+      case 1: vkCmdSetViewport(cmd, 0, 1, &viewport); break;
+      case 2: vkCmdSetScissor(cmd, 0, 1, &scissor); break;
+      case 3: vkCmdSetLineWidth(cmd, 1.0f); break;
+      case 4: vkCmdSetBlendConstants(cmd, blend); break;
+      case 5: vkCmdSetStencilReference(cmd, VK_STENCIL_FACE_FRONT_AND_BACK, i & 255); break;
+      }
+   }
+   if (draw)
+      vkCmdEndRendering(cmd);
+   VK_CHECK(vkEndCommandBuffer(cmd));
+
+   int64_t recorded = os_time_get_nano();
+
+   const VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+   };
+   VkFence fence;
+   VK_CHECK(vkCreateFence(device, &fence_info, NULL, &fence));
+
+   const VkSubmitInfo submit = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &cmd,
+   };
+   for (unsigned i = 0; i < num_submits; i++) {
+      bool last = (i % batch) == batch - 1 || i == num_submits - 1;
+      VK_CHECK(vkQueueSubmit(queue, 1, &submit, last ? fence : VK_NULL_HANDLE));
+      if (last) {
+         VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+         VK_CHECK(vkResetFences(device, 1, &fence));
+      }
+   }
+
+   int64_t end = os_time_get_nano();
+
+   double record_s = (recorded - start) / 1e9;
+   double submit_s = (end - recorded) / 1e9;
+   printf("%s\n", props.deviceName);
+   printf("record: %u commands in %.3f ms (%.2f Mcmds/s)\n",
+          num_cmds, record_s * 1e3, num_cmds / record_s / 1e6);
+   printf("submit: %u x %u commands in %.3f ms (%.2f Mcmds/s, %.3f ms/submit)\n",
+          num_submits, num_cmds, submit_s * 1e3,
+          (double)num_cmds * num_submits / submit_s / 1e6,
+          submit_s * 1e3 / num_submits);
+   if (draw) {
+      printf("draws: %u x %u draws (%.2f Mdraws/s)\n",
+             num_submits, num_cmds / 2,
+             (double)(num_cmds / 2) * num_submits / submit_s / 1e6);
+   }
+
+   vkDestroyFence(device, fence, NULL);
+   if (draw) {
+      vkDestroyPipeline(device, pipeline, NULL);
+      vkDestroyShaderModule(device, vs, NULL);
+      vkDestroyShaderModule(device, fs, NULL);
+      vkDestroyImageView(device, view, NULL);
+      vkDestroyImage(device, image, NULL);
+      vkDestroyBuffer(device, index_buffer, NULL);
+      vkFreeMemory(device, image_mem, NULL);
+      vkFreeMemory(device, index_mem, NULL);
+   }
+   vkDestroyPipelineLayout(device, layout, NULL);
+   vkDestroyCommandPool(device, pool, NULL);
+   vkDestroyDevice(device, NULL);
+   vkDestroyInstance(instance, NULL);
+   dlclose(loader);
+
+   return 0;
+}
@@ -0,0 +1,272 @@
+/**************************************************************************
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Compute throughput benchmark.
+ *
+ * Dispatches a grid of 8x8 workgroups running an ALU loop that writes
+ * one texel per invocation, and reports invocations per second.  With
+ * -c every dispatch is preceded by a clear of a render target of the
+ * same size that is flushed but not waited for, so compute and
+ * rasterization compete for the same CPUs, e.g.:
+ *
+ *   GALLIUM_DRIVER=llvmpipe LP_NUM_THREADS=8 cs-bench -g 64 -i 256
+ *   GALLIUM_DRIVER=llvmpipe LP_NUM_THREADS=8 cs-bench -g 64 -i 256 -c
+ *
+ * To see how llvmpipe scales run it with LP_NUM_THREADS set to 1, 2,
+ * 4, ... up to the number of CPUs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* tgsi_text_translate */
+#include "tgsi/tgsi_text.h"
+/* pipe_resource_reference */
+#include "util/u_inlines.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* os_time_get_nano */
+#include "util/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+
+	unsigned groups;
+	unsigned loop_iters;
+	unsigned dispatches;
+	bool clear;
+
+	void *cs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *image;
+	struct pipe_resource *target;
+	struct pipe_surface *surface;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-g groups per side] [-i loop iterations] "
+		"[-n dispatches] [-c]\n", name);
+	exit(1);
+}
+
+static void init_prog(struct program *p)
+{
+	const unsigned size = p->groups * 8;
+	struct pipe_resource tmplt;
+	struct pipe_surface surf_tmpl;
+	ASSERTED int ret;
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1, false);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	/* create the pipe driver context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+
+	/* storage image written by the shader, and the clear target */
+	memset(&tmplt, 0, sizeof(tmplt));
+	tmplt.target = PIPE_TEXTURE_2D;
+	tmplt.format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	tmplt.width0 = size;
+	tmplt.height0 = size;
+	tmplt.depth0 = 1;
+	tmplt.array_size = 1;
+	tmplt.bind = PIPE_BIND_SHADER_IMAGE;
+	p->image = p->screen->resource_create(p->screen, &tmplt);
+
+	tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	tmplt.bind = PIPE_BIND_RENDER_TARGET;
+	p->target = p->screen->resource_create(p->screen, &tmplt);
+
+	memset(&surf_tmpl, 0, sizeof(surf_tmpl));
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	p->surface = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	/* compute shader */
+	{
+		char text[2048];
+		struct tgsi_token tokens[1000];
+
+		snprintf(text, sizeof(text),
+			"COMP\n"
+			"PROPERTY CS_FIXED_BLOCK_WIDTH 8\n"
+			"PROPERTY CS_FIXED_BLOCK_HEIGHT 8\n"
+			"PROPERTY CS_FIXED_BLOCK_DEPTH 1\n"
+			"DCL SV[0], THREAD_ID\n"
+			"DCL SV[1], BLOCK_ID\n"
+			"DCL IMAGE[0], 2D, PIPE_FORMAT_R32G32B32A32_FLOAT, WR\n"
+			"DCL TEMP[0..2]\n"
+			"IMM[0] UINT32 { 8, 8, 1, 0 }\n"
+			"IMM[1] UINT32 { %u, 0, 0, 0 }\n"
+			"IMM[2] FLT32 { 0.999, 0.001, 0, 0 }\n"
+			/* TEMP[0].xy = SV[1] * IMM[0] + SV[0]; */
+			"UMAD TEMP[0].xy, SV[1], IMM[0], SV[0]\n"
+			"U2F TEMP[1], TEMP[0].xyxy\n"
+			"MOV TEMP[0].z, IMM[0].wwww\n"
+			"BGNLOOP\n"
+			"  USGE TEMP[2].x, TEMP[0].zzzz, IMM[1].xxxx\n"
+			"  UIF TEMP[2].xxxx\n"
+			"    BRK\n"
+			"  ENDIF\n"
+			"  MAD TEMP[1], TEMP[1], IMM[2].xxxx, IMM[2].yyyy\n"
+			"  UADD TEMP[0].z, TEMP[0].zzzz, IMM[0].zzzz\n"
+			"ENDLOOP\n"
+			"STORE IMAGE[0], TEMP[0], TEMP[1], 2D, PIPE_FORMAT_R32G32B32A32_FLOAT\n"
+			"END\n", p->loop_iters);
+
+		ret = tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens));
+		assert(ret);
+
+		struct pipe_compute_state state = {0};
+		state.ir_type = PIPE_SHADER_IR_TGSI;
+		state.prog = tokens;
+		p->cs = p->pipe->create_compute_state(p->pipe, &state);
+	}
+}
+
+static void close_prog(struct program *p)
+{
+	p->pipe->delete_compute_state(p->pipe, p->cs);
+
+	pipe_surface_reference(&p->surface, NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->image, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void dispatch(struct program *p)
+{
+	struct pipe_grid_info info = {0};
+
+	if (p->clear) {
+		p->pipe->clear_render_target(p->pipe, p->surface,
+					     &p->clear_color, 0, 0,
+					     p->target->width0,
+					     p->target->height0, false);
+		p->pipe->flush(p->pipe, NULL, 0);
+	}
+
+	info.block[0] = 8;
+	info.block[1] = 8;
+	info.block[2] = 1;
+	info.grid[0] = p->groups;
+	info.grid[1] = p->groups;
+	info.grid[2] = 1;
+
+	p->pipe->launch_grid(p->pipe, &info);
+}
+
+static void run(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+	struct pipe_image_view image = {0};
+
+	image.resource = p->image;
+	image.shader_access = image.access = PIPE_IMAGE_ACCESS_WRITE;
+	image.format = p->image->format;
+
+	p->pipe->bind_compute_state(p->pipe, p->cs);
+	p->pipe->set_shader_images(p->pipe, PIPE_SHADER_COMPUTE, 0, 1, 0,
+				   &image);
+
+	/* warm up, compiles the shader variant */
+	dispatch(p);
+
+	int64_t start = os_time_get_nano();
+	for (unsigned i = 0; i < p->dispatches; i++)
+		dispatch(p);
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, OS_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+	int64_t elapsed = os_time_get_nano() - start;
+
+	double secs = elapsed / 1e9;
+	double invocations = (double)p->groups * p->groups * 64 * p->dispatches;
+	printf("%ux%u groups of 8x8, %u loop iterations, %u dispatches%s\n",
+	       p->groups, p->groups, p->loop_iters, p->dispatches,
+	       p->clear ? ", clearing in between" : "");
+	printf("%.3f ms/dispatch, %.2f Minvocations/s\n",
+	       secs * 1e3 / p->dispatches, invocations / secs / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	int opt;
+
+	p->groups = 64;
+	p->loop_iters = 256;
+	p->dispatches = 100;
+
+	while ((opt = getopt(argc, argv, "g:i:n:c")) != -1) {
+		switch (opt) {
+		case 'g': p->groups = atoi(optarg); break;
+		case 'i': p->loop_iters = atoi(optarg); break;
+		case 'n': p->dispatches = atoi(optarg); break;
+		case 'c': p->clear = true; break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (!p->groups || !p->dispatches)
+		usage(argv[0]);
+
+	init_prog(p);
+	run(p);
+	close_prog(p);
+
+	return 0;
+}
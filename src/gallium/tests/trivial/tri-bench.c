@@ -0,0 +1,426 @@
+/**************************************************************************
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Triangle throughput benchmark.
+ *
+ * Draws a grid of small colored triangles covering the render target
+ * and reports triangles per second.  Lots of tiny triangles stress
+ * setup and binning, few big ones stress rasterization, e.g.:
+ *
+ *   GALLIUM_DRIVER=llvmpipe LP_NUM_THREADS=8 tri-bench -n 200000 -s 4
+ *   GALLIUM_DRIVER=llvmpipe LP_NUM_THREADS=8 tri-bench -n 64 -s 512
+ *
+ * To compare llvmpipe tile sizes run both cases with LP_TILE_SIZE set
+ * to 32, 64 and 128, on a small (-w 256 -h 256) and a large
+ * (-w 7680 -h 4320) render target.
+ *
+ * With -t, the workload runs once per llvmpipe thread count, with the
+ * threads pinned to their L3 domains and unpinned, and the frame times and
+ * the speed-up over the first thread count are reported.  A new screen is
+ * created for every run since llvmpipe reads LP_NUM_THREADS and
+ * LP_PIN_THREADS at screen creation, e.g.:
+ *
+ *   GALLIUM_DRIVER=llvmpipe tri-bench -t 1,8,32,64,128 -w 7680 -h 4320
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* os_time_get_nano */
+#include "util/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	unsigned width, height;
+	unsigned num_tris;
+	unsigned tri_size;
+	unsigned frames;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct cso_velems_state velem;
+
+	void *vs;
+	void *fs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads,...] [-w width] [-h height] "
+		"[-n triangles] [-s size] [-f frames]\n", name);
+	exit(1);
+}
+
+static void init_vertices(struct program *p)
+{
+	const unsigned verts = 3 * p->num_tris;
+	const unsigned size = verts * 2 * 4 * sizeof(float);
+	float (*v)[2][4] = MALLOC(size);
+	unsigned cols = MAX2(p->width / p->tri_size, 1);
+	float sx = 2.0f * p->tri_size / p->width;
+	float sy = 2.0f * p->tri_size / p->height;
+
+	for (unsigned t = 0; t < p->num_tris; t++) {
+		/* walk the grid, wrapping around so overdraw stays uniform */
+		unsigned cell = t % (cols * MAX2(p->height / p->tri_size, 1));
+		float x = -1.0f + (cell % cols) * sx;
+		float y = -1.0f + (cell / cols) * sy;
+		const float pos[3][2] = {
+			{ x, y }, { x + sx, y }, { x, y + sy }
+		};
+
+		for (unsigned i = 0; i < 3; i++) {
+			float *vert = v[3 * t + i][0];
+			float *color = v[3 * t + i][1];
+
+			vert[0] = pos[i][0];
+			vert[1] = pos[i][1];
+			vert[2] = 0.0f;
+			vert[3] = 1.0f;
+
+			color[0] = (t & 1) ? 1.0f : 0.0f;
+			color[1] = (t & 2) ? 1.0f : 0.0f;
+			color[2] = (float)i / 2.0f;
+			color[3] = 1.0f;
+		}
+	}
+
+	p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+				     PIPE_USAGE_DEFAULT, size);
+	pipe_buffer_write(p->pipe, p->vbuf, 0, size, v);
+	FREE(v);
+}
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	ASSERTED int ret;
+
+	/* find a hardware device */
+	ret = pipe_loader_probe(&p->dev, 1, false);
+	assert(ret);
+
+	/* init a pipe screen */
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	/* create the pipe driver context and cso context */
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe, 0);
+
+	/* set clear color */
+	p->clear_color.f[0] = 0.3;
+	p->clear_color.f[1] = 0.1;
+	p->clear_color.f[2] = 0.3;
+	p->clear_color.f[3] = 1.0;
+
+	init_vertices(p);
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = p->width;
+		tmplt.height0 = p->height;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* disabled blending/masking */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	/* no-op depth/stencil/alpha */
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	/* rasterizer */
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip_near = 1;
+	p->rasterizer.depth_clip_far = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	/* drawing destination */
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = p->width;
+	p->framebuffer.height = p->height;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	/* viewport, depth isn't really needed */
+	{
+		float half_width = (float)p->width / 2.0f;
+		float half_height = (float)p->height / 2.0f;
+
+		p->viewport.scale[0] = half_width;
+		p->viewport.scale[1] = half_height;
+		p->viewport.scale[2] = 0.5f;
+
+		p->viewport.translate[0] = half_width;
+		p->viewport.translate[1] = half_height;
+		p->viewport.translate[2] = 0.5f;
+
+		p->viewport.swizzle_x = PIPE_VIEWPORT_SWIZZLE_POSITIVE_X;
+		p->viewport.swizzle_y = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Y;
+		p->viewport.swizzle_z = PIPE_VIEWPORT_SWIZZLE_POSITIVE_Z;
+		p->viewport.swizzle_w = PIPE_VIEWPORT_SWIZZLE_POSITIVE_W;
+	}
+
+	/* vertex elements state */
+	memset(&p->velem, 0, sizeof(p->velem));
+	p->velem.count = 2;
+
+	p->velem.velems[0].src_offset = 0 * 4 * sizeof(float); /* offset 0, first element */
+	p->velem.velems[0].instance_divisor = 0;
+	p->velem.velems[0].vertex_buffer_index = 0;
+	p->velem.velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem.velems[0].src_stride = 2 * 4 * sizeof(float);
+
+	p->velem.velems[1].src_offset = 1 * 4 * sizeof(float); /* offset 16, second element */
+	p->velem.velems[1].instance_divisor = 0;
+	p->velem.velems[1].vertex_buffer_index = 0;
+	p->velem.velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+	p->velem.velems[1].src_stride = 2 * 4 * sizeof(float);
+
+	/* vertex shader */
+	{
+		const enum tgsi_semantic semantic_names[] =
+			{ TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, false);
+	}
+
+	/* fragment shader */
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+		TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, true);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+}
+
+static void draw_frame(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+
+	p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, NULL, &p->clear_color, 0, 0);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+				p->vbuf, 0,
+				MESA_PRIM_TRIANGLES,
+				3 * p->num_tris, /* verts */
+				2); /* attribs/vert */
+
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, OS_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+/* Returns the average frame time in milliseconds. */
+static double draw(struct program *p)
+{
+	/* set the render target */
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	/* set misc state we care about */
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	/* shaders */
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+
+	/* vertex element data */
+	cso_set_vertex_elements(p->cso, &p->velem);
+
+	/* warm up, compiles the shader variants */
+	draw_frame(p);
+
+	int64_t start = os_time_get_nano();
+	for (unsigned i = 0; i < p->frames; i++)
+		draw_frame(p);
+	int64_t elapsed = os_time_get_nano() - start;
+
+	return elapsed / 1e6 / p->frames;
+}
+
+static double run(struct program *p, unsigned threads, bool pin)
+{
+	char num[16];
+	double ms;
+
+	snprintf(num, sizeof(num), "%u", threads);
+	setenv("LP_NUM_THREADS", num, 1);
+	setenv("LP_PIN_THREADS", pin ? "true" : "false", 1);
+
+	init_prog(p);
+	ms = draw(p);
+	close_prog(p);
+
+	return ms;
+}
+
+static void run_scaling(struct program *p, const unsigned *threads,
+			unsigned num_threads)
+{
+	double base[2] = { 0 };
+
+	printf("%8s %12s %8s %12s %8s\n", "threads", "pinned ms", "speed-up",
+	       "unpinned ms", "speed-up");
+
+	for (unsigned i = 0; i < num_threads; i++) {
+		double pinned = run(p, threads[i], true);
+		double unpinned = run(p, threads[i], false);
+
+		if (i == 0) {
+			base[0] = pinned;
+			base[1] = unpinned;
+		}
+
+		printf("%8u %12.3f %7.2fx %12.3f %7.2fx\n", threads[i],
+		       pinned, base[0] / pinned, unpinned, base[1] / unpinned);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	unsigned threads[32];
+	unsigned num_threads = 0;
+	char *list = NULL;
+	int opt;
+
+	p->width = 1024;
+	p->height = 1024;
+	p->num_tris = 100000;
+	p->tri_size = 8;
+	p->frames = 50;
+
+	while ((opt = getopt(argc, argv, "t:w:h:n:s:f:")) != -1) {
+		switch (opt) {
+		case 't': list = optarg; break;
+		case 'w': p->width = atoi(optarg); break;
+		case 'h': p->height = atoi(optarg); break;
+		case 'n': p->num_tris = atoi(optarg); break;
+		case 's': p->tri_size = atoi(optarg); break;
+		case 'f': p->frames = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	for (char *s = list; s && *s && num_threads < ARRAY_SIZE(threads); ) {
+		threads[num_threads] = strtoul(s, &s, 10);
+		if (!threads[num_threads] || (*s && *s++ != ','))
+			usage(argv[0]);
+		num_threads++;
+	}
+
+	if ((list && !num_threads) || !p->width || !p->height ||
+	    !p->num_tris || !p->tri_size || !p->frames)
+		usage(argv[0]);
+
+	printf("%ux%u, %u triangles of %ux%u pixels, %u frames\n",
+	       p->width, p->height, p->num_tris, p->tri_size, p->tri_size,
+	       p->frames);
+
+	if (num_threads) {
+		run_scaling(p, threads, num_threads);
+	} else {
+		init_prog(p);
+		double ms = draw(p);
+		close_prog(p);
+
+		printf("%.3f ms/frame, %.2f Mtris/s, %.1f Mpixels/s\n", ms,
+		       p->num_tris / ms / 1e3,
+		       (double)p->num_tris * p->tri_size * p->tri_size / 2 /
+		       ms / 1e3);
+	}
+
+	FREE(p);
+	return 0;
+}
@@ -36,8 +36,11 @@
 
 #ifdef HAVE_ZSTD
 #include "zstd.h"
+#include "zdict.h"
 #endif
 
+#include <stdlib.h>
+
 #include "util/compress.h"
 #include "util/perf/cpu_trace.h"
 #include "macros.h"
@@ -166,4 +169,147 @@ util_compress_inflate(const uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
+struct util_compress_dict {
+#ifdef HAVE_ZSTD
+   ZSTD_CDict *cdict;
+   ZSTD_DDict *ddict;
+   unsigned id;
+#else
+   char unused;
+#endif
+};
+
+/**
+ * Trains a dictionary from the concatenated samples, returns the size of
+ * the dictionary or 0 if training failed. Only supported with zstd.
+ */
+size_t
+util_compress_dict_train(void *dict_data, size_t dict_capacity,
+                         const void *samples, const size_t *sample_sizes,
+                         unsigned num_samples)
+{
+   MESA_TRACE_FUNC();
+#ifdef HAVE_ZSTD
+   size_t ret = ZDICT_trainFromBuffer(dict_data, dict_capacity, samples,
+                                      sample_sizes, num_samples);
+   if (ZDICT_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return 0;
+#endif
+}
+
+struct util_compress_dict *
+util_compress_dict_create(const void *dict_data, size_t dict_size)
+{
+#ifdef HAVE_ZSTD
+   /* Raw content would be accepted as a dictionary too, but only a trained
+    * dictionary has an ID that ends up in the compressed frames.
+    */
+   unsigned id = ZDICT_getDictID(dict_data, dict_size);
+   if (!id)
+      return NULL;
+
+   struct util_compress_dict *dict = calloc(1, sizeof(*dict));
+   if (!dict)
+      return NULL;
+
+   dict->id = id;
+   dict->cdict = ZSTD_createCDict(dict_data, dict_size,
+                                  ZSTD_COMPRESSION_LEVEL);
+   dict->ddict = ZSTD_createDDict(dict_data, dict_size);
+   if (!dict->cdict || !dict->ddict) {
+      util_compress_dict_destroy(dict);
+      return NULL;
+   }
+
+   return dict;
+#else
+   return NULL;
+#endif
+}
+
+void
+util_compress_dict_destroy(struct util_compress_dict *dict)
+{
+   if (!dict)
+      return;
+
+#ifdef HAVE_ZSTD
+   ZSTD_freeCDict(dict->cdict);
+   ZSTD_freeDDict(dict->ddict);
+#endif
+   free(dict);
+}
+
+/**
+ * Same as util_compress_inflate(), but decompresses the data that was
+ * compressed with the dictionary. Data compressed without a dictionary
+ * is still accepted, the dictionary ID stored in the frame tells them
+ * apart.
+ */
+bool
+util_compress_inflate_dict(const struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_data_size)
+{
+#ifdef HAVE_ZSTD
+   unsigned id = ZSTD_getDictID_fromFrame(in_data, in_data_size);
+   if (!id)
+      return util_compress_inflate(in_data, in_data_size,
+                                   out_data, out_data_size);
+
+   if (!dict || dict->id != id)
+      return false;
+
+   MESA_TRACE_FUNC();
+
+   ZSTD_DCtx *dctx = ZSTD_createDCtx();
+   if (!dctx)
+      return false;
+
+   size_t ret = ZSTD_decompress_usingDDict(dctx, out_data, out_data_size,
+                                           in_data, in_data_size,
+                                           dict->ddict);
+   ZSTD_freeDCtx(dctx);
+
+   return !ZSTD_isError(ret) && ret == out_data_size;
+#else
+   return util_compress_inflate(in_data, in_data_size,
+                                out_data, out_data_size);
+#endif
+}
+
+size_t
+util_compress_deflate_dict(const struct util_compress_dict *dict,
+                           const uint8_t *in_data, size_t in_data_size,
+                           uint8_t *out_data, size_t out_buff_size)
+{
+#ifdef HAVE_ZSTD
+   if (!dict)
+      return util_compress_deflate(in_data, in_data_size,
+                                   out_data, out_buff_size);
+
+   MESA_TRACE_FUNC();
+
+   ZSTD_CCtx *cctx = ZSTD_createCCtx();
+   if (!cctx)
+      return 0;
+
+   size_t ret = ZSTD_compress_usingCDict(cctx, out_data, out_buff_size,
+                                         in_data, in_data_size, dict->cdict);
+   ZSTD_freeCCtx(cctx);
+
+   if (ZSTD_isError(ret))
+      return 0;
+
+   return ret;
+#else
+   return util_compress_deflate(in_data, in_data_size,
+                                out_data, out_buff_size);
+#endif
+}
+
 #endif
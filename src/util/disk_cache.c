@@ -39,6 +39,8 @@
 
 #include "util/compress.h"
 #include "util/crc32.h"
+#include "util/hash_table.h"
+#include "util/list.h"
 #include "util/u_debug.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
@@ -70,6 +72,330 @@ do {                                       \
    _dst += _src_size;                      \
 } while (0);
 
+/* Upper bound of the memory held by the prefetched items */
+#define DISK_CACHE_STAGING_MAX_SIZE (64 * 1024 * 1024)
+
+struct disk_cache_staged_entry {
+   cache_key key;
+   void *data;
+   size_t size;
+};
+
+static uint32_t
+cache_key_hash(const void *key)
+{
+   uint32_t hash;
+
+   /* The key is a SHA-1 already */
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+cache_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+/* Take the prefetched item out of the staging area */
+static void *
+disk_cache_take_staged(struct disk_cache *cache, const cache_key key,
+                       size_t *size)
+{
+   struct disk_cache_staged_entry *staged = NULL;
+   void *data;
+
+   /* Skip the locking unless something was prefetched */
+   if (!p_atomic_read(&cache->staging.count))
+      return NULL;
+
+   simple_mtx_lock(&cache->staging.lock);
+   struct hash_entry *entry =
+      _mesa_hash_table_search(cache->staging.entries, key);
+   if (entry) {
+      staged = entry->data;
+      _mesa_hash_table_remove(cache->staging.entries, entry);
+      cache->staging.size -= staged->size;
+      p_atomic_dec(&cache->staging.count);
+   }
+   simple_mtx_unlock(&cache->staging.lock);
+
+   if (!staged)
+      return NULL;
+
+   data = staged->data;
+   if (size)
+      *size = staged->size;
+   free(staged);
+
+   return data;
+}
+
+/* Process-wide in-memory cache of the recently used items in front of the
+ * on-disk cache. The items are spread over several shards by their key,
+ * each shard has its own lock, LRU list and share of the byte budget.
+ * Keys already hash the driver keys, so all caches of the process can share
+ * the items.
+ */
+#define DISK_CACHE_MEM_NUM_SHARDS 16
+
+struct disk_cache_mem_entry {
+   struct list_head link;
+   cache_key key;
+   size_t size;
+   uint8_t data[];
+};
+
+struct disk_cache_mem_shard {
+   simple_mtx_t lock;
+   struct hash_table *entries;
+   /* Most recently used entry first */
+   struct list_head lru;
+   size_t size;
+};
+
+static struct {
+   simple_mtx_t lock;
+   unsigned refcount;
+   size_t shard_max_size;
+   struct disk_cache_mem_shard shards[DISK_CACHE_MEM_NUM_SHARDS];
+} disk_cache_mem = {
+   .lock = SIMPLE_MTX_INITIALIZER,
+};
+
+static uint64_t
+disk_cache_parse_size(const char *size_str)
+{
+   uint64_t size;
+   char *end;
+
+   size = strtoul(size_str, &end, 10);
+   if (end == size_str)
+      return 0;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      size *= 1024;
+      break;
+   case 'M':
+   case 'm':
+      size *= 1024*1024;
+      break;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      size *= 1024*1024*1024;
+      break;
+   }
+
+   return size;
+}
+
+static bool
+disk_cache_mem_ref(void)
+{
+   bool enabled = false;
+
+   simple_mtx_lock(&disk_cache_mem.lock);
+
+   if (disk_cache_mem.refcount == 0) {
+      const char *size_str = getenv("MESA_SHADER_CACHE_MEMORY_SIZE");
+      uint64_t max_size = size_str ? disk_cache_parse_size(size_str) : 0;
+
+      disk_cache_mem.shard_max_size = max_size / DISK_CACHE_MEM_NUM_SHARDS;
+      if (!disk_cache_mem.shard_max_size)
+         goto out;
+
+      for (unsigned i = 0; i < DISK_CACHE_MEM_NUM_SHARDS; i++) {
+         struct disk_cache_mem_shard *shard = &disk_cache_mem.shards[i];
+
+         simple_mtx_init(&shard->lock, mtx_plain);
+         shard->entries = _mesa_hash_table_create(NULL, cache_key_hash,
+                                                  cache_key_equal);
+         list_inithead(&shard->lru);
+         shard->size = 0;
+      }
+   }
+
+   disk_cache_mem.refcount++;
+   enabled = true;
+
+out:
+   simple_mtx_unlock(&disk_cache_mem.lock);
+
+   return enabled;
+}
+
+static void
+disk_cache_mem_unref(void)
+{
+   simple_mtx_lock(&disk_cache_mem.lock);
+
+   if (--disk_cache_mem.refcount == 0) {
+      for (unsigned i = 0; i < DISK_CACHE_MEM_NUM_SHARDS; i++) {
+         struct disk_cache_mem_shard *shard = &disk_cache_mem.shards[i];
+
+         list_for_each_entry_safe(struct disk_cache_mem_entry, entry,
+                                  &shard->lru, link)
+            free(entry);
+
+         _mesa_hash_table_destroy(shard->entries, NULL);
+         simple_mtx_destroy(&shard->lock);
+      }
+   }
+
+   simple_mtx_unlock(&disk_cache_mem.lock);
+}
+
+static struct disk_cache_mem_shard *
+disk_cache_mem_shard(const cache_key key)
+{
+   /* The first bytes of the key are used by the hash table already */
+   return &disk_cache_mem.shards[key[CACHE_KEY_SIZE - 1] %
+                                 DISK_CACHE_MEM_NUM_SHARDS];
+}
+
+static void
+disk_cache_mem_remove_locked(struct disk_cache_mem_shard *shard,
+                             struct hash_entry *hash_entry)
+{
+   struct disk_cache_mem_entry *entry = hash_entry->data;
+
+   _mesa_hash_table_remove(shard->entries, hash_entry);
+   list_del(&entry->link);
+   shard->size -= entry->size;
+   free(entry);
+}
+
+/* Return a copy of the item if it's in memory */
+static void *
+disk_cache_mem_get(struct disk_cache *cache, const cache_key key,
+                   size_t *size)
+{
+   struct disk_cache_mem_shard *shard;
+   void *data = NULL;
+
+   if (!cache->mem_cache_enabled)
+      return NULL;
+
+   shard = disk_cache_mem_shard(key);
+
+   simple_mtx_lock(&shard->lock);
+   struct hash_entry *hash_entry =
+      _mesa_hash_table_search(shard->entries, key);
+   if (hash_entry) {
+      struct disk_cache_mem_entry *entry = hash_entry->data;
+
+      data = malloc(entry->size);
+      if (data) {
+         memcpy(data, entry->data, entry->size);
+         if (size)
+            *size = entry->size;
+
+         list_del(&entry->link);
+         list_add(&entry->link, &shard->lru);
+      }
+   }
+   simple_mtx_unlock(&shard->lock);
+
+   if (unlikely(cache->stats.enabled)) {
+      if (data)
+         p_atomic_inc(&cache->stats.mem_hits);
+      else
+         p_atomic_inc(&cache->stats.mem_misses);
+   }
+
+   return data;
+}
+
+/* Store a copy of the item, evicting the least recently used items of the
+ * shard to stay within the budget.
+ */
+static void
+disk_cache_mem_put(struct disk_cache *cache, const cache_key key,
+                   const void *data, size_t size)
+{
+   struct disk_cache_mem_shard *shard;
+   struct disk_cache_mem_entry *entry;
+   unsigned num_evicted = 0;
+
+   if (!cache->mem_cache_enabled || size > disk_cache_mem.shard_max_size)
+      return;
+
+   entry = malloc(sizeof(*entry) + size);
+   if (!entry)
+      return;
+
+   memcpy(entry->key, key, sizeof(cache_key));
+   memcpy(entry->data, data, size);
+   entry->size = size;
+
+   shard = disk_cache_mem_shard(key);
+
+   simple_mtx_lock(&shard->lock);
+
+   struct hash_entry *hash_entry =
+      _mesa_hash_table_search(shard->entries, key);
+   if (hash_entry)
+      disk_cache_mem_remove_locked(shard, hash_entry);
+
+   while (shard->size + size > disk_cache_mem.shard_max_size) {
+      struct disk_cache_mem_entry *lru =
+         list_last_entry(&shard->lru, struct disk_cache_mem_entry, link);
+
+      disk_cache_mem_remove_locked(shard,
+         _mesa_hash_table_search(shard->entries, lru->key));
+      num_evicted++;
+   }
+
+   _mesa_hash_table_insert(shard->entries, entry->key, entry);
+   list_add(&entry->link, &shard->lru);
+   shard->size += size;
+
+   simple_mtx_unlock(&shard->lock);
+
+   if (unlikely(cache->stats.enabled) && num_evicted)
+      p_atomic_add(&cache->stats.mem_evictions, num_evicted);
+}
+
+static bool
+disk_cache_mem_contains(struct disk_cache *cache, const cache_key key)
+{
+   struct disk_cache_mem_shard *shard;
+   bool found;
+
+   if (!cache->mem_cache_enabled)
+      return false;
+
+   shard = disk_cache_mem_shard(key);
+
+   simple_mtx_lock(&shard->lock);
+   found = _mesa_hash_table_search(shard->entries, key) != NULL;
+   simple_mtx_unlock(&shard->lock);
+
+   return found;
+}
+
+static void
+disk_cache_mem_remove(struct disk_cache *cache, const cache_key key)
+{
+   struct disk_cache_mem_shard *shard;
+
+   if (!cache->mem_cache_enabled)
+      return;
+
+   shard = disk_cache_mem_shard(key);
+
+   simple_mtx_lock(&shard->lock);
+   struct hash_entry *hash_entry =
+      _mesa_hash_table_search(shard->entries, key);
+   if (hash_entry)
+      disk_cache_mem_remove_locked(shard, hash_entry);
+   simple_mtx_unlock(&shard->lock);
+}
+
 static bool
 disk_cache_init_queue(struct disk_cache *cache)
 {
@@ -115,6 +441,8 @@ disk_cache_type_create(const char *gpu_name,
    if (cache == NULL)
       goto fail;
 
+   simple_mtx_init(&cache->staging.lock, mtx_plain);
+
    /* Assume failure. */
    cache->path_init_failed = true;
    cache->type = DISK_CACHE_NONE;
@@ -172,30 +500,8 @@ disk_cache_type_create(const char *gpu_name,
    }
    #endif
 
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
+   if (max_size_str)
+      max_size = disk_cache_parse_size(max_size_str);
 
    /* Default to 1GB for maximum cache size. */
    if (max_size == 0) {
@@ -244,6 +550,10 @@ disk_cache_type_create(const char *gpu_name,
    DRV_KEY_CPY(drv_key_blob, &ptr_size, ptr_size_size)
    DRV_KEY_CPY(drv_key_blob, &driver_flags, driver_flags_size)
 
+   /* The dictionary is looked up by the driver keys */
+   if (cache->type == DISK_CACHE_DATABASE && !cache->path_init_failed)
+      disk_cache_db_init_dict(cache);
+
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
@@ -296,6 +606,8 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
                                                    DISK_CACHE_SINGLE_FILE);
    }
 
+   cache->mem_cache_enabled = disk_cache_mem_ref();
+
    return cache;
 }
 
@@ -306,6 +618,13 @@ disk_cache_destroy(struct disk_cache *cache)
       printf("disk shader cache:  hits = %u, misses = %u\n",
              cache->stats.hits,
              cache->stats.misses);
+      if (cache->mem_cache_enabled) {
+         printf("disk shader cache:  memory hits = %u, memory misses = %u, "
+                "memory evictions = %u\n",
+                cache->stats.mem_hits,
+                cache->stats.mem_misses,
+                cache->stats.mem_evictions);
+      }
    }
 
    if (cache && util_queue_is_initialized(&cache->cache_queue)) {
@@ -321,9 +640,26 @@ disk_cache_destroy(struct disk_cache *cache)
       if (cache->type == DISK_CACHE_DATABASE)
          mesa_cache_db_multipart_close(&cache->cache_db);
 
+      util_compress_dict_destroy(cache->dict);
+
       disk_cache_destroy_mmap(cache);
    }
 
+   if (cache && cache->staging.entries) {
+      hash_table_foreach(cache->staging.entries, entry) {
+         struct disk_cache_staged_entry *staged = entry->data;
+         free(staged->data);
+         free(staged);
+      }
+      _mesa_hash_table_destroy(cache->staging.entries, NULL);
+   }
+
+   if (cache)
+      simple_mtx_destroy(&cache->staging.lock);
+
+   if (cache && cache->mem_cache_enabled)
+      disk_cache_mem_unref();
+
    ralloc_free(cache);
 }
 
@@ -336,6 +672,9 @@ disk_cache_wait_for_idle(struct disk_cache *cache)
 void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
+   free(disk_cache_take_staged(cache, key, NULL));
+   disk_cache_mem_remove(cache, key);
+
    if (cache->type == DISK_CACHE_DATABASE) {
       mesa_cache_db_multipart_entry_remove(&cache->cache_db, key);
       return;
@@ -546,6 +885,8 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (!util_queue_is_initialized(&cache->cache_queue))
       return;
 
+   disk_cache_mem_put(cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, (void*)data, size, cache_item_metadata, false);
 
@@ -566,6 +907,8 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
       return;
    }
 
+   disk_cache_mem_put(cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata, true);
 
@@ -576,14 +919,11 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
    }
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+static void *
+disk_cache_load(struct disk_cache *cache, const cache_key key, size_t *size)
 {
    void *buf = NULL;
 
-   if (size)
-      *size = 0;
-
    if (cache->foz_ro_cache)
       buf = disk_cache_load_item_foz(cache->foz_ro_cache, key, size);
 
@@ -601,6 +941,28 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       }
    }
 
+   return buf;
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   size_t buf_size = 0;
+   void *buf;
+
+   buf = disk_cache_mem_get(cache, key, &buf_size);
+   if (!buf) {
+      buf = disk_cache_take_staged(cache, key, &buf_size);
+      if (!buf)
+         buf = disk_cache_load(cache, key, &buf_size);
+
+      if (buf)
+         disk_cache_mem_put(cache, key, buf, buf_size);
+   }
+
+   if (size)
+      *size = buf ? buf_size : 0;
+
    if (unlikely(cache->stats.enabled)) {
       if (buf)
          p_atomic_inc(&cache->stats.hits);
@@ -611,6 +973,127 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return buf;
 }
 
+unsigned
+disk_cache_get_many(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys, void **data, size_t *sizes)
+{
+   unsigned num_found = 0;
+   bool *in_memory = calloc(num_keys, sizeof(*in_memory));
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      sizes[i] = 0;
+      data[i] = disk_cache_mem_get(cache, keys[i], &sizes[i]);
+      if (data[i] && in_memory)
+         in_memory[i] = true;
+
+      if (!data[i])
+         data[i] = disk_cache_take_staged(cache, keys[i], &sizes[i]);
+
+      if (!data[i] && cache->foz_ro_cache)
+         data[i] = disk_cache_load_item_foz(cache->foz_ro_cache, keys[i],
+                                            &sizes[i]);
+      if (data[i])
+         num_found++;
+   }
+
+   if (cache->type == DISK_CACHE_DATABASE && !cache->blob_get_cb) {
+      num_found += disk_cache_db_load_items(cache, keys, num_keys,
+                                            data, sizes);
+   } else {
+      for (unsigned i = 0; i < num_keys; i++) {
+         if (data[i])
+            continue;
+
+         data[i] = disk_cache_load(cache, keys[i], &sizes[i]);
+         if (data[i])
+            num_found++;
+      }
+   }
+
+   for (unsigned i = 0; i < num_keys && cache->mem_cache_enabled; i++) {
+      if (data[i] && !(in_memory && in_memory[i]))
+         disk_cache_mem_put(cache, keys[i], data[i], sizes[i]);
+   }
+
+   free(in_memory);
+
+   if (unlikely(cache->stats.enabled)) {
+      p_atomic_add(&cache->stats.hits, num_found);
+      p_atomic_add(&cache->stats.misses, num_keys - num_found);
+   }
+
+   return num_found;
+}
+
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+   unsigned num_pending = 0;
+   cache_key *pending;
+   size_t *sizes;
+   void **data;
+
+   if (cache->type != DISK_CACHE_DATABASE || cache->blob_get_cb ||
+       !num_keys)
+      return;
+
+   MESA_TRACE_FUNC();
+
+   pending = malloc(num_keys * sizeof(*pending));
+   data = calloc(num_keys, sizeof(*data));
+   sizes = calloc(num_keys, sizeof(*sizes));
+   if (!pending || !data || !sizes)
+      goto out;
+
+   /* Don't read the items that are in memory or staged already */
+   simple_mtx_lock(&cache->staging.lock);
+   if (!cache->staging.entries)
+      cache->staging.entries = _mesa_hash_table_create(NULL, cache_key_hash,
+                                                       cache_key_equal);
+   for (unsigned i = 0; i < num_keys && cache->staging.entries; i++) {
+      if (!_mesa_hash_table_search(cache->staging.entries, keys[i]) &&
+          !disk_cache_mem_contains(cache, keys[i]))
+         memcpy(pending[num_pending++], keys[i], sizeof(cache_key));
+   }
+   simple_mtx_unlock(&cache->staging.lock);
+
+   if (!num_pending ||
+       !disk_cache_db_load_items(cache, pending, num_pending, data, sizes))
+      goto out;
+
+   simple_mtx_lock(&cache->staging.lock);
+   for (unsigned i = 0; i < num_pending; i++) {
+      struct disk_cache_staged_entry *staged = NULL;
+
+      if (!data[i])
+         continue;
+
+      if (cache->staging.size + sizes[i] <= DISK_CACHE_STAGING_MAX_SIZE &&
+          !_mesa_hash_table_search(cache->staging.entries, pending[i]))
+         staged = malloc(sizeof(*staged));
+
+      if (!staged) {
+         free(data[i]);
+         continue;
+      }
+
+      memcpy(staged->key, pending[i], sizeof(cache_key));
+      staged->data = data[i];
+      staged->size = sizes[i];
+
+      _mesa_hash_table_insert(cache->staging.entries, staged->key, staged);
+      cache->staging.size += sizes[i];
+      p_atomic_inc(&cache->staging.count);
+   }
+   simple_mtx_unlock(&cache->staging.lock);
+
+out:
+   free(sizes);
+   free(data);
+   free(pending);
+}
+
 void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -229,6 +229,32 @@ disk_cache_put_nocopy(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Retrieve several items from the cache at once.
+ *
+ * Same as calling disk_cache_get() for each of the \num_keys keys, with
+ * the results stored to \data and \sizes. The Mesa-DB cache reads all of
+ * the entries under a single lock acquisition of each DB part.
+ *
+ * \return The number of the items found.
+ */
+unsigned
+disk_cache_get_many(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys, void **data, size_t *sizes);
+
+/**
+ * Read the items of \keys ahead of time.
+ *
+ * The items are kept in memory until a disk_cache_get() of the same key
+ * picks them up, which then doesn't touch the disk. Meant for the bursts
+ * of lookups with keys known in advance, e.g. loading all shaders of a
+ * pipeline. Only the Mesa-DB cache benefits from it, this is a no-op for
+ * the other cache types.
+ */
+void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -304,6 +330,22 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline unsigned
+disk_cache_get_many(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys, void **data, size_t *sizes)
+{
+   for (unsigned i = 0; i < num_keys; i++)
+      data[i] = NULL;
+
+   return 0;
+}
+
+static inline void
+disk_cache_prefetch(struct disk_cache *cache, const cache_key *keys,
+                    unsigned num_keys)
+{
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -99,7 +99,11 @@ disk_cache_get_function_identifier(void *ptr, struct mesa_sha1 *ctx)
 
 #include "util/blob.h"
 #include "util/crc32.h"
+#include "util/os_file.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
 #include "util/u_debug.h"
+#include "util/u_dynarray.h"
 #include "util/ralloc.h"
 #include "util/rand_xor.h"
 
@@ -544,7 +548,7 @@ disk_cache_evict_item(struct disk_cache *cache, char *filename)
 }
 
 static void *
-parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
+parse_and_validate_cache_item(struct disk_cache *cache, const void *cache_item,
                               size_t cache_item_size, size_t *size)
 {
    uint8_t *uncompressed_data = NULL;
@@ -609,8 +613,10 @@ parse_and_validate_cache_item(struct disk_cache *cache, void *cache_item,
 
       memcpy(uncompressed_data, data, cache_data_size);
    } else {
-      if (!util_compress_inflate(data, cache_data_size, uncompressed_data,
-                                 cf_data->uncompressed_size))
+      if (!util_compress_inflate_dict(p_atomic_read(&cache->dict),
+                                      data, cache_data_size,
+                                      uncompressed_data,
+                                      cf_data->uncompressed_size))
          goto fail;
    }
 
@@ -708,9 +714,13 @@ create_cache_item_header_and_blob(struct disk_cache_put_job *dc_job,
       compressed_data = malloc(max_buf);
       if (compressed_data == NULL)
          return false;
+      struct util_compress_dict *dict = NULL;
+      if (dc_job->cache->dict_enabled)
+         dict = p_atomic_read(&dc_job->cache->dict);
+
       compressed_size =
-         util_compress_deflate(dc_job->data, dc_job->size,
-                              compressed_data, max_buf);
+         util_compress_deflate_dict(dict, dc_job->data, dc_job->size,
+                                    compressed_data, max_buf);
       if (compressed_size == 0)
          goto fail;
    }
@@ -1120,21 +1130,87 @@ disk_cache_destroy_mmap(struct disk_cache *cache)
    munmap(cache->index_mmap, cache->index_mmap_size);
 }
 
+struct disk_cache_db_load_item_state {
+   struct disk_cache *cache;
+   uint8_t *uncompressed_data;
+   size_t *size;
+};
+
+static bool
+disk_cache_db_load_item_cb(const void *cache_item, size_t cache_item_size,
+                           void *data)
+{
+   struct disk_cache_db_load_item_state *state = data;
+
+   state->uncompressed_data =
+       parse_and_validate_cache_item(state->cache, cache_item,
+                                     cache_item_size, state->size);
+
+   return state->uncompressed_data != NULL;
+}
+
 void *
 disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
                         size_t *size)
 {
-   size_t cache_tem_size = 0;
-   void *cache_item = mesa_cache_db_multipart_read_entry(&cache->cache_db,
-                                                         key, &cache_tem_size);
-   if (!cache_item)
-      return NULL;
+   struct disk_cache_db_load_item_state state = {
+      .cache = cache,
+      .size = size,
+   };
 
-   uint8_t *uncompressed_data =
-       parse_and_validate_cache_item(cache, cache_item, cache_tem_size, size);
-   free(cache_item);
+   /* Inflate straight out of the DB file mapping, avoiding the copy */
+   mesa_cache_db_multipart_read_entry_cb(&cache->cache_db, key,
+                                         disk_cache_db_load_item_cb, &state);
 
-   return uncompressed_data;
+   return state.uncompressed_data;
+}
+
+struct disk_cache_db_load_items_state {
+   struct disk_cache *cache;
+   void **data;
+   size_t *sizes;
+   unsigned num_loaded;
+};
+
+static void
+disk_cache_db_load_items_cb(unsigned key_index, const void *cache_item,
+                            size_t cache_item_size, void *data)
+{
+   struct disk_cache_db_load_items_state *state = data;
+
+   state->data[key_index] =
+       parse_and_validate_cache_item(state->cache, cache_item,
+                                     cache_item_size,
+                                     &state->sizes[key_index]);
+   if (state->data[key_index])
+      state->num_loaded++;
+}
+
+/* Load the items of the keys that don't have data[i] set yet */
+unsigned
+disk_cache_db_load_items(struct disk_cache *cache, const cache_key *keys,
+                         unsigned num_keys, void **data, size_t *sizes)
+{
+   struct disk_cache_db_load_items_state state = {
+      .cache = cache,
+      .data = data,
+      .sizes = sizes,
+   };
+   bool *found = malloc(num_keys * sizeof(*found));
+   if (!found)
+      return 0;
+
+   for (unsigned i = 0; i < num_keys; i++)
+      found[i] = data[i] != NULL;
+
+   mesa_cache_db_multipart_read_entries(&cache->cache_db,
+                                        (const uint8_t *)keys, num_keys,
+                                        found, disk_cache_db_load_items_cb,
+                                        &state);
+
+   free(found);
+
+   return state.num_loaded;
 }
 
 bool
@@ -1159,6 +1235,242 @@ disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache)
 {
    return mesa_cache_db_multipart_open(&cache->cache_db, cache->path);
 }
+
+/* The dictionary is trained on up to DICT_TRAIN_SIZE bytes of the existing
+ * cache entries, with each entry contributing at most DICT_SAMPLE_SIZE
+ * bytes. Caches with less than DICT_MIN_TRAIN_SIZE bytes of entries of
+ * the driver are left alone until a later run.
+ */
+#define DICT_SIZE             (64 * 1024)
+#define DICT_SAMPLE_SIZE      (128 * 1024)
+#define DICT_TRAIN_SIZE       (8 * 1024 * 1024)
+#define DICT_MIN_TRAIN_SIZE   (1024 * 1024)
+
+struct disk_cache_dict_samples {
+   struct disk_cache *cache;
+   struct util_dynarray data;
+   struct util_dynarray sizes;
+};
+
+/* Dictionary is per driver, the driver keys identify the driver. */
+static char *
+disk_cache_db_dict_path(struct disk_cache *cache)
+{
+   unsigned char sha1[20];
+   char sha1_str[41];
+   char *path;
+
+   _mesa_sha1_compute(cache->driver_keys_blob, cache->driver_keys_blob_size,
+                      sha1);
+   _mesa_sha1_format(sha1_str, sha1);
+
+   if (asprintf(&path, "%s/zstd_dict_%s", cache->path, sha1_str) == -1)
+      return NULL;
+
+   return path;
+}
+
+static bool
+disk_cache_db_load_dict(struct disk_cache *cache, const char *path)
+{
+   struct util_compress_dict *dict;
+   size_t size;
+   char *data;
+
+   data = os_read_file(path, &size);
+   if (!data)
+      return false;
+
+   dict = util_compress_dict_create(data, size);
+   free(data);
+
+   if (!dict)
+      return false;
+
+   p_atomic_set(&cache->dict, dict);
+
+   return true;
+}
+
+static bool
+disk_cache_db_collect_dict_sample(const void *cache_item,
+                                  size_t cache_item_size, void *data)
+{
+   struct disk_cache_dict_samples *samples = data;
+   struct disk_cache *cache = samples->cache;
+   uint8_t *item;
+   size_t size;
+
+   /* Entries of other drivers share the DB, skip them */
+   if (cache_item_size < cache->driver_keys_blob_size ||
+       memcmp(cache_item, cache->driver_keys_blob,
+              cache->driver_keys_blob_size))
+      return true;
+
+   item = parse_and_validate_cache_item(cache, cache_item, cache_item_size,
+                                        &size);
+   if (!item)
+      return true;
+
+   size = MIN2(size, DICT_SAMPLE_SIZE);
+
+   void *sample = util_dynarray_grow_bytes(&samples->data, 1, size);
+   if (sample) {
+      memcpy(sample, item, size);
+      util_dynarray_append(&samples->sizes, size_t, size);
+   }
+   free(item);
+
+   return sample && samples->data.size < DICT_TRAIN_SIZE;
+}
+
+static void
+disk_cache_db_report_dict(struct disk_cache *cache,
+                          struct disk_cache_dict_samples *samples)
+{
+   size_t num_samples = util_dynarray_num_elements(&samples->sizes, size_t);
+   size_t plain_size = 0, dict_size = 0;
+   int64_t plain_time = 0, dict_time = 0;
+   const uint8_t *sample = samples->data.data;
+
+   size_t max_buf = util_compress_max_compressed_len(DICT_SAMPLE_SIZE);
+   uint8_t *compressed = malloc(max_buf);
+   uint8_t *uncompressed = malloc(DICT_SAMPLE_SIZE);
+   if (!compressed || !uncompressed)
+      goto out;
+
+   util_dynarray_foreach(&samples->sizes, size_t, size) {
+      for (unsigned i = 0; i < 2; i++) {
+         struct util_compress_dict *dict = i ? cache->dict : NULL;
+         size_t compressed_size =
+            util_compress_deflate_dict(dict, sample, *size,
+                                       compressed, max_buf);
+
+         int64_t start = os_time_get_nano();
+         util_compress_inflate_dict(dict, compressed, compressed_size,
+                                    uncompressed, *size);
+         int64_t time = os_time_get_nano() - start;
+
+         *(i ? &dict_size : &plain_size) += compressed_size;
+         *(i ? &dict_time : &plain_time) += time;
+      }
+      sample += *size;
+   }
+
+   printf("disk shader cache:  zstd dictionary trained on %zu entries, "
+          "%u bytes\n", num_samples, samples->data.size);
+   printf("disk shader cache:  compressed size %zu -> %zu bytes, "
+          "decode time %.3f -> %.3f ms\n", plain_size, dict_size,
+          plain_time / 1e6, dict_time / 1e6);
+
+out:
+   free(uncompressed);
+   free(compressed);
+}
+
+static bool
+disk_cache_db_write_dict(const char *path, const void *dict, size_t size)
+{
+   char *tmp_path;
+   bool ret = false;
+
+   if (asprintf(&tmp_path, "%s.%d", path, (int)getpid()) == -1)
+      return false;
+
+   FILE *file = fopen(tmp_path, "wb");
+   if (!file)
+      goto out;
+
+   ret = fwrite(dict, 1, size, file) == size;
+   ret = !fclose(file) && ret;
+
+   /* Don't replace the dictionary another process trained meanwhile, the
+    * entries it wrote are compressed with that one. The loser loads the
+    * winner's dictionary.
+    */
+   if (ret && link(tmp_path, path) == -1 && errno != EEXIST)
+      ret = false;
+
+   unlink(tmp_path);
+out:
+   free(tmp_path);
+
+   return ret;
+}
+
+static void
+disk_cache_db_train_dict(void *job, void *gdata, int thread_index)
+{
+   struct disk_cache *cache = job;
+   struct disk_cache_dict_samples samples = { .cache = cache };
+   size_t num_samples, dict_size;
+   void *dict = NULL;
+   char *path;
+
+   path = disk_cache_db_dict_path(cache);
+   if (!path)
+      return;
+
+   util_dynarray_init(&samples.data, NULL);
+   util_dynarray_init(&samples.sizes, NULL);
+
+   mesa_cache_db_multipart_foreach_entry(&cache->cache_db,
+                                         disk_cache_db_collect_dict_sample,
+                                         &samples);
+
+   if (samples.data.size < DICT_MIN_TRAIN_SIZE)
+      goto out;
+
+   dict = malloc(DICT_SIZE);
+   if (!dict)
+      goto out;
+
+   num_samples = util_dynarray_num_elements(&samples.sizes, size_t);
+   dict_size = util_compress_dict_train(dict, DICT_SIZE, samples.data.data,
+                                        samples.sizes.data, num_samples);
+   if (!dict_size)
+      goto out;
+
+   if (!disk_cache_db_write_dict(path, dict, dict_size) ||
+       !disk_cache_db_load_dict(cache, path))
+      goto out;
+
+   if (cache->stats.enabled)
+      disk_cache_db_report_dict(cache, &samples);
+
+out:
+   util_dynarray_fini(&samples.sizes);
+   util_dynarray_fini(&samples.data);
+   free(dict);
+   free(path);
+}
+
+/* Load the zstd dictionary of the driver, or schedule training one from
+ * the existing cache entries when the dictionary compression is enabled.
+ * The dictionary is loaded regardless of the option, so the entries that
+ * were compressed with it stay readable.
+ */
+void
+disk_cache_db_init_dict(struct disk_cache *cache)
+{
+   char *path;
+
+   if (cache->compression_disabled)
+      return;
+
+   cache->dict_enabled =
+      debug_get_bool_option("MESA_DISK_CACHE_DATABASE_ZSTD_DICT", false);
+
+   path = disk_cache_db_dict_path(cache);
+   if (!path)
+      return;
+
+   if (!disk_cache_db_load_dict(cache, path) && cache->dict_enabled)
+      util_queue_add_job(&cache->cache_queue, cache, NULL,
+                         disk_cache_db_train_dict, NULL, 0);
+
+   free(path);
+}
 #endif
 
 #endif /* ENABLE_SHADER_CACHE */
@@ -96,10 +96,32 @@ struct disk_cache {
    /* Don't compress cached data. This is for testing purposes only. */
    bool compression_disabled;
 
+   /* Entries read ahead by disk_cache_prefetch(), keyed by the cache key
+    * and picked up by disk_cache_get().
+    */
+   struct {
+      simple_mtx_t lock;
+      struct hash_table *entries;
+      size_t size;
+      unsigned count;
+   } staging;
+
+   /* Zstd dictionary of the Mesa-DB cache entries of this driver and
+    * whether new entries are compressed with it.
+    */
+   struct util_compress_dict *dict;
+   bool dict_enabled;
+
+   /* Whether the process-wide in-memory cache is in front of this cache */
+   bool mem_cache_enabled;
+
    struct {
       bool enabled;
       unsigned hits;
       unsigned misses;
+      unsigned mem_hits;
+      unsigned mem_misses;
+      unsigned mem_evictions;
    } stats;
 
    /* Internal RO FOZ cache for combined use of RO and RW caches. */
@@ -172,12 +194,19 @@ void *
 disk_cache_db_load_item(struct disk_cache *cache, const cache_key key,
                         size_t *size);
 
+unsigned
+disk_cache_db_load_items(struct disk_cache *cache, const cache_key *keys,
+                         unsigned num_keys, void **data, size_t *sizes);
+
 bool
 disk_cache_db_write_item_to_disk(struct disk_cache_put_job *dc_job);
 
 bool
 disk_cache_db_load_cache_index(void *mem_ctx, struct disk_cache *cache);
 
+void
+disk_cache_db_init_dict(struct disk_cache *cache);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Control bytes for the Swiss table layout of struct hash_table and
+ * struct set.
+ *
+ * Next to the entries, the table keeps one byte per slot: either
+ * HASH_CTRL_EMPTY, HASH_CTRL_DELETED or, for a present entry, a 7-bit tag
+ * taken from the entry's hash.  The table is made of groups of
+ * HASH_CTRL_GROUP_SIZE slots whose control bytes are compared against a
+ * tag all at once, so a lookup only touches the entries whose tag matches.
+ * Probing goes from group to group, and stops at the first group with an
+ * empty slot.
+ */
+
+#ifndef HASH_CTRL_H
+#define HASH_CTRL_H
+
+#include <stdint.h>
+
+#include "detect_arch.h"
+
+#if defined(__SSE2__) || (defined(_M_X64) && !defined(_M_ARM64EC))
+#include <emmintrin.h>
+#define HASH_CTRL_SSE2 1
+#elif DETECT_ARCH_AARCH64 && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HASH_CTRL_NEON 1
+#endif
+
+#define HASH_CTRL_GROUP_SIZE 16
+#define HASH_CTRL_EMPTY      0x80
+#define HASH_CTRL_DELETED    0xfe
+
+/**
+ * Mixes the bits of a hash before it gets split into a group index (low
+ * bits) and a tag (high bits): many of the Mesa hash functions, like
+ * _mesa_hash_pointer(), only vary in their low bits.
+ */
+static inline uint32_t
+hash_ctrl_mix(uint32_t hash)
+{
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   return hash;
+}
+
+/* Takes a hash_ctrl_mix()ed hash */
+static inline uint8_t
+hash_ctrl_tag(uint32_t mixed)
+{
+   return mixed >> 25;
+}
+
+#if HASH_CTRL_NEON
+static inline unsigned
+hash_ctrl_neon_mask(uint8x16_t eq)
+{
+   static const uint8_t bits[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+   };
+   uint8x16_t m = vandq_u8(eq, vld1q_u8(bits));
+
+   return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+}
+#endif
+
+/**
+ * Returns a mask with bit i set for the slots of the group whose control
+ * byte is \p ctrl.
+ */
+static inline unsigned
+hash_ctrl_match(const uint8_t *group, uint8_t ctrl)
+{
+#if HASH_CTRL_SSE2
+   __m128i g = _mm_loadu_si128((const __m128i *)group);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)ctrl)));
+#elif HASH_CTRL_NEON
+   return hash_ctrl_neon_mask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl)));
+#else
+   unsigned mask = 0;
+   for (unsigned i = 0; i < HASH_CTRL_GROUP_SIZE; i++)
+      mask |= (unsigned)(group[i] == ctrl) << i;
+   return mask;
+#endif
+}
+
+/**
+ * Returns a mask of the empty or deleted slots of the group.
+ */
+static inline unsigned
+hash_ctrl_match_free(const uint8_t *group)
+{
+#if HASH_CTRL_SSE2
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#elif HASH_CTRL_NEON
+   return hash_ctrl_neon_mask(vcltzq_s8(vld1q_s8((const int8_t *)group)));
+#else
+   unsigned mask = 0;
+   for (unsigned i = 0; i < HASH_CTRL_GROUP_SIZE; i++)
+      mask |= (unsigned)(group[i] >> 7) << i;
+   return mask;
+#endif
+}
+
+/**
+ * Returns the next group to probe: the groups are visited in triangular
+ * order, which covers all of them when their number is a power of two.
+ */
+static inline uint32_t
+hash_ctrl_next_group(uint32_t group, uint32_t step, uint32_t group_mask)
+{
+   return (group + step) & group_mask;
+}
+
+#endif /* HASH_CTRL_H */
@@ -45,8 +45,13 @@
 #include <assert.h>
 
 #include "hash_table.h"
+#include "hash_ctrl.h"
+#include "bitscan.h"
 #include "ralloc.h"
 #include "macros.h"
+#include "os_misc.h"
+#include "u_atomic.h"
+#include "u_debug.h"
 #include "u_memory.h"
 #include "fast_urem_by_const.h"
 #include "util/u_memory.h"
@@ -145,6 +150,224 @@ entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
    return entry->key != NULL && entry->key != ht->deleted_key;
 }
 
+/**
+ * Tables and sets use the Swiss layout by default when this is set.
+ *
+ * This can't use DEBUG_GET_ONCE_BOOL_OPTION(), the cached options are
+ * stored in a hash table.
+ */
+static bool
+use_swiss_tables(void)
+{
+   static int swiss = -1;
+
+   if (unlikely(p_atomic_read_relaxed(&swiss) < 0)) {
+      p_atomic_set(&swiss, debug_parse_bool_option(
+                      os_get_option("MESA_HASH_TABLE_SWISS"), false));
+   }
+
+   return swiss;
+}
+
+/**
+ * Swiss layout: the table size is a power of two multiple of
+ * HASH_CTRL_GROUP_SIZE, filled up to 7/8, and ht->ctrl holds one control
+ * byte per entry.  Removed entries get the deleted key like in the default
+ * layout, so iterating over the entries works the same for both.
+ */
+static bool
+swiss_alloc(struct hash_table *ht, void *mem_ctx, uint32_t size)
+{
+   struct hash_entry *table = rzalloc_array(mem_ctx, struct hash_entry, size);
+   if (table == NULL)
+      return false;
+
+   /* Freed along with the entries */
+   uint8_t *ctrl = ralloc_array(table, uint8_t, size);
+   if (ctrl == NULL) {
+      ralloc_free(table);
+      return false;
+   }
+   memset(ctrl, HASH_CTRL_EMPTY, size);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size = size;
+   ht->rehash = 0;
+   ht->size_magic = 0;
+   ht->rehash_magic = 0;
+   ht->max_entries = size - size / 8;
+   ht->size_index = 0;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   return true;
+}
+
+static uint32_t
+swiss_size_for(uint32_t entries)
+{
+   uint32_t size = HASH_CTRL_GROUP_SIZE;
+
+   while (size - size / 8 <= entries && size < (1u << 31))
+      size *= 2;
+
+   return size;
+}
+
+static struct hash_entry *
+swiss_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   const uint8_t tag = hash_ctrl_tag(mixed);
+   uint32_t group = mixed & group_mask;
+
+   for (uint32_t step = 1; step <= group_mask + 1; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = hash_ctrl_match(ctrl, tag);
+
+      while (match) {
+         struct hash_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(ht, entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (hash_ctrl_match(ctrl, HASH_CTRL_EMPTY))
+         return NULL;
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+
+   return NULL;
+}
+
+static void
+swiss_insert_rehash(struct hash_table *ht, uint32_t hash,
+                    const void *key, void *data)
+{
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   uint32_t group = mixed & group_mask;
+
+   for (uint32_t step = 1; ; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      unsigned free = hash_ctrl_match_free(ht->ctrl + base);
+
+      if (likely(free)) {
+         const uint32_t i = base + ffs(free) - 1;
+
+         ht->ctrl[i] = hash_ctrl_tag(mixed);
+         ht->table[i].hash = hash;
+         ht->table[i].key = key;
+         ht->table[i].data = data;
+         return;
+      }
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+}
+
+static void
+swiss_rehash(struct hash_table *ht, uint32_t size)
+{
+   struct hash_table old_ht = *ht;
+
+   if (!swiss_alloc(ht, ralloc_parent(old_ht.table), size)) {
+      *ht = old_ht;
+      return;
+   }
+
+   hash_table_foreach(&old_ht, entry) {
+      swiss_insert_rehash(ht, entry->hash, entry->key, entry->data);
+   }
+
+   ht->entries = old_ht.entries;
+
+   ralloc_free(old_ht.table);
+}
+
+static struct hash_entry *
+swiss_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   if (ht->entries >= ht->max_entries) {
+      swiss_rehash(ht, ht->size * 2);
+   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
+      swiss_rehash(ht, ht->size);
+   }
+
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   const uint8_t tag = hash_ctrl_tag(mixed);
+   uint32_t group = mixed & group_mask;
+   uint32_t available = UINT32_MAX;
+
+   for (uint32_t step = 1; step <= group_mask + 1; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = hash_ctrl_match(ctrl, tag);
+
+      /* Replace an entry with a matching key, see hash_table_get_entry() */
+      while (match) {
+         struct hash_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(ht, entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      /* Stash the first available entry we find */
+      if (available == UINT32_MAX) {
+         unsigned free = hash_ctrl_match_free(ctrl);
+         if (free)
+            available = base + ffs(free) - 1;
+      }
+
+      if (hash_ctrl_match(ctrl, HASH_CTRL_EMPTY))
+         break;
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+
+   if (available != UINT32_MAX) {
+      struct hash_entry *entry = ht->table + available;
+
+      if (ht->ctrl[available] == HASH_CTRL_DELETED)
+         ht->deleted_entries--;
+      ht->ctrl[available] = tag;
+      entry->hash = hash;
+      ht->entries++;
+      return entry;
+   }
+
+   /* We could hit here if a required resize failed. */
+   return NULL;
+}
+
+static void
+swiss_remove(struct hash_table *ht, struct hash_entry *entry)
+{
+   const uint32_t i = entry - ht->table;
+
+   /* Probing stops at the first group with an empty slot, so if this
+    * entry's group has one, no probe ever went past it and the entry can
+    * be freed rather than marked as deleted.
+    */
+   if (hash_ctrl_match(ht->ctrl + (i & ~(HASH_CTRL_GROUP_SIZE - 1)),
+                       HASH_CTRL_EMPTY)) {
+      ht->ctrl[i] = HASH_CTRL_EMPTY;
+      entry->key = NULL;
+   } else {
+      ht->ctrl[i] = HASH_CTRL_DELETED;
+      entry->key = ht->deleted_key;
+      ht->deleted_entries++;
+   }
+   ht->entries--;
+}
+
 bool
 _mesa_hash_table_init(struct hash_table *ht,
                       void *mem_ctx,
@@ -152,18 +375,23 @@ _mesa_hash_table_init(struct hash_table *ht,
                       bool (*key_equals_function)(const void *a,
                                                   const void *b))
 {
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+   ht->deleted_key = &deleted_key_value;
+
+   if (use_swiss_tables())
+      return swiss_alloc(ht, mem_ctx, HASH_CTRL_GROUP_SIZE);
+
+   ht->ctrl = NULL;
    ht->size_index = 0;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
    ht->size_magic = hash_sizes[ht->size_index].size_magic;
    ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
    ht->max_entries = hash_sizes[ht->size_index].max_entries;
-   ht->key_hash_function = key_hash_function;
-   ht->key_equals_function = key_equals_function;
    ht->table = rzalloc_array(mem_ctx, struct hash_entry, ht->size);
    ht->entries = 0;
    ht->deleted_entries = 0;
-   ht->deleted_key = &deleted_key_value;
 
    return ht->table != NULL;
 }
@@ -230,6 +458,16 @@ _mesa_hash_table_clone(struct hash_table *src, void *dst_mem_ctx)
 
    memcpy(ht->table, src->table, ht->size * sizeof(struct hash_entry));
 
+   if (src->ctrl) {
+      ht->ctrl = ralloc_array(ht->table, uint8_t, ht->size);
+      if (ht->ctrl == NULL) {
+         ralloc_free(ht);
+         return NULL;
+      }
+
+      memcpy(ht->ctrl, src->ctrl, ht->size);
+   }
+
    return ht;
 }
 
@@ -257,7 +495,9 @@ _mesa_hash_table_destroy(struct hash_table *ht,
 static void
 hash_table_clear_fast(struct hash_table *ht)
 {
-   memset(ht->table, 0, sizeof(struct hash_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct hash_entry) * ht->size);
+   if (ht->ctrl)
+      memset(ht->ctrl, HASH_CTRL_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -283,6 +523,8 @@ _mesa_hash_table_clear(struct hash_table *ht,
 
          entry->key = NULL;
       }
+      if (ht->ctrl)
+         memset(ht->ctrl, HASH_CTRL_EMPTY, ht->size);
       ht->entries = 0;
       ht->deleted_entries = 0;
    } else
@@ -310,6 +552,9 @@ hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(ht, key));
 
+   if (ht->ctrl)
+      return swiss_search(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_hash_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = 1 + util_fast_urem32(hash, ht->rehash,
@@ -391,7 +636,8 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
    struct hash_table old_ht;
    struct hash_entry *table;
 
-   if (ht->size_index == new_size_index && ht->deleted_entries == ht->max_entries) {
+   if (!ht->ctrl && ht->size_index == new_size_index &&
+       ht->deleted_entries == ht->max_entries) {
       hash_table_clear_fast(ht);
       assert(!ht->entries);
       return;
@@ -408,6 +654,7 @@ _mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
    old_ht = *ht;
 
    ht->table = table;
+   ht->ctrl = NULL;
    ht->size_index = new_size_index;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
@@ -433,6 +680,9 @@ hash_table_get_entry(struct hash_table *ht, uint32_t hash, const void *key)
 
    assert(!key_pointer_is_reserved(ht, key));
 
+   if (ht->ctrl)
+      return swiss_get_entry(ht, hash, key);
+
    if (ht->entries >= ht->max_entries) {
       _mesa_hash_table_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
@@ -538,6 +788,11 @@ _mesa_hash_table_remove(struct hash_table *ht,
    if (!entry)
       return;
 
+   if (ht->ctrl) {
+      swiss_remove(ht, entry);
+      return;
+   }
+
    entry->key = ht->deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -741,6 +996,10 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size)
 {
    if (size < ht->max_entries)
       return true;
+   if (ht->ctrl) {
+      swiss_rehash(ht, swiss_size_for(size));
+      return ht->max_entries >= size;
+   }
    for (unsigned i = ht->size_index + 1; i < ARRAY_SIZE(hash_sizes); i++) {
       if (hash_sizes[i].max_entries >= size) {
          _mesa_hash_table_rehash(ht, i);
@@ -750,6 +1009,32 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size)
    return ht->max_entries >= size;
 }
 
+/**
+ * Switches the table between the default layout and the Swiss layout (see
+ * hash_ctrl.h), rehashing the entries.  Returns false if the table couldn't
+ * be reallocated, in which case it is left unchanged.
+ *
+ * MESA_HASH_TABLE_SWISS=true makes the Swiss layout the default for all
+ * tables and sets.
+ */
+bool
+_mesa_hash_table_use_swiss(struct hash_table *ht, bool swiss)
+{
+   if (!!ht->ctrl == swiss)
+      return true;
+
+   if (swiss) {
+      swiss_rehash(ht, swiss_size_for(ht->entries));
+   } else {
+      unsigned size_index = 0;
+      while (hash_sizes[size_index].max_entries <= ht->entries)
+         size_index++;
+      _mesa_hash_table_rehash(ht, size_index);
+   }
+
+   return !!ht->ctrl == swiss;
+}
+
 /**
  * Hash table wrapper which supports 64-bit keys.
  *
@@ -45,6 +45,7 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   uint8_t *ctrl;   /**< control bytes of the Swiss layout, see hash_ctrl.h */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
@@ -132,6 +133,18 @@ _mesa_pointer_hash_table_create(void *mem_ctx);
 
 bool
 _mesa_hash_table_reserve(struct hash_table *ht, unsigned size);
+
+bool
+_mesa_hash_table_use_swiss(struct hash_table *ht, bool swiss);
+
+/* Marks an entry emptied by hash_table_foreach_remove() as free. */
+static inline void
+_mesa_hash_table_free_ctrl(struct hash_table *ht, struct hash_entry *entry)
+{
+   if (ht->ctrl)
+      ht->ctrl[entry - ht->table] = 0x80; /* HASH_CTRL_EMPTY */
+}
+
 /**
  * This foreach function is safe against deletion (which just replaces
  * an entry's data with the deleted marker), but not against insertion
@@ -149,6 +162,7 @@ _mesa_hash_table_reserve(struct hash_table *ht, unsigned size);
    for (struct hash_entry *entry = _mesa_hash_table_next_entry_unsafe(ht, NULL);  \
         (ht)->entries;                                                     \
         entry->hash = 0, entry->key = (void*)NULL, entry->data = NULL,      \
+        _mesa_hash_table_free_ctrl(ht, entry),                             \
         (ht)->entries--, entry = _mesa_hash_table_next_entry_unsafe(ht, entry))
 
 static inline void
@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "crc32.h"
@@ -139,6 +141,13 @@ mesa_db_generate_uuid(void)
    return ((os_time_get() / 1000000) << 32) | rand();
 }
 
+static bool
+mesa_db_header_valid(const struct mesa_db_file_header *header)
+{
+   return !strncmp(header->magic, MESA_CACHE_DB_MAGIC, sizeof(header->magic)) &&
+          header->version == MESA_CACHE_DB_VERSION && header->uuid;
+}
+
 static bool
 mesa_db_read_header(FILE *file, struct mesa_db_file_header *header)
 {
@@ -148,11 +157,7 @@ mesa_db_read_header(FILE *file, struct mesa_db_file_header *header)
    if (!mesa_db_read(file, header))
       return false;
 
-   if (strncmp(header->magic, MESA_CACHE_DB_MAGIC, sizeof(header->magic)) ||
-       header->version != MESA_CACHE_DB_VERSION || !header->uuid)
-      return false;
-
-   return true;
+   return mesa_db_header_valid(header);
 }
 
 static bool
@@ -182,6 +187,71 @@ static bool mesa_db_uuid_changed(struct mesa_cache_db *db)
    return false;
 }
 
+static void
+mesa_db_unmap_file(struct mesa_cache_db_file *db_file)
+{
+   if (db_file->map)
+      munmap(db_file->map, db_file->map_size);
+
+   db_file->map = NULL;
+   db_file->map_size = 0;
+}
+
+/* Make sure that the mapping covers the whole file. Must be called under
+ * the held lock, the file size can't change until the lock is released.
+ *
+ * The files only grow by appending between compactions, compaction and
+ * zapping shrink them, so a size change is the only event that requires
+ * a remap. A UUID change with an unchanged size is picked up through the
+ * shared mapping by itself.
+ */
+static bool
+mesa_db_map_file(struct mesa_cache_db_file *db_file, int prot)
+{
+   struct stat st;
+   void *map;
+
+   if (fstat(fileno(db_file->file), &st) == -1)
+      return false;
+
+   if (db_file->map && db_file->map_size == st.st_size)
+      return true;
+
+   mesa_db_unmap_file(db_file);
+
+   if (st.st_size < sizeof(struct mesa_db_file_header))
+      return false;
+
+   map = mmap(NULL, st.st_size, prot, MAP_SHARED, fileno(db_file->file), 0);
+   if (map == MAP_FAILED)
+      return false;
+
+   db_file->map = map;
+   db_file->map_size = st.st_size;
+
+   return true;
+}
+
+static bool
+mesa_db_map_files(struct mesa_cache_db *db)
+{
+   /* Index is mapped writable to update the entry access time in place */
+   return mesa_db_map_file(&db->cache, PROT_READ) &&
+          mesa_db_map_file(&db->index, PROT_READ | PROT_WRITE);
+}
+
+static bool
+mesa_db_mapped_uuid_changed(struct mesa_cache_db *db)
+{
+   const struct mesa_db_file_header *cache_header = db->cache.map;
+   const struct mesa_db_file_header *index_header = db->index.map;
+
+   return !mesa_db_header_valid(cache_header) ||
+          !mesa_db_header_valid(index_header) ||
+          cache_header->uuid != index_header->uuid ||
+          cache_header->uuid != db->uuid;
+}
+
 static bool
 mesa_db_write_header(struct mesa_cache_db_file *db_file,
                      uint64_t uuid, bool reset)
@@ -222,6 +292,9 @@ mesa_db_zap(struct mesa_cache_db *db)
    /* Disable cache to prevent the recurring faults */
    db->alive = false;
 
+   mesa_db_unmap_file(&db->cache);
+   mesa_db_unmap_file(&db->index);
+
    /* Zap corrupted database files to start over from a clean slate */
    if (!mesa_db_truncate(db->cache.file, 0) ||
        !mesa_db_truncate(db->index.file, 0))
@@ -234,14 +307,14 @@ mesa_db_zap(struct mesa_cache_db *db)
 }
 
 static bool
-mesa_db_index_entry_valid(struct mesa_index_db_file_entry *entry)
+mesa_db_index_entry_valid(const struct mesa_index_db_file_entry *entry)
 {
    return entry->size && entry->hash &&
           (int64_t)entry->cache_db_file_offset >= sizeof(struct mesa_db_file_header);
 }
 
 static bool
-mesa_db_cache_entry_valid(struct mesa_cache_db_file_entry *entry)
+mesa_db_cache_entry_valid(const struct mesa_cache_db_file_entry *entry)
 {
    return entry->size && entry->crc;
 }
@@ -289,6 +362,40 @@ mesa_db_update_index(struct mesa_cache_db *db)
    return db->index.offset == file_length;
 }
 
+/* Same as mesa_db_update_index(), but parses the new index entries
+ * straight out of the mapped index file.
+ */
+static bool
+mesa_db_update_mapped_index(struct mesa_cache_db *db)
+{
+   const uint8_t *map = db->index.map;
+   struct mesa_index_db_hash_entry *hash_entry;
+   struct mesa_index_db_file_entry index_entry;
+
+   while (db->index.offset + sizeof(index_entry) <= db->index.map_size) {
+      memcpy(&index_entry, map + db->index.offset, sizeof(index_entry));
+
+      /* Check whether the index entry looks valid or we have a corrupted DB */
+      if (!mesa_db_index_entry_valid(&index_entry))
+         break;
+
+      hash_entry = ralloc(db->mem_ctx, struct mesa_index_db_hash_entry);
+      if (!hash_entry)
+         break;
+
+      hash_entry->cache_db_file_offset = index_entry.cache_db_file_offset;
+      hash_entry->index_db_file_offset = db->index.offset;
+      hash_entry->last_access_time = index_entry.last_access_time;
+      hash_entry->size = index_entry.size;
+
+      _mesa_hash_table_u64_insert(db->index_db, index_entry.hash, hash_entry);
+
+      db->index.offset += sizeof(index_entry);
+   }
+
+   return db->index.offset == db->index.map_size;
+}
+
 static void
 mesa_db_hash_table_reset(struct mesa_cache_db *db)
 {
@@ -616,6 +723,8 @@ mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path)
 
    simple_mtx_init(&db->flock_mtx, mtx_plain);
 
+   db->mmap_reads = debug_get_bool_option("MESA_DISK_CACHE_DATABASE_MMAP", true);
+
    db->index_db = _mesa_hash_table_u64_create(NULL);
    if (!db->index_db)
       goto destroy_mtx;
@@ -662,6 +771,9 @@ mesa_cache_db_close(struct mesa_cache_db *db)
    simple_mtx_destroy(&db->flock_mtx);
    ralloc_free(db->mem_ctx);
 
+   mesa_db_unmap_file(&db->index);
+   mesa_db_unmap_file(&db->cache);
+
    mesa_db_close_file(&db->index);
    mesa_db_close_file(&db->cache);
 }
@@ -679,33 +791,30 @@ mesa_cache_db_file_entry_size(void)
    return sizeof(struct mesa_cache_db_file_entry);
 }
 
-void *
-mesa_cache_db_read_entry(struct mesa_cache_db *db,
-                         const uint8_t *cache_key_160bit,
-                         size_t *size)
+/* Bring the in-memory index up to date with the DB files. */
+static bool
+mesa_db_sync_index_locked(struct mesa_cache_db *db, bool mapped)
+{
+   /* Reloading doesn't change the files, the mappings stay valid */
+   if (mapped ? mesa_db_mapped_uuid_changed(db) : mesa_db_uuid_changed(db))
+      return mesa_db_reload(db);
+
+   return mapped ? mesa_db_update_mapped_index(db) : mesa_db_update_index(db);
+}
+
+/* Read the entry using the file IO. Returns a malloc'ed copy of the blob,
+ * the DB is zapped if it turns out to be corrupted.
+ */
+static void *
+mesa_db_read_hash_entry(struct mesa_cache_db *db,
+                        struct mesa_index_db_hash_entry *hash_entry,
+                        const uint8_t *cache_key_160bit,
+                        size_t *size)
 {
-   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
    struct mesa_cache_db_file_entry cache_entry;
    struct mesa_index_db_file_entry index_entry;
-   struct mesa_index_db_hash_entry *hash_entry;
    void *data = NULL;
 
-   if (!mesa_db_lock(db))
-      return NULL;
-
-   if (!db->alive)
-      goto fail;
-
-   if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
-      goto fail_fatal;
-
-   if (!mesa_db_update_index(db))
-      goto fail_fatal;
-
-   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
-   if (!hash_entry)
-      goto fail;
-
    if (!mesa_db_seek(db->cache.file, hash_entry->cache_db_file_offset) ||
        !mesa_db_read(db->cache.file, &cache_entry) ||
        !mesa_db_cache_entry_valid(&cache_entry))
@@ -738,8 +847,6 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
 
    fflush(db->index.file);
 
-   mesa_db_unlock(db);
-
    *size = cache_entry.size;
 
    return data;
@@ -749,11 +856,314 @@ fail_fatal:
 fail:
    free(data);
 
-   mesa_db_unlock(db);
+   return NULL;
+}
+
+/* Look up the entry in the mapped DB files. Returns pointer into the
+ * cache file mapping, which stays valid while the lock is held.
+ */
+static const void *
+mesa_db_map_hash_entry(struct mesa_cache_db *db,
+                       struct mesa_index_db_hash_entry *hash_entry,
+                       const uint8_t *cache_key_160bit,
+                       size_t *size)
+{
+   const struct mesa_cache_db_file_entry *cache_entry;
+   struct mesa_index_db_file_entry *index_entry;
+   const uint8_t *blob;
+
+   if (hash_entry->cache_db_file_offset + blob_file_size(hash_entry->size) >
+       db->cache.map_size ||
+       hash_entry->index_db_file_offset + sizeof(*index_entry) >
+       db->index.map_size)
+      goto fail_fatal;
+
+   cache_entry = (const void *)((const uint8_t *)db->cache.map +
+                                hash_entry->cache_db_file_offset);
+   blob = (const uint8_t *)(cache_entry + 1);
+
+   if (!mesa_db_cache_entry_valid(cache_entry) ||
+       cache_entry->size != hash_entry->size)
+      goto fail_fatal;
+
+   if (memcmp(cache_entry->key, cache_key_160bit, sizeof(cache_entry->key)))
+      return NULL;
+
+   if (util_hash_crc32(blob, cache_entry->size) != cache_entry->crc)
+      goto fail_fatal;
+
+   index_entry = (void *)((uint8_t *)db->index.map +
+                          hash_entry->index_db_file_offset);
+
+   if (!mesa_db_index_entry_valid(index_entry) ||
+       index_entry->cache_db_file_offset != hash_entry->cache_db_file_offset ||
+       index_entry->size != hash_entry->size)
+      goto fail_fatal;
+
+   /* Stores to the shared mapping are seen by the file readers right away */
+   index_entry->last_access_time = os_time_get_nano();
+   hash_entry->last_access_time = index_entry->last_access_time;
+
+   *size = cache_entry->size;
+
+   return blob;
+
+fail_fatal:
+   mesa_db_zap(db);
 
    return NULL;
 }
 
+void *
+mesa_cache_db_read_entry(struct mesa_cache_db *db,
+                         const uint8_t *cache_key_160bit,
+                         size_t *size)
+{
+   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
+   struct mesa_index_db_hash_entry *hash_entry;
+   const void *blob;
+   void *data = NULL;
+   bool mapped;
+
+   if (!mesa_db_lock(db))
+      return NULL;
+
+   if (!db->alive)
+      goto out;
+
+   mapped = db->mmap_reads && mesa_db_map_files(db);
+
+   if (!mesa_db_sync_index_locked(db, mapped)) {
+      mesa_db_zap(db);
+      goto out;
+   }
+
+   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+   if (!hash_entry)
+      goto out;
+
+   if (mapped) {
+      blob = mesa_db_map_hash_entry(db, hash_entry, cache_key_160bit, size);
+      if (blob) {
+         data = malloc(*size);
+         if (data)
+            memcpy(data, blob, *size);
+      }
+   } else {
+      data = mesa_db_read_hash_entry(db, hash_entry, cache_key_160bit, size);
+   }
+
+out:
+   mesa_db_unlock(db);
+
+   return data;
+}
+
+/* Zero-copy variant of mesa_cache_db_read_entry(). With the mmap reads
+ * the callback runs under the held DB lock and gets the blob straight out
+ * of the mapped cache file, otherwise it gets a temporary copy.
+ */
+bool
+mesa_cache_db_read_entry_cb(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            mesa_cache_db_read_cb cb, void *data)
+{
+   uint64_t hash = to_mesa_cache_db_hash(cache_key_160bit);
+   struct mesa_index_db_hash_entry *hash_entry;
+   const void *blob;
+   void *copy = NULL;
+   bool ret = false;
+   bool mapped;
+   size_t size;
+
+   if (!mesa_db_lock(db))
+      return false;
+
+   if (!db->alive)
+      goto out;
+
+   mapped = db->mmap_reads && mesa_db_map_files(db);
+
+   if (!mesa_db_sync_index_locked(db, mapped)) {
+      mesa_db_zap(db);
+      goto out;
+   }
+
+   hash_entry = _mesa_hash_table_u64_search(db->index_db, hash);
+   if (!hash_entry)
+      goto out;
+
+   if (mapped) {
+      blob = mesa_db_map_hash_entry(db, hash_entry, cache_key_160bit, &size);
+      if (blob)
+         ret = cb(blob, size, data);
+   } else {
+      copy = mesa_db_read_hash_entry(db, hash_entry, cache_key_160bit, &size);
+   }
+
+out:
+   mesa_db_unlock(db);
+
+   if (copy) {
+      ret = cb(copy, size, data);
+      free(copy);
+   }
+
+   return ret;
+}
+
+struct mesa_db_read_request {
+   struct mesa_index_db_hash_entry *hash_entry;
+   unsigned index;
+};
+
+static int
+request_sort_offset(const void *_a, const void *_b)
+{
+   const struct mesa_db_read_request *a = _a;
+   const struct mesa_db_read_request *b = _b;
+
+   return a->hash_entry->cache_db_file_offset >
+          b->hash_entry->cache_db_file_offset ? 1 : -1;
+}
+
+/* Look up several entries under a single lock acquisition. The entries are
+ * read in the cache file order, the keys that have found[i] set are
+ * skipped and found[i] is set for every entry passed to the callback.
+ * Returns the number of the entries found.
+ */
+unsigned
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, bool *found,
+                           mesa_cache_db_read_many_cb cb, void *data)
+{
+   struct mesa_index_db_hash_entry *hash_entry;
+   struct mesa_db_read_request *requests;
+   unsigned num_requests = 0, num_found = 0;
+   bool mapped;
+
+   requests = malloc(num_keys * sizeof(*requests));
+   if (!requests)
+      return 0;
+
+   if (!mesa_db_lock(db))
+      goto free_requests;
+
+   if (!db->alive)
+      goto out;
+
+   mapped = db->mmap_reads && mesa_db_map_files(db);
+
+   if (!mesa_db_sync_index_locked(db, mapped)) {
+      mesa_db_zap(db);
+      goto out;
+   }
+
+   for (unsigned i = 0; i < num_keys; i++) {
+      if (found[i])
+         continue;
+
+      hash_entry = _mesa_hash_table_u64_search(db->index_db,
+         to_mesa_cache_db_hash(&cache_keys_160bit[i * 20]));
+      if (hash_entry)
+         requests[num_requests++] = (struct mesa_db_read_request) {
+            .hash_entry = hash_entry,
+            .index = i,
+         };
+   }
+
+   qsort(requests, num_requests, sizeof(*requests), request_sort_offset);
+
+   for (unsigned i = 0; i < num_requests && db->alive; i++) {
+      const uint8_t *key = &cache_keys_160bit[requests[i].index * 20];
+      void *copy = NULL;
+      const void *blob;
+      size_t size;
+
+      if (mapped)
+         blob = mesa_db_map_hash_entry(db, requests[i].hash_entry, key, &size);
+      else
+         blob = copy = mesa_db_read_hash_entry(db, requests[i].hash_entry,
+                                               key, &size);
+      if (!blob)
+         continue;
+
+      cb(requests[i].index, blob, size, data);
+      free(copy);
+
+      found[requests[i].index] = true;
+      num_found++;
+   }
+
+out:
+   mesa_db_unlock(db);
+free_requests:
+   free(requests);
+
+   return num_found;
+}
+
+/* Walk over all entries of the DB in no particular order until the
+ * callback returns false. Returns true if all entries were visited.
+ */
+bool
+mesa_cache_db_foreach_entry(struct mesa_cache_db *db,
+                            mesa_cache_db_read_cb cb, void *data)
+{
+   struct mesa_cache_db_file_entry cache_entry;
+   void *buffer = NULL;
+
+   if (!mesa_db_lock(db))
+      return false;
+
+   if (!db->alive)
+      goto fail;
+
+   if (mesa_db_uuid_changed(db) && !mesa_db_reload(db))
+      goto fail_fatal;
+
+   if (!mesa_db_update_index(db))
+      goto fail_fatal;
+
+   hash_table_foreach(db->index_db->table, entry) {
+      struct mesa_index_db_hash_entry *hash_entry = entry->data;
+      void *new_buffer;
+
+      if (!mesa_db_seek(db->cache.file, hash_entry->cache_db_file_offset) ||
+          !mesa_db_read(db->cache.file, &cache_entry) ||
+          !mesa_db_cache_entry_valid(&cache_entry))
+         goto fail_fatal;
+
+      new_buffer = realloc(buffer, cache_entry.size);
+      if (!new_buffer)
+         goto fail;
+      buffer = new_buffer;
+
+      if (!mesa_db_read_data(db->cache.file, buffer, cache_entry.size) ||
+          util_hash_crc32(buffer, cache_entry.size) != cache_entry.crc)
+         goto fail_fatal;
+
+      if (!cb(buffer, cache_entry.size, data))
+         goto fail;
+   }
+
+   free(buffer);
+
+   mesa_db_unlock(db);
+
+   return true;
+
+fail_fatal:
+   mesa_db_zap(db);
+fail:
+   free(buffer);
+
+   mesa_db_unlock(db);
+
+   return false;
+}
+
 static bool
 mesa_cache_db_has_space_locked(struct mesa_cache_db *db, size_t blob_size)
 {
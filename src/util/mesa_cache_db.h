@@ -26,6 +26,8 @@ struct mesa_cache_db_file {
    char *path;
    off_t offset;
    uint64_t uuid;
+   void *map;
+   size_t map_size;
 };
 
 struct mesa_cache_db {
@@ -37,8 +39,22 @@ struct mesa_cache_db {
    void *mem_ctx;
    uint64_t uuid;
    bool alive;
+   bool mmap_reads;
 };
 
+/* Called with a pointer to the cache entry blob, which is only valid
+ * for the duration of the call.
+ */
+typedef bool (*mesa_cache_db_read_cb)(const void *blob, size_t size,
+                                      void *data);
+
+/* Same as above, the key_index tells which of the looked up keys the
+ * blob belongs to.
+ */
+typedef void (*mesa_cache_db_read_many_cb)(unsigned key_index,
+                                           const void *blob, size_t size,
+                                           void *data);
+
 #if DETECT_OS_WINDOWS == 0
 bool
 mesa_cache_db_open(struct mesa_cache_db *db, const char *cache_path);
@@ -58,6 +74,21 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
                          const uint8_t *cache_key_160bit,
                          size_t *size);
 
+bool
+mesa_cache_db_read_entry_cb(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            mesa_cache_db_read_cb cb, void *data);
+
+unsigned
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, bool *found,
+                           mesa_cache_db_read_many_cb cb, void *data);
+
+bool
+mesa_cache_db_foreach_entry(struct mesa_cache_db *db,
+                            mesa_cache_db_read_cb cb, void *data);
+
 bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
@@ -107,6 +138,30 @@ mesa_cache_db_read_entry(struct mesa_cache_db *db,
    return NULL;
 }
 
+static inline bool
+mesa_cache_db_read_entry_cb(struct mesa_cache_db *db,
+                            const uint8_t *cache_key_160bit,
+                            mesa_cache_db_read_cb cb, void *data)
+{
+   return false;
+}
+
+static inline unsigned
+mesa_cache_db_read_entries(struct mesa_cache_db *db,
+                           const uint8_t *cache_keys_160bit,
+                           unsigned num_keys, bool *found,
+                           mesa_cache_db_read_many_cb cb, void *data)
+{
+   return 0;
+}
+
+static inline bool
+mesa_cache_db_foreach_entry(struct mesa_cache_db *db,
+                            mesa_cache_db_read_cb cb, void *data)
+{
+   return false;
+}
+
 static inline bool
 mesa_cache_db_entry_write(struct mesa_cache_db *db,
                           const uint8_t *cache_key_160bit,
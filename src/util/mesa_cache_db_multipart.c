@@ -103,6 +103,58 @@ mesa_cache_db_multipart_read_entry(struct mesa_cache_db_multipart *db,
    return NULL;
 }
 
+bool
+mesa_cache_db_multipart_read_entry_cb(struct mesa_cache_db_multipart *db,
+                                      const uint8_t *cache_key_160bit,
+                                      mesa_cache_db_read_cb cb, void *data)
+{
+   unsigned last_read_part = db->last_read_part;
+
+   for (unsigned int i = 0; i < db->num_parts; i++) {
+      unsigned int part = (last_read_part + i) % db->num_parts;
+
+      if (mesa_cache_db_read_entry_cb(&db->parts[part], cache_key_160bit,
+                                      cb, data)) {
+         db->last_read_part = part;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+unsigned
+mesa_cache_db_multipart_read_entries(struct mesa_cache_db_multipart *db,
+                                     const uint8_t *cache_keys_160bit,
+                                     unsigned num_keys, bool *found,
+                                     mesa_cache_db_read_many_cb cb,
+                                     void *data)
+{
+   unsigned num_missing = 0, num_found = 0;
+
+   for (unsigned int i = 0; i < num_keys; i++)
+      num_missing += !found[i];
+
+   /* Each DB part is locked once for all of the keys */
+   for (unsigned int i = 0; i < db->num_parts && num_found < num_missing; i++)
+      num_found += mesa_cache_db_read_entries(&db->parts[i], cache_keys_160bit,
+                                              num_keys, found, cb, data);
+
+   return num_found;
+}
+
+bool
+mesa_cache_db_multipart_foreach_entry(struct mesa_cache_db_multipart *db,
+                                      mesa_cache_db_read_cb cb, void *data)
+{
+   for (unsigned int i = 0; i < db->num_parts; i++) {
+      if (!mesa_cache_db_foreach_entry(&db->parts[i], cb, data))
+         return false;
+   }
+
+   return true;
+}
+
 static unsigned
 mesa_cache_db_multipart_select_victim_part(struct mesa_cache_db_multipart *db)
 {
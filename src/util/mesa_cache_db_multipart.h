@@ -32,6 +32,22 @@ mesa_cache_db_multipart_read_entry(struct mesa_cache_db_multipart *db,
                                    const uint8_t *cache_key_160bit,
                                    size_t *size);
 
+bool
+mesa_cache_db_multipart_read_entry_cb(struct mesa_cache_db_multipart *db,
+                                      const uint8_t *cache_key_160bit,
+                                      mesa_cache_db_read_cb cb, void *data);
+
+unsigned
+mesa_cache_db_multipart_read_entries(struct mesa_cache_db_multipart *db,
+                                     const uint8_t *cache_keys_160bit,
+                                     unsigned num_keys, bool *found,
+                                     mesa_cache_db_read_many_cb cb,
+                                     void *data);
+
+bool
+mesa_cache_db_multipart_foreach_entry(struct mesa_cache_db_multipart *db,
+                                      mesa_cache_db_read_cb cb, void *data);
+
 bool
 mesa_cache_db_multipart_entry_write(struct mesa_cache_db_multipart *db,
                                     const uint8_t *cache_key_160bit,
@@ -102,6 +102,19 @@ _mesa_trace_scope_end(UNUSED int *scope)
 #define MESA_TRACE_SCOPE(name) _MESA_TRACE_SCOPE(name)
 #define MESA_TRACE_FUNC() _MESA_TRACE_SCOPE(__func__)
 
+/* For slices which don't match a C scope */
+#define MESA_TRACE_BEGIN(name)                                               \
+   do {                                                                      \
+      _MESA_TRACE_BEGIN(name);                                               \
+      _MESA_GPUVIS_TRACE_BEGIN(name);                                        \
+   } while (0)
+
+#define MESA_TRACE_END()                                                     \
+   do {                                                                      \
+      _MESA_GPUVIS_TRACE_END();                                              \
+      _MESA_TRACE_END();                                                     \
+   } while (0)
+
 static inline void
 util_cpu_trace_init()
 {
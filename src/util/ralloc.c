@@ -547,6 +547,9 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
 
 #define NUM_FREELIST_BUCKETS (MAX_FREELIST_SIZE / FREELIST_ALIGNMENT)
 
+/* Bucket of the allocations made from an arena chunk, see gc_set_arena(). */
+#define GC_ARENA_BUCKET (NUM_FREELIST_BUCKETS + 1)
+
 /* The size of a slab. */
 #define SLAB_SIZE (32 * 1024)
 
@@ -556,6 +559,8 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
 enum gc_flags {
    IS_USED = (1 << 0),
    CURRENT_GENERATION = (1 << 1),
+   /* Arena allocations found live by the current sweep. */
+   IS_MARKED = (1 << 2),
    IS_PADDING = (1 << 7),
 };
 
@@ -579,6 +584,8 @@ typedef struct
 
 /* This structure is at the start of the slab. Objects inside a slab are
  * allocated using a freelist backed by a simple linear allocator.
+ *
+ * Arena chunks use the same structure, but only use the linear allocator.
  */
 typedef struct gc_slab {
    alignas(HEADER_ALIGN)
@@ -605,6 +612,29 @@ typedef struct gc_slab {
    unsigned num_free;
 } gc_slab;
 
+/* Every allocation or run of free space in an arena chunk starts with this,
+ * so that a sweep can walk the chunk.
+ */
+typedef struct {
+   /* Distance to the next block. */
+   uint16_t size;
+
+   /* Offset of the gc_block_header, 0 for free space. */
+   uint16_t header_offset;
+} gc_arena_block;
+
+/* Free space of an arena chunk that allocations can be placed in. */
+typedef struct {
+   gc_arena_block block;
+   gc_slab *chunk;
+   struct list_head link;
+} gc_arena_hole;
+
+/* Smaller free space isn't tracked and only reclaimed by the next sweep. */
+#define GC_ARENA_MIN_HOLE FREELIST_ALIGNMENT
+
+static_assert(sizeof(gc_arena_hole) <= GC_ARENA_MIN_HOLE, "Holes must fit in the smallest one");
+
 struct gc_ctx {
 #ifndef NDEBUG
    unsigned canary;
@@ -625,6 +655,16 @@ struct gc_ctx {
       struct list_head free_slabs;
    } slabs[NUM_FREELIST_BUCKETS];
 
+   /* Arena chunks, the last one being the one allocations are made from. */
+   struct list_head arena_chunks;
+   bool arena;
+
+   /* Holes left in arena chunks by the last sweep, arena_holes[N] has those
+    * of at least FREELIST_ALIGNMENT * (N + 1) bytes.
+    */
+   struct list_head arena_holes[NUM_FREELIST_BUCKETS];
+   unsigned num_arena_holes;
+
    uint8_t current_gen;
    void *rubbish;
 };
@@ -675,13 +715,40 @@ gc_context(const void *parent)
    for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
       list_inithead(&ctx->slabs[i].slabs);
       list_inithead(&ctx->slabs[i].free_slabs);
+      list_inithead(&ctx->arena_holes[i]);
    }
+   list_inithead(&ctx->arena_chunks);
 #ifndef NDEBUG
    ctx->canary = GC_CONTEXT_CANARY;
 #endif
    return ctx;
 }
 
+/**
+ * Switches between allocating from size-class slabs and allocating from a
+ * bump arena.
+ *
+ * In arena mode small allocations are carved one after the other out of
+ * SLAB_SIZE chunks, whatever their size. gc_free() doesn't make the memory
+ * reusable, but a chunk is released as soon as all of its allocations are
+ * freed or found dead by a sweep, and a sweep turns the dead allocations of
+ * the other chunks into holes that later allocations are placed in. This
+ * suits users that allocate a lot and free in bulk.
+ *
+ * Existing allocations are not affected, so this can be changed at any time.
+ */
+void
+gc_set_arena(gc_ctx *ctx, bool arena)
+{
+   ctx->arena = arena;
+}
+
+bool
+gc_is_arena(const gc_ctx *ctx)
+{
+   return ctx->arena;
+}
+
 static_assert(UINT32_MAX >= MAX_FREELIST_SIZE, "Freelist sizes use uint32_t");
 
 static uint32_t
@@ -802,6 +869,210 @@ create_slab(gc_ctx *ctx, unsigned bucket)
    return slab;
 }
 
+static void
+free_arena_chunk(gc_slab *chunk)
+{
+   list_del(&chunk->link);
+   ralloc_free(chunk);
+}
+
+static unsigned
+arena_hole_bucket(uint32_t size)
+{
+   return MIN2(size / FREELIST_ALIGNMENT, NUM_FREELIST_BUCKETS) - 1;
+}
+
+/* Turns [start, end) of an arena chunk into free space, and lists it as a
+ * hole if it is large enough.
+ */
+static void
+add_arena_free(gc_ctx *ctx, gc_slab *chunk, char *start, char *end)
+{
+   gc_arena_block *block = (gc_arena_block *)start;
+   block->size = end - start;
+   block->header_offset = 0;
+
+   if (block->size < GC_ARENA_MIN_HOLE)
+      return;
+
+   gc_arena_hole *hole = (gc_arena_hole *)start;
+   hole->chunk = chunk;
+   list_addtail(&hole->link, &ctx->arena_holes[arena_hole_bucket(block->size)]);
+   ctx->num_arena_holes++;
+}
+
+static void
+remove_arena_hole(gc_ctx *ctx, gc_arena_hole *hole)
+{
+   list_del(&hole->link);
+   ctx->num_arena_holes--;
+}
+
+/* Unlists the holes of a chunk before it is freed or rewound. */
+static void
+remove_arena_holes(gc_slab *chunk)
+{
+   gc_arena_block *block;
+
+   /* Nothing is listed during a sweep either. */
+   if (!chunk->ctx->num_arena_holes)
+      return;
+
+   for (char *ptr = (char *)(chunk + 1); ptr != chunk->next_available; ptr += block->size) {
+      block = (gc_arena_block *)ptr;
+      if (!block->header_offset && block->size >= GC_ARENA_MIN_HOLE)
+         remove_arena_hole(chunk->ctx, (gc_arena_hole *)ptr);
+   }
+}
+
+/* Where the header of an allocation in a block starting at \p block goes. */
+static char *
+arena_block_header(char *block, size_t header_size, size_t alignment)
+{
+   uintptr_t ptr = (uintptr_t)block + sizeof(gc_arena_block) + header_size;
+   return (char *)align_uintptr(ptr, alignment) - header_size;
+}
+
+static char *
+arena_block_end(char *header, size_t size)
+{
+   return (char *)align_uintptr((uintptr_t)header + size, alignof(gc_arena_hole));
+}
+
+static gc_block_header *
+alloc_from_arena(gc_ctx *ctx, size_t size, size_t header_size, size_t alignment)
+{
+   gc_slab *chunk = NULL;
+   char *block = NULL, *header = NULL, *end = NULL;
+
+   /* Use the first hole that fits, from the smallest ones that might. */
+   if (ctx->num_arena_holes) {
+      unsigned first = arena_hole_bucket(MAX2(size, GC_ARENA_MIN_HOLE));
+      for (unsigned i = first; i < NUM_FREELIST_BUCKETS; i++) {
+         if (list_is_empty(&ctx->arena_holes[i]))
+            continue;
+
+         gc_arena_hole *hole = list_first_entry(&ctx->arena_holes[i], gc_arena_hole, link);
+         char *hole_end = (char *)hole + hole->block.size;
+         header = arena_block_header((char *)hole, header_size, alignment);
+         end = arena_block_end(header, size);
+         if (end > hole_end)
+            continue;
+
+         remove_arena_hole(ctx, hole);
+         chunk = hole->chunk;
+         block = (char *)hole;
+         if (end != hole_end)
+            add_arena_free(ctx, chunk, end, hole_end);
+         break;
+      }
+   }
+
+   if (!block) {
+      chunk = list_is_empty(&ctx->arena_chunks) ? NULL :
+              list_last_entry(&ctx->arena_chunks, gc_slab, link);
+
+      if (chunk) {
+         block = chunk->next_available;
+         header = arena_block_header(block, header_size, alignment);
+         end = arena_block_end(header, size);
+         if (end > (char *)chunk + SLAB_SIZE)
+            chunk = NULL;
+      }
+
+      if (!chunk) {
+         chunk = ralloc_size(ctx, SLAB_SIZE);
+         if (unlikely(!chunk))
+            return NULL;
+
+         chunk->ctx = ctx;
+         chunk->freelist = NULL;
+         chunk->num_allocated = 0;
+         chunk->num_free = 0;
+         list_addtail(&chunk->link, &ctx->arena_chunks);
+
+         /* The chunk header is HEADER_ALIGN aligned, which is the maximum. */
+         block = (char *)(chunk + 1);
+         header = arena_block_header(block, header_size, alignment);
+         end = arena_block_end(header, size);
+      }
+
+      chunk->next_available = end;
+   }
+
+   gc_arena_block *arena_block = (gc_arena_block *)block;
+   arena_block->size = end - block;
+   arena_block->header_offset = header - block;
+
+   gc_block_header *block_header = (gc_block_header *)header;
+   block_header->slab_offset = header - (char *)chunk;
+   block_header->bucket = GC_ARENA_BUCKET;
+   chunk->num_allocated++;
+
+   return block_header;
+}
+
+static void
+free_from_arena(gc_block_header *header)
+{
+   gc_slab *chunk = get_gc_slab(header);
+
+   if (--chunk->num_allocated)
+      return;
+
+   remove_arena_holes(chunk);
+
+   /* Rewind the chunk we allocate from, release the others. */
+   if (chunk == list_last_entry(&chunk->ctx->arena_chunks, gc_slab, link))
+      chunk->next_available = (char *)(chunk + 1);
+   else
+      free_arena_chunk(chunk);
+}
+
+/* Counts the live allocations of an arena chunk and merges the space between
+ * them into holes. The free space at the end of the chunk we allocate from
+ * is given back to it instead.
+ */
+static void
+sweep_arena_chunk(gc_ctx *ctx, gc_slab *chunk, bool last)
+{
+   char *chunk_end = (char *)chunk + SLAB_SIZE;
+   char *run = NULL;
+   gc_arena_block *block;
+
+   chunk->num_allocated = 0;
+   for (char *ptr = (char *)(chunk + 1); ptr != chunk->next_available; ptr += block->size) {
+      block = (gc_arena_block *)ptr;
+      if (block->header_offset) {
+         gc_block_header *header = (gc_block_header *)(ptr + block->header_offset);
+         if ((header->flags & (IS_USED | IS_MARKED)) == (IS_USED | IS_MARKED)) {
+            header->flags &= ~IS_MARKED;
+            chunk->num_allocated++;
+            if (run)
+               add_arena_free(ctx, chunk, run, ptr);
+            run = NULL;
+            continue;
+         }
+      }
+
+      if (!run)
+         run = ptr;
+   }
+
+   if (!chunk->num_allocated) {
+      chunk->next_available = (char *)(chunk + 1);
+   } else if (last) {
+      if (run)
+         chunk->next_available = run;
+   } else {
+      if (!run && chunk->next_available != chunk_end)
+         run = chunk->next_available;
+      if (run)
+         add_arena_free(ctx, chunk, run, chunk_end);
+      chunk->next_available = chunk_end;
+   }
+}
+
 void *
 gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment)
 {
@@ -823,7 +1094,11 @@ gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment)
    size += header_size;
 
    gc_block_header *header = NULL;
-   if (size <= MAX_FREELIST_SIZE) {
+   if (ctx->arena && size <= MAX_FREELIST_SIZE) {
+      header = alloc_from_arena(ctx, size, header_size, alignment);
+      if (unlikely(!header))
+         return NULL;
+   } else if (size <= MAX_FREELIST_SIZE) {
       uint32_t bucket = gc_bucket_for_size((uint32_t)size);
       if (list_is_empty(&ctx->slabs[bucket].free_slabs) && !create_slab(ctx, bucket))
          return NULL;
@@ -838,6 +1113,9 @@ gc_alloc_size(gc_ctx *ctx, size_t size, size_t alignment)
    }
 
    header->flags = ctx->current_gen | IS_USED;
+   /* Like slab allocations of the new generation, these survive the sweep. */
+   if (unlikely(ctx->rubbish) && header->bucket == GC_ARENA_BUCKET)
+      header->flags |= IS_MARKED;
 #ifndef NDEBUG
    header->canary = GC_CANARY;
 #endif
@@ -872,6 +1150,8 @@ gc_free(void *ptr)
 
    if (header->bucket < NUM_FREELIST_BUCKETS)
       free_from_slab(header, true);
+   else if (header->bucket == GC_ARENA_BUCKET)
+      free_from_arena(header);
    else
       ralloc_free(header);
 }
@@ -880,7 +1160,7 @@ gc_ctx *gc_get_context(void *ptr)
 {
    gc_block_header *header = get_gc_header(ptr);
 
-   if (header->bucket < NUM_FREELIST_BUCKETS)
+   if (header->bucket != NUM_FREELIST_BUCKETS)
       return get_gc_slab(header)->ctx;
    else
       return ralloc_parent(header);
@@ -891,6 +1171,11 @@ gc_sweep_start(gc_ctx *ctx)
 {
    ctx->current_gen ^= CURRENT_GENERATION;
 
+   /* The free space of arena chunks is found again by gc_sweep_end(). */
+   for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++)
+      list_inithead(&ctx->arena_holes[i]);
+   ctx->num_arena_holes = 0;
+
    ctx->rubbish = ralloc_context(NULL);
    ralloc_adopt(ctx->rubbish, ctx);
 }
@@ -901,6 +1186,8 @@ gc_mark_live(gc_ctx *ctx, const void *mem)
    gc_block_header *header = get_gc_header(mem);
    if (header->bucket < NUM_FREELIST_BUCKETS)
       header->flags ^= CURRENT_GENERATION;
+   else if (header->bucket == GC_ARENA_BUCKET)
+      header->flags |= IS_MARKED;
    else
       ralloc_steal(ctx, header);
 }
@@ -943,10 +1230,68 @@ gc_sweep_end(gc_ctx *ctx)
       }
    }
 
+   list_for_each_entry_safe(gc_slab, chunk, &ctx->arena_chunks, link) {
+      bool last = chunk == list_last_entry(&ctx->arena_chunks, gc_slab, link);
+      sweep_arena_chunk(ctx, chunk, last);
+      if (chunk->num_allocated || last)
+         ralloc_steal(ctx, chunk);
+      else
+         free_arena_chunk(chunk);
+   }
+
    ralloc_free(ctx->rubbish);
    ctx->rubbish = NULL;
 }
 
+/**
+ * Moves all the allocations of \p old_ctx to \p new_ctx, as if they had
+ * been made from it, and leaves \p old_ctx empty. Neither context may be in
+ * the middle of a sweep.
+ */
+void
+gc_adopt(gc_ctx *new_ctx, gc_ctx *old_ctx)
+{
+   assert(!new_ctx->rubbish && !old_ctx->rubbish);
+
+   /* Live objects are of the current generation of their context. */
+   bool flip_gen = new_ctx->current_gen != old_ctx->current_gen;
+
+   for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
+      unsigned obj_size = gc_bucket_obj_size(i);
+      list_for_each_entry(gc_slab, slab, &old_ctx->slabs[i].slabs, link) {
+         slab->ctx = new_ctx;
+         if (!flip_gen)
+            continue;
+
+         for (char *ptr = (char*)(slab + 1); ptr != slab->next_available; ptr += obj_size)
+            ((gc_block_header *)ptr)->flags ^= CURRENT_GENERATION;
+      }
+
+      list_splicetail(&old_ctx->slabs[i].slabs, &new_ctx->slabs[i].slabs);
+      list_splicetail(&old_ctx->slabs[i].free_slabs, &new_ctx->slabs[i].free_slabs);
+      list_inithead(&old_ctx->slabs[i].slabs);
+      list_inithead(&old_ctx->slabs[i].free_slabs);
+   }
+
+   /* Keep allocating from the last chunk of the new context. */
+   list_for_each_entry(gc_slab, chunk, &old_ctx->arena_chunks, link)
+      chunk->ctx = new_ctx;
+   list_splice(&old_ctx->arena_chunks, &new_ctx->arena_chunks);
+   list_inithead(&old_ctx->arena_chunks);
+
+   for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
+      list_splicetail(&old_ctx->arena_holes[i], &new_ctx->arena_holes[i]);
+      list_inithead(&old_ctx->arena_holes[i]);
+   }
+   new_ctx->num_arena_holes += old_ctx->num_arena_holes;
+   old_ctx->num_arena_holes = 0;
+
+   /* Slabs, arena chunks and large allocations are all children of the
+    * context.
+    */
+   ralloc_adopt(new_ctx, old_ctx);
+}
+
 /***************************************************************************
  * Linear allocator for short-lived allocations.
  ***************************************************************************
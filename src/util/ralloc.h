@@ -490,6 +490,10 @@ typedef struct gc_ctx gc_ctx;
  */
 gc_ctx *gc_context(const void *parent);
 
+void gc_set_arena(gc_ctx *ctx, bool arena);
+bool gc_is_arena(const gc_ctx *ctx);
+void gc_adopt(gc_ctx *new_ctx, gc_ctx *old_ctx);
+
 #define gc_alloc(ctx, type, count) gc_alloc_size(ctx, sizeof(type) * (count), alignof(type))
 #define gc_zalloc(ctx, type, count) gc_zalloc_size(ctx, sizeof(type) * (count), alignof(type))
 
@@ -516,6 +516,7 @@ ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
    int n1_class = g->nodes[n1].class;
    int n2_class = g->nodes[n2].class;
    g->nodes[n1].q_total += g->regs->classes[n1_class]->q[n2_class];
+   g->nodes[n1].spill_benefit = -1.0f;
 
    util_dynarray_append(&g->nodes[n1].adjacency_list, unsigned int, n2);
 }
@@ -529,6 +530,7 @@ ra_node_remove_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
    int n1_class = g->nodes[n1].class;
    int n2_class = g->nodes[n2].class;
    g->nodes[n1].q_total -= g->regs->classes[n1_class]->q[n2_class];
+   g->nodes[n1].spill_benefit = -1.0f;
 
    util_dynarray_delete_unordered(&g->nodes[n1].adjacency_list, unsigned int,
                                   n2);
@@ -555,6 +557,7 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
       struct ra_node* node = g->nodes + i;
       util_dynarray_init(&node->adjacency_list, g);
       node->q_total = 0;
+      node->spill_benefit = -1.0f;
       node->forced_reg = NO_REG;
       node->reg = NO_REG;
    }
@@ -568,11 +571,16 @@ ra_realloc_interference_graph(struct ra_graph *g, unsigned int alloc)
 
    g->tmp.reg_assigned = reralloc(g, g->tmp.reg_assigned, BITSET_WORD,
                                   bitset_count);
-   g->tmp.pq_test = reralloc(g, g->tmp.pq_test, BITSET_WORD, bitset_count);
-   g->tmp.min_q_total = reralloc(g, g->tmp.min_q_total, unsigned int,
-                                 bitset_count);
-   g->tmp.min_q_node = reralloc(g, g->tmp.min_q_node, unsigned int,
-                                bitset_count);
+   g->tmp.ready = reralloc(g, g->tmp.ready, BITSET_WORD, bitset_count);
+   g->tmp.ready_words = reralloc(g, g->tmp.ready_words, BITSET_WORD,
+                                 BITSET_WORDS(bitset_count));
+
+   unsigned tree_size = 2 * util_next_power_of_two(bitset_count);
+   g->tmp.min_q_key = reralloc(g, g->tmp.min_q_key, uint64_t, tree_size);
+   g->tmp.min_q_dirty = reralloc(g, g->tmp.min_q_dirty, BITSET_WORD,
+                                 BITSET_WORDS(tree_size));
+   g->tmp.min_q_stale = reralloc(g, g->tmp.min_q_stale, BITSET_WORD,
+                                 BITSET_WORDS(bitset_count));
 
    g->alloc = alloc;
 }
@@ -611,6 +619,11 @@ ra_set_node_class(struct ra_graph *g,
                   unsigned int n, struct ra_class *class)
 {
    g->nodes[n].class = class->index;
+
+   /* The spill benefits of n and its neighbors depend on its class. */
+   g->nodes[n].spill_benefit = -1.0f;
+   util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned int, n2p)
+      g->nodes[*n2p].spill_benefit = -1.0f;
 }
 
 struct ra_class *
@@ -651,6 +664,103 @@ ra_reset_node_interference(struct ra_graph *g, unsigned int n)
    }
 
    util_dynarray_clear(&g->nodes[n].adjacency_list);
+   g->nodes[n].spill_benefit = -1.0f;
+}
+
+/* Returns the sort key of node n for optimistic coloring: the lowest
+ * q_total first and, in order to remain consistent with the old naive
+ * implementation of the algorithm, the highest node index among equal ones.
+ */
+static inline uint64_t
+ra_min_q_key(struct ra_graph *g, unsigned int n)
+{
+   return (uint64_t)g->nodes[n].tmp.q_total << 32 | (UINT32_MAX - n);
+}
+
+/* Returns the minimum key of the nodes of BITSET_WORD i. */
+static uint64_t
+ra_get_word_min_q_key(struct ra_graph *g, unsigned int i)
+{
+   BITSET_WORD live = ~(g->tmp.in_stack[i] | g->tmp.reg_assigned[i]);
+   if (i == (g->count - 1) / BITSET_WORDBITS)
+      live &= BITSET_MASK(g->count);
+
+   uint64_t key = UINT64_MAX;
+   while (live) {
+      unsigned int j = u_bit_scan(&live);
+      key = MIN2(key, ra_min_q_key(g, i * BITSET_WORDBITS + j));
+   }
+
+   return key;
+}
+
+/* Returns the node to push optimistically, or UINT_MAX if there is none. */
+static unsigned int
+ra_get_min_q_node(struct ra_graph *g)
+{
+   uint64_t *tree = g->tmp.min_q_key;
+   unsigned int leaves = g->tmp.min_q_leaves;
+
+   /* Recalculate the dirty entries of the tree.  Every entry comes before
+    * its children, so going backwards recalculates it after them.
+    */
+   for (int w = BITSET_WORDS(2 * leaves) - 1; w >= 0; w--) {
+      while (g->tmp.min_q_dirty[w]) {
+         unsigned int j = util_last_bit(g->tmp.min_q_dirty[w]) - 1;
+         unsigned int k = w * BITSET_WORDBITS + j;
+         g->tmp.min_q_dirty[w] &= ~BITSET_BIT(j);
+
+         if (k >= leaves) {
+            if (BITSET_TEST(g->tmp.min_q_stale, k - leaves)) {
+               tree[k] = ra_get_word_min_q_key(g, k - leaves);
+               BITSET_CLEAR(g->tmp.min_q_stale, k - leaves);
+            }
+         } else {
+            tree[k] = MIN2(tree[2 * k], tree[2 * k + 1]);
+         }
+
+         if (k > 1)
+            BITSET_SET(g->tmp.min_q_dirty, k / 2);
+      }
+   }
+
+   if (tree[1] == UINT64_MAX)
+      return UINT_MAX;
+
+   return UINT32_MAX - (uint32_t)tree[1];
+}
+
+/* Returns the highest ready node below end, or UINT_MAX if there is none. */
+static unsigned int
+ra_get_ready_node_below(struct ra_graph *g, unsigned int end)
+{
+   unsigned int i = end / BITSET_WORDBITS;
+
+   /* First look in the BITSET_WORD of end, then use ready_words to skip
+    * all the empty ones below.
+    */
+   if (end % BITSET_WORDBITS) {
+      BITSET_WORD ready = g->tmp.ready[i] & BITSET_MASK(end);
+      if (ready)
+         return i * BITSET_WORDBITS + util_last_bit(ready) - 1;
+   }
+
+   if (!i)
+      return UINT_MAX;
+
+   int top = (i - 1) / BITSET_WORDBITS;
+   for (int w = top; w >= 0; w--) {
+      BITSET_WORD words = g->tmp.ready_words[w];
+      if (w == top)
+         words &= BITSET_MASK(i);
+
+      if (words) {
+         i = w * BITSET_WORDBITS + util_last_bit(words) - 1;
+         return i * BITSET_WORDBITS + util_last_bit(g->tmp.ready[i]) - 1;
+      }
+   }
+
+   return UINT_MAX;
 }
 
 static void
@@ -659,19 +769,19 @@ update_pq_info(struct ra_graph *g, unsigned int n)
    int i = n / BITSET_WORDBITS;
    int n_class = g->nodes[n].class;
    if (g->nodes[n].tmp.q_total < g->regs->classes[n_class]->p) {
-      BITSET_SET(g->tmp.pq_test, n);
-   } else if (g->tmp.min_q_total[i] != UINT_MAX) {
-      /* Only update min_q_total and min_q_node if min_q_total != UINT_MAX so
-       * that we don't update while we have stale data and accidentally mark
-       * it as non-stale.  Also, in order to remain consistent with the old
-       * naive implementation of the algorithm, we do a lexicographical sort
-       * to ensure that we always choose the node with the highest node index.
+      BITSET_SET(g->tmp.ready, n);
+      BITSET_SET(g->tmp.ready_words, i);
+   } else if (!BITSET_TEST(g->tmp.min_q_stale, i)) {
+      /* Only update the leaf if it isn't stale, so that we don't update
+       * while we have stale data and accidentally mark it as non-stale.  Its
+       * ancestors are only recalculated when a node has to be pushed
+       * optimistically.
        */
-      if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i] ||
-          (g->nodes[n].tmp.q_total == g->tmp.min_q_total[i] &&
-           n > g->tmp.min_q_node[i])) {
-         g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-         g->tmp.min_q_node[i] = n;
+      unsigned int k = g->tmp.min_q_leaves + i;
+      uint64_t key = ra_min_q_key(g, n);
+      if (key < g->tmp.min_q_key[k]) {
+         g->tmp.min_q_key[k] = key;
+         BITSET_SET(g->tmp.min_q_dirty, k);
       }
    }
 }
@@ -680,6 +790,7 @@ static void
 add_node_to_stack(struct ra_graph *g, unsigned int n)
 {
    int n_class = g->nodes[n].class;
+   int i = n / BITSET_WORDBITS;
 
    assert(!BITSET_TEST(g->tmp.in_stack, n));
 
@@ -699,8 +810,13 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
    g->tmp.stack_count++;
    BITSET_SET(g->tmp.in_stack, n);
 
-   /* Flag the min_q_total for n's block as dirty so it gets recalculated */
-   g->tmp.min_q_total[n / BITSET_WORDBITS] = UINT_MAX;
+   BITSET_CLEAR(g->tmp.ready, n);
+   if (!g->tmp.ready[i])
+      BITSET_CLEAR(g->tmp.ready_words, i);
+
+   /* Flag the min_q_key leaf for n's block as stale so it gets recalculated */
+   BITSET_SET(g->tmp.min_q_stale, i);
+   BITSET_SET(g->tmp.min_q_dirty, g->tmp.min_q_leaves + i);
 }
 
 /**
@@ -712,103 +828,79 @@ add_node_to_stack(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * The nodes are pushed in the same order as by sweeps from the highest node
+ * to the lowest one, repeated until no node can be pushed, but instead of
+ * scanning the whole graph, the trivially-colorable nodes are taken from the
+ * ready worklist and the optimistic ones from the min_q_key tree.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
+   unsigned int words = BITSET_WORDS(g->count);
 
-   /* Figure out the high bit and bit mask for the first iteration of a loop
-    * over BITSET_WORDs.
-    */
-   const unsigned int top_word_high_bit = (g->count - 1) % BITSET_WORDBITS;
+   g->tmp.stack_count = 0;
+   g->tmp.stack_optimistic_start = stack_optimistic_start;
+   if (!g->count)
+      return;
 
    /* Do a quick pre-pass to set things up */
-   g->tmp.stack_count = 0;
-   for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-        i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-      g->tmp.in_stack[i] = 0;
-      g->tmp.reg_assigned[i] = 0;
-      g->tmp.pq_test[i] = 0;
-      g->tmp.min_q_total[i] = UINT_MAX;
-      g->tmp.min_q_node[i] = UINT_MAX;
-      for (int j = high_bit; j >= 0; j--) {
-         unsigned int n = i * BITSET_WORDBITS + j;
-         g->nodes[n].reg = g->nodes[n].forced_reg;
-         g->nodes[n].tmp.q_total = g->nodes[n].q_total;
-         if (g->nodes[n].reg != NO_REG)
-            g->tmp.reg_assigned[i] |= BITSET_BIT(j);
-         update_pq_info(g, n);
+   memset(g->tmp.in_stack, 0, words * sizeof(BITSET_WORD));
+   memset(g->tmp.reg_assigned, 0, words * sizeof(BITSET_WORD));
+   memset(g->tmp.ready, 0, words * sizeof(BITSET_WORD));
+   memset(g->tmp.ready_words, 0, BITSET_WORDS(words) * sizeof(BITSET_WORD));
+
+   for (unsigned int n = 0; n < g->count; n++) {
+      int n_class = g->nodes[n].class;
+
+      g->nodes[n].reg = g->nodes[n].forced_reg;
+      g->nodes[n].tmp.q_total = g->nodes[n].q_total;
+      if (g->nodes[n].reg != NO_REG) {
+         BITSET_SET(g->tmp.reg_assigned, n);
+      } else if (g->nodes[n].tmp.q_total < g->regs->classes[n_class]->p) {
+         BITSET_SET(g->tmp.ready, n);
+         BITSET_SET(g->tmp.ready_words, n / BITSET_WORDBITS);
       }
    }
 
-   while (progress) {
-      unsigned int min_q_total = UINT_MAX;
-      unsigned int min_q_node = UINT_MAX;
-
-      progress = false;
-
-      for (int i = BITSET_WORDS(g->count) - 1, high_bit = top_word_high_bit;
-           i >= 0; i--, high_bit = BITSET_WORDBITS - 1) {
-         BITSET_WORD mask = ~(BITSET_WORD)0 >> (31 - high_bit);
-
-         BITSET_WORD skip = g->tmp.in_stack[i] | g->tmp.reg_assigned[i];
-         if (skip == mask)
-            continue;
-
-         BITSET_WORD pq = g->tmp.pq_test[i] & ~skip;
-         if (pq) {
-            /* In this case, we have stuff we can immediately take off the
-             * stack.  This also means that we're guaranteed to make progress
-             * and we don't need to bother updating lowest_q_total because we
-             * know we're going to loop again before attempting to do anything
-             * optimistic.
-             */
-            for (int j = high_bit; j >= 0; j--) {
-               if (pq & BITSET_BIT(j)) {
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  add_node_to_stack(g, n);
-                  /* add_node_to_stack() may update pq_test for this word so
-                   * we need to update our local copy.
-                   */
-                  pq = g->tmp.pq_test[i] & ~skip;
-                  progress = true;
-               }
-            }
-         } else if (!progress) {
-            if (g->tmp.min_q_total[i] == UINT_MAX) {
-               /* The min_q_total and min_q_node are dirty because we added
-                * one of these nodes to the stack.  It needs to be
-                * recalculated.
-                */
-               for (int j = high_bit; j >= 0; j--) {
-                  if (skip & BITSET_BIT(j))
-                     continue;
-
-                  unsigned int n = i * BITSET_WORDBITS + j;
-                  assert(n < g->count);
-                  if (g->nodes[n].tmp.q_total < g->tmp.min_q_total[i]) {
-                     g->tmp.min_q_total[i] = g->nodes[n].tmp.q_total;
-                     g->tmp.min_q_node[i] = n;
-                  }
-               }
-            }
-            if (g->tmp.min_q_total[i] < min_q_total) {
-               min_q_node = g->tmp.min_q_node[i];
-               min_q_total = g->tmp.min_q_total[i];
-            }
-         }
+   /* All the leaves of the min_q_key tree start stale, so that it only gets
+    * calculated if some node has to be pushed optimistically.
+    */
+   g->tmp.min_q_leaves = util_next_power_of_two(words);
+   unsigned int tree_size = 2 * g->tmp.min_q_leaves;
+   memset(g->tmp.min_q_key, 0xff, tree_size * sizeof(uint64_t));
+   memset(g->tmp.min_q_dirty, 0,
+          BITSET_WORDS(tree_size) * sizeof(BITSET_WORD));
+   memset(g->tmp.min_q_stale, 0xff,
+          BITSET_WORDS(words) * sizeof(BITSET_WORD));
+   for (unsigned int i = 0; i < words; i++)
+      BITSET_SET(g->tmp.min_q_dirty, g->tmp.min_q_leaves + i);
+
+   /* The sweep goes on below the last node it pushed, and starts again from
+    * the top once there is no ready node below it.
+    */
+   unsigned int sweep = g->count;
+   while (true) {
+      unsigned int n = ra_get_ready_node_below(g, sweep);
+      if (n == UINT_MAX && sweep != g->count)
+         n = ra_get_ready_node_below(g, g->count);
+
+      if (n != UINT_MAX) {
+         add_node_to_stack(g, n);
+         sweep = n;
+         continue;
       }
 
-      if (!progress && min_q_total != UINT_MAX) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->tmp.stack_count;
+      n = ra_get_min_q_node(g);
+      if (n == UINT_MAX)
+         break;
 
-         add_node_to_stack(g, min_q_node);
-         progress = true;
-      }
+      if (stack_optimistic_start == UINT_MAX)
+         stack_optimistic_start = g->tmp.stack_count;
+
+      add_node_to_stack(g, n);
+      sweep = g->count;
    }
 
    g->tmp.stack_optimistic_start = stack_optimistic_start;
@@ -1016,6 +1108,13 @@ ra_get_spill_benefit(struct ra_graph *g, unsigned int n)
    float benefit = 0;
    int n_class = g->nodes[n].class;
 
+   /* The benefit only changes with the interferences of n and their
+    * classes, so after spilling a node it only has to be recalculated for
+    * the neighbors of that node.
+    */
+   if (g->nodes[n].spill_benefit >= 0.0f)
+      return g->nodes[n].spill_benefit;
+
    /* Define the benefit of eliminating an interference between n, n2
     * through spilling as q(C, B) / p(C).  This is similar to the
     * "count number of edges" approach of traditional graph coloring,
@@ -1028,6 +1127,7 @@ ra_get_spill_benefit(struct ra_graph *g, unsigned int n)
                   g->regs->classes[n_class]->p);
    }
 
+   g->nodes[n].spill_benefit = benefit;
    return benefit;
 }
 
@@ -114,6 +114,11 @@ struct ra_node {
     */
    float spill_cost;
 
+   /* The spill benefit of this node, or a negative value if its
+    * interferences changed since it was last calculated.
+    */
+   float spill_benefit;
+
    /* Temporary data for the algorithm to scratch around in */
    struct {
       /**
@@ -149,17 +154,33 @@ struct ra_graph {
       /** Bit-set indicating, for each register, if it pre-assigned */
       BITSET_WORD *reg_assigned;
 
-      /** Bit-set indicating, for each register, the value of the pq test */
-      BITSET_WORD *pq_test;
+      /**
+       * Bit-set of the nodes which pass the pq test and are neither in the
+       * stack nor pre-assigned.
+       */
+      BITSET_WORD *ready;
 
-      /** For each BITSET_WORD, the minimum q value or ~0 if unknown */
-      unsigned int *min_q_total;
+      /** Bit-set of the BITSET_WORDs of ready which aren't 0 */
+      BITSET_WORD *ready_words;
 
-      /*
-       * * For each BITSET_WORD, the node with the minimum q_total if
-       * min_q_total[i] != ~0.
+      /**
+       * Tournament tree of the nodes with the lowest q_total, for optimistic
+       * coloring, as sort keys from ra_min_q_key().  Leaf min_q_leaves + i
+       * is the minimum key of BITSET_WORD i, every other entry k the minimum
+       * of entries 2k and 2k + 1, and entry 1 the minimum of the graph, or
+       * ~0 if there is no node left.
+       */
+      uint64_t *min_q_key;
+      unsigned int min_q_leaves;
+
+      /** Bit-set of the min_q_key entries which have to be recalculated */
+      BITSET_WORD *min_q_dirty;
+
+      /**
+       * Bit-set of the BITSET_WORDs whose min_q_key leaf is unknown because
+       * one of their nodes was added to the stack.
        */
-      unsigned int *min_q_node;
+      BITSET_WORD *min_q_stale;
 
       /**
        * Tracks the start of the set of optimistically-colored registers in the
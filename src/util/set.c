@@ -37,9 +37,14 @@
 #include <string.h>
 
 #include "hash_table.h"
+#include "hash_ctrl.h"
+#include "bitscan.h"
 #include "macros.h"
 #include "ralloc.h"
 #include "set.h"
+#include "os_misc.h"
+#include "u_atomic.h"
+#include "u_debug.h"
 #include "fast_urem_by_const.h"
 
 /*
@@ -116,20 +121,220 @@ entry_is_present(struct set_entry *entry)
    return entry->key != NULL && entry->key != deleted_key;
 }
 
+/* See use_swiss_tables() in hash_table.c */
+static bool
+use_swiss_sets(void)
+{
+   static int swiss = -1;
+
+   if (unlikely(p_atomic_read_relaxed(&swiss) < 0)) {
+      p_atomic_set(&swiss, debug_parse_bool_option(
+                      os_get_option("MESA_HASH_TABLE_SWISS"), false));
+   }
+
+   return swiss;
+}
+
+/**
+ * Swiss layout, same as for hash tables: the set size is a power of two
+ * multiple of HASH_CTRL_GROUP_SIZE, filled up to 7/8, and ht->ctrl holds
+ * one control byte per entry.
+ */
+static bool
+swiss_alloc(struct set *ht, void *mem_ctx, uint32_t size)
+{
+   struct set_entry *table = rzalloc_array(mem_ctx, struct set_entry, size);
+   if (table == NULL)
+      return false;
+
+   /* Freed along with the entries */
+   uint8_t *ctrl = ralloc_array(table, uint8_t, size);
+   if (ctrl == NULL) {
+      ralloc_free(table);
+      return false;
+   }
+   memset(ctrl, HASH_CTRL_EMPTY, size);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size = size;
+   ht->rehash = 0;
+   ht->size_magic = 0;
+   ht->rehash_magic = 0;
+   ht->max_entries = size - size / 8;
+   ht->size_index = 0;
+   ht->entries = 0;
+   ht->deleted_entries = 0;
+
+   return true;
+}
+
+static uint32_t
+swiss_size_for(uint32_t entries)
+{
+   uint32_t size = HASH_CTRL_GROUP_SIZE;
+
+   while (size - size / 8 < entries && size < (1u << 31))
+      size *= 2;
+
+   return size;
+}
+
+static struct set_entry *
+swiss_search(const struct set *ht, uint32_t hash, const void *key)
+{
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   const uint8_t tag = hash_ctrl_tag(mixed);
+   uint32_t group = mixed & group_mask;
+
+   for (uint32_t step = 1; step <= group_mask + 1; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = hash_ctrl_match(ctrl, tag);
+
+      while (match) {
+         struct set_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(entry) &&
+             ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (hash_ctrl_match(ctrl, HASH_CTRL_EMPTY))
+         return NULL;
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+
+   return NULL;
+}
+
+static void
+swiss_add_rehash(struct set *ht, uint32_t hash, const void *key)
+{
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   uint32_t group = mixed & group_mask;
+
+   for (uint32_t step = 1; ; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      unsigned free = hash_ctrl_match_free(ht->ctrl + base);
+
+      if (likely(free)) {
+         const uint32_t i = base + ffs(free) - 1;
+
+         ht->ctrl[i] = hash_ctrl_tag(mixed);
+         ht->table[i].hash = hash;
+         ht->table[i].key = key;
+         return;
+      }
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+}
+
+static void
+swiss_rehash(struct set *ht, uint32_t size)
+{
+   struct set old_ht = *ht;
+
+   if (!swiss_alloc(ht, ralloc_parent(old_ht.table), size)) {
+      *ht = old_ht;
+      return;
+   }
+
+   set_foreach(&old_ht, entry) {
+      swiss_add_rehash(ht, entry->hash, entry->key);
+   }
+
+   ht->entries = old_ht.entries;
+
+   ralloc_free(old_ht.table);
+}
+
+static struct set_entry *
+swiss_search_or_add(struct set *ht, uint32_t hash, const void *key,
+                    bool *found)
+{
+   if (ht->entries >= ht->max_entries) {
+      swiss_rehash(ht, ht->size * 2);
+   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
+      swiss_rehash(ht, ht->size);
+   }
+
+   const uint32_t group_mask = ht->size / HASH_CTRL_GROUP_SIZE - 1;
+   const uint32_t mixed = hash_ctrl_mix(hash);
+   const uint8_t tag = hash_ctrl_tag(mixed);
+   uint32_t group = mixed & group_mask;
+   uint32_t available = UINT32_MAX;
+
+   for (uint32_t step = 1; step <= group_mask + 1; step++) {
+      const uint32_t base = group * HASH_CTRL_GROUP_SIZE;
+      const uint8_t *ctrl = ht->ctrl + base;
+      unsigned match = hash_ctrl_match(ctrl, tag);
+
+      while (match) {
+         struct set_entry *entry = ht->table + base + u_bit_scan(&match);
+
+         if (entry->hash == hash && entry_is_present(entry) &&
+             ht->key_equals_function(key, entry->key)) {
+            if (found)
+               *found = true;
+            return entry;
+         }
+      }
+
+      /* Stash the first available entry we find */
+      if (available == UINT32_MAX) {
+         unsigned free = hash_ctrl_match_free(ctrl);
+         if (free)
+            available = base + ffs(free) - 1;
+      }
+
+      if (hash_ctrl_match(ctrl, HASH_CTRL_EMPTY))
+         break;
+
+      group = hash_ctrl_next_group(group, step, group_mask);
+   }
+
+   if (available != UINT32_MAX) {
+      struct set_entry *entry = ht->table + available;
+
+      if (ht->ctrl[available] == HASH_CTRL_DELETED)
+         ht->deleted_entries--;
+      ht->ctrl[available] = tag;
+      entry->hash = hash;
+      entry->key = key;
+      ht->entries++;
+      if (found)
+         *found = false;
+      return entry;
+   }
+
+   /* We could hit here if a required resize failed. */
+   return NULL;
+}
+
 bool
 _mesa_set_init(struct set *ht, void *mem_ctx,
                  uint32_t (*key_hash_function)(const void *key),
                  bool (*key_equals_function)(const void *a,
                                              const void *b))
 {
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+
+   if (use_swiss_sets())
+      return swiss_alloc(ht, mem_ctx, HASH_CTRL_GROUP_SIZE);
+
+   ht->ctrl = NULL;
    ht->size_index = 0;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
    ht->size_magic = hash_sizes[ht->size_index].size_magic;
    ht->rehash_magic = hash_sizes[ht->size_index].rehash_magic;
    ht->max_entries = hash_sizes[ht->size_index].max_entries;
-   ht->key_hash_function = key_hash_function;
-   ht->key_equals_function = key_equals_function;
    ht->table = rzalloc_array(mem_ctx, struct set_entry, ht->size);
    ht->entries = 0;
    ht->deleted_entries = 0;
@@ -196,6 +401,16 @@ _mesa_set_clone(struct set *set, void *dst_mem_ctx)
 
    memcpy(clone->table, set->table, clone->size * sizeof(struct set_entry));
 
+   if (set->ctrl) {
+      clone->ctrl = ralloc_array(clone->table, uint8_t, clone->size);
+      if (clone->ctrl == NULL) {
+         ralloc_free(clone);
+         return NULL;
+      }
+
+      memcpy(clone->ctrl, set->ctrl, clone->size);
+   }
+
    return clone;
 }
 
@@ -224,7 +439,9 @@ _mesa_set_destroy(struct set *ht, void (*delete_function)(struct set_entry *entr
 static void
 set_clear_fast(struct set *ht)
 {
-   memset(ht->table, 0, sizeof(struct set_entry) * hash_sizes[ht->size_index].size);
+   memset(ht->table, 0, sizeof(struct set_entry) * ht->size);
+   if (ht->ctrl)
+      memset(ht->ctrl, HASH_CTRL_EMPTY, ht->size);
    ht->entries = ht->deleted_entries = 0;
 }
 
@@ -249,6 +466,8 @@ _mesa_set_clear(struct set *set, void (*delete_function)(struct set_entry *entry
 
          entry->key = NULL;
       }
+      if (set->ctrl)
+         memset(set->ctrl, HASH_CTRL_EMPTY, set->size);
       set->entries = 0;
       set->deleted_entries = 0;
    } else
@@ -265,6 +484,9 @@ set_search(const struct set *ht, uint32_t hash, const void *key)
 {
    assert(!key_pointer_is_reserved(key));
 
+   if (ht->ctrl)
+      return swiss_search(ht, hash, key);
+
    uint32_t size = ht->size;
    uint32_t start_address = util_fast_urem32(hash, size, ht->size_magic);
    uint32_t double_hash = util_fast_urem32(hash, ht->rehash,
@@ -333,7 +555,8 @@ set_rehash(struct set *ht, unsigned new_size_index)
    struct set old_ht;
    struct set_entry *table;
 
-   if (ht->size_index == new_size_index && ht->deleted_entries == ht->max_entries) {
+   if (!ht->ctrl && ht->size_index == new_size_index &&
+       ht->deleted_entries == ht->max_entries) {
       set_clear_fast(ht);
       assert(!ht->entries);
       return;
@@ -350,6 +573,7 @@ set_rehash(struct set *ht, unsigned new_size_index)
    old_ht = *ht;
 
    ht->table = table;
+   ht->ctrl = NULL;
    ht->size_index = new_size_index;
    ht->size = hash_sizes[ht->size_index].size;
    ht->rehash = hash_sizes[ht->size_index].rehash;
@@ -375,6 +599,11 @@ _mesa_set_resize(struct set *set, uint32_t entries)
    if (set->entries > entries)
       entries = set->entries;
 
+   if (set->ctrl) {
+      swiss_rehash(set, swiss_size_for(entries));
+      return;
+   }
+
    unsigned size_index = 0;
    while (hash_sizes[size_index].max_entries < entries)
       size_index++;
@@ -396,6 +625,9 @@ set_search_or_add(struct set *ht, uint32_t hash, const void *key, bool *found)
 
    assert(!key_pointer_is_reserved(key));
 
+   if (ht->ctrl)
+      return swiss_search_or_add(ht, hash, key, found);
+
    if (ht->entries >= ht->max_entries) {
       set_rehash(ht, ht->size_index + 1);
    } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
@@ -546,6 +778,20 @@ _mesa_set_remove(struct set *ht, struct set_entry *entry)
    if (!entry)
       return;
 
+   if (ht->ctrl) {
+      const uint32_t i = entry - ht->table;
+
+      /* See the hash table's swiss_remove() */
+      if (hash_ctrl_match(ht->ctrl + (i & ~(HASH_CTRL_GROUP_SIZE - 1)),
+                          HASH_CTRL_EMPTY)) {
+         ht->ctrl[i] = HASH_CTRL_EMPTY;
+         entry->key = NULL;
+         ht->entries--;
+         return;
+      }
+      ht->ctrl[i] = HASH_CTRL_DELETED;
+   }
+
    entry->key = deleted_key;
    ht->entries--;
    ht->deleted_entries++;
@@ -604,6 +850,28 @@ _mesa_set_next_entry(const struct set *ht, struct set_entry *entry)
    return NULL;
 }
 
+/**
+ * Switches the set between the default layout and the Swiss layout, see
+ * _mesa_hash_table_use_swiss().
+ */
+bool
+_mesa_set_use_swiss(struct set *set, bool swiss)
+{
+   if (!!set->ctrl == swiss)
+      return true;
+
+   if (swiss) {
+      swiss_rehash(set, swiss_size_for(set->entries));
+   } else {
+      unsigned size_index = 0;
+      while (hash_sizes[size_index].max_entries < set->entries)
+         size_index++;
+      set_rehash(set, size_index);
+   }
+
+   return !!set->ctrl == swiss;
+}
+
 /**
  * Helper to create a set with pointer keys.
  */
@@ -43,6 +43,7 @@ struct set_entry {
 struct set {
    void *mem_ctx;
    struct set_entry *table;
+   uint8_t *ctrl;   /**< control bytes of the Swiss layout, see hash_ctrl.h */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    uint32_t size;
@@ -77,6 +78,8 @@ _mesa_set_destroy(struct set *set,
                   void (*delete_function)(struct set_entry *entry));
 void
 _mesa_set_resize(struct set *set, uint32_t entries);
+bool
+_mesa_set_use_swiss(struct set *set, bool swiss);
 void
 _mesa_set_clear(struct set *set,
                 void (*delete_function)(struct set_entry *entry));
@@ -134,10 +137,18 @@ _mesa_set_intersects(struct set *a, struct set *b);
  * This foreach function destroys the table as it iterates.
  * It is not safe to use when inserting or removing entries.
  */
+/* Marks an entry emptied by set_foreach_remove() as free. */
+static inline void
+_mesa_set_free_ctrl(struct set *set, struct set_entry *entry)
+{
+   if (set->ctrl)
+      set->ctrl[entry - set->table] = 0x80; /* HASH_CTRL_EMPTY */
+}
+
 #define set_foreach_remove(set, entry)                              \
    for (struct set_entry *entry = _mesa_set_next_entry_unsafe(set, NULL);  \
         (set)->entries;                                              \
-        entry->hash = 0, entry->key = (void*)NULL, (set)->entries--, entry = _mesa_set_next_entry_unsafe(set, entry))
+        entry->hash = 0, entry->key = (void*)NULL, _mesa_set_free_ctrl(set, entry), (set)->entries--, entry = _mesa_set_next_entry_unsafe(set, entry))
 
 #ifdef __cplusplus
 } /* extern C */
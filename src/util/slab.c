@@ -24,6 +24,7 @@
 #include "slab.h"
 #include "macros.h"
 #include "u_atomic.h"
+#include "u_thread.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -331,3 +332,298 @@ slab_create(struct slab_mempool *mempool,
    slab_create_parent(&mempool->parent, item_size, num_items);
    slab_create_child(&mempool->child, &mempool->parent);
 }
+
+/* Number of objects owned by another thread's cache that are collected
+ * before they are handed back to it.
+ */
+#define SLAB_BATCH_SIZE 32
+
+/* Number of other thread caches a thread can batch objects for at once. */
+#define SLAB_BATCH_OWNERS 4
+
+struct slab_free_batch {
+   struct slab_thread_cache *owner;
+   struct slab_element_header *head, *tail;
+   unsigned count;
+};
+
+/* The per-thread child pool of a slab_mt_pool. Thread caches live as long as
+ * the pool, so other threads can always hand objects back to them.
+ */
+struct slab_thread_cache {
+   /* Must be first: the owner of an element points to it. */
+   struct slab_child_pool child;
+
+   struct slab_mt_pool *pool;
+
+   /* Elements of this cache freed by other threads. Batches are pushed with
+    * a compare-and-swap, and the owner takes the whole list at once.
+    */
+   struct slab_element_header *remote_free;
+
+   /* Elements owned by other caches freed by this thread. */
+   struct slab_free_batch batches[SLAB_BATCH_OWNERS];
+
+   struct slab_thread_cache *next;
+   struct slab_thread_cache *next_idle;
+};
+
+static void
+slab_push_remote(struct slab_thread_cache *owner,
+                 struct slab_element_header *head,
+                 struct slab_element_header *tail)
+{
+   struct slab_element_header *old = p_atomic_read(&owner->remote_free);
+   struct slab_element_header *seen;
+
+   do {
+      seen = old;
+      tail->next = seen;
+      old = p_atomic_cmpxchg_ptr(&owner->remote_free, seen, head);
+   } while (old != seen);
+}
+
+static struct slab_element_header *
+slab_take_remote(struct slab_thread_cache *cache)
+{
+   struct slab_element_header *list = p_atomic_read(&cache->remote_free);
+   struct slab_element_header *seen;
+
+   /* Only the owner removes elements, so there is no ABA problem. */
+   while (list) {
+      seen = list;
+      list = p_atomic_cmpxchg_ptr(&cache->remote_free, seen, NULL);
+      if (list == seen)
+         break;
+   }
+
+   return list;
+}
+
+static void
+slab_flush_batch(struct slab_free_batch *batch)
+{
+   if (!batch->head)
+      return;
+
+   slab_push_remote(batch->owner, batch->head, batch->tail);
+   batch->head = batch->tail = NULL;
+   batch->count = 0;
+}
+
+static void
+slab_flush_batches(struct slab_thread_cache *cache)
+{
+   for (unsigned i = 0; i < SLAB_BATCH_OWNERS; i++)
+      slab_flush_batch(&cache->batches[i]);
+}
+
+/* The last pool used by this thread and its cache for it, which saves the
+ * tss_get() for threads that mostly use one pool.  The pool is identified by
+ * its id rather than its address, which could be reused.
+ */
+static __THREAD_INITIAL_EXEC uint64_t last_pool_id;
+static __THREAD_INITIAL_EXEC struct slab_thread_cache *last_cache;
+
+static uint64_t next_pool_id;
+
+/* Called when a thread that used the pool exits. */
+static void
+slab_release_thread_cache(void *data)
+{
+   struct slab_thread_cache *cache = data;
+   struct slab_mt_pool *pool = cache->pool;
+
+   slab_flush_batches(cache);
+
+   if (last_cache == cache)
+      last_pool_id = 0;
+
+   simple_mtx_lock(&pool->parent.mutex);
+   cache->next_idle = pool->idle_caches;
+   pool->idle_caches = cache;
+   simple_mtx_unlock(&pool->parent.mutex);
+}
+
+static struct slab_thread_cache *
+slab_get_thread_cache(struct slab_mt_pool *pool)
+{
+   if (likely(last_pool_id == pool->id))
+      return last_cache;
+
+   struct slab_thread_cache *cache = tss_get(pool->cache_key);
+
+   if (likely(cache)) {
+      last_pool_id = pool->id;
+      last_cache = cache;
+      return cache;
+   }
+
+   simple_mtx_lock(&pool->parent.mutex);
+   cache = pool->idle_caches;
+   if (cache)
+      pool->idle_caches = cache->next_idle;
+   simple_mtx_unlock(&pool->parent.mutex);
+
+   if (!cache) {
+      cache = calloc(1, sizeof(*cache));
+      if (!cache)
+         return NULL;
+
+      slab_create_child(&cache->child, &pool->parent);
+      cache->pool = pool;
+
+      simple_mtx_lock(&pool->parent.mutex);
+      cache->next = pool->caches;
+      pool->caches = cache;
+      simple_mtx_unlock(&pool->parent.mutex);
+   }
+
+   tss_set(pool->cache_key, cache);
+   last_pool_id = pool->id;
+   last_cache = cache;
+   return cache;
+}
+
+/**
+ * Create a thread-caching allocator for same-sized objects.
+ *
+ * Each pool uses a thread-specific storage key, so this is meant for a few
+ * long-lived pools, e.g. one per screen.
+ *
+ * \param item_size     Size of one object.
+ * \param num_items     Number of objects to allocate at once.
+ */
+bool
+slab_create_mt(struct slab_mt_pool *pool,
+               unsigned item_size,
+               unsigned num_items)
+{
+   if (tss_create(&pool->cache_key, slab_release_thread_cache) != thrd_success)
+      return false;
+
+   slab_create_parent(&pool->parent, item_size, num_items);
+   pool->id = p_atomic_inc_return(&next_pool_id);
+   pool->caches = NULL;
+   pool->idle_caches = NULL;
+
+   return true;
+}
+
+/**
+ * Destroy the pool, freeing all of its memory. No thread may use the pool
+ * anymore, and objects that were not freed become invalid.
+ */
+void
+slab_destroy_mt(struct slab_mt_pool *pool)
+{
+   tss_delete(pool->cache_key);
+
+   while (pool->caches) {
+      struct slab_thread_cache *cache = pool->caches;
+      pool->caches = cache->next;
+
+      while (cache->child.pages) {
+         struct slab_page_header *page = cache->child.pages;
+         cache->child.pages = page->u.next;
+         free(page);
+      }
+      free(cache);
+   }
+
+   slab_destroy_parent(&pool->parent);
+}
+
+/**
+ * Allocate an object from the pool. Can be called from any thread.
+ */
+void *
+slab_alloc_mt(struct slab_mt_pool *pool)
+{
+   struct slab_thread_cache *cache = slab_get_thread_cache(pool);
+   struct slab_element_header *elt;
+
+   if (unlikely(!cache))
+      return NULL;
+
+   if (!cache->child.free) {
+      /* First, collect elements that were freed by other threads. */
+      cache->child.free = slab_take_remote(cache);
+
+      /* Now allocate a new page. */
+      if (!cache->child.free) {
+         /* Let other threads reuse what we hold for them first. */
+         slab_flush_batches(cache);
+
+         if (!slab_add_new_page(&cache->child))
+            return NULL;
+      }
+   }
+
+   elt = cache->child.free;
+   cache->child.free = elt->next;
+
+   CHECK_MAGIC(elt, SLAB_MAGIC_FREE);
+   SET_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
+
+   return &elt[1];
+}
+
+/**
+ * Same as slab_alloc_mt but memset the returned object to 0.
+ */
+void *
+slab_zalloc_mt(struct slab_mt_pool *pool)
+{
+   void *r = slab_alloc_mt(pool);
+   if (r)
+      memset(r, 0, pool->parent.item_size);
+   return r;
+}
+
+/**
+ * Free an object allocated from the pool. Can be called from any thread.
+ *
+ * Objects allocated by another thread are collected in batches before they
+ * are handed back to their owner, so they are only available for new
+ * allocations once this thread frees more objects of the same owner,
+ * allocates a new page or exits.
+ */
+void
+slab_free_mt(struct slab_mt_pool *pool, void *ptr)
+{
+   struct slab_element_header *elt = ((struct slab_element_header*)ptr - 1);
+   struct slab_thread_cache *owner = (struct slab_thread_cache *)elt->owner;
+   struct slab_thread_cache *cache = slab_get_thread_cache(pool);
+
+   CHECK_MAGIC(elt, SLAB_MAGIC_ALLOCATED);
+   SET_MAGIC(elt, SLAB_MAGIC_FREE);
+
+   if (owner == cache) {
+      elt->next = cache->child.free;
+      cache->child.free = elt;
+      return;
+   }
+
+   /* We couldn't get a cache to batch in, hand the element back now. */
+   if (unlikely(!cache)) {
+      slab_push_remote(owner, elt, elt);
+      return;
+   }
+
+   struct slab_free_batch *batch =
+      &cache->batches[((uintptr_t)owner / sizeof(*owner)) % SLAB_BATCH_OWNERS];
+
+   if (batch->owner != owner) {
+      slab_flush_batch(batch);
+      batch->owner = owner;
+   }
+
+   elt->next = batch->head;
+   batch->head = elt;
+   if (!batch->tail)
+      batch->tail = elt;
+
+   if (++batch->count == SLAB_BATCH_SIZE)
+      slab_flush_batch(batch);
+}
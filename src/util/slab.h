@@ -37,11 +37,19 @@
  *
  * For convenience and to ease the transition, there is also a set of wrapper
  * functions around a single parent-child pair.
+ *
+ * Finally, slab_mt_pool hides the child pools: every thread that uses the
+ * pool gets its own child, which is kept in thread-local storage.  Objects
+ * can be allocated and freed from any thread.  Objects freed by a thread
+ * other than the one that allocated them are handed back to their owner in
+ * batches through a lock-free list.  The parent mutex is only taken when a
+ * thread uses the pool for the first time and when it exits.
  */
 
 #ifndef SLAB_H
 #define SLAB_H
 
+#include "c11/threads.h"
 #include "simple_mtx.h"
 
 #ifdef __cplusplus
@@ -50,6 +58,7 @@ extern "C" {
 
 struct slab_element_header;
 struct slab_page_header;
+struct slab_thread_cache;
 
 struct slab_parent_pool {
    simple_mtx_t mutex;
@@ -97,6 +106,32 @@ void slab_destroy(struct slab_mempool *mempool);
 void *slab_alloc_st(struct slab_mempool *mempool);
 void slab_free_st(struct slab_mempool *mempool, void *ptr);
 
+struct slab_mt_pool {
+   struct slab_parent_pool parent;
+
+   /* The slab_thread_cache of the calling thread. */
+   tss_t cache_key;
+
+   /* Unique id, for the thread's last used cache. */
+   uint64_t id;
+
+   /* All thread caches, and those of threads that exited, which are reused
+    * by new threads.
+    *
+    * These lists are protected by the parent mutex.
+    */
+   struct slab_thread_cache *caches;
+   struct slab_thread_cache *idle_caches;
+};
+
+bool slab_create_mt(struct slab_mt_pool *pool,
+                    unsigned item_size,
+                    unsigned num_items);
+void slab_destroy_mt(struct slab_mt_pool *pool);
+void *slab_alloc_mt(struct slab_mt_pool *pool);
+void *slab_zalloc_mt(struct slab_mt_pool *pool);
+void slab_free_mt(struct slab_mt_pool *pool, void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -683,6 +683,8 @@ protected:
 
    Cache() {
       mem_ctx = ralloc_context(NULL);
+      /* Some tests leave a small size limit behind */
+      unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
    }
    ~Cache() {
       ralloc_free(mem_ctx);
@@ -800,6 +802,32 @@ TEST_F(Cache, Database)
 #endif
 }
 
+TEST_F(Cache, DatabaseNoMmap)
+{
+   const char *driver_id = "make_check_uncompressed";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS", "1", 1);
+   setenv("MESA_DISK_CACHE_DATABASE_MMAP", "false", 1);
+   setenv("MESA_DISK_CACHE_DATABASE", "true", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_put_and_get(true, driver_id);
+
+   test_put_and_get_between_instances(driver_id);
+
+   setenv("MESA_DISK_CACHE_DATABASE", "false", 1);
+   unsetenv("MESA_DISK_CACHE_DATABASE_MMAP");
+   unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
 TEST_F(Cache, Combined)
 {
    const char *driver_id = "make_check";
@@ -1282,6 +1310,280 @@ TEST_F(Cache, DatabaseMultipartEviction)
 #endif
 }
 
+static void
+test_get_many_and_prefetch(const char *driver_id)
+{
+   const unsigned int num_entries = 16;
+   cache_key keys[num_entries + 1];
+   void *data[num_entries + 1];
+   size_t sizes[num_entries + 1];
+   struct disk_cache *cache;
+   unsigned int i, found;
+   char *result;
+   size_t size;
+
+   cache = disk_cache_create("test", driver_id, 0);
+
+   for (i = 0; i < num_entries + 1; i++)
+      disk_cache_compute_key(cache, &i, sizeof(i), keys[i]);
+
+   /* The last key is never stored */
+   for (i = 0; i < num_entries; i++)
+      disk_cache_put(cache, keys[i], &i, sizeof(i), NULL);
+   disk_cache_wait_for_idle(cache);
+
+   found = disk_cache_get_many(cache, keys, num_entries + 1, data, sizes);
+   EXPECT_EQ(found, num_entries) << "disk_cache_get_many found items";
+
+   for (i = 0; i < num_entries; i++) {
+      EXPECT_NE(data[i], nullptr) << "disk_cache_get_many with existent item (pointer)";
+      EXPECT_EQ(sizes[i], sizeof(i)) << "disk_cache_get_many with existent item (size)";
+      if (data[i]) {
+         EXPECT_EQ(*(unsigned *)data[i], i) << "disk_cache_get_many with existent item (data)";
+      }
+      free(data[i]);
+   }
+   EXPECT_EQ(data[num_entries], nullptr) << "disk_cache_get_many with non-existent item (pointer)";
+
+   /* Prefetched items are picked up by the following gets */
+   disk_cache_prefetch(cache, keys, num_entries + 1);
+
+   for (i = 0; i < num_entries; i++) {
+      result = (char *) disk_cache_get(cache, keys[i], &size);
+      EXPECT_NE(result, nullptr) << "disk_cache_get of prefetched item (pointer)";
+      EXPECT_EQ(size, sizeof(i)) << "disk_cache_get of prefetched item (size)";
+      free(result);
+   }
+
+   result = (char *) disk_cache_get(cache, keys[num_entries], &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get with non-existent item (pointer)";
+
+   /* Removal drops the prefetched copy as well */
+   disk_cache_prefetch(cache, keys, 1);
+   disk_cache_remove(cache, keys[0]);
+   result = (char *) disk_cache_get(cache, keys[0], &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get of removed prefetched item (pointer)";
+
+   disk_cache_destroy(cache);
+}
+
+TEST_F(Cache, DatabaseGetMany)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS", "3", 1);
+   setenv("MESA_DISK_CACHE_DATABASE", "true", 1);
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "1M", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_get_many_and_prefetch(driver_id);
+
+   unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
+   unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
+   unsetenv("MESA_DISK_CACHE_DATABASE");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+static void
+fill_dict_test_blob(unsigned i, uint8_t *blob, size_t size)
+{
+   /* Entries share structure, like the shader binaries of one driver do */
+   for (size_t j = 0; j < size; j++)
+      blob[j] = (j % 64 < 48) ? j % 64 : (i * 31 + j) & 0xff;
+}
+
+static void
+test_put_and_get_with_dict(const char *driver_id)
+{
+   const unsigned int num_entries = 400, entry_size = 4096;
+   uint8_t blob[entry_size];
+   struct disk_cache *cache;
+   cache_key key;
+   unsigned int i;
+   char *result;
+   size_t size;
+
+   /* Fill up the cache with enough entries to train the dictionary on */
+   cache = disk_cache_create("test", driver_id, 0);
+
+   for (i = 0; i < num_entries; i++) {
+      fill_dict_test_blob(i, blob, entry_size);
+      disk_cache_compute_key(cache, &i, sizeof(i), key);
+      disk_cache_put(cache, key, blob, entry_size, NULL);
+   }
+
+   disk_cache_destroy(cache);
+
+   /* Dictionary is trained from the existing entries on the queue */
+   setenv("MESA_DISK_CACHE_DATABASE_ZSTD_DICT", "true", 1);
+   cache = disk_cache_create("test", driver_id, 0);
+   disk_cache_wait_for_idle(cache);
+
+#ifdef HAVE_ZSTD
+   EXPECT_NE(cache->dict, nullptr) << "zstd dictionary trained";
+#endif
+
+   for (i = num_entries; i < 2 * num_entries; i++) {
+      fill_dict_test_blob(i, blob, entry_size);
+      disk_cache_compute_key(cache, &i, sizeof(i), key);
+      disk_cache_put(cache, key, blob, entry_size, NULL);
+   }
+   disk_cache_wait_for_idle(cache);
+
+   disk_cache_destroy(cache);
+   unsetenv("MESA_DISK_CACHE_DATABASE_ZSTD_DICT");
+
+   /* Entries with and without dictionary stay readable with the option
+    * disabled.
+    */
+   cache = disk_cache_create("test", driver_id, 0);
+
+   for (i = 0; i < 2 * num_entries; i++) {
+      fill_dict_test_blob(i, blob, entry_size);
+      disk_cache_compute_key(cache, &i, sizeof(i), key);
+
+      result = (char *) disk_cache_get(cache, key, &size);
+      EXPECT_NE(result, nullptr) << "disk_cache_get with existent item (pointer)";
+      if (result) {
+         EXPECT_EQ(size, entry_size) << "disk_cache_get with existent item (size)";
+         EXPECT_EQ(memcmp(result, blob, entry_size), 0) << "disk_cache_get with existent item (data)";
+      }
+      free(result);
+   }
+
+   disk_cache_destroy(cache);
+}
+
+TEST_F(Cache, DatabaseZstdDict)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   setenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS", "2", 1);
+   setenv("MESA_DISK_CACHE_DATABASE", "true", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME_DB, driver_id);
+
+   test_put_and_get_with_dict(driver_id);
+
+   unsetenv("MESA_DISK_CACHE_DATABASE_NUM_PARTS");
+   unsetenv("MESA_DISK_CACHE_DATABASE");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
+static void
+test_put_and_get_in_memory(const char *driver_id)
+{
+   const unsigned int num_entries = 64, entry_size = 512;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t big_blob[entry_size];
+   struct disk_cache *cache, *cache2;
+   uint8_t blob_key[20];
+   cache_key key;
+   unsigned int i;
+   char *result;
+   size_t size;
+
+   cache = disk_cache_create("test", driver_id, 0);
+   cache2 = disk_cache_create("test", driver_id, 0);
+
+   EXPECT_TRUE(cache->mem_cache_enabled) << "in-memory cache enabled";
+   cache->stats.enabled = true;
+   cache2->stats.enabled = true;
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+
+   /* The item is available before it was written out */
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+
+   result = (char *) disk_cache_get(cache, blob_key, &size);
+   EXPECT_STREQ(result, blob) << "disk_cache_get of existing item (pointer)";
+   EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get of existing item (size)";
+   EXPECT_EQ(cache->stats.mem_hits, 1) << "in-memory cache hit";
+   free(result);
+
+   disk_cache_wait_for_idle(cache);
+
+   /* Removing the item drops the in-memory copy too */
+   disk_cache_remove(cache, blob_key);
+
+   result = (char *) disk_cache_get(cache, blob_key, &size);
+   EXPECT_EQ(result, nullptr) << "disk_cache_get of removed item (pointer)";
+   EXPECT_EQ(size, 0) << "disk_cache_get of removed item (size)";
+
+   /* The items are shared between the caches of the process */
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_destroy(cache);
+
+   result = (char *) disk_cache_get(cache2, blob_key, &size);
+   EXPECT_STREQ(result, blob) << "disk_cache_get of item of another cache";
+   EXPECT_EQ(size, sizeof(blob)) << "disk_cache_get of item of another cache";
+   EXPECT_EQ(cache2->stats.mem_hits, 1) << "in-memory cache hit";
+   free(result);
+
+   /* Overflow the in-memory budget, the items are read back from disk */
+   for (i = 0; i < num_entries; i++) {
+      memset(big_blob, i, entry_size);
+      disk_cache_compute_key(cache2, &i, sizeof(i), key);
+      disk_cache_put(cache2, key, big_blob, entry_size, NULL);
+   }
+   disk_cache_wait_for_idle(cache2);
+
+   EXPECT_GT(cache2->stats.mem_evictions, 0) << "in-memory cache evictions";
+
+   for (i = 0; i < num_entries; i++) {
+      memset(big_blob, i, entry_size);
+      disk_cache_compute_key(cache2, &i, sizeof(i), key);
+
+      result = (char *) disk_cache_get(cache2, key, &size);
+      EXPECT_NE(result, nullptr) << "disk_cache_get with existent item (pointer)";
+      if (result) {
+         EXPECT_EQ(size, entry_size) << "disk_cache_get with existent item (size)";
+         EXPECT_EQ(memcmp(result, big_blob, entry_size), 0) << "disk_cache_get with existent item (data)";
+      }
+      free(result);
+   }
+
+   EXPECT_GT(cache2->stats.mem_misses, 0) << "in-memory cache misses";
+
+   disk_cache_destroy(cache2);
+}
+
+TEST_F(Cache, Memory)
+{
+   const char *driver_id = "make_check";
+
+#ifndef ENABLE_SHADER_CACHE
+   GTEST_SKIP() << "ENABLE_SHADER_CACHE not defined.";
+#else
+   /* 1K for each of the shards */
+   setenv("MESA_SHADER_CACHE_MEMORY_SIZE", "16K", 1);
+   setenv("MESA_SHADER_CACHE_MAX_SIZE", "1M", 1);
+
+   test_disk_cache_create(mem_ctx, CACHE_DIR_NAME, driver_id);
+
+   test_put_and_get_in_memory(driver_id);
+
+   unsetenv("MESA_SHADER_CACHE_MAX_SIZE");
+   unsetenv("MESA_SHADER_CACHE_MEMORY_SIZE");
+
+   int err = rmrf_local(CACHE_TEST_TMP);
+   EXPECT_EQ(err, 0) << "Removing " CACHE_TEST_TMP " again";
+#endif
+}
+
 static void
 test_put_and_get_disabled(const char *driver_id)
 {
@@ -22,6 +22,7 @@
  *
  */
 
+#include <set>
 #include <gtest/gtest.h>
 #include "util/ralloc.h"
 
@@ -46,3 +47,128 @@ TEST(gc_alloc, align)
       }
    }
 }
+
+TEST(gc_alloc, arena)
+{
+   gc_ctx *ctx = gc_context(NULL);
+   void *slab_ptr = gc_alloc_size(ctx, 24, 8);
+   void *ptrs[4096];
+
+   gc_set_arena(ctx, true);
+   EXPECT_TRUE(gc_is_arena(ctx));
+
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++) {
+      size_t align = 4 << (i % 3);
+      ptrs[i] = gc_alloc_size(ctx, 4 + (i % 64) * 4, align);
+      EXPECT_EQ((uintptr_t)ptrs[i] % align, 0);
+      EXPECT_EQ(gc_get_context(ptrs[i]), ctx);
+      memset(ptrs[i], i & 0xff, 4);
+   }
+   EXPECT_EQ(gc_get_context(slab_ptr), ctx);
+
+   /* Free every other allocation, then sweep away the remaining odd ones
+    * except the last few.
+    */
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i += 2)
+      gc_free(ptrs[i]);
+
+   gc_sweep_start(ctx);
+   gc_mark_live(ctx, slab_ptr);
+   for (unsigned i = ARRAY_SIZE(ptrs) - 7; i < ARRAY_SIZE(ptrs); i += 2)
+      gc_mark_live(ctx, ptrs[i]);
+   gc_sweep_end(ctx);
+
+   for (unsigned i = ARRAY_SIZE(ptrs) - 7; i < ARRAY_SIZE(ptrs); i += 2) {
+      EXPECT_EQ(*(uint8_t *)ptrs[i], i & 0xff);
+      gc_free(ptrs[i]);
+   }
+
+   /* Back to the slabs */
+   gc_set_arena(ctx, false);
+   void *ptr = gc_alloc_size(ctx, 24, 8);
+   EXPECT_EQ(gc_get_context(ptr), ctx);
+   gc_free(ptr);
+   gc_free(slab_ptr);
+
+   ralloc_free(ctx);
+}
+
+TEST(gc_alloc, arena_sweep_reuse)
+{
+   gc_ctx *ctx = gc_context(NULL);
+   void *ptrs[2048];
+   std::set<void *> dead;
+
+   gc_set_arena(ctx, true);
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++)
+      ptrs[i] = gc_alloc_size(ctx, 32, 8);
+
+   /* Keep every fourth allocation, in all the chunks. */
+   gc_sweep_start(ctx);
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++) {
+      if (i % 4 == 0) {
+         gc_mark_live(ctx, ptrs[i]);
+         memset(ptrs[i], i & 0xff, 32);
+      } else {
+         dead.insert(ptrs[i]);
+      }
+   }
+   gc_sweep_end(ctx);
+
+   /* The dead allocations are reused in place, one after the other. */
+   std::set<void *> reused;
+   for (unsigned i = 0; i < dead.size(); i++) {
+      void *ptr = gc_alloc_size(ctx, 32, 8);
+      EXPECT_TRUE(dead.count(ptr)) << "allocation " << i;
+      EXPECT_TRUE(reused.insert(ptr).second);
+      memset(ptr, 0xcc, 32);
+   }
+
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i += 4) {
+      for (unsigned j = 0; j < 32; j++)
+         EXPECT_EQ(((uint8_t *)ptrs[i])[j], i & 0xff);
+   }
+
+   ralloc_free(ctx);
+}
+
+TEST(gc_alloc, adopt)
+{
+   gc_ctx *ctx = gc_context(NULL);
+   gc_ctx *other = gc_context(NULL);
+   void *ptrs[256];
+
+   /* Put "other" in another generation than "ctx". */
+   gc_sweep_start(other);
+   gc_sweep_end(other);
+
+   gc_set_arena(other, true);
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++) {
+      if (i == ARRAY_SIZE(ptrs) / 2)
+         gc_set_arena(other, false);
+      ptrs[i] = gc_alloc_size(other, i % 4 == 3 ? 8192 : 8 + (i % 16) * 4, 8);
+      memset(ptrs[i], i & 0xff, 4);
+   }
+   void *own = gc_alloc_size(ctx, 24, 8);
+
+   gc_adopt(ctx, other);
+   ralloc_free(other);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++)
+      EXPECT_EQ(gc_get_context(ptrs[i]), ctx);
+
+   /* Everything adopted stays alive through a sweep of the new context. */
+   gc_sweep_start(ctx);
+   gc_mark_live(ctx, own);
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++)
+      gc_mark_live(ctx, ptrs[i]);
+   gc_sweep_end(ctx);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(ptrs); i++) {
+      EXPECT_EQ(*(uint8_t *)ptrs[i], i & 0xff);
+      gc_free(ptrs[i]);
+   }
+   gc_free(own);
+
+   ralloc_free(ctx);
+}
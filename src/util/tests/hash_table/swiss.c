@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "util/hash_table.h"
+
+#define NUM_KEYS 1000
+
+/* Runs of 32 keys share a hash, so they overflow their group. */
+static uint32_t
+key_hash(const void *key)
+{
+   return *(const unsigned *)key / 32;
+}
+
+static bool
+key_equal(const void *a, const void *b)
+{
+   return *(const unsigned *)a == *(const unsigned *)b;
+}
+
+static void
+check(struct hash_table *ht, unsigned *keys, bool *present)
+{
+   for (unsigned k = 0; k < NUM_KEYS; k++) {
+      struct hash_entry *entry = _mesa_hash_table_search(ht, &keys[k]);
+
+      assert((entry != NULL) == present[k]);
+      assert(!entry || entry->data == &keys[k]);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   static unsigned keys[NUM_KEYS];
+   static bool present[NUM_KEYS];
+   struct hash_table *ht, *clone;
+   unsigned count = 0;
+
+   (void) argc;
+   (void) argv;
+
+   for (unsigned k = 0; k < NUM_KEYS; k++)
+      keys[k] = k;
+
+   ht = _mesa_hash_table_create(NULL, key_hash, key_equal);
+   assert(_mesa_hash_table_use_swiss(ht, true));
+   assert(ht->ctrl);
+
+   /* Random inserts and removals, so that probing has to skip deleted
+    * entries.
+    */
+   srand(0);
+   for (unsigned i = 0; i < 20000; i++) {
+      unsigned k = rand() % NUM_KEYS;
+
+      if (present[k]) {
+         _mesa_hash_table_remove_key(ht, &keys[k]);
+         count--;
+      } else {
+         _mesa_hash_table_insert(ht, &keys[k], &keys[k]);
+         count++;
+      }
+      present[k] = !present[k];
+      assert(ht->entries == count);
+   }
+   check(ht, keys, present);
+
+   clone = _mesa_hash_table_clone(ht, NULL);
+   assert(clone->ctrl);
+   check(clone, keys, present);
+
+   /* Back and forth between the two layouts */
+   assert(_mesa_hash_table_use_swiss(ht, false));
+   assert(!ht->ctrl);
+   check(ht, keys, present);
+   assert(_mesa_hash_table_use_swiss(ht, true));
+   check(ht, keys, present);
+
+   assert(_mesa_hash_table_reserve(ht, 4 * NUM_KEYS));
+   check(ht, keys, present);
+
+   /* The rehashes above got rid of the deleted entries. */
+   assert(ht->deleted_entries == 0);
+   hash_table_foreach_remove(ht, entry) {
+      assert(entry->data == entry->key);
+   }
+   assert(ht->entries == 0);
+
+   _mesa_hash_table_clear(clone, NULL);
+   for (unsigned k = 0; k < NUM_KEYS; k++)
+      present[k] = false;
+   check(ht, keys, present);
+   check(clone, keys, present);
+
+   _mesa_hash_table_insert(ht, &keys[0], &keys[0]);
+   _mesa_hash_table_insert(clone, &keys[0], &keys[0]);
+   present[0] = true;
+   check(ht, keys, present);
+   check(clone, keys, present);
+
+   _mesa_hash_table_destroy(ht, NULL);
+   _mesa_hash_table_destroy(clone, NULL);
+
+   return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * hash_table and set throughput benchmark.
+ *
+ * Inserts N pointer keys into a table, looks all of them up, looks up N
+ * keys which aren't in the table, removes every key and reports the
+ * operations per second of each step, for the default open addressing
+ * layout and for the Swiss layout (see hash_ctrl.h):
+ *
+ *   hash_table_bench [-n entries] [-r passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/set.h"
+
+enum step {
+   STEP_INSERT,
+   STEP_LOOKUP_HIT,
+   STEP_LOOKUP_MISS,
+   STEP_REMOVE,
+   NUM_STEPS,
+};
+
+static const char *step_names[NUM_STEPS] = {
+   "insert", "hit", "miss", "remove",
+};
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-n entries] [-r passes]\n", name);
+   exit(1);
+}
+
+static void
+fail(const char *what, unsigned i)
+{
+   fprintf(stderr, "%s failed for key %u\n", what, i);
+   exit(1);
+}
+
+static void
+run_hash_table(bool swiss, char *keys, unsigned num_entries, double *time)
+{
+   struct hash_table *ht = _mesa_pointer_hash_table_create(NULL);
+
+   if (!_mesa_hash_table_use_swiss(ht, swiss)) {
+      fprintf(stderr, "failed to switch the table layout\n");
+      exit(1);
+   }
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++)
+      _mesa_hash_table_insert(ht, keys + i, keys + i);
+
+   int64_t t = os_time_get_nano();
+   time[STEP_INSERT] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      struct hash_entry *entry = _mesa_hash_table_search(ht, keys + i);
+      if (!entry || entry->data != keys + i)
+         fail("lookup", i);
+   }
+
+   t = os_time_get_nano();
+   time[STEP_LOOKUP_HIT] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      if (_mesa_hash_table_search(ht, keys + num_entries + i))
+         fail("lookup of a missing key", i);
+   }
+
+   t = os_time_get_nano();
+   time[STEP_LOOKUP_MISS] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++)
+      _mesa_hash_table_remove_key(ht, keys + i);
+
+   t = os_time_get_nano();
+   time[STEP_REMOVE] += (t - start) / 1e9;
+
+   if (ht->entries)
+      fail("remove", 0);
+
+   _mesa_hash_table_destroy(ht, NULL);
+}
+
+static void
+run_set(bool swiss, char *keys, unsigned num_entries, double *time)
+{
+   struct set *set = _mesa_pointer_set_create(NULL);
+
+   if (!_mesa_set_use_swiss(set, swiss)) {
+      fprintf(stderr, "failed to switch the set layout\n");
+      exit(1);
+   }
+
+   int64_t start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++)
+      _mesa_set_add(set, keys + i);
+
+   int64_t t = os_time_get_nano();
+   time[STEP_INSERT] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      if (!_mesa_set_search(set, keys + i))
+         fail("lookup", i);
+   }
+
+   t = os_time_get_nano();
+   time[STEP_LOOKUP_HIT] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++) {
+      if (_mesa_set_search(set, keys + num_entries + i))
+         fail("lookup of a missing key", i);
+   }
+
+   t = os_time_get_nano();
+   time[STEP_LOOKUP_MISS] += (t - start) / 1e9;
+   start = t;
+
+   for (unsigned i = 0; i < num_entries; i++)
+      _mesa_set_remove_key(set, keys + i);
+
+   t = os_time_get_nano();
+   time[STEP_REMOVE] += (t - start) / 1e9;
+
+   if (set->entries)
+      fail("remove", 0);
+
+   _mesa_set_destroy(set, NULL);
+}
+
+static void
+run(bool is_set, bool swiss, char *keys, unsigned num_entries,
+    unsigned passes)
+{
+   double time[NUM_STEPS] = { 0 };
+
+   for (unsigned i = 0; i < passes; i++) {
+      if (is_set)
+         run_set(swiss, keys, num_entries, time);
+      else
+         run_hash_table(swiss, keys, num_entries, time);
+   }
+
+   printf("%-10s %-7s", is_set ? "set" : "hash_table",
+          swiss ? "swiss" : "default");
+   for (unsigned i = 0; i < NUM_STEPS; i++) {
+      printf(" %s: %7.2f Mops/s", step_names[i],
+             (double)num_entries * passes / time[i] / 1e6);
+   }
+   printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_entries = 100000;
+   unsigned passes = 10;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+      switch (opt) {
+      case 'n': num_entries = atoi(optarg); break;
+      case 'r': passes = atoi(optarg); break;
+      default: usage(argv[0]);
+      }
+   }
+   if (!num_entries || !passes)
+      usage(argv[0]);
+
+   /* The pointer keys, the second half is never inserted */
+   char *keys = malloc(2 * num_entries);
+
+   printf("%u entries, %u passes\n", num_entries, passes);
+
+   run(false, false, keys, num_entries, passes);
+   run(false, true, keys, num_entries, passes);
+   run(true, false, keys, num_entries, passes);
+   run(true, true, keys, num_entries, passes);
+
+   free(keys);
+
+   return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Mesa-DB read benchmark.
+ *
+ * Fills a single-part cache database with N entries and measures entry
+ * lookups per second, both with the file IO and with the mmap read path.
+ * Lookups go through mesa_cache_db_read_entry_cb() like disk_cache does,
+ * or through mesa_cache_db_read_entries() in batches of -b keys.
+ * The cold pass starts with a freshly opened database with the files
+ * dropped from the page cache, the warm passes re-read the same entries:
+ *
+ *   mesa_cache_db_bench [-n entries] [-s entry size] [-r warm passes]
+ *                       [-b batch size] [dir]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/mesa_cache_db.h"
+#include "util/macros.h"
+#include "util/mesa-sha1.h"
+#include "util/os_time.h"
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr,
+           "usage: %s [-n entries] [-s size] [-r passes] [-b batch] [dir]\n",
+           name);
+   exit(1);
+}
+
+static void
+make_key(unsigned i, uint8_t key[20])
+{
+   _mesa_sha1_compute(&i, sizeof(i), key);
+}
+
+static void
+drop_page_cache(const char *dir)
+{
+   static const char *files[] = { "mesa_cache.db", "mesa_cache.idx" };
+
+   for (unsigned i = 0; i < 2; i++) {
+      char path[4096];
+      snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+
+      int fd = open(path, O_RDONLY);
+      if (fd == -1)
+         continue;
+
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+   }
+}
+
+static bool
+check_entry(const void *blob, size_t size, void *data)
+{
+   return size == *(size_t *)data;
+}
+
+static void
+check_batch_entry(unsigned key_index, const void *blob, size_t size,
+                  void *data)
+{
+   if (size != *(size_t *)data) {
+      fprintf(stderr, "entry %u has a wrong size\n", key_index);
+      exit(1);
+   }
+}
+
+static double
+read_pass(struct mesa_cache_db *db, unsigned num_entries, size_t entry_size,
+          unsigned batch)
+{
+   uint8_t *keys = malloc(batch * 20);
+   bool *found = malloc(batch * sizeof(*found));
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_entries; i += batch) {
+      unsigned n = MIN2(batch, num_entries - i);
+
+      for (unsigned j = 0; j < n; j++) {
+         make_key(i + j, keys + j * 20);
+         found[j] = false;
+      }
+
+      if (batch == 1) {
+         if (!mesa_cache_db_read_entry_cb(db, keys, check_entry,
+                                          &entry_size)) {
+            fprintf(stderr, "entry %u is missing\n", i);
+            exit(1);
+         }
+      } else if (mesa_cache_db_read_entries(db, keys, n, found,
+                                            check_batch_entry,
+                                            &entry_size) != n) {
+         fprintf(stderr, "entries of batch %u are missing\n", i / batch);
+         exit(1);
+      }
+   }
+
+   double rate = num_entries / ((os_time_get_nano() - start) / 1e9);
+
+   free(found);
+   free(keys);
+
+   return rate;
+}
+
+static void
+run(const char *dir, bool mmap_reads, unsigned num_entries,
+    size_t entry_size, unsigned passes, unsigned batch)
+{
+   struct mesa_cache_db db;
+
+   drop_page_cache(dir);
+
+   if (!mesa_cache_db_open(&db, dir)) {
+      fprintf(stderr, "failed to open the database in %s\n", dir);
+      exit(1);
+   }
+   db.mmap_reads = mmap_reads;
+
+   double cold = read_pass(&db, num_entries, entry_size, batch);
+   double warm = 0;
+
+   for (unsigned i = 0; i < passes; i++)
+      warm += read_pass(&db, num_entries, entry_size, batch);
+
+   printf("%-5s batch %-4u cold: %10.0f gets/s  warm: %10.0f gets/s\n",
+          mmap_reads ? "mmap" : "stdio", batch, cold, warm / passes);
+
+   mesa_cache_db_close(&db);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_entries = 10000;
+   unsigned passes = 10;
+   unsigned batch = 64;
+   size_t entry_size = 4096;
+   char tmpl[] = "/tmp/mesa_cache_db_bench.XXXXXX";
+   const char *dir;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:s:r:b:")) != -1) {
+      switch (opt) {
+      case 'n': num_entries = atoi(optarg); break;
+      case 's': entry_size = atoi(optarg); break;
+      case 'r': passes = atoi(optarg); break;
+      case 'b': batch = atoi(optarg); break;
+      default: usage(argv[0]);
+      }
+   }
+   if (!num_entries || !entry_size || !passes || !batch)
+      usage(argv[0]);
+
+   if (optind < argc) {
+      dir = argv[optind];
+   } else {
+      dir = mkdtemp(tmpl);
+      if (!dir) {
+         perror("mkdtemp");
+         return 1;
+      }
+   }
+
+   struct mesa_cache_db db;
+   if (!mesa_cache_db_open(&db, dir)) {
+      fprintf(stderr, "failed to open the database in %s\n", dir);
+      return 1;
+   }
+   mesa_cache_db_set_size_limit(&db, UINT64_MAX / 2);
+
+   uint8_t *blob = malloc(entry_size);
+   for (unsigned i = 0; i < num_entries; i++) {
+      uint8_t key[20];
+
+      make_key(i, key);
+      memset(blob, i, entry_size);
+
+      /* Existing entries are kept when re-running on the same directory */
+      mesa_cache_db_entry_write(&db, key, blob, entry_size);
+   }
+   free(blob);
+   mesa_cache_db_close(&db);
+
+   printf("%u entries of %zu bytes\n", num_entries, entry_size);
+
+   run(dir, false, num_entries, entry_size, passes, 1);
+   run(dir, true, num_entries, entry_size, passes, 1);
+
+   if (batch > 1) {
+      run(dir, false, num_entries, entry_size, passes, batch);
+      run(dir, true, num_entries, entry_size, passes, batch);
+   }
+
+   if (optind >= argc) {
+      mesa_db_wipe_path(dir);
+      rmdir(dir);
+   }
+
+   return 0;
+}
@@ -21,6 +21,9 @@
  * IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include <gtest/gtest.h>
 #include "ralloc.h"
 #include "register_allocate.h"
@@ -279,3 +282,182 @@ TEST_F(ra_test, serialization_roundtrip)
    blob_finish(&blob);
 }
 
+
+/* Builds the interference graph of count random live ranges of up to
+ * max_len instructions, like the liveness of a long shader would give, with
+ * a class picked at random among classes for each node.
+ */
+static struct ra_graph *
+build_interval_graph(struct ra_regs *regs, struct ra_class **classes,
+                     unsigned num_classes, unsigned count, unsigned max_len)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+   std::vector<std::pair<unsigned, unsigned>> ranges(count);
+   std::vector<unsigned> order(count);
+   unsigned seed = 1;
+
+   for (unsigned n = 0; n < count; n++) {
+      seed = seed * 1103515245 + 12345;
+      unsigned start = (seed >> 8) % (count * 2);
+      seed = seed * 1103515245 + 12345;
+      ranges[n] = std::make_pair(start, start + 1 + (seed >> 8) % max_len);
+
+      ra_set_node_class(g, n, classes[n % num_classes]);
+      ra_set_node_spill_cost(g, n, 1.0f + n % 7);
+      order[n] = n;
+   }
+
+   std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+      return ranges[a].first < ranges[b].first;
+   });
+
+   for (unsigned i = 0; i < count; i++) {
+      unsigned a = order[i];
+      for (unsigned j = i + 1; j < count; j++) {
+         unsigned b = order[j];
+         if (ranges[b].first >= ranges[a].second)
+            break;
+         ra_add_node_interference(g, a, b);
+      }
+   }
+
+   return g;
+}
+
+/* Builds a random graph in which every node interferes with degree others. */
+static struct ra_graph *
+build_random_graph(struct ra_regs *regs, struct ra_class **classes,
+                   unsigned num_classes, unsigned count, unsigned degree)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(regs, count);
+   unsigned seed = 1;
+
+   for (unsigned n = 0; n < count; n++) {
+      ra_set_node_class(g, n, classes[n % num_classes]);
+      ra_set_node_spill_cost(g, n, 1.0f + n % 7);
+   }
+
+   for (unsigned n = 0; n < count; n++) {
+      for (unsigned i = 0; i < degree / 2; i++) {
+         seed = seed * 1103515245 + 12345;
+         ra_add_node_interference(g, n, (seed >> 8) % count);
+      }
+   }
+
+   return g;
+}
+
+/* Allocates the graph like a backend would, spilling one node whenever the
+ * allocation fails, and returns the number of spilled nodes.
+ */
+static unsigned
+allocate_with_spilling(struct ra_graph *g)
+{
+   unsigned spills = 0;
+
+   while (!ra_allocate(g)) {
+      int n = ra_get_best_spill_node(g);
+      EXPECT_GE(n, 0);
+      if (n < 0)
+         break;
+
+      ra_set_node_spill_cost(g, n, 0.0f);
+      ra_reset_node_interference(g, n);
+      spills++;
+   }
+
+   return spills;
+}
+
+static void
+check_allocation(struct ra_graph *g)
+{
+   for (unsigned n = 0; n < g->count; n++) {
+      unsigned r = ra_get_node_reg(g, n);
+      struct ra_class *c = ra_get_node_class(g, n);
+      ASSERT_NE(r, NO_REG);
+      ASSERT_TRUE(BITSET_TEST(c->regs, r));
+
+      util_dynarray_foreach(&g->nodes[n].adjacency_list, unsigned, n2p) {
+         ASSERT_FALSE(ra_class_allocations_conflict(c, r,
+                                                    ra_get_node_class(g, *n2p),
+                                                    ra_get_node_reg(g, *n2p)));
+      }
+   }
+}
+
+static struct ra_regs *
+alloc_contig_reg_set(void *mem_ctx, unsigned count, struct ra_class **classes)
+{
+   struct ra_regs *regs = ra_alloc_reg_set(mem_ctx, count, true);
+
+   for (unsigned i = 0; i < 3; i++) {
+      unsigned size = 1 << i;
+      classes[i] = ra_alloc_contig_reg_class(regs, size);
+      for (unsigned r = 0; r + size <= count; r += size)
+         ra_class_add_reg(classes[i], r);
+   }
+
+   ra_set_finalize(regs, NULL);
+   return regs;
+}
+
+/* The tests below on large synthetic graphs also serve as benchmarks of the
+ * allocator, through the times gtest reports for them.
+ */
+TEST_F(ra_test, large_interval_graph)
+{
+   struct ra_class *classes[3];
+   struct ra_regs *regs = alloc_contig_reg_set(mem_ctx, 128, classes);
+
+   struct ra_graph *g = build_interval_graph(regs, classes, 3, 16384, 16);
+   EXPECT_EQ(allocate_with_spilling(g), 0);
+   check_allocation(g);
+   ralloc_free(g);
+}
+
+TEST_F(ra_test, large_interval_graph_spilling)
+{
+   struct ra_class *classes[3];
+   struct ra_regs *regs = alloc_contig_reg_set(mem_ctx, 32, classes);
+
+   struct ra_graph *g = build_interval_graph(regs, classes, 3, 4096, 24);
+   EXPECT_GT(allocate_with_spilling(g), 0);
+   check_allocation(g);
+   ralloc_free(g);
+}
+
+TEST_F(ra_test, large_random_graph)
+{
+   struct ra_class *classes[3];
+   struct ra_regs *regs = alloc_contig_reg_set(mem_ctx, 32, classes);
+
+   struct ra_graph *g = build_random_graph(regs, classes, 1, 16384, 16);
+   allocate_with_spilling(g);
+   check_allocation(g);
+   ralloc_free(g);
+}
+
+TEST_F(ra_test, spill_benefit_follows_class_changes)
+{
+   struct ra_class *classes[3];
+   struct ra_regs *regs = alloc_contig_reg_set(mem_ctx, 8, classes);
+
+   /* Nodes 0 and 2 can be spilled, and interfere with nodes 1 and 3. */
+   struct ra_graph *g = ra_alloc_interference_graph(regs, 4);
+   for (unsigned n = 0; n < 4; n++)
+      ra_set_node_class(g, n, classes[0]);
+   ra_add_node_interference(g, 0, 1);
+   ra_add_node_interference(g, 2, 3);
+   ra_set_node_spill_cost(g, 0, 1.0f);
+   ra_set_node_spill_cost(g, 2, 1.0f);
+
+   ASSERT_TRUE(ra_allocate(g));
+   EXPECT_EQ(ra_get_best_spill_node(g), 0);
+
+   /* A pair of registers conflicts with more registers of node 2. */
+   ra_set_node_class(g, 3, classes[1]);
+   EXPECT_EQ(ra_get_best_spill_node(g), 2);
+
+   ralloc_free(g);
+}
@@ -171,3 +171,66 @@ TEST(set, search_or_add)
 
    _mesa_set_destroy(s, NULL);
 }
+
+/* Runs of 32 keys share a hash, so they overflow their group. */
+static uint32_t hash_int_run(const void *p)
+{
+   return *(const int *)p / 32;
+}
+
+TEST(set, swiss)
+{
+   struct set *s = _mesa_set_create(NULL, hash_int_run, cmp_int);
+   static int keys[1000];
+   bool present[1000] = { false };
+   unsigned count = 0;
+
+   EXPECT_TRUE(_mesa_set_use_swiss(s, true));
+   EXPECT_TRUE(s->ctrl);
+
+   for (unsigned i = 0; i < 1000; i++)
+      keys[i] = i;
+
+   srand(0);
+   for (unsigned i = 0; i < 20000; i++) {
+      unsigned k = rand() % 1000;
+
+      if (present[k]) {
+         _mesa_set_remove_key(s, &keys[k]);
+         count--;
+      } else {
+         _mesa_set_add(s, &keys[k]);
+         count++;
+      }
+      present[k] = !present[k];
+      EXPECT_EQ(s->entries, count);
+   }
+
+   for (unsigned k = 0; k < 1000; k++)
+      EXPECT_EQ(_mesa_set_search(s, &keys[k]) != NULL, present[k]);
+
+   struct set *clone = _mesa_set_clone(s, NULL);
+   EXPECT_TRUE(clone->ctrl);
+
+   /* Back to the default layout and to the Swiss one again. */
+   EXPECT_TRUE(_mesa_set_use_swiss(s, false));
+   EXPECT_FALSE(s->ctrl);
+   EXPECT_TRUE(_mesa_set_use_swiss(s, true));
+
+   for (unsigned k = 0; k < 1000; k++) {
+      EXPECT_EQ(_mesa_set_search(s, &keys[k]) != NULL, present[k]);
+      EXPECT_EQ(_mesa_set_search(clone, &keys[k]) != NULL, present[k]);
+   }
+
+   _mesa_set_resize(clone, 0);
+   set_foreach_remove(clone, entry) {
+      EXPECT_TRUE(present[*(const int *)entry->key]);
+   }
+   EXPECT_EQ(clone->entries, 0);
+   EXPECT_FALSE(_mesa_set_search(clone, &keys[0]));
+   _mesa_set_add(clone, &keys[0]);
+   EXPECT_TRUE(_mesa_set_search(clone, &keys[0]));
+
+   _mesa_set_destroy(s, NULL);
+   _mesa_set_destroy(clone, NULL);
+}
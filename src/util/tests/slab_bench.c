@@ -0,0 +1,188 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Multi-threaded slab allocator benchmark.
+ *
+ * Each of T threads allocates N objects, then every thread frees the
+ * objects of the next thread (or its own ones with -l), over and over.
+ * Reports allocations + frees per second for malloc, for one slab child
+ * pool per thread and for slab_mt_pool:
+ *
+ *   slab_bench [-t threads] [-n objects per round] [-r rounds]
+ *              [-s object size] [-l]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/slab.h"
+#include "util/u_thread.h"
+
+enum mode {
+   MODE_MALLOC,
+   MODE_CHILD,
+   MODE_MT,
+};
+
+static const char *mode_names[] = { "malloc", "child", "mt" };
+
+struct bench {
+   enum mode mode;
+   unsigned num_threads;
+   unsigned num_objects;
+   unsigned rounds;
+   unsigned size;
+   bool local;
+
+   struct slab_parent_pool parent;
+   struct slab_mt_pool mt;
+   util_barrier barrier;
+   void ***objects;
+};
+
+struct thread {
+   struct bench *bench;
+   unsigned index;
+};
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-t threads] [-n objects] [-r rounds] "
+           "[-s size] [-l]\n", name);
+   exit(1);
+}
+
+static int
+thread_func(void *data)
+{
+   struct thread *thread = data;
+   struct bench *b = thread->bench;
+   struct slab_child_pool child;
+   unsigned other = b->local ? thread->index :
+                               (thread->index + 1) % b->num_threads;
+   void **mine = b->objects[thread->index];
+   void **theirs = b->objects[other];
+
+   if (b->mode == MODE_CHILD)
+      slab_create_child(&child, &b->parent);
+
+   for (unsigned r = 0; r < b->rounds; r++) {
+      for (unsigned i = 0; i < b->num_objects; i++) {
+         switch (b->mode) {
+         case MODE_MALLOC: mine[i] = malloc(b->size); break;
+         case MODE_CHILD: mine[i] = slab_alloc(&child); break;
+         case MODE_MT: mine[i] = slab_alloc_mt(&b->mt); break;
+         }
+         *(unsigned *)mine[i] = thread->index;
+      }
+
+      util_barrier_wait(&b->barrier);
+
+      for (unsigned i = 0; i < b->num_objects; i++) {
+         if (*(unsigned *)theirs[i] != other) {
+            fprintf(stderr, "object %u of thread %u was overwritten\n",
+                    i, other);
+            exit(1);
+         }
+
+         switch (b->mode) {
+         case MODE_MALLOC: free(theirs[i]); break;
+         case MODE_CHILD: slab_free(&child, theirs[i]); break;
+         case MODE_MT: slab_free_mt(&b->mt, theirs[i]); break;
+         }
+      }
+
+      util_barrier_wait(&b->barrier);
+   }
+
+   if (b->mode == MODE_CHILD)
+      slab_destroy_child(&child);
+
+   return 0;
+}
+
+static void
+run(struct bench *b, enum mode mode)
+{
+   struct thread *threads = calloc(b->num_threads, sizeof(*threads));
+   thrd_t *handles = calloc(b->num_threads, sizeof(*handles));
+
+   b->mode = mode;
+   if (mode == MODE_CHILD)
+      slab_create_parent(&b->parent, b->size, 64);
+   if (mode == MODE_MT && !slab_create_mt(&b->mt, b->size, 64)) {
+      fprintf(stderr, "failed to create the pool\n");
+      exit(1);
+   }
+   util_barrier_init(&b->barrier, b->num_threads);
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < b->num_threads; i++) {
+      threads[i].bench = b;
+      threads[i].index = i;
+      thrd_create(&handles[i], thread_func, &threads[i]);
+   }
+   for (unsigned i = 0; i < b->num_threads; i++)
+      thrd_join(handles[i], NULL);
+
+   double seconds = (os_time_get_nano() - start) / 1e9;
+   double ops = 2.0 * b->num_threads * b->num_objects * b->rounds;
+
+   printf("%-6s %2u threads, %s frees: %8.2f Mops/s\n", mode_names[mode],
+          b->num_threads, b->local ? "local" : "remote", ops / seconds / 1e6);
+
+   util_barrier_destroy(&b->barrier);
+   if (mode == MODE_CHILD)
+      slab_destroy_parent(&b->parent);
+   if (mode == MODE_MT)
+      slab_destroy_mt(&b->mt);
+   free(handles);
+   free(threads);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct bench b = {
+      .num_threads = 4,
+      .num_objects = 1000,
+      .rounds = 1000,
+      .size = 64,
+   };
+   int opt;
+
+   while ((opt = getopt(argc, argv, "t:n:r:s:l")) != -1) {
+      switch (opt) {
+      case 't': b.num_threads = atoi(optarg); break;
+      case 'n': b.num_objects = atoi(optarg); break;
+      case 'r': b.rounds = atoi(optarg); break;
+      case 's': b.size = atoi(optarg); break;
+      case 'l': b.local = true; break;
+      default: usage(argv[0]);
+      }
+   }
+   if (!b.num_threads || !b.num_objects || !b.rounds ||
+       b.size < sizeof(unsigned))
+      usage(argv[0]);
+
+   b.objects = calloc(b.num_threads, sizeof(*b.objects));
+   for (unsigned i = 0; i < b.num_threads; i++)
+      b.objects[i] = calloc(b.num_objects, sizeof(void *));
+
+   run(&b, MODE_MALLOC);
+   run(&b, MODE_CHILD);
+   run(&b, MODE_MT);
+
+   for (unsigned i = 0; i < b.num_threads; i++)
+      free(b.objects[i]);
+   free(b.objects);
+
+   return 0;
+}
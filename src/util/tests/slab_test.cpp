@@ -0,0 +1,202 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Testing slab_alloc_mt and slab_free_mt of slab.h
+ */
+
+#include <gtest/gtest.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/slab.h"
+#include "util/u_atomic.h"
+
+#define ITEM_SIZE 16
+#define PAGE_ITEMS 64
+#define BATCH_SIZE 32 /* SLAB_BATCH_SIZE */
+
+struct remote_free_state {
+   struct slab_mt_pool *pool;
+   void **objs;
+   unsigned num_objs;
+
+   /* Set by the thread once it freed objs, and by the test to let it exit */
+   int freed;
+   int done;
+};
+
+static void
+wait_for(int *flag)
+{
+   while (!p_atomic_read(flag))
+      os_time_sleep(100);
+}
+
+/* Frees objs, then waits until the test is done with the pool */
+static int
+remote_free_thread(void *data)
+{
+   struct remote_free_state *state = (struct remote_free_state *)data;
+
+   for (unsigned i = 0; i < state->num_objs; i++)
+      slab_free_mt(state->pool, state->objs[i]);
+
+   p_atomic_set(&state->freed, 1);
+   wait_for(&state->done);
+   return 0;
+}
+
+static bool
+contains(void **objs, unsigned num_objs, void *obj)
+{
+   for (unsigned i = 0; i < num_objs; i++) {
+      if (objs[i] == obj)
+         return true;
+   }
+   return false;
+}
+
+TEST(slab_mt_test, remote_free_batch)
+{
+   struct slab_mt_pool pool;
+   void *objs[PAGE_ITEMS];
+   thrd_t thread;
+
+   ASSERT_TRUE(slab_create_mt(&pool, ITEM_SIZE, PAGE_ITEMS));
+
+   for (unsigned i = 0; i < PAGE_ITEMS; i++) {
+      objs[i] = slab_alloc_mt(&pool);
+      ASSERT_NE(objs[i], nullptr);
+   }
+
+   /* A full batch is handed back right away, while the thread still runs */
+   struct remote_free_state state = { &pool, objs, BATCH_SIZE, 0, 0 };
+   ASSERT_EQ(thrd_create(&thread, remote_free_thread, &state), thrd_success);
+   wait_for(&state.freed);
+
+   for (unsigned i = 0; i < BATCH_SIZE; i++) {
+      void *obj = slab_alloc_mt(&pool);
+      EXPECT_TRUE(contains(objs, BATCH_SIZE, obj)) << "reused remote free " << i;
+   }
+
+   /* The page is used up, so this comes from a new one */
+   void *obj = slab_alloc_mt(&pool);
+   EXPECT_FALSE(contains(objs, PAGE_ITEMS, obj));
+   slab_free_mt(&pool, obj);
+
+   p_atomic_set(&state.done, 1);
+   thrd_join(thread, NULL);
+
+   slab_destroy_mt(&pool);
+}
+
+TEST(slab_mt_test, remote_free_partial_batch)
+{
+   struct slab_mt_pool pool;
+   void *objs[PAGE_ITEMS];
+   thrd_t thread;
+
+   ASSERT_TRUE(slab_create_mt(&pool, ITEM_SIZE, PAGE_ITEMS));
+
+   for (unsigned i = 0; i < PAGE_ITEMS; i++)
+      objs[i] = slab_alloc_mt(&pool);
+
+   /* Less than a batch stays with the thread until it exits */
+   struct remote_free_state state = { &pool, objs, BATCH_SIZE - 1, 0, 0 };
+   ASSERT_EQ(thrd_create(&thread, remote_free_thread, &state), thrd_success);
+   wait_for(&state.freed);
+
+   void *obj = slab_alloc_mt(&pool);
+   EXPECT_FALSE(contains(objs, PAGE_ITEMS, obj));
+
+   p_atomic_set(&state.done, 1);
+   thrd_join(thread, NULL);
+
+   /* The new page goes first, then the objects handed back on exit */
+   for (unsigned i = 1; i < PAGE_ITEMS; i++)
+      slab_alloc_mt(&pool);
+   for (unsigned i = 0; i < BATCH_SIZE - 1; i++) {
+      void *obj = slab_alloc_mt(&pool);
+      EXPECT_TRUE(contains(objs, BATCH_SIZE - 1, obj)) << "reused remote free " << i;
+   }
+
+   slab_destroy_mt(&pool);
+}
+
+struct alloc_state {
+   struct slab_mt_pool *pool;
+   void *first, *second;
+};
+
+/* Allocates two objects and frees the first one */
+static int
+alloc_thread(void *data)
+{
+   struct alloc_state *state = (struct alloc_state *)data;
+
+   state->first = slab_alloc_mt(state->pool);
+   state->second = slab_alloc_mt(state->pool);
+   slab_free_mt(state->pool, state->first);
+   return 0;
+}
+
+TEST(slab_mt_test, exited_thread_cache_reuse)
+{
+   struct slab_mt_pool pool;
+   struct alloc_state states[2];
+   thrd_t thread;
+
+   ASSERT_TRUE(slab_create_mt(&pool, ITEM_SIZE, PAGE_ITEMS));
+
+   for (unsigned i = 0; i < 2; i++) {
+      states[i].pool = &pool;
+      ASSERT_EQ(thrd_create(&thread, alloc_thread, &states[i]), thrd_success);
+      thrd_join(thread, NULL);
+   }
+
+   /* The second thread took over the cache of the first one, including the
+    * object it freed and the rest of its page.
+    */
+   EXPECT_EQ(states[1].first, states[0].first);
+   EXPECT_NE(states[1].second, states[0].second);
+   EXPECT_EQ((char *)states[1].second - (char *)states[0].second,
+             (char *)states[0].second - (char *)states[0].first);
+
+   /* The objects can still be freed by any thread */
+   slab_free_mt(&pool, states[0].second);
+   slab_free_mt(&pool, states[1].second);
+
+   slab_destroy_mt(&pool);
+}
+
+TEST(slab_mt_test, destroy_with_parked_frees)
+{
+   struct slab_mt_pool pool;
+   void *objs[PAGE_ITEMS];
+   thrd_t threads[2];
+
+   ASSERT_TRUE(slab_create_mt(&pool, ITEM_SIZE, PAGE_ITEMS));
+
+   for (unsigned i = 0; i < PAGE_ITEMS; i++)
+      objs[i] = slab_alloc_mt(&pool);
+
+   /* One thread exits and hands its partial batch back, the other one is
+    * still alive with its partial batch when the pool is destroyed.
+    */
+   struct remote_free_state states[2] = {
+      { &pool, objs, 8, 0, 1 },
+      { &pool, objs + 8, 8, 0, 0 },
+   };
+   for (unsigned i = 0; i < 2; i++) {
+      ASSERT_EQ(thrd_create(&threads[i], remote_free_thread, &states[i]),
+                thrd_success);
+      wait_for(&states[i].freed);
+   }
+   thrd_join(threads[0], NULL);
+
+   slab_destroy_mt(&pool);
+
+   /* The pool is gone, the thread must not touch it when it exits */
+   p_atomic_set(&states[1].done, 1);
+   thrd_join(threads[1], NULL);
+}
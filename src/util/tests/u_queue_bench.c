@@ -0,0 +1,129 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * util_queue job submission benchmark.
+ *
+ * N producer threads add trivial jobs to a queue with M threads as fast as
+ * they can, and the number of jobs executed per second is reported for the
+ * mutex protected job ring and for the lock-free one
+ * (UTIL_QUEUE_INIT_LOCKLESS):
+ *
+ *   u_queue_bench [-p producers] [-c consumers] [-n jobs per producer]
+ *                 [-q queue size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+struct producer {
+   struct util_queue *queue;
+   unsigned num_jobs;
+};
+
+static unsigned num_executed;
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-p producers] [-c consumers] [-n jobs] "
+           "[-q queue size]\n", name);
+   exit(1);
+}
+
+static void
+execute_job(void *job, void *gdata, int thread_index)
+{
+   p_atomic_inc((unsigned *)job);
+}
+
+static int
+producer_func(void *data)
+{
+   struct producer *producer = data;
+
+   for (unsigned i = 0; i < producer->num_jobs; i++)
+      util_queue_add_job(producer->queue, &num_executed, NULL, execute_job,
+                         NULL, 0);
+
+   return 0;
+}
+
+static void
+run(unsigned flags, unsigned num_producers, unsigned num_consumers,
+    unsigned num_jobs, unsigned queue_size)
+{
+   struct producer producer;
+   struct util_queue queue;
+   thrd_t *threads;
+
+   if (!util_queue_init(&queue, "bench", queue_size, num_consumers, flags,
+                        NULL)) {
+      fprintf(stderr, "failed to create the queue\n");
+      exit(1);
+   }
+   util_queue_adjust_num_threads(&queue, num_consumers, false);
+
+   threads = malloc(num_producers * sizeof(*threads));
+   producer.queue = &queue;
+   producer.num_jobs = num_jobs;
+   num_executed = 0;
+
+   int64_t start = os_time_get_nano();
+
+   for (unsigned i = 0; i < num_producers; i++)
+      thrd_create(&threads[i], producer_func, &producer);
+   for (unsigned i = 0; i < num_producers; i++)
+      thrd_join(threads[i], NULL);
+   util_queue_finish(&queue);
+
+   double seconds = (os_time_get_nano() - start) / 1e9;
+
+   if (num_executed != num_producers * num_jobs) {
+      fprintf(stderr, "%u jobs of %u executed\n", num_executed,
+              num_producers * num_jobs);
+      exit(1);
+   }
+
+   printf("%-8s %2u producers x %2u consumers: %10.0f jobs/s\n",
+          flags & UTIL_QUEUE_INIT_LOCKLESS ? "lockless" : "mutex",
+          num_producers, num_consumers, num_executed / seconds);
+
+   util_queue_destroy(&queue);
+   free(threads);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_producers = 4;
+   unsigned num_consumers = 4;
+   unsigned num_jobs = 250000;
+   unsigned queue_size = 64;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "p:c:n:q:")) != -1) {
+      switch (opt) {
+      case 'p': num_producers = atoi(optarg); break;
+      case 'c': num_consumers = atoi(optarg); break;
+      case 'n': num_jobs = atoi(optarg); break;
+      case 'q': queue_size = atoi(optarg); break;
+      default: usage(argv[0]);
+      }
+   }
+   if (!num_producers || !num_consumers || !num_jobs || !queue_size)
+      usage(argv[0]);
+
+   run(0, num_producers, num_consumers, num_jobs, queue_size);
+   run(UTIL_QUEUE_INIT_LOCKLESS, num_producers, num_consumers, num_jobs,
+       queue_size);
+
+   return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Testing the UTIL_QUEUE_INIT_LOCKLESS job ring of u_queue.h
+ */
+
+#include <gtest/gtest.h>
+
+#include "c11/threads.h"
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
+
+#define NUM_JOBS 1000
+
+static void
+count_job(void *data, void *gdata, int thread_index)
+{
+   p_atomic_inc((int *)data);
+}
+
+/* Blocks until *data is set */
+static void
+wait_job(void *data, void *gdata, int thread_index)
+{
+   while (!p_atomic_read((int *)data))
+      os_time_sleep(100);
+}
+
+/* Sets *data after a short delay, so the caller is already waiting */
+static int
+release_thread(void *data)
+{
+   os_time_sleep(20000);
+   p_atomic_set((int *)data, 1);
+   return 0;
+}
+
+class u_queue_lockless_test : public ::testing::Test {
+protected:
+   void SetUp() override
+   {
+      if (!UTIL_FUTEX_SUPPORTED)
+         GTEST_SKIP() << "no futexes, the lock-free ring isn't used";
+   }
+};
+
+TEST_F(u_queue_lockless_test, rejects_resize)
+{
+   struct util_queue queue;
+
+   EXPECT_FALSE(util_queue_init(&queue, "test", 8, 1,
+                                UTIL_QUEUE_INIT_LOCKLESS |
+                                UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL));
+   EXPECT_FALSE(util_queue_is_initialized(&queue));
+}
+
+TEST_F(u_queue_lockless_test, finish)
+{
+   struct util_queue queue;
+   int count = 0;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 4,
+                               UTIL_QUEUE_INIT_LOCKLESS, NULL));
+
+   /* More jobs than the ring holds, so adding them waits for free slots */
+   for (unsigned i = 0; i < NUM_JOBS; i++)
+      util_queue_add_job(&queue, &count, NULL, count_job, NULL, 0);
+
+   util_queue_finish(&queue);
+   EXPECT_EQ(p_atomic_read(&count), NUM_JOBS);
+
+   util_queue_destroy(&queue);
+}
+
+TEST_F(u_queue_lockless_test, drop_job)
+{
+   struct util_queue queue;
+   struct util_queue_fence fences[2];
+   int released = 0, count = 0;
+   thrd_t thread;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 1,
+                               UTIL_QUEUE_INIT_LOCKLESS, NULL));
+
+   util_queue_fence_init(&fences[0]);
+   util_queue_fence_init(&fences[1]);
+
+   util_queue_add_job(&queue, &released, &fences[0], wait_job, NULL, 0);
+   util_queue_add_job(&queue, &count, &fences[1], count_job, NULL, 0);
+   ASSERT_EQ(thrd_create(&thread, release_thread, &released), thrd_success);
+
+   /* Jobs can't be taken out of the ring, so this waits for the job */
+   util_queue_drop_job(&queue, &fences[1]);
+   EXPECT_TRUE(util_queue_fence_is_signalled(&fences[1]));
+   EXPECT_TRUE(util_queue_fence_is_signalled(&fences[0]));
+   EXPECT_EQ(p_atomic_read(&count), 1);
+
+   thrd_join(thread, NULL);
+   util_queue_destroy(&queue);
+   util_queue_fence_destroy(&fences[0]);
+   util_queue_fence_destroy(&fences[1]);
+}
+
+TEST_F(u_queue_lockless_test, kill_threads)
+{
+   struct util_queue queue;
+   struct util_queue_fence fences[4];
+   int released = 0, count = 0;
+   thrd_t thread;
+
+   ASSERT_TRUE(util_queue_init(&queue, "test", 8, 4,
+                               UTIL_QUEUE_INIT_LOCKLESS, NULL));
+
+   util_queue_adjust_num_threads(&queue, 4, false);
+   EXPECT_EQ(queue.num_threads, 4);
+
+   /* The threads above the new count are woken up and exit */
+   util_queue_adjust_num_threads(&queue, 1, false);
+   EXPECT_EQ(queue.num_threads, 1);
+
+   for (unsigned i = 0; i < NUM_JOBS; i++)
+      util_queue_add_job(&queue, &count, NULL, count_job, NULL, 0);
+   util_queue_finish(&queue);
+   EXPECT_EQ(p_atomic_read(&count), NUM_JOBS);
+
+   /* Jobs still in the ring when the last thread exits are only signalled */
+   for (unsigned i = 0; i < ARRAY_SIZE(fences); i++)
+      util_queue_fence_init(&fences[i]);
+
+   util_queue_add_job(&queue, &released, &fences[0], wait_job, NULL, 0);
+   for (unsigned i = 1; i < ARRAY_SIZE(fences); i++)
+      util_queue_add_job(&queue, &count, &fences[i], count_job, NULL, 0);
+   ASSERT_EQ(thrd_create(&thread, release_thread, &released), thrd_success);
+
+   util_queue_destroy(&queue);
+   for (unsigned i = 0; i < ARRAY_SIZE(fences); i++) {
+      EXPECT_TRUE(util_queue_fence_is_signalled(&fences[i]));
+      util_queue_fence_destroy(&fences[i]);
+   }
+
+   thrd_join(thread, NULL);
+}
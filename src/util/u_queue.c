@@ -29,6 +29,8 @@
 #include "c11/threads.h"
 #include "util/u_cpu_detect.h"
 #include "util/os_time.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
 #include "u_process.h"
@@ -237,6 +239,306 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
 }
 #endif
 
+/****************************************************************************
+ * Lock-free job ring (UTIL_QUEUE_INIT_LOCKLESS)
+ *
+ * A bounded multi-producer multi-consumer ring. Every cell has a sequence
+ * number telling whether it's free for the producer of a given position or
+ * holds the job for the consumer of that position, so producers and
+ * consumers only race for their position counters (D. Vyukov's bounded MPMC
+ * queue). Idle threads sleep on a futex which producers only touch when
+ * some thread sleeps, the same way producers wait for space when the ring
+ * is full.
+ */
+
+/* Number of attempts to take a job before going to sleep */
+#define UTIL_QUEUE_RING_SPIN_COUNT 64
+
+struct util_queue_ring_cell {
+   uint32_t seq;
+   struct util_queue_job job;
+};
+
+/* Threads sleeping until the ring changes */
+struct util_queue_ring_waiters {
+   /* Futex bumped on every wake-up */
+   uint32_t seq;
+   uint32_t num_waiting;
+   /* Set while a woken thread didn't run yet, no need to wake another one
+    * until it looks at the ring again.
+    */
+   uint32_t wake_pending;
+};
+
+struct util_queue_ring {
+   struct util_queue_ring_cell *cells;
+   uint32_t mask;
+
+   /* Keep the counters written by producers and consumers apart. */
+   uint8_t pad0[CACHE_LINE_SIZE];
+   uint32_t write_pos;
+   uint8_t pad1[CACHE_LINE_SIZE];
+   uint32_t read_pos;
+   uint8_t pad2[CACHE_LINE_SIZE];
+
+   /* Threads waiting for a job and producers waiting for a free cell */
+   struct util_queue_ring_waiters idle;
+   struct util_queue_ring_waiters full;
+};
+
+/* Order the update of the ring or a waiter counter against the following
+ * read of the other one. Without the GCC builtins, a read-modify-write of
+ * the counter both sides access orders them as well.
+ */
+#if defined(USE_GCC_ATOMIC_BUILTINS)
+#define util_queue_ring_barrier(counter) __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define util_queue_ring_barrier(counter) ((void)p_atomic_add_return(counter, 0))
+#endif
+
+static void
+util_queue_ring_futex_wait(uint32_t *addr, uint32_t value)
+{
+#if UTIL_FUTEX_SUPPORTED
+   futex_wait(addr, value, NULL);
+#else
+   unreachable("lock-free ring without futexes");
+#endif
+}
+
+static void
+util_queue_ring_futex_wake(uint32_t *addr, int count)
+{
+#if UTIL_FUTEX_SUPPORTED
+   futex_wake(addr, count);
+#else
+   unreachable("lock-free ring without futexes");
+#endif
+}
+
+/* Register as a waiter, the ring has to be checked again afterwards. */
+static uint32_t
+util_queue_ring_wait_prepare(struct util_queue_ring_waiters *waiters)
+{
+   uint32_t seq = p_atomic_read(&waiters->seq);
+
+   p_atomic_inc(&waiters->num_waiting);
+   util_queue_ring_barrier(&waiters->num_waiting);
+
+   return seq;
+}
+
+/* Unregister after a wait or a successful recheck. A wake-up may have been
+ * sent meanwhile, so acknowledge it to let the next one through. Exchanging
+ * the flag also makes the ring updates done before the wake-up visible.
+ */
+static void
+util_queue_ring_wait_cancel(struct util_queue_ring_waiters *waiters)
+{
+   p_atomic_dec(&waiters->num_waiting);
+   p_atomic_xchg(&waiters->wake_pending, 0);
+}
+
+static void
+util_queue_ring_wait(struct util_queue_ring_waiters *waiters, uint32_t seq)
+{
+   util_queue_ring_futex_wait(&waiters->seq, seq);
+   util_queue_ring_wait_cancel(waiters);
+}
+
+static void
+util_queue_ring_wake_one(struct util_queue_ring_waiters *waiters)
+{
+   util_queue_ring_barrier(&waiters->num_waiting);
+
+   if (p_atomic_read(&waiters->num_waiting) &&
+       !p_atomic_xchg(&waiters->wake_pending, 1)) {
+      p_atomic_inc(&waiters->seq);
+      util_queue_ring_futex_wake(&waiters->seq, 1);
+   }
+}
+
+static void
+util_queue_ring_wake_all(struct util_queue_ring_waiters *waiters)
+{
+   p_atomic_inc(&waiters->seq);
+   util_queue_ring_futex_wake(&waiters->seq, INT_MAX);
+}
+
+static struct util_queue_ring *
+util_queue_ring_create(unsigned max_jobs)
+{
+   unsigned num_cells = util_next_power_of_two(MAX2(max_jobs, 2));
+   struct util_queue_ring *ring = calloc(1, sizeof(*ring));
+
+   if (!ring)
+      return NULL;
+
+   ring->cells = calloc(num_cells, sizeof(*ring->cells));
+   if (!ring->cells) {
+      free(ring);
+      return NULL;
+   }
+
+   for (unsigned i = 0; i < num_cells; i++)
+      ring->cells[i].seq = i;
+   ring->mask = num_cells - 1;
+
+   return ring;
+}
+
+static void
+util_queue_ring_destroy(struct util_queue_ring *ring)
+{
+   if (ring)
+      free(ring->cells);
+   free(ring);
+}
+
+static bool
+util_queue_ring_try_push(struct util_queue_ring *ring,
+                         const struct util_queue_job *job)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->write_pos);
+
+   while (1) {
+      struct util_queue_ring_cell *cell = &ring->cells[pos & ring->mask];
+      int32_t diff = (int32_t)(p_atomic_read(&cell->seq) - pos);
+
+      if (diff == 0) {
+         uint32_t old = p_atomic_cmpxchg(&ring->write_pos, pos, pos + 1);
+
+         if (old == pos) {
+            cell->job = *job;
+            p_atomic_set(&cell->seq, pos + 1);
+            return true;
+         }
+         pos = old;
+      } else if (diff < 0) {
+         /* The ring is full. */
+         return false;
+      } else {
+         pos = p_atomic_read_relaxed(&ring->write_pos);
+      }
+   }
+}
+
+static bool
+util_queue_ring_try_pop(struct util_queue_ring *ring,
+                        struct util_queue_job *job)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->read_pos);
+
+   while (1) {
+      struct util_queue_ring_cell *cell = &ring->cells[pos & ring->mask];
+      int32_t diff = (int32_t)(p_atomic_read(&cell->seq) - (pos + 1));
+
+      if (diff == 0) {
+         uint32_t old = p_atomic_cmpxchg(&ring->read_pos, pos, pos + 1);
+
+         if (old == pos) {
+            *job = cell->job;
+            p_atomic_set(&cell->seq, pos + ring->mask + 1);
+            return true;
+         }
+         pos = old;
+      } else if (diff < 0) {
+         /* The ring is empty. */
+         return false;
+      } else {
+         pos = p_atomic_read_relaxed(&ring->read_pos);
+      }
+   }
+}
+
+static bool
+util_queue_ring_is_empty(struct util_queue_ring *ring)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->read_pos);
+
+   return p_atomic_read(&ring->cells[pos & ring->mask].seq) != pos + 1;
+}
+
+static bool
+util_queue_ring_is_full(struct util_queue_ring *ring)
+{
+   uint32_t pos = p_atomic_read_relaxed(&ring->write_pos);
+
+   return p_atomic_read(&ring->cells[pos & ring->mask].seq) != pos;
+}
+
+static void
+util_queue_ring_push(struct util_queue_ring *ring,
+                     const struct util_queue_job *job)
+{
+   bool waited = false;
+
+   while (!util_queue_ring_try_push(ring, job)) {
+      uint32_t seq = util_queue_ring_wait_prepare(&ring->full);
+
+      if (util_queue_ring_try_push(ring, job)) {
+         util_queue_ring_wait_cancel(&ring->full);
+         break;
+      }
+
+      util_queue_ring_wait(&ring->full, seq);
+      waited = true;
+   }
+
+   util_queue_ring_wake_one(&ring->idle);
+
+   /* Only one waiter is woken at a time, pass it on while there is space. */
+   if (waited && !util_queue_ring_is_full(ring))
+      util_queue_ring_wake_one(&ring->full);
+}
+
+/* Take the next job, sleeping while there is none. Returns false when the
+ * thread should terminate.
+ */
+static bool
+util_queue_ring_pop(struct util_queue *queue, int thread_index,
+                    struct util_queue_job *job)
+{
+   struct util_queue_ring *ring = queue->ring;
+
+   while (1) {
+      for (unsigned i = 0; i < UTIL_QUEUE_RING_SPIN_COUNT; i++) {
+         if (thread_index >= p_atomic_read(&queue->num_threads))
+            return false;
+
+         if (util_queue_ring_try_pop(ring, job))
+            goto popped;
+      }
+
+      uint32_t seq = util_queue_ring_wait_prepare(&ring->idle);
+
+      if (thread_index >= p_atomic_read(&queue->num_threads)) {
+         util_queue_ring_wait_cancel(&ring->idle);
+         return false;
+      }
+
+      if (util_queue_ring_try_pop(ring, job)) {
+         util_queue_ring_wait_cancel(&ring->idle);
+         goto popped;
+      }
+
+      util_queue_ring_wait(&ring->idle, seq);
+   }
+
+popped:
+   p_atomic_dec(&queue->num_queued);
+   util_queue_ring_wake_one(&ring->full);
+
+   /* Only one thread is woken at a time, pass it on while there are jobs.
+    * The job taken may block until other threads take the next ones, like
+    * the util_queue_finish barrier jobs do.
+    */
+   if (!util_queue_ring_is_empty(ring))
+      util_queue_ring_wake_one(&ring->idle);
+
+   return true;
+}
+
 /****************************************************************************
  * util_queue implementation
  */
@@ -279,7 +581,22 @@ util_queue_thread_func(void *input)
       u_thread_setname(name);
    }
 
-   while (1) {
+   while (queue->ring) {
+      struct util_queue_job job;
+
+      if (!util_queue_ring_pop(queue, thread_index, &job))
+         break;
+
+      if (job.job) {
+         job.execute(job.job, job.global_data, thread_index);
+         if (job.fence)
+            util_queue_fence_signal(job.fence);
+         if (job.cleanup)
+            job.cleanup(job.job, job.global_data, thread_index);
+      }
+   }
+
+   while (!queue->ring) {
       struct util_queue_job job;
 
       mtx_lock(&queue->lock);
@@ -316,7 +633,15 @@ util_queue_thread_func(void *input)
 
    /* signal remaining jobs if all threads are being terminated */
    mtx_lock(&queue->lock);
-   if (queue->num_threads == 0) {
+   if (queue->num_threads == 0 && queue->ring) {
+      struct util_queue_job job;
+
+      while (util_queue_ring_try_pop(queue->ring, &job)) {
+         if (job.job && job.fence)
+            util_queue_fence_signal(job.fence);
+      }
+      queue->num_queued = 0;
+   } else if (queue->num_threads == 0) {
       for (unsigned i = queue->read_idx; i != queue->write_idx;
            i = (i + 1) % queue->max_jobs) {
          if (queue->jobs[i].job) {
@@ -435,6 +760,11 @@ util_queue_init(struct util_queue *queue,
 
    memset(queue, 0, sizeof(*queue));
 
+   /* The lock-free ring can't grow. */
+   if ((flags & UTIL_QUEUE_INIT_LOCKLESS) &&
+       (flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      return false;
+
    if (process_len) {
       snprintf(queue->name, sizeof(queue->name), "%.*s:%s",
                process_len, process_name, name);
@@ -455,10 +785,16 @@ util_queue_init(struct util_queue *queue,
    cnd_init(&queue->has_queued_cond);
    cnd_init(&queue->has_space_cond);
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
-      goto fail;
+   if (UTIL_FUTEX_SUPPORTED && (flags & UTIL_QUEUE_INIT_LOCKLESS)) {
+      queue->ring = util_queue_ring_create(max_jobs);
+      if (!queue->ring)
+         goto fail;
+   } else {
+      queue->jobs = (struct util_queue_job*)
+                    calloc(max_jobs, sizeof(struct util_queue_job));
+      if (!queue->jobs)
+         goto fail;
+   }
 
    queue->threads = (thrd_t*) calloc(queue->max_threads, sizeof(thrd_t));
    if (!queue->threads)
@@ -484,11 +820,12 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->jobs || queue->ring) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
       mtx_destroy(&queue->lock);
       free(queue->jobs);
+      util_queue_ring_destroy(queue->ring);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -514,7 +851,10 @@ util_queue_kill_threads(struct util_queue *queue, unsigned keep_num_threads,
     * Then cnd_broadcast wakes them up and they will exit their function.
     */
    queue->num_threads = keep_num_threads;
-   cnd_broadcast(&queue->has_queued_cond);
+   if (queue->ring)
+      util_queue_ring_wake_all(&queue->ring->idle);
+   else
+      cnd_broadcast(&queue->has_queued_cond);
 
    /* Wait for threads to terminate. */
    if (keep_num_threads < old_num_threads) {
@@ -551,9 +891,45 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->lock);
    free(queue->jobs);
+   util_queue_ring_destroy(queue->ring);
    free(queue->threads);
 }
 
+static void
+util_queue_add_job_lockless(struct util_queue *queue,
+                            void *job,
+                            struct util_queue_fence *fence,
+                            util_queue_execute_func execute,
+                            util_queue_execute_func cleanup,
+                            const size_t job_size,
+                            bool locked)
+{
+   const struct util_queue_job ring_job = {
+      .job = job,
+      .global_data = queue->global_data,
+      .job_size = job_size,
+      .fence = fence,
+      .execute = execute,
+      .cleanup = cleanup,
+   };
+
+   /* Scale the number of threads up if there's already one job waiting. */
+   if (p_atomic_read(&queue->num_queued) > 0 &&
+       queue->create_threads_on_demand &&
+       execute != util_queue_finish_execute &&
+       queue->num_threads < queue->max_threads) {
+      if (!locked)
+         mtx_lock(&queue->lock);
+      if (queue->create_threads_on_demand)
+         util_queue_adjust_num_threads(queue, queue->num_threads + 1, true);
+      if (!locked)
+         mtx_unlock(&queue->lock);
+   }
+
+   p_atomic_inc(&queue->num_queued);
+   util_queue_ring_push(queue->ring, &ring_job);
+}
+
 static void
 util_queue_add_job_locked(struct util_queue *queue,
                           void *job,
@@ -565,10 +941,11 @@ util_queue_add_job_locked(struct util_queue *queue,
 {
    struct util_queue_job *ptr;
 
-   if (!locked)
+   /* The lock-free ring only needs the lock to start threads. */
+   if (!locked && !queue->ring)
       mtx_lock(&queue->lock);
-   if (queue->num_threads == 0) {
-      if (!locked)
+   if (p_atomic_read(&queue->num_threads) == 0) {
+      if (!locked && !queue->ring)
          mtx_unlock(&queue->lock);
       /* well no good option here, but any leaks will be
        * short-lived as things are shutting down..
@@ -579,6 +956,12 @@ util_queue_add_job_locked(struct util_queue *queue,
    if (fence)
       util_queue_fence_reset(fence);
 
+   if (queue->ring) {
+      util_queue_add_job_lockless(queue, job, fence, execute, cleanup,
+                                  job_size, locked);
+      return;
+   }
+
    assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
 
    /* Scale the number of threads up if there's already one job waiting. */
@@ -659,7 +1042,9 @@ util_queue_add_job(struct util_queue *queue,
  * the queue. If the job has started execution, the function waits for it to
  * complete.
  *
- * In all cases, the fence is signalled when the function returns.
+ * In all cases, the fence is signalled when the function returns. Queues
+ * using the lock-free ring can't remove jobs, so the function always waits
+ * for the job there.
  *
  * The function can be used when destroying an object associated with the job
  * when you don't care about the job completion state.
@@ -672,6 +1057,12 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
+   /* Jobs can't be taken out of the lock-free ring, so just wait. */
+   if (queue->ring) {
+      util_queue_fence_wait(fence);
+      return;
+   }
+
    mtx_lock(&queue->lock);
    for (unsigned i = queue->read_idx; i != queue->write_idx;
         i = (i + 1) % queue->max_jobs) {
@@ -701,6 +1092,7 @@ util_queue_finish(struct util_queue *queue)
 {
    util_barrier barrier;
    struct util_queue_fence *fences;
+   unsigned num_threads;
 
    /* If 2 threads were adding jobs for 2 different barries at the same time,
     * a deadlock would happen, because 1 barrier requires that all threads
@@ -722,10 +1114,12 @@ util_queue_finish(struct util_queue *queue)
     */
    queue->create_threads_on_demand = false;
 
-   fences = malloc(queue->num_threads * sizeof(*fences));
-   util_barrier_init(&barrier, queue->num_threads);
+   /* Other threads may add threads again once the lock is dropped. */
+   num_threads = queue->num_threads;
+   fences = malloc(num_threads * sizeof(*fences));
+   util_barrier_init(&barrier, num_threads);
 
-   for (unsigned i = 0; i < queue->num_threads; ++i) {
+   for (unsigned i = 0; i < num_threads; ++i) {
       util_queue_fence_init(&fences[i]);
       util_queue_add_job_locked(queue, &barrier, &fences[i],
                                 util_queue_finish_execute, NULL, 0, true);
@@ -733,7 +1127,7 @@ util_queue_finish(struct util_queue *queue)
    queue->create_threads_on_demand = true;
    mtx_unlock(&queue->lock);
 
-   for (unsigned i = 0; i < queue->num_threads; ++i) {
+   for (unsigned i = 0; i < num_threads; ++i) {
       util_queue_fence_wait(&fences[i]);
       util_queue_fence_destroy(&fences[i]);
    }
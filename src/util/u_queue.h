@@ -50,6 +50,13 @@ extern "C" {
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
 #define UTIL_QUEUE_INIT_SET_FULL_THREAD_AFFINITY  (1 << 2)
+/* Pass jobs through a lock-free ring instead of the mutex protected one.
+ * The ring can't grow, so producers wait for a free slot when it's full and
+ * util_queue_init fails when this is combined with
+ * UTIL_QUEUE_INIT_RESIZE_IF_FULL. util_queue_drop_job waits for the job
+ * instead of removing it. Ignored without futexes.
+ */
+#define UTIL_QUEUE_INIT_LOCKLESS                  (1 << 3)
 
 #if UTIL_FUTEX_SUPPORTED
 #define UTIL_QUEUE_FENCE_FUTEX
@@ -217,6 +224,7 @@ struct util_queue {
    int write_idx, read_idx; /* ring buffer pointers */
    size_t total_jobs_size;  /* memory use of all jobs in the queue */
    struct util_queue_job *jobs;
+   struct util_queue_ring *ring; /* only with UTIL_QUEUE_INIT_LOCKLESS */
    void *global_data;
 
    /* for cleanup at exit(), protected by exit_mutex */
@@ -413,6 +413,43 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
    return object;
 }
 
+void
+vk_pipeline_cache_prefetch_objects(struct vk_pipeline_cache *cache,
+                                   const void *key_data, size_t key_size,
+                                   uint32_t count)
+{
+   if (cache == NULL || cache->skip_disk_cache || cache->object_cache == NULL)
+      return;
+
+   struct disk_cache *disk_cache = cache->base.device->physical->disk_cache;
+   if (disk_cache == NULL || count < 2)
+      return;
+
+   cache_key *cache_keys = malloc(count * sizeof(*cache_keys));
+   if (cache_keys == NULL)
+      return;
+
+   uint32_t num_keys = 0;
+   for (uint32_t i = 0; i < count; i++) {
+      struct vk_pipeline_cache_object key = {
+         .key_data = (const uint8_t *)key_data + i * key_size,
+         .key_size = key_size,
+      };
+
+      vk_pipeline_cache_lock(cache);
+      bool found = _mesa_set_search(cache->object_cache, &key) != NULL;
+      vk_pipeline_cache_unlock(cache);
+
+      if (!found) {
+         disk_cache_compute_key(disk_cache, key.key_data, key_size,
+                                cache_keys[num_keys++]);
+      }
+   }
+
+   disk_cache_prefetch(disk_cache, cache_keys, num_keys);
+   free(cache_keys);
+}
+
 struct vk_pipeline_cache_object *
 vk_pipeline_cache_add_object(struct vk_pipeline_cache *cache,
                              struct vk_pipeline_cache_object *object)
@@ -234,6 +234,20 @@ vk_pipeline_cache_lookup_object(struct vk_pipeline_cache *cache,
                                 const struct vk_pipeline_cache_object_ops *ops,
                                 bool *cache_hit);
 
+/** Reads the disk cache entries of several objects ahead of time
+ *
+ * The keys are packed back to back in key_data, each key_size bytes long.
+ * Entries of the objects that are missing in the in-memory cache are read
+ * from the disk cache in a single batch, so the following
+ * vk_pipeline_cache_lookup_object() calls with the same keys don't go to
+ * the disk one by one.  This is purely an optimization, the objects still
+ * need to be looked up.
+ */
+void
+vk_pipeline_cache_prefetch_objects(struct vk_pipeline_cache *cache,
+                                   const void *key_data, size_t key_size,
+                                   uint32_t count);
+
 /** Adds an object to the pipeline cache
  *
  * This function adds the given object to the pipeline cache.  We do not